@@ -26,6 +26,9 @@
  */
 RCSIDH(cursor_h, "$Id$")
 
+#include <stdbool.h>
+#include <stdint.h>
+
 /** Callback for implementing custom iterators
  *
  * @param[out] prev	*prev != NULL, must be updated to the list item before the
@@ -79,6 +82,25 @@ void *fr_cursor_replace(fr_cursor_t *cursor, void *r) CC_HINT(nonnull);
 
 void fr_cursor_list_free(fr_cursor_t *cursor) CC_HINT(nonnull);
 
+/** Maximum number of lists in an #fr_cursor_list_watch_t
+ */
+#define FR_CURSOR_LIST_WATCH_MAX	(4)
+
+/** A set of lists whose modifications can be tracked
+ *
+ * Owned by whatever owns the lists, e.g. a request.
+ */
+typedef struct {
+	void * const	*head[FR_CURSOR_LIST_WATCH_MAX];	//!< Lists in the set.  NULL if a slot is unused.
+	uint64_t	generation[FR_CURSOR_LIST_WATCH_MAX];	//!< Incremented whenever the list is touched.
+} fr_cursor_list_watch_t;
+
+fr_cursor_list_watch_t *fr_cursor_list_watch(fr_cursor_list_watch_t *watch);
+
+bool fr_cursor_list_watched(fr_cursor_list_watch_t const *watch) CC_HINT(nonnull);
+
+void fr_cursor_list_touch(void * const *head);
+
 /** Initialise a cursor with runtime talloc type safety checks and a custom iterator
  *
  * @param[in] _cursor	to initialise.
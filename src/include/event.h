@@ -82,6 +82,7 @@ int		fr_event_list_num_fds(fr_event_list_t *el);
 int		fr_event_list_num_elements(fr_event_list_t *el);
 int		fr_event_list_kq(fr_event_list_t *el);
 int		fr_event_list_time(struct timeval *when, fr_event_list_t *el);
+int		fr_event_list_timer_wheel(fr_event_list_t *el, bool enable);
 
 int		fr_event_fd_delete(fr_event_list_t *el, int fd);
 int		fr_event_fd_insert(fr_event_list_t *el, int fd,
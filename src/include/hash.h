@@ -36,6 +36,7 @@ extern "C" {
 uint32_t fr_hash(void const *, size_t);
 uint32_t fr_hash_update(void const *data, size_t size, uint32_t hash);
 uint32_t fr_hash_string(char const *p);
+uint32_t fr_hash_wide(void const *data, size_t size);
 
 typedef struct fr_hash_table_t fr_hash_table_t;
 typedef void (*fr_hash_table_free_t)(void *);
@@ -47,6 +48,7 @@ fr_hash_table_t *fr_hash_table_create(TALLOC_CTX *ctx,
 				      fr_hash_table_hash_t hashNode,
 				      fr_hash_table_cmp_t cmpNode,
 				      fr_hash_table_free_t freeNode);
+void		fr_hash_table_open_addressing(bool enable);
 void		fr_hash_table_free(fr_hash_table_t *ht);
 int		fr_hash_table_insert(fr_hash_table_t *ht, void const *data);
 int		fr_hash_table_delete(fr_hash_table_t *ht, void const *data);
@@ -70,6 +70,7 @@ void	fr_md5_transform(uint32_t state[4], uint8_t const block[MD5_BLOCK_LENGTH])
 #else  /* HAVE_OPENSSL_EVP_H */
 USES_APPLE_DEPRECATED_API
 #include <openssl/md5.h>
+#  define MD5_BLOCK_LENGTH		MD5_CBLOCK
 #  define FR_MD5_CTX			MD5_CTX
 #  define fr_md5_init			MD5_Init
 #  define fr_md5_update			MD5_Update
@@ -78,13 +79,49 @@ USES_APPLE_DEPRECATED_API
 #  define fr_md5_copy(_out, _in)	memcpy(_out, _in, sizeof(*_out))
 #endif
 
+/** One message in a batch hashed by #fr_md5_multi
+ *
+ * The message is in up to two parts, which are hashed as if they were
+ * one contiguous buffer.
+ */
+typedef struct {
+	uint32_t const	*state;			//!< Chaining value to continue from, as returned by
+						//!< #fr_md5_multi_state.  NULL to start a new hash.
+	size_t		state_len;		//!< Amount of data hashed into state.  Must be a
+						//!< multiple of MD5_BLOCK_LENGTH.
+	uint8_t const	*in;			//!< First part of the message.
+	size_t		inlen;			//!< Length of the first part.
+	uint8_t const	*in2;			//!< Second part of the message.  May be NULL.
+	size_t		in2len;			//!< Length of the second part.
+	uint8_t		*out;			//!< Where to write the digest.
+} fr_md5_job_t;
+
+/** HMAC-MD5 state with the key already absorbed
+ *
+ * The key is always padded out to a full block, so the inner and outer
+ * MD5 states can be computed once, and reused for every message.
+ */
+typedef struct {
+	FR_MD5_CTX	inner;			//!< After absorbing the key XORd with ipad.
+	FR_MD5_CTX	outer;			//!< After absorbing the key XORd with opad.
+	uint32_t	inner_state[4];		//!< Chaining value of inner, for #fr_md5_multi.
+	uint32_t	outer_state[4];		//!< Chaining value of outer, for #fr_md5_multi.
+} fr_hmac_md5_ctx_t;
+
 /* hmac.c */
 void	fr_hmac_md5(uint8_t digest[MD5_DIGEST_LENGTH], uint8_t const *text, size_t text_len,
 		    uint8_t const *key, size_t key_len)
 	CC_BOUNDED(__minbytes__, 1, MD5_DIGEST_LENGTH);
+void	fr_hmac_md5_init(fr_hmac_md5_ctx_t *ctx, uint8_t const *key, size_t key_len);
+void	fr_hmac_md5_precomputed(uint8_t digest[MD5_DIGEST_LENGTH], uint8_t const *text, size_t text_len,
+				fr_hmac_md5_ctx_t const *ctx)
+	CC_BOUNDED(__minbytes__, 1, MD5_DIGEST_LENGTH);
 
 /* md5.c */
 void	fr_md5_calc(uint8_t *out, uint8_t const *in, size_t inlen);
+void	fr_md5_multi_state(uint32_t state[4], uint8_t const *in, size_t inlen);
+void	fr_md5_multi(fr_md5_job_t *jobs, size_t num);
+unsigned int fr_md5_multi_lanes(void);
 
 #ifdef __cplusplus
 }
@@ -26,6 +26,7 @@
 RCSIDH(pair_h, "$Id$")
 
 #include <freeradius-devel/value.h>
+#include <freeradius-devel/cursor.h>
 
 #ifdef __cplusplus
 extern "C" {
@@ -82,6 +83,9 @@ typedef struct value_pair {
 
 	int8_t			tag;				//!< Tag value used to group valuepairs.
 
+	bool			arena;				//!< Allocated from a pair arena, and only
+								//!< released when the arena is freed.
+
 	union {
 	//	VALUE_SET	*set;				//!< Set of child attributes.
 	//	VALUE_LIST	*list;				//!< List of values for
@@ -174,6 +178,7 @@ typedef struct value_pair_raw {
 #define NUM_LAST		(INT_MIN + 3)
 
 /* Allocation and management */
+TALLOC_CTX	*fr_pair_arena_alloc(TALLOC_CTX *ctx, size_t size);
 VALUE_PAIR	*fr_pair_afrom_da(TALLOC_CTX *ctx, fr_dict_attr_t const *da);
 VALUE_PAIR	*fr_pair_afrom_num(TALLOC_CTX *ctx, unsigned int vendor, unsigned int attr);
 VALUE_PAIR	*fr_pair_afrom_child_num(TALLOC_CTX *ctx, fr_dict_attr_t const *parent, unsigned int attr);
@@ -230,12 +235,28 @@ int		fr_pair_list_afrom_file(TALLOC_CTX *ctx, VALUE_PAIR **out, FILE *fp, bool *
 VALUE_PAIR	*fr_pair_list_copy(TALLOC_CTX *ctx, VALUE_PAIR *from);
 VALUE_PAIR	*fr_pair_list_copy_by_num(TALLOC_CTX *ctx, VALUE_PAIR *from,
 				     unsigned int vendor, unsigned int attr, int8_t tag);
+int		fr_pair_list_arena_copy(TALLOC_CTX *ctx, VALUE_PAIR **vps);
 void		fr_pair_list_move(TALLOC_CTX *ctx, VALUE_PAIR **to, VALUE_PAIR **from);
 void		fr_pair_list_move_by_num(TALLOC_CTX *ctx, VALUE_PAIR **to, VALUE_PAIR **from,
 					 unsigned int vendor, unsigned int attr, int8_t tag);
 void		fr_pair_list_mcopy_by_num(TALLOC_CTX *ctx, VALUE_PAIR **to, VALUE_PAIR **from,
 					  unsigned int vendor, unsigned int attr, int8_t tag);
 
+/** Record that a list has been modified, so that indexes over it are rebuilt
+ *
+ * @param[in] _head	of the list.
+ */
+#define		fr_pair_list_touch(_head) fr_cursor_list_touch((void * const *)(_head))
+
+/* Indexes */
+typedef struct fr_pair_index fr_pair_index_t;
+
+void		fr_pair_index_enable(bool enable);
+bool		fr_pair_index_enabled(void);
+fr_pair_index_t	*fr_pair_index_alloc(TALLOC_CTX *ctx, fr_cursor_list_watch_t *watch, int list);
+VALUE_PAIR	*fr_pair_index_find(fr_pair_index_t *index, VALUE_PAIR * const *head,
+				    fr_dict_attr_t const *da, int8_t tag);
+
 /* Value manipulation */
 int		fr_pair_value_from_str(VALUE_PAIR *vp, char const *value, size_t len);
 void		fr_pair_value_memcpy(VALUE_PAIR *vp, uint8_t const *src, size_t len);
@@ -46,6 +46,7 @@ VALUE_PAIR	*fr_pair_cursor_next_by_ancestor(vp_cursor_t *cursor, fr_dict_attr_t
 VALUE_PAIR	*fr_pair_cursor_next(vp_cursor_t *cursor);
 VALUE_PAIR	*fr_pair_cursor_next_peek(vp_cursor_t *cursor);
 VALUE_PAIR	*fr_pair_cursor_current(vp_cursor_t *cursor);
+VALUE_PAIR	*fr_pair_cursor_seek(vp_cursor_t *cursor, VALUE_PAIR *vp);
 void		fr_pair_cursor_prepend(vp_cursor_t *cursor, VALUE_PAIR *vp);
 void		fr_pair_cursor_append(vp_cursor_t *cursor, VALUE_PAIR *vp);
 void		fr_pair_cursor_merge(vp_cursor_t *cursor, VALUE_PAIR *vp);
@@ -134,6 +134,8 @@ typedef struct main_config {
 	uint32_t	continuation_timeout;		//!< How long to wait before cleaning up state entries.
 	uint32_t	max_requests;
 	bool		drop_requests;			//!< Administratively disable request processing.
+	bool		timer_wheel;			//!< Use a timer wheel for the event list timers.
+	bool		pair_index;			//!< Index the attribute lists of each request.
 
 	char const	*log_file;
 	int		syslog_facility;
@@ -251,6 +253,9 @@ struct rad_request {
 	VALUE_PAIR		*control;	//!< #VALUE_PAIR (s) used to set per request parameters
 						//!< for modules and the server core at runtime.
 
+	TALLOC_CTX		*pair_arena;	//!< For #VALUE_PAIR (s) added to the request, reply and
+						//!< control lists.  See radius_list_ctx().
+
 	uint64_t		seq_start;	//!< State sequence ID.  Stable identifier for a sequence of requests
 						//!< and responses.
 	TALLOC_CTX		*state_ctx;	//!< for request->state
@@ -258,6 +263,11 @@ struct rad_request {
 						//!< attempt. Useful where the attempt involves a sequence of
 						//!< many request/challenge packets, like OTP, and EAP.
 
+	fr_pair_index_t		*pair_index[PAIR_LIST_STATE];	//!< Indexes over the request, reply, control
+								//!< and state lists.  See radius_list_index().
+	fr_cursor_list_watch_t	list_watch;			//!< Generations of the indexed lists.  Only
+								//!< updated while the interpreter is running.
+
 	rad_master_state_t	master_state;	//!< Set by the master thread to signal the child that's currently
 						//!< working with the request, to do something.
 	rad_child_state_t	child_state;
@@ -487,6 +497,11 @@ void	regex_sub_to_request(REQUEST *request, regex_t **preg, char const *value,
 
 int	regex_request_to_sub(TALLOC_CTX *ctx, char **out, REQUEST *request, uint32_t num);
 
+ssize_t	regex_cache_compile(REQUEST *request, regex_t **out, char const *pattern, size_t len,
+			    bool ignore_case, bool multiline);
+
+void	regex_cache_stats(uint64_t *hits, uint64_t *misses);
+
 /*
  *	Named capture groups only supported by PCRE.
  */
@@ -50,6 +50,7 @@ typedef struct regmatch {
 
 typedef struct regex {
 	bool		precompiled;	//!< Whether this regex was precompiled, or compiled for one of evaluation.
+	bool		cached;		//!< Whether this regex belongs to a thread's regex cache.
 	pcre		*compiled;	//!< Compiled regular expression.
 
 	bool		jitd;		//!< Whether JIT data is available.
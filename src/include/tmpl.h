@@ -365,6 +365,8 @@ do {\
 
 VALUE_PAIR		**radius_list(REQUEST *request, pair_lists_t list);
 
+fr_pair_index_t		*radius_list_index(REQUEST *request, pair_lists_t list);
+
 RADIUS_PACKET		*radius_packet(REQUEST *request, pair_lists_t list_name);
 
 TALLOC_CTX		*radius_list_ctx(REQUEST *request, pair_lists_t list_name);
@@ -241,6 +241,159 @@ bool fr_atomic_queue_pop(fr_atomic_queue_t *aq, void **p_data)
 	return true;
 }
 
+/** Push multiple pointers into the atomic queue
+ *
+ *  A contiguous run of entries is reserved with a single CAS, so
+ *  that the cost of contention is paid once per batch, instead of
+ *  once per entry.  Readers see each entry as soon as it is
+ *  written, in order.
+ *
+ * @param[in] aq the queue
+ * @param[in] data the array of pointers to push
+ * @param[in] num the number of pointers in the array
+ * @return
+ *	- the number of pointers pushed, which may be less than num
+ *	  if the queue is nearly full.
+ *	- 0 on queue full
+ */
+int fr_atomic_queue_push_n(fr_atomic_queue_t *aq, void **data, int num)
+{
+	int i, avail;
+	int64_t head;
+	fr_atomic_queue_entry_t *entry;
+
+	if (!data || (num <= 0)) return 0;
+
+	if (num > aq->size) num = aq->size;
+
+	head = load(aq->head);
+
+	for (;;) {
+		int64_t seq, diff;
+
+		entry = &aq->entry[ head % aq->size ];
+		seq = aquire(entry->seq);
+		diff = (seq - head);
+
+		/*
+		 *	head is larger than the current entry, the queue is full.
+		 */
+		if (diff < 0) return 0;
+
+		/*
+		 *	Someone else has already written to this entry.  Get the new head pointer, and continue.
+		 */
+		if (diff > 0) {
+			head = load(aq->head);
+			continue;
+		}
+
+		/*
+		 *	The first entry is free.  See how many of the
+		 *	following entries are also free.  Entries
+		 *	which are free can only be taken by a CAS on
+		 *	the head, so if the CAS succeeds, they're
+		 *	still free.
+		 */
+		for (avail = 1; avail < num; avail++) {
+			entry = &aq->entry[ (head + avail) % aq->size ];
+			seq = aquire(entry->seq);
+			if (seq != (head + avail)) break;
+		}
+
+		if (atomic_compare_exchange_strong_explicit(&aq->head, &head, head + avail,
+							    memory_order_release, memory_order_relaxed)) {
+			break;
+		}
+	}
+
+	/*
+	 *	Store the data in the queue, in order.  Each entry is
+	 *	visible to the readers as soon as its sequence number
+	 *	is updated.
+	 */
+	for (i = 0; i < avail; i++) {
+		entry = &aq->entry[ (head + i) % aq->size ];
+		entry->data = data[i];
+		store(entry->seq, head + i + 1);
+	}
+
+	return avail;
+}
+
+
+/** Pop multiple pointers from the atomic queue
+ *
+ *  A contiguous run of entries is claimed with a single CAS.
+ *
+ * @param[in] aq the queue
+ * @param[out] p_data the array where the pointers are written
+ * @param[in] num the maximum number of pointers to pop
+ * @return
+ *	- the number of pointers popped
+ *	- 0 on queue empty
+ */
+int fr_atomic_queue_pop_n(fr_atomic_queue_t *aq, void **p_data, int num)
+{
+	int i, avail;
+	int64_t tail, seq;
+	fr_atomic_queue_entry_t *entry;
+
+	if (!p_data || (num <= 0)) return 0;
+
+	if (num > aq->size) num = aq->size;
+
+	tail = load(aq->tail);
+
+	for (;;) {
+		int64_t diff;
+
+		entry = &aq->entry[ tail % aq->size ];
+		seq = aquire(entry->seq);
+
+		diff = (seq - (tail + 1));
+
+		/*
+		 *	The first entry hasn't been written, the queue is empty.
+		 */
+		if (diff < 0) return 0;
+
+		if (diff > 0) {
+			tail = load(aq->tail);
+			continue;
+		}
+
+		/*
+		 *	See how many of the following entries have
+		 *	been written.
+		 */
+		for (avail = 1; avail < num; avail++) {
+			entry = &aq->entry[ (tail + avail) % aq->size ];
+			seq = aquire(entry->seq);
+			if (seq != (tail + avail + 1)) break;
+		}
+
+		if (atomic_compare_exchange_strong_explicit(&aq->tail, &tail, tail + avail,
+							    memory_order_release, memory_order_relaxed)) {
+			break;
+		}
+	}
+
+	/*
+	 *	Copy the pointers to the caller BEFORE updating the
+	 *	queue entries, and then mark the entries as unused.
+	 */
+	for (i = 0; i < avail; i++) {
+		entry = &aq->entry[ (tail + i) % aq->size ];
+		p_data[i] = entry->data;
+
+		seq = tail + i + aq->size;
+		store(entry->seq, seq);
+	}
+
+	return avail;
+}
+
 #ifndef NDEBUG
 
 #if 0
@@ -29,6 +29,12 @@ RCSID("$Id$")
 #include <freeradius-devel/fr_log.h>
 #include <freeradius-devel/rad_assert.h>
 
+#ifdef HAVE_STDATOMIC_H
+#  include <stdatomic.h>
+#else
+#  include <freeradius-devel/stdatomic.h>
+#endif
+
 /*
  *	Debugging, mainly for channel_test
  */
@@ -102,8 +108,12 @@ typedef struct fr_channel_end_t {
 
 	size_t			num_resignals;	//!< number of signals resent
 
+	size_t			num_suppressed;	//!< number of signals we didn't send, because the other end was awake
+
 	size_t			num_kevents;	//!< number of times we've looked at kevents
 
+	size_t			num_recalled;	//!< number of requests recalled by the master
+
 	uint64_t		sequence;	//!< sequence number for this channel.
 	uint64_t		ack;		//!< sequence number of the other end
 	uint64_t		their_view_of_my_sequence;	//!< should be clear
@@ -130,6 +140,8 @@ typedef struct fr_channel_t {
 
 	bool			active;		//!< is this channel active?
 
+	atomic_bool		worker_awake;	//!< the worker is polling the channel, and doesn't need signals
+
 	fr_channel_end_t	end[2];		//!< two ends of the channel
 } fr_channel_t;
 
@@ -202,6 +214,7 @@ fr_channel_t *fr_channel_create(TALLOC_CTX *ctx, fr_control_t *master, fr_contro
 	ch->end[FROM_WORKER].last_sent_signal = when;
 
 	ch->active = true;
+	atomic_init(&ch->worker_awake, false);
 
 	return ch;
 }
@@ -262,49 +275,97 @@ static int fr_channel_data_ready(fr_channel_t *ch, fr_time_t when, fr_channel_en
  */
 int fr_channel_send_request(fr_channel_t *ch, fr_channel_data_t *cd, fr_channel_data_t **p_reply)
 {
+	if (fr_channel_send_request_batch(ch, &cd, 1, p_reply) < 1) return -1;
+
+	return 0;
+}
+
+/** Send multiple request messages into the channel
+ *
+ *  The messages should be initialized, other than "sequence" and
+ *  "ack".  They are pushed into the channel with one atomic queue
+ *  operation, and the worker is signaled (at most) once.
+ *
+ *  No matter what the function returns, the caller should check the
+ *  reply pointer.  If the reply pointer is not NULL, the caller
+ *  should call fr_channel_recv_reply() until that function returns
+ *  NULL.
+ *
+ * @param[in] ch the channel
+ * @param[in] cd the array of messages to send
+ * @param[in] num_messages the number of messages in the array
+ * @param[out] p_reply a pointer to a reply message
+ * @return
+ *	- <0 on error
+ *	- the number of messages sent.  If this is less than
+ *	  num_messages, the caller should send the rest via another
+ *	  channel.
+ */
+int fr_channel_send_request_batch(fr_channel_t *ch, fr_channel_data_t **cd, int num_messages, fr_channel_data_t **p_reply)
+{
+	int i, num_sent;
 	uint64_t sequence;
 	fr_time_t when, message_interval;
 	fr_channel_end_t *master;
 
 	master = &(ch->end[TO_WORKER]);
-	when = cd->m.when;
 
-	sequence = master->sequence + 1;
-	cd->live.sequence = sequence;
-	cd->live.ack = master->ack;
+	/*
+	 *	The sequence numbers have to be set before the push,
+	 *	as the worker may read the messages immediately.
+	 */
+	sequence = master->sequence;
+	for (i = 0; i < num_messages; i++) {
+		cd[i]->live.sequence = ++sequence;
+		cd[i]->live.ack = master->ack;
+	}
 
 	/*
-	 *	Push the message onto the queue for the other end.  If
-	 *	the push fails, the caller should try another queue.
+	 *	Push the messages onto the queue for the other end.
+	 *	If the push fails, the caller should try another
+	 *	queue.
 	 */
-	if (!fr_atomic_queue_push(master->aq, cd)) {
+	num_sent = fr_atomic_queue_push_n(master->aq, (void **) cd, num_messages);
+	if (!num_sent) {
 		fr_strerror_printf("Failed pushing to atomic queue");
 		*p_reply = fr_channel_recv_reply(ch);
 		return -1;
 	}
 
-	master->sequence = sequence;
-	message_interval = when - master->last_write;
+	master->sequence += num_sent;
 
-	if (!master->message_interval) {
-		master->message_interval = message_interval;
-	} else {
-		master->message_interval = RTT(master->message_interval, message_interval);
-	}
+	for (i = 0; i < num_sent; i++) {
+		/*
+		 *	Requests recalled from another channel keep
+		 *	their original receive time, which may be older
+		 *	than our last write.  The worker relies on that
+		 *	time being unchanged, so only our statistics use
+		 *	the clamped value.
+		 */
+		when = cd[i]->m.when;
+		if (when < master->last_write) when = master->last_write;
 
-	rad_assert(master->last_write <= when);
-	master->last_write = when;
+		message_interval = when - master->last_write;
 
-	master->num_outstanding++;
-	master->num_packets++;
+		if (!master->message_interval) {
+			master->message_interval = message_interval;
+		} else {
+			master->message_interval = RTT(master->message_interval, message_interval);
+		}
+
+		master->last_write = when;
+	}
+
+	master->num_outstanding += num_sent;
+	master->num_packets += num_sent;
 
 	MPRINT("MASTER requests %zd, num_outstanding %zd\n", master->num_packets, master->num_outstanding);
 
 #if ENABLE_SKIPS
 	/*
-	 *	We just sent the first packet.  There can't possibly be a reply, so don't bother looking.
+	 *	We just sent the first packets.  There can't possibly be a reply, so don't bother looking.
 	 */
-	if (master->num_outstanding == 1) {
+	if (master->num_outstanding == num_sent) {
 		*p_reply = NULL;
 
 
@@ -312,7 +373,7 @@ int fr_channel_send_request(fr_channel_t *ch, fr_channel_data_t *cd, fr_channel_
 		 *	There is at least one old packet which is
 		 *	outstanding, look for a reply.
 		 */
-	} else if (master->num_outstanding > 1) {
+	} else if (master->num_outstanding > num_sent) {
 		*p_reply = fr_channel_recv_reply(ch);
 
 		/*
@@ -323,16 +384,80 @@ int fr_channel_send_request(fr_channel_t *ch, fr_channel_data_t *cd, fr_channel_
 		if (!*p_reply ||
 		    ((*p_reply && (master->num_outstanding > 1)))) {
 			MPRINT("MASTER SKIPS signal\n");
-			return 0;
+			return num_sent;
 		}
 	}
+#else
+	*p_reply = NULL;
 #endif
 
+	/*
+	 *	The worker is polling its channels, so it will see the
+	 *	new messages without a signal.  The fence orders our
+	 *	push before the load, and pairs with the one in
+	 *	fr_channel_worker_awake().  So either we see that the
+	 *	worker is asleep, or the worker sees our messages.
+	 */
+	atomic_thread_fence(memory_order_seq_cst);
+	if (atomic_load_explicit(&ch->worker_awake, memory_order_relaxed)) {
+		MPRINT("MASTER SUPPRESSES signal\n");
+		master->num_suppressed++;
+		return num_sent;
+	}
+
 	/*
 	 *	Tell the other end that there is new data ready.
 	 */
 	MPRINT("MASTER SIGNALS\n");
-	return fr_channel_data_ready(ch, when, master, FR_CHANNEL_SIGNAL_DATA_TO_WORKER);
+
+	/*
+	 *	The messages are already in the queue, so we can't
+	 *	tell the caller to send them elsewhere.  If the signal
+	 *	fails, the worker will still see them the next time
+	 *	it services the channel.
+	 */
+	(void) fr_channel_data_ready(ch, master->last_write, master, FR_CHANNEL_SIGNAL_DATA_TO_WORKER);
+
+	return num_sent;
+}
+
+/** Recall a request message which the worker hasn't read yet
+ *
+ *  This function MUST only be called by the master.  It takes a
+ *  request back out of the channel, as if it had never been sent.
+ *  The worker and the master may both be reading from the same
+ *  atomic queue, but each message is only returned to one of them.
+ *
+ *  The sequence number of the recalled message leaves a gap in the
+ *  sequence numbers seen by the worker.  That's fine, as both ends
+ *  only require the sequence numbers to increase.
+ *
+ * @param[in] ch the channel
+ * @return
+ *	- NULL on no data to recall
+ *	- the message on success
+ */
+fr_channel_data_t *fr_channel_recall_request(fr_channel_t *ch)
+{
+	fr_channel_data_t *cd;
+	fr_channel_end_t *master;
+	fr_atomic_queue_t *aq;
+
+	aq = ch->end[TO_WORKER].aq;
+	master = &(ch->end[TO_WORKER]);
+
+	/*
+	 *	The worker has already read everything we sent it.
+	 */
+	if (!fr_atomic_queue_pop(aq, (void **) &cd)) return NULL;
+
+	rad_assert(master->num_outstanding > 0);
+	master->num_outstanding--;
+	master->num_recalled++;
+
+	MPRINT("MASTER recalled %zd, num_outstanding %zd\n", master->num_recalled, master->num_outstanding);
+
+	return cd;
 }
 
 /** Receive a reply message from the channel
@@ -405,6 +530,27 @@ fr_channel_data_t *fr_channel_recv_reply(fr_channel_t *ch)
 fr_channel_data_t *fr_channel_recv_request(fr_channel_t *ch)
 {
 	fr_channel_data_t *cd;
+
+	if (fr_channel_recv_request_batch(ch, &cd, 1) < 1) return NULL;
+
+	return cd;
+}
+
+/** Receive multiple request messages from the channel
+ *
+ *  The messages are popped from the channel with one atomic queue
+ *  operation.
+ *
+ * @param[in] ch the channel
+ * @param[out] cd the array where the messages are written
+ * @param[in] max_messages the maximum number of messages to receive
+ * @return
+ *	- 0 on no data to receive
+ *	- the number of messages received
+ */
+int fr_channel_recv_request_batch(fr_channel_t *ch, fr_channel_data_t **cd, int max_messages)
+{
+	int i, num_messages;
 	fr_channel_end_t *worker;
 	fr_atomic_queue_t *aq;
 
@@ -414,19 +560,26 @@ fr_channel_data_t *fr_channel_recv_request(fr_channel_t *ch)
 	/*
 	 *	It's OK for the queue to be empty.
 	 */
-	if (!fr_atomic_queue_pop(aq, (void **) &cd)) return NULL;
+	num_messages = fr_atomic_queue_pop_n(aq, (void **) cd, max_messages);
+	if (!num_messages) return 0;
 
-	rad_assert(cd->live.sequence > worker->ack);
-	rad_assert(cd->live.sequence >= worker->sequence); /* must have more requests than replies */
+	for (i = 0; i < num_messages; i++) {
+		rad_assert(cd[i]->live.sequence > worker->ack);
+		rad_assert(cd[i]->live.sequence >= worker->sequence); /* must have more requests than replies */
 
-	worker->num_outstanding++;
-	worker->ack = cd->live.sequence;
-	worker->their_view_of_my_sequence = cd->live.ack;
+		worker->ack = cd[i]->live.sequence;
+		worker->their_view_of_my_sequence = cd[i]->live.ack;
 
-	rad_assert(worker->last_read_other <= cd->m.when);
-	worker->last_read_other = cd->m.when;
+		/*
+		 *	Recalled requests may be older than ones we've
+		 *	already read.  See fr_channel_send_request_batch().
+		 */
+		if (worker->last_read_other < cd[i]->m.when) worker->last_read_other = cd[i]->m.when;
+	}
 
-	return cd;
+	worker->num_outstanding += num_messages;
+
+	return num_messages;
 }
 
 /** Send a reply message into the channel
@@ -825,14 +978,45 @@ int fr_channel_signal_open(fr_channel_t *ch)
 	return fr_control_message_send(ch->end[TO_WORKER].control, ch->end[TO_WORKER].rb, FR_CONTROL_ID_CHANNEL, &cc, sizeof(cc));
 }
 
+/** Tell the master whether or not the worker is polling the channel
+ *
+ *  While the worker is awake, the master doesn't signal it when
+ *  sending new requests.  Before going to sleep, the worker MUST
+ *  mark itself asleep, and then check the channel one last time.
+ *  Otherwise it may miss requests which were sent without a signal.
+ *
+ * @param[in] ch the channel
+ * @param[in] awake whether or not the worker is polling the channel
+ */
+void fr_channel_worker_awake(fr_channel_t *ch, bool awake)
+{
+	atomic_store_explicit(&ch->worker_awake, awake, memory_order_relaxed);
+	atomic_thread_fence(memory_order_seq_cst);
+}
+
+/** Get the signal counters for the master side of a channel
+ *
+ * @param[in] ch the channel
+ * @param[out] p_sent the number of signals sent to the worker
+ * @param[out] p_suppressed the number of signals which were
+ *	suppressed because the worker was awake.
+ */
+void fr_channel_signal_stats(fr_channel_t *ch, uint64_t *p_sent, uint64_t *p_suppressed)
+{
+	*p_sent = ch->end[TO_WORKER].num_signals;
+	*p_suppressed = ch->end[TO_WORKER].num_suppressed;
+}
+
 void fr_channel_debug(fr_channel_t *ch, FILE *fp)
 {
 	fprintf(fp, "to worker\n");
 	fprintf(fp, "\tnum_signals sent = %zd\n", ch->end[TO_WORKER].num_signals);
 	fprintf(fp, "\tnum_signals re-sent = %zd\n", ch->end[TO_WORKER].num_resignals);
+	fprintf(fp, "\tnum_signals suppressed = %zd\n", ch->end[TO_WORKER].num_suppressed);
 	fprintf(fp, "\tnum_kevents checked = %zd\n", ch->end[TO_WORKER].num_kevents);
 	fprintf(fp, "\tsequence = %zd\n", ch->end[TO_WORKER].sequence);
 	fprintf(fp, "\tack = %zd\n", ch->end[TO_WORKER].ack);
+	fprintf(fp, "\tnum_recalled = %zd\n", ch->end[TO_WORKER].num_recalled);
 
 	fprintf(fp, "to receive\n");
 	fprintf(fp, "\tnum_signals sent = %zd\n", ch->end[FROM_WORKER].num_signals);
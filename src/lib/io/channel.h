@@ -108,12 +108,17 @@ typedef struct fr_channel_data_t {
 fr_channel_t *fr_channel_create(TALLOC_CTX *ctx, fr_control_t *master, fr_control_t *worker) CC_HINT(nonnull);
 
 int fr_channel_send_request(fr_channel_t *ch, fr_channel_data_t *cm, fr_channel_data_t **p_reply) CC_HINT(nonnull);
+int fr_channel_send_request_batch(fr_channel_t *ch, fr_channel_data_t **cm, int num_messages, fr_channel_data_t **p_reply) CC_HINT(nonnull);
 fr_channel_data_t *fr_channel_recv_request(fr_channel_t *ch) CC_HINT(nonnull);
+int fr_channel_recv_request_batch(fr_channel_t *ch, fr_channel_data_t **cm, int max_messages) CC_HINT(nonnull);
 
 int fr_channel_send_reply(fr_channel_t *ch, fr_channel_data_t *cm, fr_channel_data_t **p_request) CC_HINT(nonnull);
 fr_channel_data_t *fr_channel_recv_reply(fr_channel_t *ch) CC_HINT(nonnull);
+fr_channel_data_t *fr_channel_recall_request(fr_channel_t *ch) CC_HINT(nonnull);
 
 int fr_channel_worker_sleeping(fr_channel_t *ch) CC_HINT(nonnull);
+void fr_channel_worker_awake(fr_channel_t *ch, bool awake) CC_HINT(nonnull);
+void fr_channel_signal_stats(fr_channel_t *ch, uint64_t *p_sent, uint64_t *p_suppressed) CC_HINT(nonnull);
 
 int fr_channel_service_kevent(fr_channel_t *ch, fr_control_t *c, struct kevent const *kev) CC_HINT(nonnull);
 fr_channel_event_t fr_channel_service_message(fr_time_t when, fr_channel_t **p_channel, void const *data, size_t data_size) CC_HINT(nonnull);
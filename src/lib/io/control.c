@@ -33,6 +33,7 @@ RCSID("$Id$")
 
 #define FR_CONTROL_SIGNAL	(1024)
 #define FR_CONTROL_MAX_IDENT	(32)
+#define FR_CONTROL_POP_BATCH	(16)
 
 /*
  *	Debugging, mainly for channel_test
@@ -315,27 +316,19 @@ int fr_control_message_send(fr_control_t *c, fr_ring_buffer_t *rb, uint32_t id,
 }
 
 
-/** Pop control-plane message
- *
- *  This function is called ONLY from the receiving thread.
+/** Copy the data out of a control-plane message, and mark it done
  *
- * @param[in] aq the recipients atomic queue for control-plane messages
+ * @param[in] m the message
  * @param[out] p_id the ident of this message.
  * @param[in,out] data where the data is stored
  * @param[in] data_size the size of the buffer where we store the data.
  * @return
- *	- <0 the size of the data we need to read the next message
- *	- 0 this kevent is not for us.
+ *	- <0 the size of the data we need to read the message
  *	- >0 the amount of data we've read
  */
-ssize_t fr_control_message_pop(fr_atomic_queue_t *aq, uint32_t *p_id, void *data, size_t data_size)
+static ssize_t fr_control_message_copy(fr_control_message_t *m, uint32_t *p_id, void *data, size_t data_size)
 {
 	uint8_t *p;
-	fr_control_message_t *m;
-
-	MPRINT("CONTROL pop aq %p\n", aq);
-
-	if (!fr_atomic_queue_pop(aq, (void **) &m)) return 0;
 
 	rad_assert(m->status == FR_CONTROL_MESSAGE_USED);
 
@@ -356,6 +349,29 @@ ssize_t fr_control_message_pop(fr_atomic_queue_t *aq, uint32_t *p_id, void *data
 	return data_size;
 }
 
+/** Pop control-plane message
+ *
+ *  This function is called ONLY from the receiving thread.
+ *
+ * @param[in] aq the recipients atomic queue for control-plane messages
+ * @param[out] p_id the ident of this message.
+ * @param[in,out] data where the data is stored
+ * @param[in] data_size the size of the buffer where we store the data.
+ * @return
+ *	- <0 the size of the data we need to read the next message
+ *	- 0 this kevent is not for us.
+ *	- >0 the amount of data we've read
+ */
+ssize_t fr_control_message_pop(fr_atomic_queue_t *aq, uint32_t *p_id, void *data, size_t data_size)
+{
+	fr_control_message_t *m;
+
+	MPRINT("CONTROL pop aq %p\n", aq);
+
+	if (!fr_atomic_queue_pop(aq, (void **) &m)) return 0;
+
+	return fr_control_message_copy(m, p_id, data, data_size);
+}
 
 /** Service a control-plane kevent
  *
@@ -441,19 +457,38 @@ int fr_control_callback_delete(fr_control_t *c, uint32_t id)
 	return 0;
 }
 
+/** Service all pending control-plane messages
+ *
+ *  This function is called ONLY from the receiving thread.  The
+ *  messages are popped from the atomic queue in batches, and the
+ *  callback for each one is run in order.
+ *
+ * @param[in] c the control structure
+ * @param[in] data where the message data is copied to.
+ * @param[in] data_size the size of the buffer where we store the data.
+ * @param[in] now the current time
+ */
 void fr_control_service(fr_control_t *c, void *data, size_t data_size, fr_time_t now)
 {
-	uint32_t id = 0;
-	size_t message_size;
+	int i, num_messages;
+	uint32_t id;
+	fr_control_message_t *array[FR_CONTROL_POP_BATCH];
 
 	while (true) {
-		message_size = fr_control_message_pop(c->aq, &id, data, data_size);
-		if (!message_size) return;
+		num_messages = fr_atomic_queue_pop_n(c->aq, (void **) array, FR_CONTROL_POP_BATCH);
+		if (!num_messages) return;
+
+		for (i = 0; i < num_messages; i++) {
+			ssize_t message_size;
 
-		if (id >= FR_CONTROL_MAX_IDENT) continue;
+			message_size = fr_control_message_copy(array[i], &id, data, data_size);
+			if (message_size <= 0) continue;
 
-		if (!c->ident[id].callback) continue;
+			if (id >= FR_CONTROL_MAX_IDENT) continue;
 
-		c->ident[id].callback(c->ident[id].ctx, data, message_size, now);
+			if (!c->ident[id].callback) continue;
+
+			c->ident[id].callback(c->ident[id].ctx, data, message_size, now);
+		}
 	}
 }
@@ -56,6 +56,7 @@ typedef	void (*fr_control_callback_t)(void *ctx, void const *data, size_t data_s
 #define FR_CONTROL_ID_CHANNEL (1)
 #define FR_CONTROL_ID_SOCKET  (2)
 #define FR_CONTROL_ID_WORKER  (3)
+#define FR_CONTROL_ID_SOCKET_DELETE (4)
 
 fr_control_t *fr_control_create(TALLOC_CTX *ctx, int kq, fr_atomic_queue_t *aq);
 void fr_control_free(fr_control_t *c);
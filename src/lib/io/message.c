@@ -1115,6 +1115,103 @@ fr_message_t *fr_message_alloc_reserve(fr_message_set_t *ms, fr_message_t *m, si
 	return m2;
 }
 
+/** Allocate packet data for a batch of messages
+ *
+ *  The application should call fr_message_reserve() with room for
+ *  multiple packets, read the packets into the buffer, and then pack
+ *  them together at the start of the buffer.  This function then
+ *  splits the reservation into one message per packet.
+ *
+ *  The reserved message 'm' is used for the first packet.  The other
+ *  messages are allocated here, and their packet data is allocated
+ *  directly after the previous packet.  Any reserved space which is
+ *  not used is left in the ring buffer as free space, so the ring
+ *  buffer does not become fragmented.
+ *
+ *  If we run out of messages part way through the batch, the
+ *  remaining packets are left in the (now released) reservation.
+ *  The caller should treat them as dropped.
+ *
+ * @param[in] ms the message set
+ * @param[in] m the reserved message, which holds the packed packets
+ * @param[in] packet_len array of packet lengths
+ * @param[in] num_messages number of entries in the packet_len array
+ * @param[out] m_array where the allocated messages are written
+ * @return
+ *      - <0 on error, and input message m is left alone
+ *	- the number of messages allocated on success.
+ */
+int fr_message_alloc_batch(fr_message_set_t *ms, fr_message_t *m, size_t const *packet_len, int num_messages,
+			   fr_message_t **m_array)
+{
+	int i;
+	bool cleaned_up;
+	uint8_t *p;
+	fr_message_t *m2;
+
+	(void) talloc_get_type_abort(ms, fr_message_set_t);
+
+	/* m is NOT talloc'd */
+
+	rad_assert(m->status == FR_MESSAGE_USED);
+	rad_assert(m->rb != NULL);
+	rad_assert(m->data != NULL);
+	rad_assert(m->data_size == 0);
+
+	if (num_messages <= 0) {
+		fr_strerror_printf("Cannot allocate an empty batch of messages");
+		return -1;
+	}
+
+	/*
+	 *	Allocate the first packet using the reserved message.
+	 *	Once this is done, the ring buffer is guaranteed to
+	 *	have data in it, so any garbage collection done below
+	 *	can't reset the ring buffer out from under us.
+	 */
+	if (!fr_message_alloc(ms, m, packet_len[0])) return -1;
+
+	m_array[0] = m;
+	p = m->data + packet_len[0];
+
+	for (i = 1; i < num_messages; i++) {
+		m2 = fr_message_get_message(ms, &cleaned_up);
+		if (!m2) {
+			MPRINT("Failed allocating batched message %d\n", i);
+			break;
+		}
+
+		m2->rb = m->rb;
+		m2->data = fr_ring_buffer_alloc(m2->rb, packet_len[i]);
+		if (!m2->data) {
+			m2->rb = NULL;
+			m2->status = FR_MESSAGE_DONE;
+			break;
+		}
+
+		m2->data_size = packet_len[i];
+		m2->rb_size = packet_len[i];
+
+		/*
+		 *	The packets were read into one contiguous
+		 *	reservation, so the allocation MUST follow
+		 *	the previous one.  If it doesn't, mark the
+		 *	message as done so that the data is cleaned
+		 *	up, and drop the rest of the batch.
+		 */
+		rad_assert(m2->data == p);
+		if (m2->data != p) {
+			m2->status = FR_MESSAGE_DONE;
+			break;
+		}
+
+		m_array[i] = m2;
+		p += packet_len[i];
+	}
+
+	return i;
+}
+
 #define MS_ALIGN_SIZE (16)
 #define MS_ALIGN(_x) (((_x) + (MS_ALIGN_SIZE-1)) & ~(MS_ALIGN_SIZE-1))
 
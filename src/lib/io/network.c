@@ -33,11 +33,18 @@ RCSID("$Id$")
 #include <freeradius-devel/io/worker.h>
 #include <freeradius-devel/io/network.h>
 
+#define fr_ptr_to_type(TYPE, MEMBER, PTR) (TYPE *) (((char *)PTR) - offsetof(TYPE, MEMBER))
+
 typedef struct fr_network_worker_t {
 	int			heap_id;		//!< workers are in a heap
 	fr_time_t		cpu_time;		//!< how much CPU time this worker has spent
 	fr_time_t		predicted;		//!< predicted processing time for one packet
 
+	int			num_outstanding;	//!< requests sent to the worker, with no reply
+	fr_time_t		last_active;		//!< when the worker last replied, or was given work
+
+	fr_dlist_t		entry;			//!< in the list of all workers
+
 	fr_channel_t		*channel;		//!< channel to the worker
 	fr_worker_t		*worker;		//!< worker pointer
 } fr_network_worker_t;
@@ -51,6 +58,10 @@ typedef struct fr_network_socket_t {
 
 	fr_message_set_t	*ms;			//!< message buffers for this socket.
 	fr_channel_data_t	*cd;			//!< cached in case of allocation & read error
+
+	fr_dlist_t		pending_entry;		//!< in the list of sockets with replies to write
+	fr_channel_data_t	**pending;		//!< replies waiting to be written
+	int			num_pending;		//!< number of replies waiting to be written
 } fr_network_socket_t;
 
 
@@ -70,11 +81,15 @@ struct fr_network_t {
 	fr_heap_t		*replies;		//!< replies from the worker, ordered by priority / origin time
 	fr_heap_t		*workers;		//!< workers, ordered by total CPU time spent
 	fr_heap_t		*closing;		//!< workers which are being closed
+	fr_dlist_t		worker_list;		//!< all workers, for stealing work from stalled ones
+	fr_event_timer_t	*steal_ev;		//!< timer for checking for stalled workers
+	fr_time_t		steal_delay;		//!< how long until the next check
 
 	uint64_t		num_requests;		//!< number of requests we sent
 	uint64_t		num_replies;		//!< number of replies we received
 
 	fr_heap_t		*sockets;		//!< list of sockets we're managing
+	fr_dlist_t		pending_sockets;	//!< sockets with replies waiting to be written
 
 	uint32_t		num_transports;		//!< how many transport layers we have
 	fr_transport_t		**transports;		//!< array of active transports.
@@ -120,6 +135,17 @@ static int reply_cmp(void const *one, void const *two)
 #define IALPHA (8)
 #define RTT(_old, _new) ((_new + ((IALPHA - 1) * _old)) / IALPHA)
 
+/*
+ *	How long a worker can have requests outstanding without
+ *	replying, before we move its unread requests to an idle
+ *	worker.  And how many requests we move to each idle worker.
+ */
+#define STEAL_INTERVAL (NANOSEC / 1000)
+#define MAX_STEAL_BATCH (16)
+#define MAX_STEAL_DELAY (STEAL_INTERVAL * 64)
+
+static void fr_network_steal_timer_arm(fr_network_t *nr);
+
 /** Drain the input channel
  *
  * @param[in] nr the network
@@ -148,6 +174,8 @@ static void fr_network_drain_input(fr_network_t *nr, fr_channel_t *ch, fr_channe
 		 */
 		w = fr_channel_master_ctx_get(ch);
 		w->cpu_time = cd->reply.cpu_time;
+		w->last_active = cd->m.when;
+		if (w->num_outstanding > 0) w->num_outstanding--;
 		if (!w->predicted) {
 			w->predicted = cd->reply.processing_time;
 		} else {
@@ -241,85 +269,436 @@ static void fr_network_channel_callback(void *ctx, void const *data, size_t data
 	}
 }
 
-/** Send a message on the "best" channel.
+/** Send messages on the "best" channel.
+ *
+ *  Messages are sent to the worker with the least total CPU time.  We
+ *  keep sending messages from the batch to the same worker until its
+ *  projected CPU time exceeds that of the next worker.  This means we
+ *  don't have to pop / insert the worker heap for every message, and
+ *  that the messages can be pushed into the channel all at once.
  *
  * @param nr the network
- * @param cd the message we've received
+ * @param cd the array of messages we've received
+ * @param num_messages the number of messages in the array
+ * @return the number of messages which were sent to a worker.
  */
-static int fr_network_send_request(fr_network_t *nr, fr_channel_data_t *cd)
+static int fr_network_send_request(fr_network_t *nr, fr_channel_data_t **cd, int num_messages)
 {
-	fr_network_worker_t *worker;
+	int sent = 0;
+	int num, rcode;
+	fr_time_t cpu_time;
+	fr_network_worker_t *worker, *next;
 	fr_channel_data_t *reply;
 
 	(void) talloc_get_type_abort(nr, fr_network_t);
 
-	/*
-	 *	Grab the worker with the least total CPU time.
-	 */
-	worker = fr_heap_pop(nr->workers);
-	if (!worker) {
-		fr_log(nr->log, L_DBG, "no workers");
-		return 0;
+	while (sent < num_messages) {
+		/*
+		 *	Grab the worker with the least total CPU time.
+		 */
+		worker = fr_heap_pop(nr->workers);
+		if (!worker) {
+			fr_log(nr->log, L_DBG, "no workers");
+			return sent;
+		}
+
+		(void) talloc_get_type_abort(worker, fr_network_worker_t);
+
+		next = fr_heap_peek(nr->workers);
+
+		/*
+		 *	Figure out how many messages we can send to
+		 *	this worker, before its projected CPU time
+		 *	exceeds that of the next worker.
+		 */
+		cpu_time = worker->cpu_time + worker->predicted;
+		num = 1;
+		while (((sent + num) < num_messages) && (!next || (cpu_time < next->cpu_time))) {
+			cpu_time += worker->predicted;
+			num++;
+		}
+
+		/*
+		 *	Send the messages to the channel.  If we fail,
+		 *	recurse.  That's easier than manually tracking
+		 *	the channel we popped off of the heap.
+		 *
+		 *	The only practical reason why the channel send
+		 *	will fail is because the recipient is not
+		 *	servicing it's queue.  When that happens, we
+		 *	just hand the rest of the requests to another
+		 *	channel.
+		 *
+		 *	If we run out of channels to use, the caller
+		 *	needs to allocate another one, and hand it to
+		 *	the scheduler.
+		 */
+		rcode = fr_channel_send_request_batch(worker->channel, &cd[sent], num, &reply);
+		if (rcode > 0) {
+			if (!worker->num_outstanding) worker->last_active = cd[sent]->m.when;
+			worker->num_outstanding += rcode;
+			sent += rcode;
+
+			/*
+			 *	We're projecting that the worker will
+			 *	use more CPU time to process these
+			 *	requests.  The CPU time will be updated
+			 *	with a more accurate number when we
+			 *	receive a reply from this channel.
+			 */
+			worker->cpu_time += worker->predicted * rcode;
+		}
+
+		/*
+		 *	If we have a reply, push it onto our local
+		 *	queue, and poll for more replies.
+		 */
+		if (reply) fr_network_drain_input(nr, worker->channel, reply);
+
+		if (rcode < num) {
+			int rest;
+
+			rest = num - ((rcode > 0) ? rcode : 0);
+
+			fr_log(nr->log, L_DBG, "recursing in send_request");
+			rcode = fr_network_send_request(nr, &cd[sent], rest);
+
+			/*
+			 *	Mark this channel as still busy, for some
+			 *	future time.  This process ensures that we
+			 *	don't immediately pop it off the heap and try
+			 *	to send it another request.
+			 */
+			worker->cpu_time = cd[sent]->m.when + worker->predicted;
+			(void) fr_heap_insert(nr->workers, worker);
+
+			sent += rcode;
+			if (rcode < rest) break;
+			continue;
+		}
+
+		/*
+		 *	Insert the worker back into the heap of workers.
+		 */
+		(void) fr_heap_insert(nr->workers, worker);
+	}
+
+	if (sent && !nr->steal_ev) fr_network_steal_timer_arm(nr);
+
+	return sent;
+}
+
+/** Move requests from a stalled worker to an idle one.
+ *
+ *  The requests are ones which the stalled worker hasn't yet read
+ *  from its channel, i.e. ones which haven't been decoded.
+ *
+ * @param nr the network
+ * @param stalled the worker to take requests from
+ * @param idle the worker to give the requests to
+ * @param now the current time
+ * @return the number of requests which were moved.
+ */
+static int fr_network_steal(fr_network_t *nr, fr_network_worker_t *stalled, fr_network_worker_t *idle, fr_time_t now)
+{
+	int stolen;
+	fr_channel_data_t *cd, *reply;
+
+	for (stolen = 0; stolen < MAX_STEAL_BATCH; stolen++) {
+		cd = fr_channel_recall_request(stalled->channel);
+		if (!cd) break;
+
+		if (stalled->num_outstanding > 0) stalled->num_outstanding--;
+
+		/*
+		 *	Leave cd->m.when alone.  The worker compares it
+		 *	to the original receive time, to see if the
+		 *	packet has been superseded.
+		 */
+		if (fr_channel_send_request(idle->channel, cd, &reply) < 0) {
+			if (fr_network_send_request(nr, &cd, 1) == 0) {
+				fr_log(nr->log, L_ERR, "Failed sending stolen packet to worker");
+				fr_message_done(&cd->m);
+			}
+			continue;
+		}
+
+		if (!idle->num_outstanding) idle->last_active = now;
+		idle->num_outstanding++;
+
+		(void) fr_heap_extract(nr->workers, idle);
+		idle->cpu_time += idle->predicted;
+		(void) fr_heap_insert(nr->workers, idle);
+
+		if (reply) fr_network_drain_input(nr, idle->channel, reply);
 	}
 
-	(void) talloc_get_type_abort(worker, fr_network_worker_t);
+	if (!stolen) return 0;
+
+	fr_log(nr->log, L_DBG, "moved %d packets from stalled worker %p to idle worker %p",
+	       stolen, stalled->worker, idle->worker);
 
 	/*
-	 *	Send the message to the channel.  If we fail, recurse.
-	 *	That's easier than manually tracking the channel we
-	 *	popped off of the heap.
-	 *
-	 *	The only practical reason why the channel send will
-	 *	fail is because the recipient is not servicing it's
-	 *	queue.  When that happens, we just hand the request to
-	 *	another channel.
-	 *
-	 *	If we run out of channels to use, the caller needs to
-	 *	allocate another one, and hand it to the scheduler.
+	 *	Mark the stalled worker as busy for some future time,
+	 *	so that we don't immediately send it the next
+	 *	request.  Its CPU time will be updated when it
+	 *	finally sends us a reply.
 	 */
-	if (fr_channel_send_request(worker->channel, cd, &reply) < 0) {
-		int rcode;
+	(void) fr_heap_extract(nr->workers, stalled);
+	stalled->cpu_time = now + STEAL_INTERVAL;
+	(void) fr_heap_insert(nr->workers, stalled);
+
+	return stolen;
+}
+
+/** Check for stalled workers, and re-route their requests.
+ *
+ *  A worker is stalled if it has had requests outstanding for
+ *  STEAL_INTERVAL, and hasn't sent us a reply in that time.
+ *  e.g. it is blocked in a synchronous module.  Any requests which
+ *  it hasn't read from its channel are moved to idle workers.
+ *
+ *  While checks find nothing to move, they're done less and less
+ *  often, up to MAX_STEAL_DELAY.  If every busy worker is stalled,
+ *  and has nothing left to move, the timer isn't re-armed.  Sending
+ *  the next request to a worker arms it again.
+ *
+ * @param el the event list
+ * @param when the current time
+ * @param ctx the network
+ */
+static void fr_network_steal_timer(UNUSED fr_event_list_t *el, UNUSED struct timeval *when, void *ctx)
+{
+	fr_time_t now;
+	fr_dlist_t *entry, *idle_entry;
+	fr_network_worker_t *stalled, *idle;
+	fr_network_t *nr = talloc_get_type_abort(ctx, fr_network_t);
+	bool busy = false, more = false, empty;
+	int stolen = 0, rcode;
+
+	now = fr_time();
+
+	for (entry = FR_DLIST_FIRST(nr->worker_list);
+	     entry != NULL;
+	     entry = FR_DLIST_NEXT(nr->worker_list, entry)) {
+		stalled = fr_ptr_to_type(fr_network_worker_t, entry, entry);
+
+		if (!stalled->num_outstanding) continue;
 
-		fr_log(nr->log, L_DBG, "recursing in send_request");
-		rcode = fr_network_send_request(nr, cd);
+		busy = true;
 
 		/*
-		 *	Mark this channel as still busy, for some
-		 *	future time.  This process ensures that we
-		 *	don't immediately pop it off the heap and try
-		 *	to send it another request.
+		 *	It may stall later, with requests it hasn't
+		 *	read.
 		 */
-		worker->cpu_time = cd->m.when + worker->predicted;
-		(void) fr_heap_insert(nr->workers, worker);
+		if ((now - stalled->last_active) < STEAL_INTERVAL) {
+			more = true;
+			continue;
+		}
 
-		return rcode;
+		/*
+		 *	Give each idle worker a batch of requests,
+		 *	until there's nothing left to steal.
+		 */
+		empty = false;
+		for (idle_entry = FR_DLIST_FIRST(nr->worker_list);
+		     idle_entry != NULL;
+		     idle_entry = FR_DLIST_NEXT(nr->worker_list, idle_entry)) {
+			idle = fr_ptr_to_type(fr_network_worker_t, entry, idle_entry);
+
+			if (idle->num_outstanding > 0) continue;
+
+			rcode = fr_network_steal(nr, stalled, idle, now);
+			if (!rcode) {
+				empty = true;
+				break;
+			}
+
+			stolen += rcode;
+		}
+
+		/*
+		 *	We ran out of idle workers before we ran out
+		 *	of requests.
+		 */
+		if (!empty) more = true;
 	}
 
 	/*
-	 *	We're projecting that the worker will use more CPU
-	 *	time to process this request.  The CPU time will be
-	 *	updated with a more accurate number when we receive a
-	 *	reply from this channel.
+	 *	Check again soon, as the idle workers may be about
+	 *	to stall, too.
 	 */
-	worker->cpu_time += worker->predicted;
+	if (stolen) {
+		nr->steal_delay = STEAL_INTERVAL;
+		fr_network_steal_timer_arm(nr);
+		return;
+	}
+
+	if (!busy) {
+		nr->steal_delay = STEAL_INTERVAL;
+		return;
+	}
+
+	if (!more) return;
+
+	nr->steal_delay *= 2;
+	if (nr->steal_delay > MAX_STEAL_DELAY) nr->steal_delay = MAX_STEAL_DELAY;
+
+	fr_network_steal_timer_arm(nr);
+}
+
+/** Arm the timer which checks for stalled workers.
+ *
+ * @param nr the network
+ */
+static void fr_network_steal_timer_arm(fr_network_t *nr)
+{
+	struct timeval when;
+
+	gettimeofday(&when, NULL);
+	when.tv_usec += nr->steal_delay / 1000;
+	while (when.tv_usec >= USEC) {
+		when.tv_sec++;
+		when.tv_usec -= USEC;
+	}
+
+	if (fr_event_timer_insert(nr->el, fr_network_steal_timer, nr, &when, &nr->steal_ev) < 0) {
+		fr_log(nr->log, L_DBG_ERR, "Failed inserting steal timer: %s", fr_strerror());
+	}
+}
+
+
+static fr_time_t start_time = 0;
+
+
+#define MAX_READ_BATCH (16)
+
+/** Read a batch of packets from the network.
+ *
+ *  We reserve room for MAX_READ_BATCH packets in one contiguous
+ *  chunk of the ring buffer, and let the transport fill as many of
+ *  them as it can in one call.  The packets are then packed together,
+ *  and split into individual messages.  Any reserved room which
+ *  wasn't used goes back to the ring buffer.
+ *
+ * @param nr the network
+ * @param s the network socket which is ready to read
+ */
+static void fr_network_read_batch(fr_network_t *nr, fr_network_socket_t *s)
+{
+	int i, num_read, num_packets, num_messages, num_sent;
+	size_t size;
+	uint8_t *p;
+	fr_time_t now;
+	fr_channel_data_t *cd;
+	uint8_t *buffer[MAX_READ_BATCH];
+	size_t packet_len[MAX_READ_BATCH];
+	fr_message_t *m_array[MAX_READ_BATCH];
+	fr_channel_data_t *cd_array[MAX_READ_BATCH];
+
+	size = s->transport->default_message_size;
+
+	if (!s->cd) {
+		cd = (fr_channel_data_t *) fr_message_reserve(s->ms, size * MAX_READ_BATCH);
+		if (!cd) {
+			fr_log(nr->log, L_ERR, "Failed allocating message size %zd!", size * MAX_READ_BATCH);
+
+			/*
+			 *	@todo - handle errors via transport callback
+			 */
+			_exit(1);
+		}
+	} else {
+		cd = s->cd;
+	}
+
+	rad_assert(cd->m.data != NULL);
+	rad_assert(cd->m.rb_size >= size * MAX_READ_BATCH);
+
+	for (i = 0; i < MAX_READ_BATCH; i++) {
+		buffer[i] = cd->m.data + (i * size);
+	}
+
+	num_read = s->transport->read_batch(s->fd, s->ctx, buffer, size, packet_len, MAX_READ_BATCH);
+	if (num_read < 0) {
+		fr_log(nr->log, L_DBG_ERR, "error from transport read");
+
+		/*
+		 *	@todo - handle errors via transport callback
+		 */
+		_exit(1);
+	}
 
 	/*
-	 *	Insert the worker back into the heap of workers.
+	 *	Pack the packets together at the start of the
+	 *	reservation, skipping any which the transport told us
+	 *	to ignore.
 	 */
-	(void) fr_heap_insert(nr->workers, worker);
+	p = cd->m.data;
+	num_packets = 0;
+	for (i = 0; i < num_read; i++) {
+		if (!packet_len[i]) continue;
+
+		if (buffer[i] != p) memmove(p, buffer[i], packet_len[i]);
+
+		packet_len[num_packets++] = packet_len[i];
+		p += packet_len[i];
+	}
 
 	/*
-	 *	If we have a reply, push it onto our local queue, and
-	 *	poll for more replies.
+	 *	Nothing to do.  Keep the reservation for the next
+	 *	read.
 	 */
-	if (reply) fr_network_drain_input(nr, worker->channel, reply);
+	if (!num_packets) {
+		fr_log(nr->log, L_DBG, "got no data from transport read");
+		s->cd = cd;
+		return;
+	}
+	s->cd = NULL;
 
-	return 1;
-}
+	fr_log(nr->log, L_DBG, "got %d packets", num_packets);
 
+	num_messages = fr_message_alloc_batch(s->ms, &cd->m, packet_len, num_packets, m_array);
+	if (num_messages < 0) {
+		fr_log(nr->log, L_ERR, "Failed allocating messages: %s", fr_strerror());
 
-static fr_time_t start_time = 0;
+		/*
+		 *	@todo - handle errors via transport callback
+		 */
+		_exit(1);
+	}
 
+	if (num_messages < num_packets) {
+		fr_log(nr->log, L_ERR, "Dropping %d packets due to lack of message buffers",
+		       num_packets - num_messages);
+	}
+
+	/*
+	 *	Initialize the rest of the fields of the channel data.
+	 */
+	now = fr_time();
+	for (i = 0; i < num_messages; i++) {
+		cd = cd_array[i] = (fr_channel_data_t *) m_array[i];
+
+		cd->m.when = now;
+		cd->packet_ctx = s->ctx;
+		cd->io_ctx = s;
+		cd->transport = 0;	/* @todo - set transport number from the transport */
+		cd->priority = 0;	/* @todo - set priority based on information from the transport layer  */
+		cd->request.start_time = &start_time; /* @todo - set by transport */
+	}
+
+	start_time = now;
+
+	num_sent = fr_network_send_request(nr, cd_array, num_messages);
+	if (num_sent < num_messages) {
+		fr_log(nr->log, L_ERR, "Failed sending %d packets to worker", num_messages - num_sent);
+
+		for (i = num_sent; i < num_messages; i++) {
+			fr_message_done(&cd_array[i]->m);
+		}
+	}
+}
 
 /** Read a packet from the network.
  *
@@ -338,6 +717,11 @@ static void fr_network_read(UNUSED fr_event_list_t *el, int sockfd, void *ctx)
 
 	fr_log(nr->log, L_DBG, "network read");
 
+	if (s->transport->read_batch) {
+		fr_network_read_batch(nr, s);
+		return;
+	}
+
 	if (!s->cd) {
 		cd = (fr_channel_data_t *) fr_message_reserve(s->ms, s->transport->default_message_size);
 		if (!cd) {
@@ -395,12 +779,84 @@ static void fr_network_read(UNUSED fr_event_list_t *el, int sockfd, void *ctx)
 
 	(void) fr_message_alloc(s->ms, &cd->m, data_size);
 
-	if (!fr_network_send_request(nr, cd)) {
+	if (!fr_network_send_request(nr, &cd, 1)) {
 		fr_log(nr->log, L_ERR, "Failed sending packet to worker");
 		fr_message_done(&cd->m);
 	}
 }
 
+#define MAX_WRITE_BATCH (16)
+#define MAX_WRITE_LATENCY (NANOSEC / 10000)
+
+/** Write all of the pending replies for a socket
+ *
+ * @param nr the network
+ * @param s the network socket which has pending replies
+ */
+static void fr_network_write_flush(fr_network_t *nr, fr_network_socket_t *s)
+{
+	int i, num_written;
+	uint8_t *buffer[MAX_WRITE_BATCH];
+	size_t buffer_len[MAX_WRITE_BATCH];
+
+	rad_assert(s->num_pending > 0);
+	rad_assert(s->num_pending <= MAX_WRITE_BATCH);
+
+	for (i = 0; i < s->num_pending; i++) {
+		buffer[i] = s->pending[i]->m.data;
+		buffer_len[i] = s->pending[i]->m.data_size;
+	}
+
+	num_written = s->transport->write_batch(s->fd, s->ctx, buffer, buffer_len, s->num_pending);
+	if (num_written < s->num_pending) {
+		fr_log(nr->log, L_DBG_ERR, "Failed writing %d replies to socket %p",
+		       s->num_pending - ((num_written < 0) ? 0 : num_written), s);
+	}
+
+	fr_log(nr->log, L_DBG, "handling %d replies to socket %p", s->num_pending, s);
+
+	/*
+	 *	@todo - call transport "done" for replies which
+	 *	weren't written.
+	 */
+	for (i = 0; i < s->num_pending; i++) {
+		fr_message_done(&s->pending[i]->m);
+	}
+
+	s->num_pending = 0;
+	fr_dlist_remove(&s->pending_entry);
+}
+
+/** Queue a reply for a socket, and write the queue if it is full.
+ *
+ * @param nr the network
+ * @param s the network socket
+ * @param cd the reply to write
+ */
+static void fr_network_write_queue(fr_network_t *nr, fr_network_socket_t *s, fr_channel_data_t *cd)
+{
+	if (!s->num_pending) fr_dlist_insert_tail(&nr->pending_sockets, &s->pending_entry);
+
+	s->pending[s->num_pending++] = cd;
+
+	if (s->num_pending == MAX_WRITE_BATCH) fr_network_write_flush(nr, s);
+}
+
+/** Write pending replies for all sockets.
+ *
+ * @param nr the network
+ */
+static void fr_network_write_flush_all(fr_network_t *nr)
+{
+	fr_dlist_t *entry;
+	fr_network_socket_t *s;
+
+	while ((entry = FR_DLIST_FIRST(nr->pending_sockets)) != NULL) {
+		s = fr_ptr_to_type(fr_network_socket_t, pending_entry, entry);
+		fr_network_write_flush(nr, s);
+	}
+}
+
 /** Handle a network control message callback for a new socket
  *
  * @param[in] ctx the network
@@ -421,14 +877,37 @@ static void fr_network_socket_callback(void *ctx, void const *data, size_t data_
 	rad_assert(s != NULL);
 	memcpy(s, data, sizeof(*s));
 
+	FR_DLIST_INIT(s->pending_entry);
+	if (s->transport->write_batch) {
+		s->pending = talloc_array(s, fr_channel_data_t *, MAX_WRITE_BATCH);
+		if (!s->pending) {
+			fr_log(nr->log, L_ERR, "Failed allocating reply queue for network IO.");
+
+			/*
+			 *	@todo - handle errors via transport callback
+			 */
+			_exit(1);
+		}
+	}
+
 #define MIN_MESSAGES (8)
 
 	/*
 	 *	@todo - make the default number of messages configurable?
+	 *
+	 *	Batched reads reserve room for MAX_READ_BATCH packets
+	 *	at a time.  The largest allocation from a message set
+	 *	is half of the ring buffer, so size it accordingly.
 	 */
-	s->ms = fr_message_set_create(s, MIN_MESSAGES,
-				      sizeof(fr_channel_data_t),
-				      s->transport->default_message_size * MIN_MESSAGES);
+	if (s->transport->read_batch) {
+		s->ms = fr_message_set_create(s, MAX_READ_BATCH * 2,
+					      sizeof(fr_channel_data_t),
+					      s->transport->default_message_size * MAX_READ_BATCH * 2);
+	} else {
+		s->ms = fr_message_set_create(s, MIN_MESSAGES,
+					      sizeof(fr_channel_data_t),
+					      s->transport->default_message_size * MIN_MESSAGES);
+	}
 	if (!s->ms) {
 		fr_log(nr->log, L_ERR, "Failed creating message buffers for network IO.");
 
@@ -449,6 +928,70 @@ static void fr_network_socket_callback(void *ctx, void const *data, size_t data_
 	fr_log(nr->log, L_DBG, "Using new socket with FD %d", s->fd);
 }
 
+/** Handle a network control message callback for deleting a socket
+ *
+ * @param[in] ctx the network
+ * @param[in] data the message
+ * @param[in] data_size size of the data
+ * @param[in] now the current time
+ */
+static void fr_network_socket_delete_callback(void *ctx, void const *data, size_t data_size, UNUSED fr_time_t now)
+{
+	fr_network_t *nr = ctx;
+	fr_network_socket_t *s, *found = NULL;
+	fr_network_socket_t **keep;
+	size_t i, num;
+	int fd;
+
+	rad_assert(data_size == sizeof(fd));
+
+	if (data_size != sizeof(fd)) return;
+
+	memcpy(&fd, data, sizeof(fd));
+
+	/*
+	 *	The heap can't be searched, so take everything out of
+	 *	it, and put back the sockets we're keeping.  Deleting
+	 *	sockets is rare.
+	 */
+	num = fr_heap_num_elements(nr->sockets);
+	keep = talloc_array(nr, fr_network_socket_t *, num);
+	if (!keep) {
+		fr_log(nr->log, L_ERR, "Failed deleting socket with FD %d: out of memory", fd);
+		return;
+	}
+
+	for (i = 0; i < num; i++) {
+		keep[i] = fr_heap_pop(nr->sockets);
+		if (keep[i]->fd == fd) found = keep[i];
+	}
+
+	for (i = 0; i < num; i++) {
+		if (keep[i] != found) (void) fr_heap_insert(nr->sockets, keep[i]);
+	}
+	talloc_free(keep);
+
+	if (!found) {
+		fr_log(nr->log, L_ERR, "Failed deleting socket with FD %d: no such socket", fd);
+		return;
+	}
+	s = found;
+
+	if (s->num_pending) fr_network_write_flush(nr, s);
+
+	(void) fr_event_fd_delete(nr->el, s->fd);
+	close(s->fd);
+	s->fd = -1;
+
+	/*
+	 *	Requests read from the socket may still be running,
+	 *	and their messages are in the socket's message set.
+	 *	So the socket is freed with the network, and replies
+	 *	to it are discarded.
+	 */
+	fr_log(nr->log, L_DBG, "Deleted socket with FD %d", fd);
+}
+
 
 /** Handle a network control message callback for a new worker
  *
@@ -478,6 +1021,7 @@ static void fr_network_worker_callback(void *ctx, void const *data, size_t data_
 	fr_channel_master_ctx_add(w->channel, w);
 
 	(void) fr_heap_insert(nr->workers, w);
+	fr_dlist_insert_tail(&nr->worker_list, &w->entry);
 }
 
 
@@ -577,6 +1121,12 @@ fr_network_t *fr_network_create(TALLOC_CTX *ctx, fr_log_t *logger, uint32_t num_
 		return NULL;
 	}
 
+	if (fr_control_callback_add(nr->control, FR_CONTROL_ID_SOCKET_DELETE, nr, fr_network_socket_delete_callback) < 0) {
+		fr_strerror_printf("Failed adding socket delete callback: %s", fr_strerror());
+		talloc_free(nr);
+		return NULL;
+	}
+
 	if (fr_control_callback_add(nr->control, FR_CONTROL_ID_WORKER, nr, fr_network_worker_callback) < 0) {
 		fr_strerror_printf("Failed adding worker callback: %s", fr_strerror());
 		talloc_free(nr);
@@ -604,18 +1154,22 @@ fr_network_t *fr_network_create(TALLOC_CTX *ctx, fr_log_t *logger, uint32_t num_
 		goto nomem;
 	}
 
-	nr->workers = fr_heap_create(worker_cmp, offsetof(fr_channel_data_t, channel.heap_id));
+	nr->workers = fr_heap_create(worker_cmp, offsetof(fr_network_worker_t, heap_id));
 	if (!nr->workers) {
 		talloc_free(nr);
 		goto nomem;
 	}
 
-	nr->closing = fr_heap_create(worker_cmp, offsetof(fr_channel_data_t, channel.heap_id));
+	nr->closing = fr_heap_create(worker_cmp, offsetof(fr_network_worker_t, heap_id));
 	if (!nr->closing) {
 		talloc_free(nr);
 		goto nomem;
 	}
 
+	FR_DLIST_INIT(nr->pending_sockets);
+	FR_DLIST_INIT(nr->worker_list);
+	nr->steal_delay = STEAL_INTERVAL;
+
 	nr->num_transports = num_transports;
 	nr->transports = transports;
 
@@ -661,6 +1215,11 @@ int fr_network_destroy(fr_network_t *nr)
 		fr_message_done(&cd->m);
 	}
 
+	/*
+	 *	Write any replies which are still queued.
+	 */
+	fr_network_write_flush_all(nr);
+
 	talloc_free(nr);
 
 	return 0;
@@ -675,7 +1234,7 @@ void fr_network(fr_network_t *nr)
 	while (true) {
 		bool wait_for_event;
 		int num_events;
-//		fr_time_t now;
+		fr_time_t now;
 		fr_channel_data_t *cd;
 		fr_network_socket_t *s;
 
@@ -695,27 +1254,45 @@ void fr_network(fr_network_t *nr)
 		if (num_events < 0) break;
 
 		/*
-		 *	Service outstanding events.
+		 *	Service outstanding events.  We do this even
+		 *	if there are no FD events, as it also runs the
+		 *	timer which checks for stalled workers.
 		 */
-		if (num_events > 0) {
-			fr_log(nr->log, L_DBG, "servicing events");
-			fr_event_service(nr->el);
-		}
+		fr_log(nr->log, L_DBG, "servicing events");
+		fr_event_service(nr->el);
 
-//		now = fr_time();
-
-		cd = fr_heap_pop(nr->replies);
-		if (!cd) continue;
+		now = fr_time();
 
 		/*
-		 *	@todo - call transport "recv reply"
+		 *	Handle the replies in priority order.  Replies
+		 *	for sockets which can do batched writes are
+		 *	queued, and written at the end of this loop.
+		 *	We stop after MAX_WRITE_LATENCY, so that
+		 *	replies don't sit in the queue for too long.
 		 */
-		s = cd->io_ctx;
+		while ((cd = fr_heap_pop(nr->replies)) != NULL) {
+			/*
+			 *	@todo - call transport "recv reply"
+			 */
+			s = cd->io_ctx;
 
-		s->transport->write(s->fd, s->ctx, cd->m.data, cd->m.data_size);
+			if (s->fd < 0) {
+				fr_message_done(&cd->m);
 
-		fr_log(nr->log, L_DBG, "handling reply to socket %p", cd->io_ctx);
-		fr_message_done(&cd->m);
+			} else if (s->transport->write_batch) {
+				fr_network_write_queue(nr, s, cd);
+
+			} else {
+				s->transport->write(s->fd, s->ctx, cd->m.data, cd->m.data_size);
+
+				fr_log(nr->log, L_DBG, "handling reply to socket %p", cd->io_ctx);
+				fr_message_done(&cd->m);
+			}
+
+			if ((fr_time() - now) > MAX_WRITE_LATENCY) break;
+		}
+
+		fr_network_write_flush_all(nr);
 	}
 }
 
@@ -730,6 +1307,24 @@ void fr_network_exit(fr_network_t *nr)
 	fr_event_loop_exit(nr->el, 1);
 }
 
+/** Use a timer wheel for the network's timers
+ *
+ *  Must be called before the network has any timers, i.e. before it
+ *  runs.
+ *
+ * @param[in] nr the network
+ * @param[in] enable whether to use the timer wheel.
+ * @return
+ *	- 0 on success.
+ *	- -1 on failure.
+ */
+int fr_network_timer_wheel(fr_network_t *nr, bool enable)
+{
+	(void) talloc_get_type_abort(nr, fr_network_t);
+
+	return fr_event_list_timer_wheel(nr->el, enable);
+}
+
 /** Add a socket to a network
  *
  * @param nr the network
@@ -749,6 +1344,18 @@ int fr_network_socket_add(fr_network_t *nr, int fd, void *ctx, fr_transport_t *t
 	return fr_control_message_send(nr->control, nr->rb, FR_CONTROL_ID_SOCKET, &m, sizeof(m));
 }
 
+/** Delete a socket from a network
+ *
+ *  The network closes the socket.
+ *
+ * @param nr the network
+ * @param fd the file descriptor for the socket
+ */
+int fr_network_socket_delete(fr_network_t *nr, int fd)
+{
+	return fr_control_message_send(nr->control, nr->rb, FR_CONTROL_ID_SOCKET_DELETE, &fd, sizeof(fd));
+}
+
 /** Add a worker to a network
  *
  * @param nr the network
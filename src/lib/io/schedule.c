@@ -106,6 +106,8 @@ typedef struct fr_schedule_network_t {
 	int		id;			//!< a unique ID
 	fr_schedule_t	*sc;			//!< the scheduler we are running under
 
+	int		num_sockets;		//!< number of sockets this network is reading from
+
 	fr_schedule_child_status_t status;	//!< status of the worker
 	fr_network_t	*rc;			//!< the receive data structure
 } fr_schedule_network_t;
@@ -122,6 +124,10 @@ struct fr_schedule_t {
 	int		max_inputs;		//!< number of network threads
 	int		max_workers;		//!< max number of worker threads
 
+	bool		cpu_affinity;		//!< pin network and worker threads to CPUs
+	uint32_t	spin_usec;		//!< how long workers poll their channels before sleeping
+	bool		timer_wheel;		//!< use timer wheels for the worker and network timers
+
 	int		num_workers;		//!< number of worker threads
 	int		num_workers_exited;	//!< number of exited workers
 
@@ -137,7 +143,8 @@ struct fr_schedule_t {
 	fr_heap_t	*workers;		//!< heap of workers
 	fr_heap_t	*done_workers;		//!< heap of done workers
 
-	fr_schedule_network_t *sn;		//!< pointer to the (one) network thread
+	int		num_networks;		//!< number of network threads
+	fr_schedule_network_t **sn;		//!< array of network threads
 
 	uint32_t	num_transports;		//!< how many transport layers we have
 	fr_transport_t	**transports;		//!< array of active transports.
@@ -190,6 +197,41 @@ int fr_schedule_get_worker_kq(fr_schedule_t *sc)
 }
 
 
+#ifdef HAVE_PTHREAD_SETAFFINITY_NP
+/** Pin the current thread to a CPU
+ *
+ *  Network thread N is pinned to CPU 2N, and worker thread N to CPU
+ *  2N+1, so that each network thread has a worker next to it.  Any
+ *  workers left over after that are placed on the following CPUs.
+ *  If there are more threads than CPUs, we wrap around.
+ *
+ * @param[in] sc the scheduler
+ * @param[in] name of the thread type, for logging
+ * @param[in] id of the thread
+ * @param[in] slot the CPU slot to use
+ */
+static void fr_schedule_cpu_pin(fr_schedule_t *sc, char const *name, int id, int slot)
+{
+	int rcode;
+	long num_cpus;
+	cpu_set_t cpuset;
+
+	num_cpus = sysconf(_SC_NPROCESSORS_ONLN);
+	if (num_cpus <= 0) return;
+
+	CPU_ZERO(&cpuset);
+	CPU_SET(slot % num_cpus, &cpuset);
+
+	rcode = pthread_setaffinity_np(pthread_self(), sizeof(cpuset), &cpuset);
+	if (rcode != 0) {
+		fr_log(sc->log, L_ERR, "%s %d - Failed setting CPU affinity: %s", name, id, fr_syserror(rcode));
+		return;
+	}
+
+	fr_log(sc->log, L_DBG, "%s %d - Pinned to CPU %ld", name, id, slot % num_cpus);
+}
+#endif
+
 /** Initialize and run the worker thread.
  *
  * @param[in] arg the fr_schedule_worker_t
@@ -197,6 +239,7 @@ int fr_schedule_get_worker_kq(fr_schedule_t *sc)
  */
 static void *fr_schedule_worker_thread(void *arg)
 {
+	int i;
 	TALLOC_CTX *ctx;
 	fr_schedule_worker_t *sw = arg;
 	fr_schedule_t *sc = sw->sc;
@@ -205,6 +248,13 @@ static void *fr_schedule_worker_thread(void *arg)
 
 	fr_log(sc->log, L_INFO, "Worker %d starting\n", sw->id);
 
+#ifdef HAVE_PTHREAD_SETAFFINITY_NP
+	if (sc->cpu_affinity) {
+		fr_schedule_cpu_pin(sc, "Worker", sw->id,
+				    (sw->id < sc->num_networks) ? (2 * sw->id) + 1 : sc->num_networks + sw->id);
+	}
+#endif
+
 	ctx = talloc_init("worker");
 	if (!ctx) {
 		fr_log(sc->log, L_ERR, "Worker %d - Failed allocating memory", sw->id);
@@ -219,6 +269,12 @@ static void *fr_schedule_worker_thread(void *arg)
 
 	snprintf(buffer, sizeof(buffer), "thread %d - ", sw->id);
 	fr_worker_name(sw->worker, buffer);
+	fr_worker_spin_time(sw->worker, sc->spin_usec);
+
+	if (fr_worker_timer_wheel(sw->worker, sc->timer_wheel) < 0) {
+		fr_log(sc->log, L_ERR, "Worker %d - Failed enabling timer wheel: %s", sw->id, fr_strerror());
+		goto fail;
+	}
 
 	/*
 	 *	@todo make this a registry
@@ -236,7 +292,13 @@ static void *fr_schedule_worker_thread(void *arg)
 	sc->num_workers++;
 	PTHREAD_MUTEX_UNLOCK(&sc->mutex);
 
-	(void) fr_network_worker_add(sc->sn->rc, sw->worker);
+	/*
+	 *	Every network thread can send requests to every
+	 *	worker.
+	 */
+	for (i = 0; i < sc->num_networks; i++) {
+		(void) fr_network_worker_add(sc->sn[i]->rc, sw->worker);
+	}
 
 	fr_log(sc->log, L_INFO, "Worker %d running\n", sw->id);
 
@@ -306,7 +368,11 @@ static void *fr_schedule_network_thread(void *arg)
 	fr_schedule_t *sc = sn->sc;
 	fr_schedule_child_status_t status = FR_CHILD_FAIL;
 
-	fr_log(sc->log, L_INFO, "Network starting\n");
+	fr_log(sc->log, L_INFO, "Network %d starting\n", sn->id);
+
+#ifdef HAVE_PTHREAD_SETAFFINITY_NP
+	if (sc->cpu_affinity) fr_schedule_cpu_pin(sc, "Network", sn->id, 2 * sn->id);
+#endif
 
 	ctx = talloc_init("network");
 	if (!ctx) {
@@ -320,6 +386,11 @@ static void *fr_schedule_network_thread(void *arg)
 		goto fail;
 	}
 
+	if (fr_network_timer_wheel(sn->rc, sc->timer_wheel) < 0) {
+		fr_log(sc->log, L_ERR, "Network %d - Failed enabling timer wheel: %s", sn->id, fr_strerror());
+		goto fail;
+	}
+
 	sn->status = FR_CHILD_RUNNING;
 
 	/*
@@ -327,7 +398,7 @@ static void *fr_schedule_network_thread(void *arg)
 	 */
 	sem_post(&sc->semaphore);
 
-	fr_log(sc->log, L_INFO, "Network running");
+	fr_log(sc->log, L_INFO, "Network %d running", sn->id);
 
 	/*
 	 *	Do all of the work.
@@ -349,7 +420,7 @@ fail:
 
 	sn->status = status;
 
-	fr_log(sc->log, L_INFO, "Network exiting");
+	fr_log(sc->log, L_INFO, "Network %d exiting", sn->id);
 
 	/*
 	 *	Tell the scheduler we're done.
@@ -366,6 +437,11 @@ fail:
  * @param[in] logger the destination for all logging messages
  * @param[in] max_inputs the number of network threads
  * @param[in] max_workers the number of worker threads
+ * @param[in] cpu_affinity whether to pin the network and worker threads to CPUs
+ * @param[in] spin_usec how long workers poll their channels before sleeping.
+ *	0 means workers sleep as soon as they're idle.
+ * @param[in] timer_wheel whether the worker and network event lists use
+ *	timer wheels instead of heaps.
  * @param[in] num_transports the number of transports in the transport array
  * @param[in] transports the array of transports.
  * @param[in] worker_thread_instantiate callback for new worker threads
@@ -375,6 +451,7 @@ fail:
  *	- fr_schedule_t new scheduler
  */
 fr_schedule_t *fr_schedule_create(TALLOC_CTX *ctx, fr_log_t *logger, int max_inputs, int max_workers,
+				  bool cpu_affinity, uint32_t spin_usec, bool timer_wheel,
 				  uint32_t num_transports, fr_transport_t **transports,
 				  fr_schedule_thread_instantiate_t worker_thread_instantiate,
 				  void *worker_thread_ctx)
@@ -401,8 +478,18 @@ fr_schedule_t *fr_schedule_create(TALLOC_CTX *ctx, fr_log_t *logger, int max_inp
 
 	sc->max_inputs = max_inputs;
 	sc->max_workers = max_workers;
+	sc->cpu_affinity = cpu_affinity;
+	sc->spin_usec = spin_usec;
+	sc->timer_wheel = timer_wheel;
 	sc->log = logger;
 
+#ifndef HAVE_PTHREAD_SETAFFINITY_NP
+	if (sc->cpu_affinity) {
+		fr_log(sc->log, L_WARN, "CPU affinity is not supported on this platform");
+		sc->cpu_affinity = false;
+	}
+#endif
+
 	sc->worker_thread_instantiate = worker_thread_instantiate;
 	sc->worker_instantiate_ctx = worker_thread_ctx;
 
@@ -449,24 +536,40 @@ fr_schedule_t *fr_schedule_create(TALLOC_CTX *ctx, fr_log_t *logger, int max_inp
 	}
 
 	/*
-	 *	Create the network thread first.
+	 *	Create the network threads first.
 	 */
-	sc->sn = talloc_zero(sc, fr_schedule_network_t);
-	sc->sn->sc = sc;
-	sc->sn->id = 0;
-
-	rcode = pthread_create(&sc->sn->pthread_id, &attr, fr_schedule_network_thread, sc->sn);
-	if (rcode != 0) {
-		fr_strerror_printf("Failed creating network thread: %s", fr_syserror(errno));
-		goto fail;
+	sc->sn = talloc_zero_array(sc, fr_schedule_network_t *, sc->max_inputs);
+	if (!sc->sn) {
+		talloc_free(sc);
+		goto nomem;
 	}
 
-	SEM_WAIT_INTR(&sc->semaphore);
-	if (sc->sn->status != FR_CHILD_RUNNING) {
-	fail:
-		TALLOC_FREE(sc->sn);
-		fr_schedule_destroy(sc);
-		return NULL;
+	for (i = 0; i < sc->max_inputs; i++) {
+		fr_schedule_network_t *sn;
+
+		sn = talloc_zero(sc->sn, fr_schedule_network_t);
+		if (!sn) goto fail;
+
+		sn->sc = sc;
+		sn->id = i;
+
+		rcode = pthread_create(&sn->pthread_id, &attr, fr_schedule_network_thread, sn);
+		if (rcode != 0) {
+			fr_strerror_printf("Failed creating network thread: %s", fr_syserror(rcode));
+			talloc_free(sn);
+			goto fail;
+		}
+
+		SEM_WAIT_INTR(&sc->semaphore);
+		if (sn->status != FR_CHILD_RUNNING) {
+			talloc_free(sn);
+		fail:
+			fr_schedule_destroy(sc);
+			return NULL;
+		}
+
+		sc->sn[i] = sn;
+		sc->num_networks++;
 	}
 
 	/*
@@ -581,8 +684,6 @@ int fr_schedule_destroy(fr_schedule_t *sc)
 	sc->running = false;
 
 #ifdef HAVE_PTHREAD_H
-	rad_assert(sc->num_workers > 0);
-
 	fr_log(sc->log, L_DBG, "Destroying scheduler\n");
 
 	/*
@@ -618,10 +719,12 @@ int fr_schedule_destroy(fr_schedule_t *sc)
 	}
 
 	/*
-	 *	If the network thread is running, tell it to exit.
+	 *	If the network threads are running, tell them to exit.
 	 */
-	if (sc->sn->status == FR_CHILD_RUNNING) {
-		fr_network_exit(sc->sn->rc);
+	for (i = 0; i < sc->num_networks; i++) {
+		if (sc->sn[i]->status != FR_CHILD_RUNNING) continue;
+
+		fr_network_exit(sc->sn[i]->rc);
 		SEM_WAIT_INTR(&sc->semaphore);
 	}
 
@@ -640,6 +743,9 @@ int fr_schedule_destroy(fr_schedule_t *sc)
 }
 
 /** Add a socket to a scheduler.
+ *
+ *  The socket is given to the network thread which is reading from
+ *  the fewest sockets.
  *
  * @param sc the scheduler
  * @param fd the file descriptor for the socket
@@ -648,7 +754,93 @@ int fr_schedule_destroy(fr_schedule_t *sc)
  */
 int fr_schedule_socket_add(fr_schedule_t *sc, int fd, void *ctx, fr_transport_t *transport)
 {
-	return fr_network_socket_add(sc->sn->rc, fd, ctx, transport);
+	int i;
+	fr_schedule_network_t *sn;
+
+	if (!sc->num_networks) {
+		fr_strerror_printf("No network threads are running");
+		return -1;
+	}
+
+	sn = sc->sn[0];
+	for (i = 1; i < sc->num_networks; i++) {
+		if (sc->sn[i]->num_sockets < sn->num_sockets) sn = sc->sn[i];
+	}
+
+	sn->num_sockets++;
+
+	return fr_network_socket_add(sn->rc, fd, ctx, transport);
+}
+
+/** Add one SO_REUSEPORT socket per network thread.
+ *
+ *  The callback is called once for each network thread.  It should
+ *  open a socket for the same address and port, mark it with
+ *  fr_socket_server_reuseport(), and bind it.  The kernel then
+ *  distributes incoming packets across the sockets, and each socket
+ *  is read only by its own network thread.
+ *
+ * @param sc the scheduler
+ * @param socket_open callback to open a socket
+ * @param uctx context for the callback
+ * @param transport the transport
+ * @return
+ *	- <0 on error
+ *	- the number of sockets added on success
+ */
+int fr_schedule_socket_add_reuseport(fr_schedule_t *sc, fr_schedule_socket_open_t socket_open, void *uctx,
+				     fr_transport_t *transport)
+{
+	int i, fd;
+	int *fds;
+	void *ctx;
+
+	if (!sc->num_networks) {
+		fr_strerror_printf("No network threads are running");
+		return -1;
+	}
+
+	fds = talloc_array(sc, int, sc->num_networks);
+	if (!fds) {
+		fr_strerror_printf("Out of memory");
+		return -1;
+	}
+
+	for (i = 0; i < sc->num_networks; i++) {
+		ctx = NULL;
+
+		fd = socket_open(uctx, i, &ctx);
+		if (fd < 0) {
+			fr_strerror_printf("Failed opening socket for network %d: %s", i, fr_strerror());
+			goto fail;
+		}
+
+		if (fr_network_socket_add(sc->sn[i]->rc, fd, ctx, transport) < 0) {
+			close(fd);
+			goto fail;
+		}
+
+		fds[i] = fd;
+		sc->sn[i]->num_sockets++;
+	}
+
+	talloc_free(fds);
+
+	return i;
+
+fail:
+	/*
+	 *	Don't leave some of the networks listening.  They own
+	 *	the sockets which were added, so they close them.
+	 */
+	while (i-- > 0) {
+		(void) fr_network_socket_delete(sc->sn[i]->rc, fds[i]);
+		sc->sn[i]->num_sockets--;
+	}
+
+	talloc_free(fds);
+
+	return -1;
 }
 
 
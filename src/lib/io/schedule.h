@@ -35,7 +35,14 @@ extern "C" {
 typedef struct fr_schedule_t fr_schedule_t;
 typedef int (*fr_schedule_thread_instantiate_t)(void *ctx);
 
+/**
+ *  Open a socket for network thread "id".  Returns the socket, and
+ *  writes the transport context for the socket to p_ctx.
+ */
+typedef int (*fr_schedule_socket_open_t)(void *uctx, int id, void **p_ctx);
+
 fr_schedule_t *fr_schedule_create(TALLOC_CTX *ctx, fr_log_t *log, int max_inputs, int max_workers,
+				  bool cpu_affinity, uint32_t spin_usec, bool timer_wheel,
 				  uint32_t num_transports, fr_transport_t **transports,
 				  fr_schedule_thread_instantiate_t worker_thread_instantiate,
 				  void *worker_thread_ctx);
@@ -44,6 +51,8 @@ int fr_schedule_destroy(fr_schedule_t *sc);
 int fr_schedule_get_worker_kq(fr_schedule_t *sc);
 
 int fr_schedule_socket_add(fr_schedule_t *sc, int fd, void *ctx, fr_transport_t *transport) CC_HINT(nonnull);
+int fr_schedule_socket_add_reuseport(fr_schedule_t *sc, fr_schedule_socket_open_t socket_open, void *uctx,
+				     fr_transport_t *transport) CC_HINT(nonnull(1,2,4));
 
 #ifdef __cplusplus
 }
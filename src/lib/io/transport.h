@@ -102,6 +102,30 @@ typedef int *(*fr_transport_recv_request_t)(REQUEST *);
  */
 typedef ssize_t (*fr_transport_io_t)(int sockfd, void *packet_ctx, uint8_t *buffer, size_t buffer_len);
 
+/**
+ *  Read multiple packets from a socket in one call.
+ *
+ *  Each entry in "buffer" has room for buffer_len bytes.  The length
+ *  of each packet read is written to "packet_len".  Packets which
+ *  should be ignored (e.g. they failed validation) have a length of
+ *  zero.
+ *
+ *  Returns the number of buffers which were filled, 0 for "no data",
+ *  or <0 on error.
+ */
+typedef int (*fr_transport_read_batch_t)(int sockfd, void *packet_ctx, uint8_t **buffer, size_t buffer_len,
+					 size_t *packet_len, int num_packets);
+
+/**
+ *  Write multiple packets to a socket in one call.
+ *
+ *  Returns the number of leading buffers which were written, or <0
+ *  on error.  i.e. if N is returned, buffer[0..N-1] were written, and
+ *  buffer[N] onwards were not.
+ */
+typedef int (*fr_transport_write_batch_t)(int sockfd, void *packet_ctx, uint8_t **buffer, size_t *buffer_len,
+					  int num_packets);
+
 /**
  *  Receive a reply in the master thread.
  */
@@ -127,7 +151,9 @@ typedef struct fr_transport_t {
 	uint32_t			id;		//!< ID of this transport
 	size_t				default_message_size; // usually minimum message size
 	fr_transport_io_t		read;		//!< read from a socket to a data buffer
+	fr_transport_read_batch_t	read_batch;	//!< read multiple packets at once (optional)
 	fr_transport_io_t		write;		//!< write from a data buffer to a socket
+	fr_transport_write_batch_t	write_batch;	//!< write multiple packets at once (optional)
 	fr_transport_recv_request_t	recv_request;	//!< function to receive a request (worker -> master)
 	fr_transport_decode_t		decode;		//!< function to decode packet to request (worker)
 	fr_transport_encode_t		encode;		//!< function to encode request to packet (worker)
@@ -160,7 +186,8 @@ struct rad_request {
 	uint64_t		number;
 	int			heap_id;
 
-	fr_dlist_t		time_order;		//!< tracking requests by time order
+	int			time_order_id;		//!< entry in the worker's time order heap
+	fr_dlist_t		time_order;		//!< for the worker's "waiting to die" list
 	fr_heap_t		*runnable;		//!< heap of runnable requests
 
 	uint32_t		priority;
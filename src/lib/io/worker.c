@@ -46,11 +46,11 @@
  *  the heap for "too long", in fr_worker_check_timeouts().
  *
  *  When a packet is decoded, it is put into the "runnable" heap, and
- *  also into the head of the "time_order" linked list. The main loop
- *  fr_worker() then pulls requests off of this heap and runs them.
- *  The fr_worker_check_timeouts() function also checks the tail of
- *  the "time_order" list, and ages out requests which have been
- *  running for "too long".
+ *  also into the "time_order" heap, which is ordered by receive time.
+ *  The main loop fr_worker() then pulls requests off of the runnable
+ *  heap and runs them.  The fr_worker_check_timeouts() function also
+ *  checks the oldest entries in the "time_order" heap, and ages out
+ *  requests which have been running for "too long".
  *
  *  A request may return one of FR_TRANSPORT_YIELD,
  *  FR_TRANSPORT_REPLY, or FR_TRANSPORT_DONE.  If a request is
@@ -102,11 +102,15 @@ struct fr_worker_t {
 
 	fr_time_t		checked_timeout; //!< when we last checked the tails of the queues
 
+	fr_time_t		spin_time;	//!< how long to poll the channels before sleeping
+	bool			awake;		//!< whether the channels know we're polling them
+	uint64_t		num_spins;	//!< number of times we polled the channels and found nothing
+
 	fr_worker_heap_t	to_decode;	//!< messages from the master, to be decoded or localized
 	fr_worker_heap_t       	localized;	//!< localized messages to be decoded
 
 	fr_heap_t      		*runnable;	//!< current runnable requests which we've spent time processing
-	fr_dlist_t		time_order;	//!< time order of requests
+	fr_heap_t		*time_order;	//!< time order of requests
 
 	fr_dlist_t		waiting_to_die;	//!< waiting to die
 
@@ -151,6 +155,64 @@ struct fr_worker_t {
                fr_dlist_remove(&_var->_member);			 \
        } while (0)
 
+/** Start tracking a request by receive time
+ *
+ *  Requests may be received from multiple network threads out of
+ *  order, so we can't just append to a list.  The heap gives us
+ *  O(log n) insertion no matter how many requests are in flight, and
+ *  the request tracks its position in the heap, so removal doesn't
+ *  need a search.
+ */
+static inline void worker_time_order_insert(fr_worker_t *worker, REQUEST *request)
+{
+	FR_DLIST_INIT(request->time_order);
+	(void) fr_heap_insert(worker->time_order, request);
+}
+
+/** Stop tracking a request by receive time
+ *
+ *  The request may be in the time order heap, or on the "waiting to
+ *  die" list.
+ */
+static inline void worker_time_order_remove(fr_worker_t *worker, REQUEST *request)
+{
+	if (request->time_order_id >= 0) (void) fr_heap_extract(worker->time_order, request);
+	fr_dlist_remove(&request->time_order);
+}
+
+/** Move a request from the time order heap to the "waiting to die" list
+ *
+ */
+static inline void worker_time_order_kill(fr_worker_t *worker, REQUEST *request)
+{
+	(void) fr_heap_extract(worker->time_order, request);
+	fr_dlist_insert_tail(&worker->waiting_to_die, &request->time_order);
+}
+
+/** Get the oldest request, if it has been waiting for too long
+ *
+ * @param[in] worker the worker
+ * @param[in] now the current time
+ * @param[in] timeout how long a request may wait
+ * @return
+ *	- NULL if no request has been waiting for "timeout" or longer.
+ *	- the oldest request, which is still in the time order heap.
+ */
+static inline REQUEST *worker_time_order_expired(fr_worker_t *worker, fr_time_t now, fr_time_t timeout)
+{
+	REQUEST *request;
+
+	request = fr_heap_peek(worker->time_order);
+	if (!request || ((now - request->recv_time) < timeout)) return NULL;
+
+	return request;
+}
+
+
+/*
+ *	The maximum number of messages we pull from a channel at once.
+ */
+#define MAX_RECV_BATCH (16)
 
 /** Drain the input channel
  *
@@ -160,20 +222,113 @@ struct fr_worker_t {
  */
 static void fr_worker_drain_input(fr_worker_t *worker, fr_channel_t *ch, fr_channel_data_t *cd)
 {
-	if (!cd) {
-		cd = fr_channel_recv_request(ch);
-		if (!cd) {
+	int i, num_messages;
+	fr_channel_data_t *array[MAX_RECV_BATCH];
+
+	if (cd) {
+		array[0] = cd;
+		num_messages = 1;
+
+	} else {
+		num_messages = fr_channel_recv_request_batch(ch, array, MAX_RECV_BATCH);
+		if (!num_messages) {
 			fr_log(worker->log, L_DBG, "\t%sno data?", worker->name);
 			return;
 		}
 	}
 
 	do {
-		worker->num_requests++;
-		fr_log(worker->log, L_DBG, "\t%sreceived request %d", worker->name, worker->num_requests);
-		cd->channel.ch = ch;
-		WORKER_HEAP_INSERT(to_decode, cd, request.list);
-	} while ((cd = fr_channel_recv_request(ch)) != NULL);
+		for (i = 0; i < num_messages; i++) {
+			cd = array[i];
+
+			worker->num_requests++;
+			fr_log(worker->log, L_DBG, "\t%sreceived request %d", worker->name, worker->num_requests);
+			cd->channel.ch = ch;
+			WORKER_HEAP_INSERT(to_decode, cd, request.list);
+		}
+	} while ((num_messages = fr_channel_recv_request_batch(ch, array, MAX_RECV_BATCH)) > 0);
+}
+
+/** Tell the channels whether or not we're polling them
+ *
+ * @param[in] worker the worker
+ * @param[in] awake whether or not we're polling the channels
+ */
+static void fr_worker_awake(fr_worker_t *worker, bool awake)
+{
+	int i;
+
+	if (worker->awake == awake) return;
+
+	worker->awake = awake;
+
+	for (i = 0; i < worker->max_channels; i++) {
+		if (!worker->channel[i]) continue;
+
+		fr_channel_worker_awake(worker->channel[i], awake);
+	}
+}
+
+/** Poll all of the channels for new requests
+ *
+ * @param[in] worker the worker
+ * @return
+ *	- true if we received new requests
+ *	- false if there were no new requests
+ */
+static bool fr_worker_poll(fr_worker_t *worker)
+{
+	int i;
+	bool found = false;
+	fr_channel_data_t *cd;
+
+	for (i = 0; i < worker->max_channels; i++) {
+		if (!worker->channel[i]) continue;
+
+		cd = fr_channel_recv_request(worker->channel[i]);
+		if (!cd) continue;
+
+		fr_worker_drain_input(worker, worker->channel[i], cd);
+		found = true;
+	}
+
+	return found;
+}
+
+/** Spin on the channels for a while before going to sleep
+ *
+ *  Waking up a sleeping worker requires a kevent, which is much more
+ *  expensive than polling a few atomic queues.  So when there's
+ *  nothing to do, we poll the channels for "spin_time".  If nothing
+ *  arrives, we tell the channels that we're asleep.
+ *
+ * @param[in] worker the worker
+ * @return
+ *	- true if we received new requests
+ *	- false if the worker should go to sleep
+ */
+static bool fr_worker_spin(fr_worker_t *worker)
+{
+	fr_time_t start;
+
+	start = fr_time();
+
+	do {
+		if (fr_worker_poll(worker)) return true;
+
+		worker->num_spins++;
+	} while ((fr_time() - start) < worker->spin_time);
+
+	/*
+	 *	The master may have sent us a request just before we
+	 *	marked ourselves asleep.  It didn't signal us, so we
+	 *	have to check the channels one last time.
+	 */
+	fr_worker_awake(worker, false);
+	if (!fr_worker_poll(worker)) return false;
+
+	fr_worker_awake(worker, true);
+	return true;
 }
 
 
@@ -238,6 +393,8 @@ static void fr_worker_channel_callback(void *ctx, void const *data, size_t data_
 			rad_assert(ms != NULL);
 			fr_channel_worker_ctx_add(ch, ms);
 
+			if (worker->awake) fr_channel_worker_awake(ch, true);
+
 			worker->num_channels++;
 			ok = true;
 			break;
@@ -470,7 +627,7 @@ static void fr_worker_send_reply(fr_worker_t *worker, REQUEST *request, size_t s
 	 *	@todo Use a talloc pool for the request.  Clean it up,
 	 *	and insert it back into a slab allocator.
 	 */
-	fr_dlist_remove(&request->time_order);
+	worker_time_order_remove(worker, request);
 	talloc_free(request);
 }
 
@@ -490,7 +647,8 @@ static void fr_worker_send_reply(fr_worker_t *worker, REQUEST *request, size_t s
 static void fr_worker_check_timeouts(fr_worker_t *worker, fr_time_t now)
 {
 	fr_time_t waiting;
-	fr_dlist_t *entry;
+	fr_dlist_t *entry, *next;
+	REQUEST *request;
 
 	/*
 	 *	Check the "localized" queue for old packets.
@@ -548,25 +706,18 @@ static void fr_worker_check_timeouts(fr_worker_t *worker, fr_time_t now)
 	/*
 	 *	Check the "runnable" queue for old requests.
 	 */
-	while ((entry = FR_DLIST_TAIL(worker->time_order)) != NULL) {
-		REQUEST *request;
+	while ((request = worker_time_order_expired(worker, now, NANOSEC)) != NULL) {
 		fr_transport_final_t final;
 
-		request = fr_ptr_to_type(REQUEST, time_order, entry);
-		waiting = now - request->recv_time;
-
-		if (waiting < NANOSEC) break;
-
 		/*
 		 *	Waiting too long, delete it.
 		 */
-		fr_dlist_remove(&request->time_order);
-		(void) fr_heap_extract(worker->runnable, request);
+		if (request->heap_id >= 0) (void) fr_heap_extract(worker->runnable, request);
 
 		final = request->process_async(request, FR_TRANSPORT_ACTION_DONE);
 
 		if (final != FR_TRANSPORT_DONE) {
-			fr_dlist_insert_tail(&worker->waiting_to_die, &request->time_order);
+			worker_time_order_kill(worker, request);
 			continue;
 		}
 
@@ -579,21 +730,20 @@ static void fr_worker_check_timeouts(fr_worker_t *worker, fr_time_t now)
 	}
 
 	/*
-	 *	Check the waiting_to_die list.
+	 *	Check the waiting_to_die list.  The request may be
+	 *	freed, so get the next entry before processing it.
 	 */
 	for (entry = FR_DLIST_FIRST(worker->waiting_to_die);
 	     entry != NULL;
-	     entry = FR_DLIST_NEXT(worker->waiting_to_die, entry)) {
-		REQUEST *request;
+	     entry = next) {
 		fr_transport_final_t final;
 
+		next = FR_DLIST_NEXT(worker->waiting_to_die, entry);
 		request = fr_ptr_to_type(REQUEST, time_order, entry);
 
 		final = request->process_async(request, FR_TRANSPORT_ACTION_DONE);
 
 		if (final == FR_TRANSPORT_DONE) {
-			fr_dlist_remove(&worker->waiting_to_die);
-
 			fr_log(worker->log, L_DBG, "(%zd) finally finished", request->number);
 
 			/*
@@ -618,7 +768,6 @@ static REQUEST *fr_worker_get_request(fr_worker_t *worker, fr_time_t now)
 	int rcode;
 	fr_channel_data_t *cd;
 	REQUEST *request;
-	fr_dlist_t *entry;
 #ifndef HAVE_TALLOC_POOLED_OBJECT
 	TALLOC_CTX *ctx;
 #endif
@@ -726,44 +875,14 @@ nak:
 	fr_message_done(&cd->m);
 
 	/*
-	 *	New requests are inserted into the time order list in
-	 *	strict time priority.  Once they are in the list, they
-	 *	are only removed when the request is freed.
-	 *
-	 *	Requests may be received from multiple network threads
-	 *	out of order.  We should walk the list to insert this
-	 *	one into the right place.
+	 *	New requests are inserted into the time order heap,
+	 *	which is ordered by receive time.  Once they are in
+	 *	the heap, they are only removed when the request is
+	 *	freed, or when it is moved to the "waiting to die"
+	 *	list.
 	 */
-	entry = FR_DLIST_FIRST(worker->time_order);
-	if (!entry) {
-		fr_dlist_insert_head(&worker->time_order, &request->time_order);
-	} else {
-		REQUEST *old;
-		fr_dlist_t *prev = &worker->time_order;
-
-		/*
-		 *	Requests are orderd by their receive time.
-		 *	Requests which are older (i.e. smaller receive
-		 *	time) are at the tail of the list.
-		 */
-		while (entry) {
-			old = fr_ptr_to_type(REQUEST, time_order, entry);
-
-			/*
-			 *	If entry is older than the new packet,
-			 *	insert the new packet *before* the
-			 *	current entry.
-			 */
-			if (old->recv_time < request->recv_time) {
-				break;
-			}
-
-			prev = entry;
-			entry = FR_DLIST_NEXT(worker->time_order, entry);
-		}
-
-		fr_dlist_insert_head(prev, &request->time_order);
-	}
+	request->heap_id = -1;
+	worker_time_order_insert(worker, request);
 
 	/*
 	 *	Bootstrap the async state machine with the initial
@@ -811,8 +930,7 @@ static void fr_worker_run_request(fr_worker_t *worker, REQUEST *request)
 		 *	async cleanup queue.
 		 */
 		if (final != FR_TRANSPORT_DONE) {
-			fr_dlist_remove(&request->time_order);
-			fr_dlist_insert_tail(&worker->waiting_to_die, &request->time_order);
+			worker_time_order_kill(worker, request);
 			return;
 		}
 	}
@@ -921,6 +1039,20 @@ static int worker_message_cmp(void const *one, void const *two)
 	return 0;
 }
 
+/**
+ *  Track a REQUEST in the "time_order" heap, oldest first.
+ */
+static int worker_time_order_cmp(void const *one, void const *two)
+{
+	REQUEST const *a = one;
+	REQUEST const *b = two;
+
+	if (a->recv_time < b->recv_time) return -1;
+	if (a->recv_time > b->recv_time) return +1;
+
+	return 0;
+}
+
 /**
  *  Track a REQUEST in the "running" heap.
  */
@@ -1081,7 +1213,12 @@ nomem:
 		talloc_free(worker);
 		goto nomem;;
 	}
-	FR_DLIST_INIT(worker->time_order);
+
+	worker->time_order = fr_heap_create(worker_time_order_cmp, offsetof(REQUEST, time_order_id));
+	if (!worker->time_order) {
+		talloc_free(worker);
+		goto nomem;
+	}
 	FR_DLIST_INIT(worker->waiting_to_die);
 
 	worker->num_transports = num_transports;
@@ -1130,6 +1267,22 @@ void fr_worker(fr_worker_t *worker)
 		 *	the event loop, but we don't wait for events.
 		 */
 		wait_for_event = (fr_heap_num_elements(worker->runnable) == 0);
+
+		/*
+		 *	The masters don't signal us while we're awake,
+		 *	so we have to poll the channels ourselves.  If
+		 *	there's nothing to do, spin for a while before
+		 *	going to sleep.
+		 */
+		if (worker->spin_time) {
+			if (fr_worker_poll(worker)) {
+				wait_for_event = false;
+
+			} else if (wait_for_event) {
+				wait_for_event = !fr_worker_spin(worker);
+			}
+		}
+
 		fr_log(worker->log, L_DBG, "\t%sWaiting for events %d", worker->name, wait_for_event);
 
 		/*
@@ -1143,6 +1296,8 @@ void fr_worker(fr_worker_t *worker)
 			break;
 		}
 
+		if (worker->spin_time) fr_worker_awake(worker, true);
+
 		/*
 		 *	Service outstanding events.
 		 */
@@ -1212,6 +1367,23 @@ void fr_worker_debug(fr_worker_t *worker, FILE *fp)
 
 	fr_time_tracking_debug(&worker->tracking, fp);
 
+	if (worker->spin_time) {
+		int i;
+		uint64_t sent, suppressed, total_sent = 0, total_suppressed = 0;
+
+		for (i = 0; i < worker->max_channels; i++) {
+			if (!worker->channel[i]) continue;
+
+			fr_channel_signal_stats(worker->channel[i], &sent, &suppressed);
+			total_sent += sent;
+			total_suppressed += suppressed;
+		}
+
+		fprintf(fp, "\tspin time = %" PRIu64 " us\n", worker->spin_time / 1000);
+		fprintf(fp, "\tnum_spins = %" PRIu64 "\n", worker->num_spins);
+		fprintf(fp, "\tsignals sent = %" PRIu64 "\n", total_sent);
+		fprintf(fp, "\tsignals suppressed = %" PRIu64 "\n", total_suppressed);
+	}
 }
 
 /** Create a channel to the worker
@@ -1261,3 +1433,36 @@ void fr_worker_name(fr_worker_t *worker, char const *name)
 
 	worker->name = talloc_strdup(worker, name);
 }
+
+/** Set how long a worker polls its channels before sleeping
+ *
+ *  While the worker is polling, the network threads don't signal it
+ *  when they send new requests.
+ *
+ * @param[in] worker the worker
+ * @param[in] usec the spin time in microseconds.  0 disables spinning.
+ */
+void fr_worker_spin_time(fr_worker_t *worker, uint32_t usec)
+{
+	(void) talloc_get_type_abort(worker, fr_worker_t);
+
+	worker->spin_time = ((fr_time_t) usec) * 1000;
+}
+
+/** Use a timer wheel for the worker's timers
+ *
+ *  Must be called before the worker has any timers, i.e. before it
+ *  runs.
+ *
+ * @param[in] worker the worker
+ * @param[in] enable whether to use the timer wheel.
+ * @return
+ *	- 0 on success.
+ *	- -1 on failure.
+ */
+int fr_worker_timer_wheel(fr_worker_t *worker, bool enable)
+{
+	(void) talloc_get_type_abort(worker, fr_worker_t);
+
+	return fr_event_list_timer_wheel(worker->el, enable);
+}
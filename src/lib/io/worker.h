@@ -51,6 +51,8 @@ void fr_worker(fr_worker_t *worker) CC_HINT(nonnull);
 void fr_worker_exit(fr_worker_t *worker) CC_HINT(nonnull);
 void fr_worker_debug(fr_worker_t *worker, FILE *fp) CC_HINT(nonnull);
 void fr_worker_name(fr_worker_t *worker, char const *name) CC_HINT(nonnull);
+void fr_worker_spin_time(fr_worker_t *worker, uint32_t usec) CC_HINT(nonnull);
+int fr_worker_timer_wheel(fr_worker_t *worker, bool enable) CC_HINT(nonnull);
 fr_channel_t *fr_worker_channel_create(fr_worker_t const *worker, TALLOC_CTX *ctx, fr_control_t *master) CC_HINT(nonnull);
 
 #ifdef __cplusplus
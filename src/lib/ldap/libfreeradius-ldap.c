@@ -758,6 +758,60 @@ fr_ldap_rcode_t fr_ldap_search_async(int *msgid, REQUEST *request,
 	return LDAP_PROC_SUCCESS;
 }
 
+/** Process the result of a search started with #fr_ldap_search_async
+ *
+ * Checks each message in the result for errors, and counts the entries, in the same
+ * way as #fr_ldap_search.
+ *
+ * @param[in,out] result	All messages received for the search's msgid.  Will be freed
+ *				and set to NULL unless LDAP_PROC_SUCCESS is returned.
+ * @param[in] request		Current request.  May be NULL.
+ * @param[in] conn		the search was sent on.
+ * @param[in] dn		used as base for the search.
+ * @return One of the LDAP_PROC_* (#fr_ldap_rcode_t) values.
+ */
+fr_ldap_rcode_t fr_ldap_search_async_result(LDAPMessage **result, REQUEST *request,
+					    fr_ldap_conn_t const *conn, char const *dn)
+{
+	fr_ldap_rcode_t			status = LDAP_PROC_SUCCESS;
+	fr_ldap_handle_config_t const	*handle_config = conn->config;
+	LDAPMessage			*msg;
+	int				count;
+
+	for (msg = ldap_first_message(conn->handle, *result);
+	     msg;
+	     msg = ldap_next_message(conn->handle, msg)) {
+		status = fr_ldap_error_check(NULL, conn, msg, dn);
+		if (status != LDAP_PROC_SUCCESS) break;
+	}
+
+	if (status != LDAP_PROC_SUCCESS) {
+		ROPTIONAL(RPEDEBUG, PERROR, "Failed performing search");
+		goto error;
+	}
+
+	count = ldap_count_entries(conn->handle, *result);
+	if (count < 0) {
+		ROPTIONAL(REDEBUG, ERROR, "Error counting results: %s", fr_ldap_error_str(conn));
+		status = LDAP_PROC_ERROR;
+		goto error;
+	}
+
+	if (count == 0) {
+		ROPTIONAL(RDEBUG, DEBUG, "Search returned no results");
+		status = LDAP_PROC_NO_RESULT;
+		goto error;
+	}
+
+	return LDAP_PROC_SUCCESS;
+
+error:
+	ldap_msgfree(*result);
+	*result = NULL;
+
+	return status;
+}
+
 /** Modify something in the LDAP directory
  *
  * Binds as the administrative user and attempts to modify an LDAP object.
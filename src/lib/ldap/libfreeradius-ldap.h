@@ -387,6 +387,9 @@ fr_ldap_rcode_t	fr_ldap_search_async(int *msgid, REQUEST *request,
 				     char const *dn, int scope, char const *filter, char const * const *attrs,
 				     LDAPControl **serverctrls, LDAPControl **clientctrls);
 
+fr_ldap_rcode_t	fr_ldap_search_async_result(LDAPMessage **result, REQUEST *request,
+					    fr_ldap_conn_t const *conn, char const *dn);
+
 fr_ldap_rcode_t	fr_ldap_modify(REQUEST *request, fr_ldap_conn_t **pconn,
 			       char const *dn, LDAPMod *mods[],
 			       LDAPControl **serverctrls, LDAPControl **clientctrls);
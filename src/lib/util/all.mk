@@ -29,6 +29,7 @@ SOURCES		:= base64.c \
 		   net.c \
 		   pair.c \
 		   pair_cursor.c \
+		   pair_index.c \
 		   pcap.c \
 		   print.c \
 		   proto.c \
@@ -32,9 +32,70 @@ RCSID("$Id$")
 #include <string.h>
 #include <stdint.h>
 #include <freeradius-devel/cursor.h>
+#include <freeradius-devel/threads.h>
 
 #define NEXT_PTR(_v) ((void **)(((uint8_t *)(_v)) + cursor->offset))
 
+/*
+ *	The set of lists whose modifications are being tracked by this
+ *	thread.  Set by fr_cursor_list_watch(), and NULL if nothing is
+ *	being tracked.
+ */
+static _Thread_local fr_cursor_list_watch_t *list_watch;
+
+/** Start tracking modifications to a set of lists
+ *
+ * Only one set is tracked at a time, per thread.  While a set is
+ * tracked, #fr_cursor_list_touch increments the generation of any
+ * list in it.  The lists may be modified at any time while the set
+ * isn't tracked, so every generation in the set is incremented when
+ * tracking starts.
+ *
+ * @param[in] watch	set of lists to track, or NULL to stop tracking.
+ * @return the set which was being tracked before, so that it can
+ *	be restored.
+ */
+fr_cursor_list_watch_t *fr_cursor_list_watch(fr_cursor_list_watch_t *watch)
+{
+	fr_cursor_list_watch_t	*old = list_watch;
+	int			i;
+
+	if (watch) for (i = 0; i < FR_CURSOR_LIST_WATCH_MAX; i++) watch->generation[i]++;
+
+	list_watch = watch;
+
+	return old;
+}
+
+/** Return whether a set of lists is having its modifications tracked
+ *
+ * @param[in] watch	set of lists.
+ * @return true if modifications are being tracked.
+ */
+bool fr_cursor_list_watched(fr_cursor_list_watch_t const *watch)
+{
+	return (watch == list_watch);
+}
+
+/** Record that a list has been modified
+ *
+ * Must be called by anything which links items into, or unlinks
+ * items from a list, other than the fr_cursor_* functions, which
+ * call it themselves.
+ *
+ * @param[in] head	of the list which was modified.
+ */
+void fr_cursor_list_touch(void * const *head)
+{
+	int i;
+
+	if (!list_watch || !head) return;
+
+	for (i = 0; i < FR_CURSOR_LIST_WATCH_MAX; i++) {
+		if (list_watch->head[i] == head) list_watch->generation[i]++;
+	}
+}
+
 /** Internal function to get the next attribute
  *
  * @param[in,out] prev	attribute to the one we returned.  May be NULL.
@@ -244,6 +305,8 @@ void CC_HINT(hot) fr_cursor_prepend(fr_cursor_t *cursor, void *v)
 	/*
 	 *	Cursor was initialised with a pointer to a NULL item
 	 */
+	fr_cursor_list_touch(cursor->head);
+
 	if (!*(cursor->head)) {
 		*cursor->head = v;
 		cursor->tail = *cursor->head;
@@ -278,6 +341,8 @@ void CC_HINT(hot) fr_cursor_append(fr_cursor_t *cursor, void *v)
 	if (cursor->type) _talloc_get_type_abort(v, cursor->type, __location__);
 #endif
 
+	fr_cursor_list_touch(cursor->head);
+
 	/*
 	 *	Cursor was initialised with a pointer to a NULL item
 	 */
@@ -328,6 +393,8 @@ void fr_cursor_insert(fr_cursor_t *cursor, void *v)
 		return;
 	}
 
+	fr_cursor_list_touch(cursor->head);
+
 	old = *NEXT_PTR(cursor->current);
 	*NEXT_PTR(cursor->current) = v;
 	*NEXT_PTR(v) = old;
@@ -388,6 +455,8 @@ void * CC_HINT(hot) fr_cursor_remove(fr_cursor_t *cursor)
 	v = cursor->current;
 	p = cursor->prev;
 
+	fr_cursor_list_touch(cursor->head);
+
 	if (*cursor->head == v) {
 		*cursor->head = *NEXT_PTR(v);			/* at the start (make next head)*/
 		cursor->current = NULL;
@@ -455,6 +524,8 @@ void * CC_HINT(hot) fr_cursor_replace(fr_cursor_t *cursor, void *r)
 	v = cursor->current;
 	p = cursor->prev;
 
+	fr_cursor_list_touch(cursor->head);
+
 	/*
 	 *	Item at the head of the list.
 	 */
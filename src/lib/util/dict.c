@@ -29,11 +29,16 @@ RCSID("$Id$")
 #endif
 
 #include <ctype.h>
+#include <fcntl.h>
 
 #ifdef HAVE_SYS_STAT_H
 #  include <sys/stat.h>
 #endif
 
+#ifdef HAVE_SYS_MMAN_H
+#  include <sys/mman.h>
+#endif
+
 #define MAX_ARGV (16)
 
 /** Magic internal dictionary
@@ -46,12 +51,23 @@ RCSID("$Id$")
  */
 fr_dict_t	*fr_dict_internal = NULL;	//!< Internal server dictionary.
 
+/*
+ *	Highest top level attribute number we've seen.  Attributes
+ *	added with number -1 are allocated numbers above this.
+ */
+static unsigned int dict_max_attr = UINT8_MAX + 1;
+
+static char	*dict_cache_dir = NULL;		//!< Where binary dictionary caches are kept.
+							//!< NULL disables the cache.
+
 /*
  *	For faster HUP's, we cache the stat information for
  *	files we've $INCLUDEd
  */
 typedef struct dict_stat_t {
 	struct dict_stat_t *next;
+	char		*path;		//!< Full path of the file, for the dictionary cache.
+	bool		missing;	//!< An optional $INCLUDE- which didn't exist.
 	struct stat stat_buf;
 } dict_stat_t;
 
@@ -427,15 +443,24 @@ static int dict_enum_value_cmp(void const *one, void const *two)
 }
 
 /** Add an entry to the list of stat buffers.
+ *
+ * @param[in] dict	to add the entry to.
+ * @param[in] path	of the file.
+ * @param[in] stat_buf	of the file, or NULL if the file doesn't exist.
  */
-static void dict_stat_add(fr_dict_t *dict, struct stat const *stat_buf)
+static void dict_stat_add(fr_dict_t *dict, char const *path, struct stat const *stat_buf)
 {
 	dict_stat_t *this;
 
 	this = talloc_zero(dict, dict_stat_t);
 	if (!this) return;
 
-	memcpy(&(this->stat_buf), stat_buf, sizeof(this->stat_buf));
+	this->path = talloc_strdup(this, path);
+	if (stat_buf) {
+		memcpy(&(this->stat_buf), stat_buf, sizeof(this->stat_buf));
+	} else {
+		this->missing = true;
+	}
 
 	if (!dict->stat_head) {
 		dict->stat_head = dict->stat_tail = this;
@@ -445,6 +470,20 @@ static void dict_stat_add(fr_dict_t *dict, struct stat const *stat_buf)
 	}
 }
 
+/** See if a file has changed since we last read it
+ *
+ * The mtime only has a resolution of one second, so we also check
+ * the size, which catches most edits made in the same second the
+ * file was read.
+ */
+static bool dict_stat_changed(dict_stat_t const *this, struct stat const *stat_buf)
+{
+	if (this->stat_buf.st_mtime < stat_buf->st_mtime) return true;
+	if (this->stat_buf.st_size != stat_buf->st_size) return true;
+
+	return false;
+}
+
 /** See if any dictionaries have changed.  If not, don't do anything
  */
 static int dict_stat_check(fr_dict_t *dict, char const *dir, char const *file)
@@ -472,13 +511,14 @@ static int dict_stat_check(fr_dict_t *dict, char const *dir, char const *file)
 	 *	       to reload B at the minimum.
 	 */
 	for (this = dict->stat_head; this != NULL; this = this->next) {
+		if (this->missing) continue;
 		if (this->stat_buf.st_dev != stat_buf.st_dev) continue;
 		if (this->stat_buf.st_ino != stat_buf.st_ino) continue;
 
 		/*
 		 *	The file has changed.  Re-read it.
 		 */
-		if (this->stat_buf.st_mtime < stat_buf.st_mtime) return 0;
+		if (dict_stat_changed(this, &stat_buf)) return 0;
 
 		/*
 		 *	The file is the same.  Ignore it.
@@ -876,19 +916,17 @@ static fr_dict_attr_t *fr_dict_attr_add_by_name(fr_dict_t *dict, fr_dict_attr_t
 	/******************** sanity check attribute number ********************/
 
 	if (parent->flags.is_root) {
-		static unsigned int max_attr = UINT8_MAX + 1;
-
 		if (attr == -1) {
 			if (fr_dict_attr_by_name(dict, name)) return 0; /* exists, don't add it again */
-			attr = ++max_attr;
+			attr = ++dict_max_attr;
 			flags.internal = 1;
 
 		} else if (attr <= 0) {
 			fr_strerror_printf("ATTRIBUTE number %i is invalid, must be greater than zero", attr);
 			goto error;
 
-		} else if ((unsigned int) attr > max_attr) {
-			max_attr = attr;
+		} else if ((unsigned int) attr > dict_max_attr) {
+			dict_max_attr = attr;
 		}
 
 		/*
@@ -2284,6 +2322,8 @@ static int _dict_from_file(dict_from_file_ctx_t *ctx,
 	}
 
 	if ((fp = fopen(fn, "r")) == NULL) {
+		int err = errno;
+
 		if (!src_file) {
 			fr_strerror_printf("%s: Couldn't open dictionary '%s': %s",
 					   __FUNCTION__, fn, fr_syserror(errno));
@@ -2291,6 +2331,13 @@ static int _dict_from_file(dict_from_file_ctx_t *ctx,
 			fr_strerror_printf("%s: %s[%d]: Couldn't open dictionary '%s': %s",
 					   __FUNCTION__, src_file, src_line, fn, fr_syserror(errno));
 		}
+
+		/*
+		 *	Remember optional files which don't exist, so
+		 *	that the dictionary cache is invalidated if
+		 *	they're created.
+		 */
+		if (err == ENOENT) dict_stat_add(ctx->dict, fn, NULL);
 		return -2;
 	}
 
@@ -2321,7 +2368,7 @@ static int _dict_from_file(dict_from_file_ctx_t *ctx,
 	}
 #endif
 
-	dict_stat_add(ctx->dict, &statbuf);
+	dict_stat_add(ctx->dict, fn, &statbuf);
 
 	/*
 	 *	Seed the random pool with data.
@@ -2644,6 +2691,879 @@ static int dict_from_file(fr_dict_t *dict,
 
 static bool defined_cast_types = false;
 
+/*
+ *	Binary dictionary cache.
+ *
+ *	Tokenizing hundreds of text files on every start is slow.  So
+ *	once a dictionary has been read, we write an image of it to the
+ *	cache directory set with fr_dict_cache_dir().  The name of the
+ *	image includes a hash of the directory the dictionary was read
+ *	from, so one cache directory can hold images of dictionaries
+ *	from several places.  On the next start, if none
+ *	of the files recorded in the image have changed, the image is
+ *	mmap'd, and the vendors, attributes and enums are created from
+ *	it directly, without any parsing or validation.
+ *
+ *	Pointers are stored as indexes into the attribute array, and are
+ *	fixed up after all of the attributes have been allocated.  The
+ *	attributes themselves still have to be copied out of the image,
+ *	as the rest of the library expects them to be talloc chunks.
+ *
+ *	The image is in host byte order, and is only valid for the
+ *	library which wrote it.  Anything which doesn't match exactly is
+ *	ignored, and we fall back to reading the text files.
+ */
+#define DICT_CACHE_MAGIC	(0x46524443)	/* FRDC */
+#define DICT_CACHE_VERSION	(1)
+#define DICT_CACHE_NONE		(-1)
+
+typedef struct dict_cache_header_t {
+	uint32_t		magic;
+	uint32_t		version;
+	uint32_t		sizeof_attr;		//!< Catches changes to the attribute layout.
+	uint32_t		sizeof_flags;
+	uint32_t		type_max;
+	uint32_t		has_casts;		//!< The root has the Tmp-Cast-* attributes.
+	uint32_t		max_attr;		//!< dict_max_attr when the image was written.
+	uint32_t		root_name;		//!< Offset of the root name in the string table.
+	int32_t			root_children;		//!< Bin array of the root, or DICT_CACHE_NONE.
+	uint32_t		num_stats;
+	uint32_t		num_enums;
+	uint32_t		num_vendors;
+	uint32_t		num_attrs;
+	uint32_t		num_bins;		//!< Number of UINT8_MAX + 1 entry bin arrays.
+	uint32_t		strings_len;
+	uint32_t		pad;
+} dict_cache_header_t;
+
+typedef struct dict_cache_stat_t {
+	uint64_t		dev;
+	uint64_t		ino;
+	int64_t			mtime;
+	int64_t			size;
+	uint32_t		path;			//!< Offset in the string table.
+	uint32_t		missing;		//!< Optional file which didn't exist.
+} dict_cache_stat_t;
+
+typedef struct dict_cache_enum_t {
+	int64_t			value;
+	int32_t			da;			//!< Index of the attribute.
+	uint32_t		name;
+	uint32_t		by_da;			//!< Is the entry in values_by_da.
+	uint32_t		pad;
+} dict_cache_enum_t;
+
+typedef struct dict_cache_vendor_t {
+	uint32_t		vendorpec;
+	uint32_t		type;
+	uint32_t		length;
+	uint32_t		flags;
+	uint32_t		name;
+	uint32_t		by_num;			//!< Is the entry in vendors_by_num.
+} dict_cache_vendor_t;
+
+typedef struct dict_cache_attr_t {
+	uint32_t		vendor;
+	uint32_t		attr;
+	uint32_t		type;
+	uint32_t		name;
+	uint32_t		by_name;		//!< Is the entry in attributes_by_name.
+	uint32_t		combo;			//!< Are the IPv4 and IPv6 variants in attributes_combo.
+	int32_t			parent;			//!< Index of the parent, or DICT_CACHE_NONE for the root.
+	int32_t			next;			//!< Index of the next attribute in the bin.
+	int32_t			children;		//!< Bin array, or DICT_CACHE_NONE.
+	fr_dict_attr_flags_t	flags;
+} dict_cache_attr_t;
+
+/** Where each section lives in a cache image
+ */
+typedef struct dict_cache_image_t {
+	dict_cache_header_t const	*hdr;
+	dict_cache_stat_t const		*stats;
+	dict_cache_enum_t const		*enums;
+	dict_cache_vendor_t const	*vendors;
+	dict_cache_attr_t const		*attrs;
+	int32_t const			*bins;
+	char const			*strings;
+} dict_cache_image_t;
+
+/** Map an attribute to its index in the image
+ */
+typedef struct dict_cache_map_t {
+	fr_dict_attr_t const	*da;
+	int32_t			index;
+} dict_cache_map_t;
+
+typedef struct dict_cache_ctx_t {
+	fr_dict_t		*dict;
+
+	fr_dict_attr_t const	**attrs;		//!< In tree order, parents before children.
+	dict_cache_map_t	*map;			//!< Sorted by address.
+	uint32_t		num_attrs;
+	uint32_t		num_bins;
+
+	dict_cache_vendor_t	*vendors;
+	uint32_t		num_vendors;
+
+	dict_cache_enum_t	*enums;
+	uint32_t		num_enums;
+
+	char			*strings;
+	uint32_t		strings_len;
+	bool			failed;
+} dict_cache_ctx_t;
+
+/** Set the directory for binary dictionary caches
+ *
+ * The cache is disabled by default.  The directory must exist, and
+ * be writable by the process if new images are to be written.
+ *
+ * @param[in] dir	to read and write images in, or NULL to always
+ *			parse the text files.
+ * @return
+ *	- 0 on success.
+ *	- -1 on failure.
+ */
+int fr_dict_cache_dir(char const *dir)
+{
+	char *copy = NULL;
+
+	if (dir) {
+		copy = talloc_typed_strdup(NULL, dir);
+		if (!copy) {
+			fr_strerror_printf("%s: Out of memory", __FUNCTION__);
+			return -1;
+		}
+	}
+
+	talloc_free(dict_cache_dir);
+	dict_cache_dir = copy;
+
+	return 0;
+}
+
+/** Print the path of the image for a dictionary
+ *
+ * @param[out] out	Where to write the path.
+ * @param[in] outlen	Size of the output buffer.
+ * @param[in] dir	the dictionary was read from.
+ * @param[in] fn	the dictionary was read from.
+ * @return
+ *	- 0 on success.
+ *	- -1 if the path was truncated.
+ */
+static int dict_cache_path(char *out, size_t outlen, char const *dir, char const *fn)
+{
+	if (snprintf(out, outlen, "%s/%s.%08x.cache", dict_cache_dir, fn,
+		     fr_hash_string(dir)) >= (int) outlen) return -1;
+
+	return 0;
+}
+
+/** Add a string to the string table of the image
+ */
+static uint32_t dict_cache_string(dict_cache_ctx_t *cc, char const *str)
+{
+	size_t	len = strlen(str) + 1;
+	size_t	size = talloc_array_length(cc->strings);
+	uint32_t offset;
+
+	if ((cc->strings_len + len) > size) {
+		char *p;
+
+		p = talloc_realloc(cc, cc->strings, char, (cc->strings_len + len) * 2);
+		if (!p) {
+			cc->failed = true;
+			return 0;
+		}
+		cc->strings = p;
+	}
+
+	memcpy(cc->strings + cc->strings_len, str, len);
+	offset = cc->strings_len;
+	cc->strings_len += len;
+
+	return offset;
+}
+
+static void dict_cache_attr_count(dict_cache_ctx_t *cc, fr_dict_attr_t const *da)
+{
+	size_t			i, len;
+	fr_dict_attr_t const	*p;
+
+	if (!da->children) return;
+
+	len = talloc_array_length(da->children);
+	if (len != (UINT8_MAX + 1)) {
+		cc->failed = true;
+		return;
+	}
+	cc->num_bins++;
+
+	for (i = 0; i < len; i++) {
+		for (p = da->children[i]; p; p = p->next) {
+			cc->num_attrs++;
+			dict_cache_attr_count(cc, p);
+		}
+	}
+}
+
+static void dict_cache_attr_collect(dict_cache_ctx_t *cc, fr_dict_attr_t const *da)
+{
+	size_t			i;
+	fr_dict_attr_t const	*p;
+
+	if (!da->children) return;
+
+	for (i = 0; i <= UINT8_MAX; i++) {
+		for (p = da->children[i]; p; p = p->next) {
+			cc->map[cc->num_attrs].da = p;
+			cc->map[cc->num_attrs].index = cc->num_attrs;
+			cc->attrs[cc->num_attrs++] = p;
+			dict_cache_attr_collect(cc, p);
+		}
+	}
+}
+
+static int dict_cache_map_cmp(void const *one, void const *two)
+{
+	dict_cache_map_t const *a = one;
+	dict_cache_map_t const *b = two;
+
+	if ((uintptr_t) a->da < (uintptr_t) b->da) return -1;
+	if ((uintptr_t) a->da > (uintptr_t) b->da) return +1;
+
+	return 0;
+}
+
+static int32_t dict_cache_attr_index(dict_cache_ctx_t *cc, fr_dict_attr_t const *da)
+{
+	dict_cache_map_t my_map, *found;
+
+	if (!da) return DICT_CACHE_NONE;
+
+	my_map.da = da;
+	found = bsearch(&my_map, cc->map, cc->num_attrs, sizeof(*cc->map), dict_cache_map_cmp);
+	if (!found) {
+		cc->failed = true;
+		return DICT_CACHE_NONE;
+	}
+
+	return found->index;
+}
+
+static int dict_cache_vendor_collect(void *ctx, void *data)
+{
+	dict_cache_ctx_t	*cc = ctx;
+	fr_dict_vendor_t	*vendor = data;
+	dict_cache_vendor_t	*rec = &cc->vendors[cc->num_vendors++];
+
+	rec->vendorpec = vendor->vendorpec;
+	rec->type = vendor->type;
+	rec->length = vendor->length;
+	rec->flags = vendor->flags;
+	rec->name = dict_cache_string(cc, vendor->name);
+	rec->by_num = (fr_hash_table_finddata(cc->dict->vendors_by_num, vendor) == vendor);
+
+	return 0;
+}
+
+static int dict_cache_enum_collect(void *ctx, void *data)
+{
+	dict_cache_ctx_t	*cc = ctx;
+	fr_dict_enum_t		*dval = data;
+	dict_cache_enum_t	*rec = &cc->enums[cc->num_enums++];
+
+	rec->value = dval->value;
+	rec->da = dict_cache_attr_index(cc, dval->da);
+	if (rec->da == DICT_CACHE_NONE) cc->failed = true;
+	rec->name = dict_cache_string(cc, dval->name);
+	rec->by_da = (fr_hash_table_finddata(cc->dict->values_by_da, dval) == dval);
+
+	return 0;
+}
+
+static int dict_cache_write_all(int fd, void const *data, size_t len)
+{
+	uint8_t const *p = data;
+
+	while (len > 0) {
+		ssize_t slen;
+
+		slen = write(fd, p, len);
+		if (slen < 0) {
+			if (errno == EINTR) continue;
+			return -1;
+		}
+
+		p += slen;
+		len -= slen;
+	}
+
+	return 0;
+}
+
+/** Write an image of a dictionary to the cache directory
+ *
+ * The image is written to a temporary file which is then renamed,
+ * so that other processes never see a partial image.  Failures are
+ * not fatal, the next start will just read the text files again.
+ *
+ * @param[in] dict	to write.
+ * @param[in] dir	the dictionary was read from.
+ * @param[in] fn	the dictionary was read from.
+ * @param[in] name	of the root attribute.
+ * @param[in] has_casts	whether the Tmp-Cast-* attributes were added to this dictionary.
+ * @return
+ *	- 0 on success.
+ *	- -1 on failure.
+ */
+static int dict_cache_write(fr_dict_t *dict, char const *dir, char const *fn, char const *name, bool has_casts)
+{
+	dict_cache_ctx_t	*cc;
+	dict_cache_header_t	hdr;
+	dict_cache_stat_t	*stats;
+	dict_cache_attr_t	*attrs;
+	int32_t			*bins;
+	dict_stat_t		*this;
+	uint32_t		i, j, num_stats = 0, num_bins = 0;
+	char			path[PATH_MAX];
+	char			*tmp;
+	int			fd, rcode = -1;
+
+	cc = talloc_zero(NULL, dict_cache_ctx_t);
+	if (!cc) return -1;
+	cc->dict = dict;
+
+	memset(&hdr, 0, sizeof(hdr));
+	hdr.magic = DICT_CACHE_MAGIC;
+	hdr.version = DICT_CACHE_VERSION;
+	hdr.sizeof_attr = sizeof(fr_dict_attr_t);
+	hdr.sizeof_flags = sizeof(fr_dict_attr_flags_t);
+	hdr.type_max = FR_TYPE_MAX;
+	hdr.has_casts = has_casts;
+	hdr.max_attr = dict_max_attr;
+	hdr.root_name = dict_cache_string(cc, name);
+
+	/*
+	 *	The files we read, and the ones we didn't find.
+	 */
+	for (this = dict->stat_head; this != NULL; this = this->next) num_stats++;
+
+	stats = talloc_zero_array(cc, dict_cache_stat_t, num_stats);
+	if (!stats) goto done;
+
+	for (this = dict->stat_head, i = 0; this != NULL; this = this->next, i++) {
+		if (!this->path) goto done;
+
+		stats[i].dev = this->stat_buf.st_dev;
+		stats[i].ino = this->stat_buf.st_ino;
+		stats[i].mtime = this->stat_buf.st_mtime;
+		stats[i].size = this->stat_buf.st_size;
+		stats[i].path = dict_cache_string(cc, this->path);
+		stats[i].missing = this->missing;
+	}
+	hdr.num_stats = num_stats;
+
+	/*
+	 *	Flatten the attribute tree.
+	 */
+	dict_cache_attr_count(cc, dict->root);
+	if (cc->failed) goto done;
+
+	cc->attrs = talloc_array(cc, fr_dict_attr_t const *, cc->num_attrs);
+	cc->map = talloc_array(cc, dict_cache_map_t, cc->num_attrs);
+	attrs = talloc_zero_array(cc, dict_cache_attr_t, cc->num_attrs);
+	bins = talloc_array(cc, int32_t, (size_t) cc->num_bins * (UINT8_MAX + 1));
+	if (!cc->attrs || !cc->map || !attrs || !bins) goto done;
+
+	hdr.num_attrs = cc->num_attrs;
+	hdr.num_bins = cc->num_bins;
+	cc->num_attrs = 0;
+	dict_cache_attr_collect(cc, dict->root);
+	qsort(cc->map, cc->num_attrs, sizeof(*cc->map), dict_cache_map_cmp);
+
+	if (dict->root->children) {
+		hdr.root_children = num_bins++;
+		for (j = 0; j <= UINT8_MAX; j++) {
+			bins[(hdr.root_children * (UINT8_MAX + 1)) + j] = dict_cache_attr_index(cc, dict->root->children[j]);
+		}
+	} else {
+		hdr.root_children = DICT_CACHE_NONE;
+	}
+
+	for (i = 0; i < cc->num_attrs; i++) {
+		fr_dict_attr_t const	*da = cc->attrs[i];
+		dict_cache_attr_t	*rec = &attrs[i];
+
+		rec->vendor = da->vendor;
+		rec->attr = da->attr;
+		rec->type = da->type;
+		rec->name = dict_cache_string(cc, da->name);
+		rec->by_name = (fr_hash_table_finddata(dict->attributes_by_name, da) == da);
+		rec->parent = (da->parent == dict->root) ? DICT_CACHE_NONE : dict_cache_attr_index(cc, da->parent);
+		rec->next = dict_cache_attr_index(cc, da->next);
+		memcpy(&rec->flags, &da->flags, sizeof(rec->flags));
+
+		/*
+		 *	The variants are only added for attributes which
+		 *	went through fr_dict_attr_add().
+		 */
+		if (da->type == FR_TYPE_COMBO_IP_ADDR) {
+			fr_dict_attr_t		my_da;
+			fr_dict_attr_t const	*found;
+
+			memcpy(&my_da, da, sizeof(my_da));
+			my_da.type = FR_TYPE_IPV4_ADDR;
+
+			found = fr_hash_table_finddata(dict->attributes_combo, &my_da);
+			rec->combo = found && (strcmp(found->name, da->name) == 0);
+		}
+
+		if (!da->children) {
+			rec->children = DICT_CACHE_NONE;
+			continue;
+		}
+
+		rec->children = num_bins++;
+		for (j = 0; j <= UINT8_MAX; j++) {
+			bins[(rec->children * (UINT8_MAX + 1)) + j] = dict_cache_attr_index(cc, da->children[j]);
+		}
+	}
+
+	/*
+	 *	Vendors and enums are only in the hash tables.
+	 */
+	cc->vendors = talloc_zero_array(cc, dict_cache_vendor_t, fr_hash_table_num_elements(dict->vendors_by_name));
+	cc->enums = talloc_zero_array(cc, dict_cache_enum_t, fr_hash_table_num_elements(dict->values_by_name));
+	if (!cc->vendors || !cc->enums) goto done;
+
+	fr_hash_table_walk(dict->vendors_by_name, dict_cache_vendor_collect, cc);
+	fr_hash_table_walk(dict->values_by_name, dict_cache_enum_collect, cc);
+	hdr.num_vendors = cc->num_vendors;
+	hdr.num_enums = cc->num_enums;
+	hdr.strings_len = cc->strings_len;
+
+	if (cc->failed) goto done;
+
+	if (dict_cache_path(path, sizeof(path), dir, fn) < 0) goto done;
+
+	tmp = talloc_asprintf(cc, "%s.XXXXXX", path);
+	if (!tmp) goto done;
+
+	fd = mkstemp(tmp);
+	if (fd < 0) goto done;
+
+	if ((fchmod(fd, S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH) < 0) ||
+	    (dict_cache_write_all(fd, &hdr, sizeof(hdr)) < 0) ||
+	    (dict_cache_write_all(fd, stats, sizeof(*stats) * hdr.num_stats) < 0) ||
+	    (dict_cache_write_all(fd, cc->enums, sizeof(*cc->enums) * hdr.num_enums) < 0) ||
+	    (dict_cache_write_all(fd, cc->vendors, sizeof(*cc->vendors) * hdr.num_vendors) < 0) ||
+	    (dict_cache_write_all(fd, attrs, sizeof(*attrs) * hdr.num_attrs) < 0) ||
+	    (dict_cache_write_all(fd, bins, sizeof(*bins) * (UINT8_MAX + 1) * hdr.num_bins) < 0) ||
+	    (dict_cache_write_all(fd, cc->strings, hdr.strings_len) < 0)) {
+		close(fd);
+		unlink(tmp);
+		goto done;
+	}
+
+	if ((close(fd) < 0) || (rename(tmp, path) < 0)) {
+		unlink(tmp);
+		goto done;
+	}
+
+	rcode = 0;
+
+done:
+	talloc_free(cc);
+	return rcode;
+}
+
+/** Find the sections of an image, and check that everything in it is in range
+ *
+ * @return
+ *	- 0 if the image is usable.
+ *	- -1 if it isn't.
+ */
+static int dict_cache_image_verify(dict_cache_image_t *img, uint8_t const *data, size_t len,
+				   char const *name, bool has_casts)
+{
+	dict_cache_header_t const	*hdr = (dict_cache_header_t const *) data;
+	uint64_t			offset;
+	uint32_t			i;
+
+#define STRING_OK(_off, _max) (((_off) < hdr->strings_len) && (strlen(img->strings + (_off)) < (_max)))
+
+	if (len < sizeof(*hdr)) return -1;
+
+	if ((hdr->magic != DICT_CACHE_MAGIC) ||
+	    (hdr->version != DICT_CACHE_VERSION) ||
+	    (hdr->sizeof_attr != sizeof(fr_dict_attr_t)) ||
+	    (hdr->sizeof_flags != sizeof(fr_dict_attr_flags_t)) ||
+	    (hdr->type_max != FR_TYPE_MAX) ||
+	    (hdr->has_casts != has_casts)) return -1;
+
+	img->hdr = hdr;
+	offset = sizeof(*hdr);
+
+	img->stats = (dict_cache_stat_t const *) (data + offset);
+	offset += (uint64_t) hdr->num_stats * sizeof(*img->stats);
+
+	img->enums = (dict_cache_enum_t const *) (data + offset);
+	offset += (uint64_t) hdr->num_enums * sizeof(*img->enums);
+
+	img->vendors = (dict_cache_vendor_t const *) (data + offset);
+	offset += (uint64_t) hdr->num_vendors * sizeof(*img->vendors);
+
+	img->attrs = (dict_cache_attr_t const *) (data + offset);
+	offset += (uint64_t) hdr->num_attrs * sizeof(*img->attrs);
+
+	img->bins = (int32_t const *) (data + offset);
+	offset += (uint64_t) hdr->num_bins * (UINT8_MAX + 1) * sizeof(*img->bins);
+
+	img->strings = (char const *) (data + offset);
+	offset += hdr->strings_len;
+
+	if (offset != len) return -1;
+	if (!hdr->strings_len || (img->strings[hdr->strings_len - 1] != '\0')) return -1;
+
+	if (!STRING_OK(hdr->root_name, FR_DICT_ATTR_MAX_NAME_LEN) ||
+	    (strcmp(img->strings + hdr->root_name, name) != 0)) return -1;
+
+	if ((hdr->root_children != DICT_CACHE_NONE) &&
+	    ((hdr->root_children < 0) || ((uint32_t) hdr->root_children >= hdr->num_bins))) return -1;
+
+	for (i = 0; i < hdr->num_stats; i++) {
+		if (!STRING_OK(img->stats[i].path, PATH_MAX)) return -1;
+	}
+
+	for (i = 0; i < hdr->num_enums; i++) {
+		if ((img->enums[i].da < 0) || ((uint32_t) img->enums[i].da >= hdr->num_attrs)) return -1;
+		if (!STRING_OK(img->enums[i].name, FR_DICT_ENUM_MAX_NAME_LEN)) return -1;
+	}
+
+	for (i = 0; i < hdr->num_vendors; i++) {
+		if (!STRING_OK(img->vendors[i].name, FR_DICT_VENDOR_MAX_NAME_LEN)) return -1;
+	}
+
+	/*
+	 *	Parents always come before their children, and the
+	 *	next attribute in a bin always comes after the
+	 *	current one.  So there are no loops.
+	 */
+	for (i = 0; i < hdr->num_attrs; i++) {
+		dict_cache_attr_t const *rec = &img->attrs[i];
+
+		if (rec->type > FR_TYPE_MAX) return -1;
+		if (!STRING_OK(rec->name, FR_DICT_ATTR_MAX_NAME_LEN)) return -1;
+		if ((rec->parent != DICT_CACHE_NONE) && ((rec->parent < 0) || ((uint32_t) rec->parent >= i))) return -1;
+		if ((rec->next != DICT_CACHE_NONE) &&
+		    (((uint32_t) rec->next <= i) || ((uint32_t) rec->next >= hdr->num_attrs))) return -1;
+		if ((rec->children != DICT_CACHE_NONE) &&
+		    ((rec->children < 0) || ((uint32_t) rec->children >= hdr->num_bins))) return -1;
+	}
+
+	for (i = 0; i < hdr->num_bins * (UINT8_MAX + 1); i++) {
+		if ((img->bins[i] != DICT_CACHE_NONE) &&
+		    ((img->bins[i] < 0) || ((uint32_t) img->bins[i] >= hdr->num_attrs))) return -1;
+	}
+
+#undef STRING_OK
+
+	return 0;
+}
+
+/** Check that none of the files used to build the image have changed
+ *
+ * Copies the stat information from the image into the dictionary,
+ * so that later calls to dict_stat_check() work as if the text files
+ * had been read.
+ *
+ * @return
+ *	- 0 if all of the files are unchanged.
+ *	- -1 if any have changed, been created, or been removed.
+ */
+static int dict_cache_stat_verify(fr_dict_t *dict, dict_cache_image_t const *img)
+{
+	uint32_t	i;
+	dict_stat_t	*this, *next;
+	struct stat	stat_buf;
+
+	for (i = 0; i < img->hdr->num_stats; i++) {
+		memset(&stat_buf, 0, sizeof(stat_buf));
+		stat_buf.st_dev = img->stats[i].dev;
+		stat_buf.st_ino = img->stats[i].ino;
+		stat_buf.st_mtime = img->stats[i].mtime;
+		stat_buf.st_size = img->stats[i].size;
+
+		dict_stat_add(dict, img->strings + img->stats[i].path, img->stats[i].missing ? NULL : &stat_buf);
+	}
+
+	for (this = dict->stat_head; this != NULL; this = this->next) {
+		if (!this->path) goto changed;
+
+		if (stat(this->path, &stat_buf) < 0) {
+			if (this->missing && (errno == ENOENT)) continue;
+			goto changed;
+		}
+
+		if (this->missing ||
+		    !S_ISREG(stat_buf.st_mode) ||
+#ifdef S_IWOTH
+		    ((stat_buf.st_mode & S_IWOTH) != 0) ||
+#endif
+		    (this->stat_buf.st_dev != stat_buf.st_dev) ||
+		    (this->stat_buf.st_ino != stat_buf.st_ino) ||
+		    dict_stat_changed(this, &stat_buf)) goto changed;
+	}
+
+	return 0;
+
+changed:
+	for (this = dict->stat_head; this != NULL; this = next) {
+		next = this->next;
+		talloc_free(this);
+	}
+	dict->stat_head = dict->stat_tail = NULL;
+
+	return -1;
+}
+
+/** Create the vendors, attributes and enums from a verified image
+ */
+static int dict_cache_image_load(fr_dict_t *dict, dict_cache_image_t const *img)
+{
+	dict_cache_header_t const	*hdr = img->hdr;
+	fr_dict_attr_t			**das;
+	uint32_t			i, j;
+	int				rcode = -1;
+
+	for (i = 0; i < hdr->num_vendors; i++) {
+		dict_cache_vendor_t const	*rec = &img->vendors[i];
+		char const			*name = img->strings + rec->name;
+		size_t				len = strlen(name);
+		fr_dict_vendor_t		*vendor;
+
+		vendor = (fr_dict_vendor_t *)talloc_zero_array(dict->pool, uint8_t, sizeof(*vendor) + len);
+		if (!vendor) {
+			fr_strerror_printf("%s: Out of memory", __FUNCTION__);
+			return -1;
+		}
+		talloc_set_type(vendor, fr_dict_vendor_t);
+
+		strlcpy(vendor->name, name, len + 1);
+		vendor->vendorpec = rec->vendorpec;
+		vendor->type = rec->type;
+		vendor->length = rec->length;
+		vendor->flags = rec->flags;
+
+		if (!fr_hash_table_insert(dict->vendors_by_name, vendor)) {
+			fr_strerror_printf("%s: Failed inserting vendor name %s", __FUNCTION__, name);
+			return -1;
+		}
+
+		if (rec->by_num && !fr_hash_table_replace(dict->vendors_by_num, vendor)) {
+			fr_strerror_printf("%s: Failed inserting vendor %s", __FUNCTION__, name);
+			return -1;
+		}
+	}
+
+	das = talloc_array(NULL, fr_dict_attr_t *, hdr->num_attrs);
+	if (!das) {
+		fr_strerror_printf("%s: Out of memory", __FUNCTION__);
+		return -1;
+	}
+
+	for (i = 0; i < hdr->num_attrs; i++) {
+		dict_cache_attr_t const	*rec = &img->attrs[i];
+		fr_dict_attr_t const	*parent;
+		fr_dict_attr_flags_t	flags;
+		fr_dict_attr_t		*n;
+
+		parent = (rec->parent == DICT_CACHE_NONE) ? dict->root : das[rec->parent];
+		memcpy(&flags, &rec->flags, sizeof(flags));
+
+		n = fr_dict_attr_alloc(dict->pool, parent, img->strings + rec->name,
+				       rec->vendor, rec->attr, rec->type, &flags);
+		if (!n) goto done;
+		das[i] = n;
+
+		if (rec->by_name && !fr_hash_table_insert(dict->attributes_by_name, n)) {
+			fr_strerror_printf("%s: Failed inserting attribute %s", __FUNCTION__, n->name);
+			goto done;
+		}
+
+		/*
+		 *	Hacks for combo-IP
+		 */
+		if (rec->combo) {
+			size_t		len = talloc_array_length((uint8_t *) n);
+			fr_dict_attr_t	*v4, *v6;
+
+			v4 = (fr_dict_attr_t *)talloc_memdup(dict->pool, n, len);
+			v6 = (fr_dict_attr_t *)talloc_memdup(dict->pool, n, len);
+			if (!v4 || !v6) {
+				fr_strerror_printf("%s: Out of memory", __FUNCTION__);
+				goto done;
+			}
+			talloc_set_type(v4, fr_dict_attr_t);
+			talloc_set_type(v6, fr_dict_attr_t);
+
+			v4->type = FR_TYPE_IPV4_ADDR;
+			v6->type = FR_TYPE_IPV6_ADDR;
+
+			if (!fr_hash_table_replace(dict->attributes_combo, v4) ||
+			    !fr_hash_table_replace(dict->attributes_combo, v6)) {
+				fr_strerror_printf("%s: Failed inserting combo attribute %s", __FUNCTION__, n->name);
+				goto done;
+			}
+		}
+	}
+
+	/*
+	 *	Now that all of the attributes exist, fix up the
+	 *	pointers between them.
+	 */
+	if (hdr->root_children != DICT_CACHE_NONE) {
+		int32_t const *bin = &img->bins[hdr->root_children * (UINT8_MAX + 1)];
+
+		dict->root->children = talloc_zero_array(dict->root, fr_dict_attr_t const *, UINT8_MAX + 1);
+		if (!dict->root->children) goto oom;
+
+		for (j = 0; j <= UINT8_MAX; j++) {
+			if (bin[j] != DICT_CACHE_NONE) dict->root->children[j] = das[bin[j]];
+		}
+	}
+
+	for (i = 0; i < hdr->num_attrs; i++) {
+		dict_cache_attr_t const	*rec = &img->attrs[i];
+		int32_t const		*bin;
+
+		if (rec->next != DICT_CACHE_NONE) das[i]->next = das[rec->next];
+
+		if (rec->children == DICT_CACHE_NONE) continue;
+
+		das[i]->children = talloc_zero_array(das[i], fr_dict_attr_t const *, UINT8_MAX + 1);
+		if (!das[i]->children) goto oom;
+
+		bin = &img->bins[rec->children * (UINT8_MAX + 1)];
+		for (j = 0; j <= UINT8_MAX; j++) {
+			if (bin[j] != DICT_CACHE_NONE) das[i]->children[j] = das[bin[j]];
+		}
+	}
+
+	for (i = 0; i < hdr->num_enums; i++) {
+		dict_cache_enum_t const	*rec = &img->enums[i];
+		char const		*name = img->strings + rec->name;
+		size_t			len = strlen(name);
+		fr_dict_enum_t		*dval;
+
+		dval = (fr_dict_enum_t *)talloc_zero_array(dict->pool, uint8_t, sizeof(*dval) + len);
+		if (!dval) goto oom;
+		talloc_set_type(dval, fr_dict_enum_t);
+
+		strcpy(dval->name, name);
+		dval->value = rec->value;
+		dval->da = das[rec->da];
+
+		if (!fr_hash_table_insert(dict->values_by_name, dval)) {
+			fr_strerror_printf("%s: Duplicate VALUE name '%s' for attribute '%s'",
+					   __FUNCTION__, name, dval->da->name);
+			goto done;
+		}
+
+		if (rec->by_da && !fr_hash_table_replace(dict->values_by_da, dval)) {
+			fr_strerror_printf("%s: Failed inserting value %s", __FUNCTION__, name);
+			goto done;
+		}
+	}
+
+	if (hdr->max_attr > dict_max_attr) dict_max_attr = hdr->max_attr;
+
+	rcode = 0;
+
+done:
+	talloc_free(das);
+	return rcode;
+
+oom:
+	fr_strerror_printf("%s: Out of memory", __FUNCTION__);
+	goto done;
+}
+
+/** Load a dictionary from the cache directory
+ *
+ * @param[in] dict	to populate.  Must have its hash tables and root
+ *			attribute, but nothing else.
+ * @param[in] dir	the dictionary is in.
+ * @param[in] fn	of the dictionary.
+ * @param[in] name	of the root attribute.
+ * @return
+ *	- 0 if the dictionary was loaded from the cache.
+ *	- -1 if there's no usable cache, and the text files should be read.
+ *	- -2 if the cache was usable, but we failed creating the dictionary.
+ */
+static int dict_cache_load(fr_dict_t *dict, char const *dir, char const *fn, char const *name)
+{
+	char			path[PATH_MAX];
+	struct stat		stat_buf;
+	dict_cache_image_t	img;
+	uint8_t			*data;
+	int			fd, rcode = -1;
+
+	if (dict_cache_path(path, sizeof(path), dir, fn) < 0) return -1;
+
+	fd = open(path, O_RDONLY);
+	if (fd < 0) return -1;
+
+	/*
+	 *	Same rules as for the text files.
+	 */
+	if ((fstat(fd, &stat_buf) < 0) || !S_ISREG(stat_buf.st_mode) ||
+#ifdef S_IWOTH
+	    ((stat_buf.st_mode & S_IWOTH) != 0) ||
+#endif
+	    (stat_buf.st_size < (off_t) sizeof(dict_cache_header_t))) {
+		close(fd);
+		return -1;
+	}
+
+#ifdef HAVE_SYS_MMAN_H
+	data = mmap(NULL, stat_buf.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	if (data == MAP_FAILED) {
+		close(fd);
+		return -1;
+	}
+#else
+	data = talloc_array(NULL, uint8_t, stat_buf.st_size);
+	if (!data || (read(fd, data, stat_buf.st_size) != stat_buf.st_size)) {
+		talloc_free(data);
+		close(fd);
+		return -1;
+	}
+#endif
+	close(fd);
+
+	if ((dict_cache_image_verify(&img, data, stat_buf.st_size, name, !defined_cast_types) < 0) ||
+	    (dict_cache_stat_verify(dict, &img) < 0)) goto done;
+
+	if (dict_cache_image_load(dict, &img) < 0) {
+		rcode = -2;
+		goto done;
+	}
+
+	if (img.hdr->has_casts) defined_cast_types = true;
+	rcode = 0;
+
+done:
+#ifdef HAVE_SYS_MMAN_H
+	munmap(data, stat_buf.st_size);
+#else
+	talloc_free(data);
+#endif
+	return rcode;
+}
+
 /** (re)initialize a protocol dictionary
  *
  * Initialize the directory, then fix the attr member of all attributes.
@@ -2662,7 +3582,8 @@ static bool defined_cast_types = false;
  */
 int fr_dict_from_file(TALLOC_CTX *ctx, fr_dict_t **out, char const *dir, char const *fn, char const *name)
 {
-	fr_dict_t *dict;
+	fr_dict_t	*dict;
+	bool		added_casts = false;
 
 	if (!*out) {
 		/* Pre-Allocate 5MB of pool memory for rapid startup */
@@ -2719,7 +3640,11 @@ int fr_dict_from_file(TALLOC_CTX *ctx, fr_dict_t **out, char const *dir, char co
 	dict->values_by_name = fr_hash_table_create(dict, dict_enum_name_hash, dict_enum_name_cmp, hash_pool_free);
 	if (!dict->values_by_name) goto error;
 
-	dict->values_by_da = fr_hash_table_create(dict, dict_enum_value_hash, dict_enum_value_cmp, hash_pool_free);
+	/*
+	 *	Enum values are owned by values_by_name.  Values which
+	 *	are replaced here are still found by their old names.
+	 */
+	dict->values_by_da = fr_hash_table_create(dict, dict_enum_value_hash, dict_enum_value_cmp, NULL);
 	if (!dict->values_by_da) goto error;
 
 	/*
@@ -2735,6 +3660,21 @@ int fr_dict_from_file(TALLOC_CTX *ctx, fr_dict_t **out, char const *dir, char co
 
 	dict->enum_fixup = NULL;        /* just to be safe. */
 
+	/*
+	 *	Skip parsing the text files if we have an up to
+	 *	date image of the dictionary.
+	 */
+	if (dict_cache_dir) switch (dict_cache_load(dict, dir, fn, name)) {
+	case 0:
+		goto finish;
+
+	case -1:
+		break;
+
+	default:
+		goto error;
+	}
+
 	/*
 	 *	Add cast attributes.  We do it this way,
 	 *	so cast attributes get added automatically for new types.
@@ -2771,6 +3711,7 @@ int fr_dict_from_file(TALLOC_CTX *ctx, fr_dict_t **out, char const *dir, char co
 			talloc_free(type_name);
 		}
 		defined_cast_types = true;
+		added_casts = true;
 	}
 
 	if (dict_from_file(dict, dir, fn, NULL, 0) < 0) goto error;
@@ -2820,6 +3761,13 @@ int fr_dict_from_file(TALLOC_CTX *ctx, fr_dict_t **out, char const *dir, char co
 		}
 	}
 
+	/*
+	 *	Failing to write the cache just means the next
+	 *	start will be slower.
+	 */
+	if (dict_cache_dir) (void) dict_cache_write(dict, dir, fn, name, added_casts);
+
+finish:
 	/*
 	 *	Walk over all of the hash tables to ensure they're
 	 *	initialized.  We do this because the threads may perform
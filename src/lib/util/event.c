@@ -33,9 +33,41 @@ RCSID("$Id$")
 
 #define FR_EV_BATCH_FDS (256)
 
+/*
+ *	On Linux, kqueue is provided by libkqueue, which translates
+ *	every kevent() call into one or more epoll calls.  So we use
+ *	epoll directly for file descriptors, and a timerfd for timers.
+ *
+ *	EVFILT_USER events are still delivered through the kqueue, as
+ *	other threads signal us by kq.  The kqueue descriptor is
+ *	itself pollable, so it's just one more FD in the epoll set.
+ */
+#if defined(HAVE_SYS_EPOLL_H) && defined(HAVE_SYS_TIMERFD_H)
+#  define FR_EVENT_EPOLL (1)
+#  include <sys/epoll.h>
+#  include <sys/timerfd.h>
+#endif
+
 #undef USEC
 #define USEC (1000000)
 
+/*
+ *	The timer wheel has TIMER_WHEEL_LEVELS levels of
+ *	TIMER_WHEEL_SLOTS slots each.  A level 0 slot covers one tick
+ *	(1024us), a level 1 slot covers 64 ticks, and so on.  With 4
+ *	levels, the wheel covers about 4.8 hours.  Timers which are
+ *	further away than that are put into the last slot, and are
+ *	re-inserted when that slot is cascaded.
+ *
+ *	Timers which are due in the current tick are moved to the
+ *	heap, so they still fire in order, and at the correct time.
+ */
+#define TIMER_WHEEL_TICK_BITS	(10)
+#define TIMER_WHEEL_BITS	(6)
+#define TIMER_WHEEL_SLOTS	(1 << TIMER_WHEEL_BITS)
+#define TIMER_WHEEL_MASK	(TIMER_WHEEL_SLOTS - 1)
+#define TIMER_WHEEL_LEVELS	(4)
+
 /** A timer event
  *
  */
@@ -46,6 +78,10 @@ struct fr_event_timer_t {
 
 	fr_event_timer_t	**parent;		//!< Previous timer.
 	int			heap;			//!< Where to store opaque heap data.
+
+	fr_event_timer_t	*next;			//!< Next timer in the same wheel slot.
+	fr_event_timer_t	**prev_p;		//!< Pointer to us in the wheel slot.  NULL if
+							//!< the timer is in the heap.
 };
 
 /** A file descriptor event
@@ -59,7 +95,7 @@ typedef struct fr_event_fd_t {
 	fr_event_fd_handler_t	error;			//!< Callback for when an error occurs on the FD.
 
 	bool			is_registered;		//!< Whether this fr_event_fd_t's FD has been registered with
-							//!< kevent.  Mostly for debugging.
+							//!< kevent (or epoll).  Mostly for debugging.
 
 	bool			in_handler;		//!< Event is currently being serviced.  Deletes should be
 							//!< deferred until after the handlers complete.
@@ -75,6 +111,11 @@ typedef struct fr_event_fd_t {
  */
 struct fr_event_list_t {
 	fr_heap_t		*times;			//!< of timer events to be executed.
+
+	bool			use_wheel;		//!< put timers into the wheel instead of the heap.
+	uint64_t		wheel_now;		//!< the tick which the wheel has been advanced to.
+	int			wheel_num;		//!< number of timers in the wheel.
+	fr_event_timer_t	*wheel[TIMER_WHEEL_LEVELS][TIMER_WHEEL_SLOTS]; //!< timers which aren't due yet.
 	rbtree_t		*fds;			//!< Tree used to track FDs with filters in kqueue.
 
 	int			exit;
@@ -95,6 +136,14 @@ struct fr_event_list_t {
 	void			*user_ctx;		//!< Context pointer to pass to the user callback.
 
 	struct kevent		events[FR_EV_BATCH_FDS]; /* so it doesn't go on the stack every time */
+
+#ifdef FR_EVENT_EPOLL
+	int			epoll_fd;		//!< epoll instance for FDs, timers, and the kq.
+	int			timer_fd;		//!< timerfd which fires for the next timer event.
+	struct timeval		timer_armed;		//!< when timer_fd is set to fire.
+
+	struct epoll_event	ep_events[FR_EV_BATCH_FDS]; //!< I/O events from epoll_wait().
+#endif
 };
 
 /** Compare two timer events to see which one should occur first
@@ -139,6 +188,14 @@ static int fr_event_fd_cmp(void const *a, void const *b)
 	return 0;
 }
 
+/** Convert a time to a timer wheel tick
+ *
+ */
+static inline uint64_t fr_event_timer_tick(struct timeval const *when)
+{
+	return ((((uint64_t) when->tv_sec) * USEC) + when->tv_usec) >> TIMER_WHEEL_TICK_BITS;
+}
+
 /** Return the number of file descriptors is_registered with this event loop
  *
  */
@@ -158,7 +215,36 @@ int fr_event_list_num_elements(fr_event_list_t *el)
 {
 	if (!el) return -1;
 
-	return fr_heap_num_elements(el->times);
+	return fr_heap_num_elements(el->times) + el->wheel_num;
+}
+
+/** Use a timer wheel instead of a heap for timer events
+ *
+ * Inserting and deleting timers in the wheel is O(1), which is
+ * cheaper than the heap when there are many timers, and most of them
+ * are deleted before they fire.
+ *
+ * @param[in] el	to change.
+ * @param[in] enable	whether to use the timer wheel.
+ * @return
+ *	- 0 on success.
+ *	- -1 if there are timer events in the event list.
+ */
+int fr_event_list_timer_wheel(fr_event_list_t *el, bool enable)
+{
+	struct timeval now;
+
+	if (fr_event_list_num_elements(el) != 0) {
+		fr_strerror_printf("Cannot change the timer wheel while there are timer events");
+		return -1;
+	}
+
+	gettimeofday(&now, NULL);
+
+	el->use_wheel = enable;
+	el->wheel_now = fr_event_timer_tick(&now);
+
+	return 0;
 }
 
 /** Return the kq associated with an event list.
@@ -248,20 +334,31 @@ int fr_event_fd_delete(fr_event_list_t *el, int fd)
  */
 static int _fr_event_fd_free(fr_event_fd_t *ef)
 {
+#ifndef FR_EVENT_EPOLL
 	int		filter = 0;
 	struct kevent	evset;
+#endif
 
 	fr_event_list_t	*el = talloc_parent(ef);
 
+#ifndef FR_EVENT_EPOLL
 	if (ef->read) filter |= EVFILT_READ;
 	if (ef->write) filter |= EVFILT_WRITE;
+#endif
 
 	if (ef->is_registered) {
+#ifdef FR_EVENT_EPOLL
+		if (epoll_ctl(el->epoll_fd, EPOLL_CTL_DEL, ef->fd, NULL) < 0) {
+			fr_strerror_printf("Failed removing filters for FD %i: %s", ef->fd, fr_syserror(errno));
+			return -1;
+		}
+#else
 		EV_SET(&evset, ef->fd, filter, EV_DELETE, 0, 0, 0);
 		if (kevent(el->kq, &evset, 1, NULL, 0, NULL) < 0) {
 			fr_strerror_printf("Failed removing filters for FD %i: %s", ef->fd, fr_syserror(errno));
 			return -1;
 		}
+#endif
 	}
 	rbtree_deletebydata(el->fds, ef);
 	ef->is_registered = false;
@@ -289,8 +386,12 @@ int fr_event_fd_insert(fr_event_list_t *el, int fd,
 		       fr_event_fd_handler_t error,
 		       void *ctx)
 {
+#ifdef FR_EVENT_EPOLL
+	struct epoll_event evset;
+#else
 	int	      	filter = 0;
 	struct kevent	evset;
+#endif
 	fr_event_fd_t	*ef, find;
 	bool		pre_existing;
 
@@ -346,6 +447,7 @@ int fr_event_fd_insert(fr_event_list_t *el, int fd,
 	} else {
 		pre_existing = true;
 
+#ifndef FR_EVENT_EPOLL
 		if (ef->read && !read_fn) filter |= EVFILT_READ;
 		if (ef->write && !write_fn) filter |= EVFILT_WRITE;
 
@@ -364,6 +466,7 @@ int fr_event_fd_insert(fr_event_list_t *el, int fd,
 			}
 			filter = 0;
 		}
+#endif
 
 		/*
 		 *	I/O handler may delete an event, then
@@ -375,6 +478,28 @@ int fr_event_fd_insert(fr_event_list_t *el, int fd,
 
 	ef->ctx = ctx;
 
+#ifdef FR_EVENT_EPOLL
+	/*
+	 *	EPOLL_CTL_MOD replaces the existing events, so there's
+	 *	no need to delete the old filters first.
+	 */
+	memset(&evset, 0, sizeof(evset));
+	evset.data.ptr = ef;
+
+	ef->read = read_fn;
+	if (read_fn) evset.events |= EPOLLIN | EPOLLRDHUP;
+
+	ef->write = write_fn;
+	if (write_fn) evset.events |= EPOLLOUT;
+
+	ef->error = error;
+
+	if (epoll_ctl(el->epoll_fd, ef->is_registered ? EPOLL_CTL_MOD : EPOLL_CTL_ADD, fd, &evset) < 0) {
+		fr_strerror_printf("Failed adding filter for FD %i: %s", fd, fr_syserror(errno));
+		if (!pre_existing) talloc_free(ef);
+		return -1;
+	}
+#else
 	if (read_fn) {
 		ef->read = read_fn;
 		filter |= EVFILT_READ;
@@ -392,12 +517,196 @@ int fr_event_fd_insert(fr_event_list_t *el, int fd,
 		if (!pre_existing) talloc_free(ef);
 		return -1;
 	}
+#endif
 	ef->is_registered = true;
 
 	return 0;
 }
 
 
+/** Add a timer event to the heap, or to the timer wheel
+ *
+ * @param[in] el	to insert the event into.
+ * @param[in] ev	to insert.
+ * @return
+ *	- 0 on success.
+ *	- -1 on failure.
+ */
+static int fr_event_timer_link(fr_event_list_t *el, fr_event_timer_t *ev)
+{
+	int level;
+	uint64_t tick, diff;
+	fr_event_timer_t **slot;
+
+	ev->prev_p = NULL;
+
+	if (!el->use_wheel) goto heap;
+
+	tick = fr_event_timer_tick(&ev->when);
+
+	/*
+	 *	Due in the current tick (or earlier).  The heap
+	 *	sorts these by the exact time.
+	 */
+	if (tick <= el->wheel_now) {
+	heap:
+		if (!fr_heap_insert(el->times, ev)) {
+			fr_strerror_printf("Failed inserting event into heap");
+			return -1;
+		}
+		return 0;
+	}
+
+	diff = tick - el->wheel_now;
+
+	for (level = 0; level < (TIMER_WHEEL_LEVELS - 1); level++) {
+		if (diff < ((uint64_t) 1 << (TIMER_WHEEL_BITS * (level + 1)))) break;
+	}
+
+	/*
+	 *	Too far in the future.  Put it into the last slot we
+	 *	can reach.  It will be re-inserted when that slot is
+	 *	cascaded.
+	 */
+	if (diff >= ((uint64_t) 1 << (TIMER_WHEEL_BITS * TIMER_WHEEL_LEVELS))) {
+		tick = el->wheel_now + ((uint64_t) 1 << (TIMER_WHEEL_BITS * TIMER_WHEEL_LEVELS)) - 1;
+	}
+
+	slot = &el->wheel[level][(tick >> (TIMER_WHEEL_BITS * level)) & TIMER_WHEEL_MASK];
+
+	ev->next = *slot;
+	if (ev->next) ev->next->prev_p = &ev->next;
+	ev->prev_p = slot;
+	*slot = ev;
+
+	el->wheel_num++;
+
+	return 0;
+}
+
+/** Remove a timer event from the heap, or from the timer wheel
+ *
+ * @param[in] el	to remove the event from.
+ * @param[in] ev	to remove.
+ * @return
+ *	- 1 if the event was removed.
+ *	- 0 if the event wasn't found.
+ */
+static int fr_event_timer_unlink(fr_event_list_t *el, fr_event_timer_t *ev)
+{
+	if (!ev->prev_p) return fr_heap_extract(el->times, ev);
+
+	*ev->prev_p = ev->next;
+	if (ev->next) ev->next->prev_p = ev->prev_p;
+
+	ev->next = NULL;
+	ev->prev_p = NULL;
+
+	el->wheel_num--;
+
+	return 1;
+}
+
+/** Re-insert all of the timers in a wheel slot
+ *
+ * @param[in] el	containing the timer wheel.
+ * @param[in] slot	to empty.
+ */
+static void fr_event_wheel_cascade(fr_event_list_t *el, fr_event_timer_t **slot)
+{
+	fr_event_timer_t *ev, *next;
+
+	ev = *slot;
+	*slot = NULL;
+
+	for (; ev != NULL; ev = next) {
+		next = ev->next;
+
+		ev->next = NULL;
+		el->wheel_num--;
+
+		(void) fr_cond_assert(fr_event_timer_link(el, ev) == 0);
+	}
+}
+
+/** Advance the timer wheel, moving timers which are due to the heap
+ *
+ * @param[in] el	containing the timer wheel.
+ * @param[in] now	the current time.
+ */
+static void fr_event_wheel_advance(fr_event_list_t *el, struct timeval const *now)
+{
+	int level;
+	uint64_t tick;
+
+	tick = fr_event_timer_tick(now);
+
+	while (el->wheel_now < tick) {
+		/*
+		 *	Nothing in the wheel, so we can skip straight
+		 *	to the current tick.
+		 */
+		if (!el->wheel_num) {
+			el->wheel_now = tick;
+			break;
+		}
+
+		el->wheel_now++;
+
+		/*
+		 *	When a level wraps, the next slot of the level
+		 *	above is spread out over the levels below.
+		 */
+		for (level = 1; level < TIMER_WHEEL_LEVELS; level++) {
+			if ((el->wheel_now & (((uint64_t) 1 << (TIMER_WHEEL_BITS * level)) - 1)) != 0) break;
+
+			fr_event_wheel_cascade(el, &el->wheel[level][(el->wheel_now >> (TIMER_WHEEL_BITS * level)) & TIMER_WHEEL_MASK]);
+		}
+
+		/*
+		 *	Everything in this slot is due in this tick.
+		 */
+		fr_event_wheel_cascade(el, &el->wheel[0][el->wheel_now & TIMER_WHEEL_MASK]);
+	}
+}
+
+/** Get the time when the event list should next check the timer events
+ *
+ * For the heap, this is the time of the first event.  The timer
+ * wheel doesn't track the exact time of its first event, so we use
+ * the start of the next tick which has timers in it.  Or, the next
+ * time the wheel cascades, which may be a little early.
+ *
+ * @param[in] el	containing the timer events.
+ * @param[out] when	the time of the next timer event.
+ * @return
+ *	- false if there are no timer events.
+ *	- true if "when" has been filled in.
+ */
+static bool fr_event_timer_first(fr_event_list_t *el, struct timeval *when)
+{
+	uint64_t tick, usec;
+	fr_event_timer_t *ev;
+	struct timeval wheel;
+
+	ev = fr_heap_peek(el->times);
+	if (ev) *when = ev->when;
+
+	if (!el->wheel_num) return (ev != NULL);
+
+	for (tick = el->wheel_now + 1; (tick & TIMER_WHEEL_MASK) != 0; tick++) {
+		if (el->wheel[0][tick & TIMER_WHEEL_MASK]) break;
+	}
+
+	usec = tick << TIMER_WHEEL_TICK_BITS;
+	wheel.tv_sec = usec / USEC;
+	wheel.tv_usec = usec % USEC;
+
+	if (!ev || (fr_timeval_cmp(&wheel, when) < 0)) *when = wheel;
+
+	return true;
+}
+
 /** Delete a timer event from the event list
  *
  * @param[in] el	to delete event from.
@@ -434,10 +743,10 @@ int fr_event_timer_delete(fr_event_list_t *el, fr_event_timer_t **parent)
 	}
 	*parent = NULL;
 
-	ret = fr_heap_extract(el->times, ev);
+	ret = fr_event_timer_unlink(el, ev);
 
 	/*
-	 *	Events MUST be in the heap
+	 *	Events MUST be in the heap, or in the wheel
 	 */
 	if (!fr_cond_assert(ret == 1)) {
 		fr_strerror_printf("Event not found in heap");
@@ -491,6 +800,18 @@ int fr_event_timer_insert(fr_event_list_t *el, fr_event_callback_t callback, voi
 		return -1;
 	}
 
+	/*
+	 *	The wheel hasn't been advanced while it was empty.
+	 *	Catch up, so that we don't have to walk through all
+	 *	of the empty ticks later.
+	 */
+	if (el->use_wheel && !el->wheel_num) {
+		struct timeval now;
+
+		gettimeofday(&now, NULL);
+		if (fr_event_timer_tick(&now) > el->wheel_now) el->wheel_now = fr_event_timer_tick(&now);
+	}
+
 	/*
 	 *	If there is an event, re-use it instead of freeing it
 	 *	and allocating a new one.
@@ -500,8 +821,8 @@ int fr_event_timer_insert(fr_event_list_t *el, fr_event_callback_t callback, voi
 
 		ev = talloc_get_type_abort(*parent, fr_event_timer_t);
 
-		ret = fr_heap_extract(el->times, ev);
-		if (!fr_cond_assert(ret == 1)) return -1;	/* events MUST be in the heap */
+		ret = fr_event_timer_unlink(el, ev);
+		if (!fr_cond_assert(ret == 1)) return -1;	/* events MUST be in the heap or the wheel */
 
 		memset(ev, 0, sizeof(*ev));
 	} else {
@@ -514,8 +835,7 @@ int fr_event_timer_insert(fr_event_list_t *el, fr_event_callback_t callback, voi
 	ev->when = *when;
 	ev->parent = parent;
 
-	if (!fr_heap_insert(el->times, ev)) {
-		fr_strerror_printf("Failed inserting event into heap");
+	if (fr_event_timer_link(el, ev) < 0) {
 		talloc_free(ev);
 		return -1;
 	}
@@ -580,26 +900,25 @@ int fr_event_timer_run(fr_event_list_t *el, struct timeval *when)
 
 	if (!el) return 0;
 
-	if (fr_heap_num_elements(el->times) == 0) {
-		when->tv_sec = 0;
-		when->tv_usec = 0;
-		return 0;
-	}
+	/*
+	 *	Move any timers which are due from the wheel to the
+	 *	heap.
+	 */
+	if (el->wheel_num) fr_event_wheel_advance(el, when);
 
 	ev = fr_heap_peek(el->times);
-	if (!ev) {
-		when->tv_sec = 0;
-		when->tv_usec = 0;
-		return 0;
-	}
 
 	/*
 	 *	See if it's time to do this one.
 	 */
-	if ((ev->when.tv_sec > when->tv_sec) ||
+	if (!ev ||
+	    (ev->when.tv_sec > when->tv_sec) ||
 	    ((ev->when.tv_sec == when->tv_sec) &&
 	     (ev->when.tv_usec > when->tv_usec))) {
-		*when = ev->when;
+		if (!fr_event_timer_first(el, when)) {
+			when->tv_sec = 0;
+			when->tv_usec = 0;
+		}
 		return 0;
 	}
 
@@ -626,8 +945,12 @@ int fr_event_timer_run(fr_event_list_t *el, struct timeval *when)
  */
 int fr_event_corral(fr_event_list_t *el, bool wait)
 {
-	struct timeval when, *wake;
+	struct timeval when, *wake, first;
+#ifdef FR_EVENT_EPOLL
+	int timeout;
+#else
 	struct timespec ts_when, *ts_wake;
+#endif
 
 	if (el->exit) {
 		fr_strerror_printf("Event loop exiting");
@@ -643,19 +966,14 @@ int fr_event_corral(fr_event_list_t *el, bool wait)
 	wake = &when;
 
 	if (wait) {
-		if (fr_heap_num_elements(el->times) > 0) {
-			fr_event_timer_t *ev;
-
-			ev = fr_heap_peek(el->times);
-			if (!fr_cond_assert(ev)) return -1;
-
+		if (fr_event_timer_first(el, &first)) {
 			gettimeofday(&el->now, NULL);
 
 			/*
 			 *	Next event is in the future, get the time
 			 *	between now and that event.
 			 */
-			if (fr_timeval_cmp(&ev->when, &el->now) > 0) fr_timeval_subtract(&when, &ev->when, &el->now);
+			if (fr_timeval_cmp(&first, &el->now) > 0) fr_timeval_subtract(&when, &first, &el->now);
 		} else {
 			wake = NULL;
 		}
@@ -674,6 +992,39 @@ int fr_event_corral(fr_event_list_t *el, bool wait)
 		}
 	}
 
+#ifdef FR_EVENT_EPOLL
+	/*
+	 *	epoll_wait() only has millisecond resolution, so we
+	 *	use a timerfd to wake up for the next timer event.
+	 *	The timer is only re-armed when the first event
+	 *	changes.
+	 */
+	if (!wake) {
+		timeout = -1;
+
+	} else if ((when.tv_sec == 0) && (when.tv_usec == 0)) {
+		timeout = 0;
+
+	} else {
+		if (fr_timeval_cmp(&first, &el->timer_armed) != 0) {
+			struct itimerspec its;
+
+			memset(&its, 0, sizeof(its));
+			its.it_value.tv_sec = first.tv_sec;
+			its.it_value.tv_nsec = first.tv_usec * 1000;
+
+			if (timerfd_settime(el->timer_fd, TFD_TIMER_ABSTIME, &its, NULL) < 0) {
+				fr_strerror_printf("Failed setting timer: %s", fr_syserror(errno));
+				return -1;
+			}
+			el->timer_armed = first;
+		}
+
+		timeout = -1;
+	}
+
+	el->num_fd_events = epoll_wait(el->epoll_fd, el->ep_events, FR_EV_BATCH_FDS, timeout);
+#else
 	if (wake) {
 		ts_wake = &ts_when;
 		ts_when.tv_sec = when.tv_sec;
@@ -688,6 +1039,7 @@ int fr_event_corral(fr_event_list_t *el, bool wait)
 	 *	or wait for the next timer event.
 	 */
 	el->num_fd_events = kevent(el->kq, NULL, 0, el->events, FR_EV_BATCH_FDS, ts_wake);
+#endif
 
 	/*
 	 *	Interrupt is different from timeout / FD events.
@@ -697,6 +1049,107 @@ int fr_event_corral(fr_event_list_t *el, bool wait)
 	return el->num_fd_events;
 }
 
+#ifdef FR_EVENT_EPOLL
+/** Service the EVFILT_USER events which are pending on the kq
+ *
+ * @param[in] el containing events to service.
+ */
+static void fr_event_user_service(fr_event_list_t *el)
+{
+	int i, num_events;
+	struct timespec ts_zero = { 0, 0 };
+
+	num_events = kevent(el->kq, NULL, 0, el->events, FR_EV_BATCH_FDS, &ts_zero);
+
+	for (i = 0; i < num_events; i++) {
+		if (el->events[i].filter != EVFILT_USER) continue;
+
+		/*
+		 *	This is just a "wakeup" event, which
+		 *	is always ignored.
+		 */
+		if (el->events[i].ident == 0) continue;
+
+		if (el->user) el->user(el->kq, &el->events[i], el->user_ctx);
+	}
+}
+
+/** Service any outstanding timer or file descriptor events
+ *
+ * @param[in] el containing events to service.
+ */
+void fr_event_service(fr_event_list_t *el)
+{
+	int i;
+
+	if (el->exit) return;
+
+	/*
+	 *	Loop over all of the events, servicing them.
+	 */
+	for (i = 0; i < el->num_fd_events; i++) {
+		fr_event_fd_t *ev;
+		uint32_t events = el->ep_events[i].events;
+		void *ptr = el->ep_events[i].data.ptr;
+
+		/*
+		 *	The timer fired.  The timer events are run
+		 *	below, so all we do here is clear the timerfd.
+		 */
+		if (ptr == &el->timer_fd) {
+			uint64_t expirations;
+
+			if (read(el->timer_fd, &expirations, sizeof(expirations)) < 0) {
+				/* nothing */
+			}
+
+			memset(&el->timer_armed, 0, sizeof(el->timer_armed));
+			continue;
+		}
+
+		/*
+		 *	Process any user events
+		 */
+		if (ptr == &el->kq) {
+			fr_event_user_service(el);
+			continue;
+		}
+
+		ev = talloc_get_type_abort(ptr, fr_event_fd_t);
+
+		if (!fr_cond_assert(ev->is_registered)) continue;
+
+		if (events & (EPOLLERR | EPOLLHUP | EPOLLRDHUP)) {
+			/*
+			 *	Call the error handler which should
+			 *	tear down the connection.
+			 */
+			if (ev->error) ev->error(el, ev->fd, ev->ctx);
+			continue;
+		}
+
+		ev->in_handler = true;
+		if (ev->read && (events & EPOLLIN)) ev->read(el, ev->fd, ev->ctx);
+		if (ev->write && (events & EPOLLOUT) && !ev->do_delete) ev->write(el, ev->fd, ev->ctx);
+		ev->in_handler = false;
+
+		/*
+		 *	Process any deferred deletes performed
+		 *	by the I/O handler.
+		 */
+		if (ev->do_delete) fr_event_fd_delete(el, ev->fd);
+	}
+
+	if (fr_event_list_num_elements(el) > 0) {
+		struct timeval when;
+
+		do {
+			gettimeofday(&el->now, NULL);
+			when = el->now;
+		} while (fr_event_timer_run(el, &when) == 1);
+	}
+}
+#else
 /** Service any outstanding timer or file descriptor events
  *
  * @param[in] el containing events to service.
@@ -757,7 +1210,7 @@ void fr_event_service(fr_event_list_t *el)
 		if (ev->do_delete) fr_event_fd_delete(el, ev->fd);
 	}
 
-	if (fr_heap_num_elements(el->times) > 0) {
+	if (fr_event_list_num_elements(el) > 0) {
 		struct timeval when;
 
 		do {
@@ -766,6 +1219,7 @@ void fr_event_service(fr_event_list_t *el)
 		} while (fr_event_timer_run(el, &when) == 1);
 	}
 }
+#endif
 
 /** Signal an event loop exit with the specified code
  *
@@ -827,14 +1281,28 @@ int fr_event_loop(fr_event_list_t *el)
  */
 static int _event_list_free(fr_event_list_t *el)
 {
+	int i, j;
 	fr_event_timer_t *ev;
 
 	while ((ev = fr_heap_peek(el->times)) != NULL) {
 		fr_event_timer_delete(el, &ev);
 	}
 
+	for (i = 0; i < TIMER_WHEEL_LEVELS; i++) {
+		for (j = 0; j < TIMER_WHEEL_SLOTS; j++) {
+			while ((ev = el->wheel[i][j]) != NULL) {
+				fr_event_timer_delete(el, &ev);
+			}
+		}
+	}
+
 	fr_heap_delete(el->times);
 
+#ifdef FR_EVENT_EPOLL
+	if (el->timer_fd >= 0) close(el->timer_fd);
+	if (el->epoll_fd >= 0) close(el->epoll_fd);
+#endif
+
 	close(el->kq);
 
 	return 0;
@@ -853,11 +1321,18 @@ fr_event_list_t *fr_event_list_alloc(TALLOC_CTX *ctx, fr_event_status_t status,
 {
 	fr_event_list_t *el;
 	struct kevent kev;
+#ifdef FR_EVENT_EPOLL
+	struct epoll_event evset;
+#endif
 
 	el = talloc_zero(ctx, fr_event_list_t);
 	if (!fr_cond_assert(el)) {
 		return NULL;
 	}
+#ifdef FR_EVENT_EPOLL
+	el->epoll_fd = -1;
+	el->timer_fd = -1;
+#endif
 	talloc_set_destructor(el, _event_list_free);
 
 	el->times = fr_heap_create(fr_event_timer_cmp, offsetof(fr_event_timer_t, heap));
@@ -885,6 +1360,44 @@ fr_event_list_t *fr_event_list_alloc(TALLOC_CTX *ctx, fr_event_status_t status,
 		return NULL;
 	}
 
+#ifdef FR_EVENT_EPOLL
+	el->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+	if (el->epoll_fd < 0) {
+		fr_strerror_printf("Failed creating epoll instance: %s", fr_syserror(errno));
+		talloc_free(el);
+		return NULL;
+	}
+
+	el->timer_fd = timerfd_create(CLOCK_REALTIME, TFD_NONBLOCK | TFD_CLOEXEC);
+	if (el->timer_fd < 0) {
+		fr_strerror_printf("Failed creating timerfd: %s", fr_syserror(errno));
+		talloc_free(el);
+		return NULL;
+	}
+
+	/*
+	 *	The timerfd and the kq are tagged with pointers to
+	 *	their fields in the event list, so that
+	 *	fr_event_service() can tell them apart from the
+	 *	fr_event_fd_t structures.
+	 */
+	memset(&evset, 0, sizeof(evset));
+	evset.events = EPOLLIN;
+	evset.data.ptr = &el->timer_fd;
+	if (epoll_ctl(el->epoll_fd, EPOLL_CTL_ADD, el->timer_fd, &evset) < 0) {
+		fr_strerror_printf("Failed adding timerfd: %s", fr_syserror(errno));
+		talloc_free(el);
+		return NULL;
+	}
+
+	evset.data.ptr = &el->kq;
+	if (epoll_ctl(el->epoll_fd, EPOLL_CTL_ADD, el->kq, &evset) < 0) {
+		fr_strerror_printf("Failed adding kq: %s", fr_syserror(errno));
+		talloc_free(el);
+		return NULL;
+	}
+#endif
+
 	return el;
 }
 
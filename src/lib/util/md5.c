@@ -18,6 +18,7 @@ RCSID("$Id$")
  *  If we don't do this, it might pick up the systems broken MD5.
  */
 #include <freeradius-devel/md5.h>
+#include <freeradius-devel/rad_assert.h>
 
 /** Calculate the MD5 hash of the contents of a buffer
  *
@@ -34,23 +35,6 @@ void fr_md5_calc(uint8_t *out, uint8_t const *in, size_t inlen)
 	fr_md5_final(out, &ctx);
 }
 
-#ifndef HAVE_OPENSSL_EVP_H
-/*
- * This code implements the MD5 message-digest algorithm.
- * The algorithm is due to Ron Rivest.	This code was
- * written by Colin Plumb in 1993, no copyright is claimed.
- * This code is in the public domain; do with it what you wish.
- *
- * Equivalent code is available from RSA Data Security, Inc.
- * This code has been tested against that, and is equivalent,
- * except that you don't need to include two pages of legalese
- * with every copy.
- *
- * To compute the message digest of a chunk of bytes, declare an
- * MD5Context structure, pass it to fr_md5_init, call fr_md5_update as
- * needed on buffers full of bytes, and then call fr_md5_final, which
- * will fill a supplied 16-byte array with the digest.
- */
 #define PUT_64BIT_LE(cp, value) do {\
 	(cp)[7] = (value)[1] >> 24;\
 	(cp)[6] = (value)[1] >> 16;\
@@ -69,6 +53,109 @@ void fr_md5_calc(uint8_t *out, uint8_t const *in, size_t inlen)
 	(cp)[0] = (value);\
 } while (0)
 
+/* The four core functions - F1 is optimized somewhat */
+#define F1(x, y, z) (z ^ (x & (y ^ z)))
+#define F2(x, y, z) F1(z, x, y)
+#define F3(x, y, z) (x ^ y ^ z)
+#define F4(x, y, z) (y ^ (x | ~z))
+
+/* This is the central step in the MD5 algorithm. */
+#define MD5STEP(f, w, x, y, z, data, s) (w += f(x, y, z) + data, w = w << s | w >> (32 - s),  w += x)
+
+/*
+ *	All 64 steps of the MD5 compression function.  Works on any
+ *	type which supports the usual integer operators, so the same
+ *	steps are used for the scalar, and the SIMD transforms.
+ *
+ *	Expects the working variables to be called a, b, c, and d.
+ */
+#define MD5_ROUNDS(_in) do { \
+	MD5STEP(F1, a, b, c, d, _in[ 0] + 0xd76aa478,  7); \
+	MD5STEP(F1, d, a, b, c, _in[ 1] + 0xe8c7b756, 12); \
+	MD5STEP(F1, c, d, a, b, _in[ 2] + 0x242070db, 17); \
+	MD5STEP(F1, b, c, d, a, _in[ 3] + 0xc1bdceee, 22); \
+	MD5STEP(F1, a, b, c, d, _in[ 4] + 0xf57c0faf,  7); \
+	MD5STEP(F1, d, a, b, c, _in[ 5] + 0x4787c62a, 12); \
+	MD5STEP(F1, c, d, a, b, _in[ 6] + 0xa8304613, 17); \
+	MD5STEP(F1, b, c, d, a, _in[ 7] + 0xfd469501, 22); \
+	MD5STEP(F1, a, b, c, d, _in[ 8] + 0x698098d8,  7); \
+	MD5STEP(F1, d, a, b, c, _in[ 9] + 0x8b44f7af, 12); \
+	MD5STEP(F1, c, d, a, b, _in[10] + 0xffff5bb1, 17); \
+	MD5STEP(F1, b, c, d, a, _in[11] + 0x895cd7be, 22); \
+	MD5STEP(F1, a, b, c, d, _in[12] + 0x6b901122,  7); \
+	MD5STEP(F1, d, a, b, c, _in[13] + 0xfd987193, 12); \
+	MD5STEP(F1, c, d, a, b, _in[14] + 0xa679438e, 17); \
+	MD5STEP(F1, b, c, d, a, _in[15] + 0x49b40821, 22); \
+\
+	MD5STEP(F2, a, b, c, d, _in[ 1] + 0xf61e2562,  5); \
+	MD5STEP(F2, d, a, b, c, _in[ 6] + 0xc040b340,  9); \
+	MD5STEP(F2, c, d, a, b, _in[11] + 0x265e5a51, 14); \
+	MD5STEP(F2, b, c, d, a, _in[ 0] + 0xe9b6c7aa, 20); \
+	MD5STEP(F2, a, b, c, d, _in[ 5] + 0xd62f105d,  5); \
+	MD5STEP(F2, d, a, b, c, _in[10] + 0x02441453,  9); \
+	MD5STEP(F2, c, d, a, b, _in[15] + 0xd8a1e681, 14); \
+	MD5STEP(F2, b, c, d, a, _in[ 4] + 0xe7d3fbc8, 20); \
+	MD5STEP(F2, a, b, c, d, _in[ 9] + 0x21e1cde6,  5); \
+	MD5STEP(F2, d, a, b, c, _in[14] + 0xc33707d6,  9); \
+	MD5STEP(F2, c, d, a, b, _in[ 3] + 0xf4d50d87, 14); \
+	MD5STEP(F2, b, c, d, a, _in[ 8] + 0x455a14ed, 20); \
+	MD5STEP(F2, a, b, c, d, _in[13] + 0xa9e3e905,  5); \
+	MD5STEP(F2, d, a, b, c, _in[ 2] + 0xfcefa3f8,  9); \
+	MD5STEP(F2, c, d, a, b, _in[ 7] + 0x676f02d9, 14); \
+	MD5STEP(F2, b, c, d, a, _in[12] + 0x8d2a4c8a, 20); \
+\
+	MD5STEP(F3, a, b, c, d, _in[ 5] + 0xfffa3942,  4); \
+	MD5STEP(F3, d, a, b, c, _in[ 8] + 0x8771f681, 11); \
+	MD5STEP(F3, c, d, a, b, _in[11] + 0x6d9d6122, 16); \
+	MD5STEP(F3, b, c, d, a, _in[14] + 0xfde5380c, 23); \
+	MD5STEP(F3, a, b, c, d, _in[ 1] + 0xa4beea44,  4); \
+	MD5STEP(F3, d, a, b, c, _in[ 4] + 0x4bdecfa9, 11); \
+	MD5STEP(F3, c, d, a, b, _in[ 7] + 0xf6bb4b60, 16); \
+	MD5STEP(F3, b, c, d, a, _in[10] + 0xbebfbc70, 23); \
+	MD5STEP(F3, a, b, c, d, _in[13] + 0x289b7ec6,  4); \
+	MD5STEP(F3, d, a, b, c, _in[ 0] + 0xeaa127fa, 11); \
+	MD5STEP(F3, c, d, a, b, _in[ 3] + 0xd4ef3085, 16); \
+	MD5STEP(F3, b, c, d, a, _in[ 6] + 0x04881d05, 23); \
+	MD5STEP(F3, a, b, c, d, _in[ 9] + 0xd9d4d039,  4); \
+	MD5STEP(F3, d, a, b, c, _in[12] + 0xe6db99e5, 11); \
+	MD5STEP(F3, c, d, a, b, _in[15] + 0x1fa27cf8, 16); \
+	MD5STEP(F3, b, c, d, a, _in[2 ] + 0xc4ac5665, 23); \
+\
+	MD5STEP(F4, a, b, c, d, _in[ 0] + 0xf4292244,  6); \
+	MD5STEP(F4, d, a, b, c, _in[7 ] + 0x432aff97, 10); \
+	MD5STEP(F4, c, d, a, b, _in[14] + 0xab9423a7, 15); \
+	MD5STEP(F4, b, c, d, a, _in[5 ] + 0xfc93a039, 21); \
+	MD5STEP(F4, a, b, c, d, _in[12] + 0x655b59c3,  6); \
+	MD5STEP(F4, d, a, b, c, _in[3 ] + 0x8f0ccc92, 10); \
+	MD5STEP(F4, c, d, a, b, _in[10] + 0xffeff47d, 15); \
+	MD5STEP(F4, b, c, d, a, _in[1 ] + 0x85845dd1, 21); \
+	MD5STEP(F4, a, b, c, d, _in[8 ] + 0x6fa87e4f,  6); \
+	MD5STEP(F4, d, a, b, c, _in[15] + 0xfe2ce6e0, 10); \
+	MD5STEP(F4, c, d, a, b, _in[6 ] + 0xa3014314, 15); \
+	MD5STEP(F4, b, c, d, a, _in[13] + 0x4e0811a1, 21); \
+	MD5STEP(F4, a, b, c, d, _in[4 ] + 0xf7537e82,  6); \
+	MD5STEP(F4, d, a, b, c, _in[11] + 0xbd3af235, 10); \
+	MD5STEP(F4, c, d, a, b, _in[2 ] + 0x2ad7d2bb, 15); \
+	MD5STEP(F4, b, c, d, a, _in[9 ] + 0xeb86d391, 21); \
+} while (0)
+
+#ifndef HAVE_OPENSSL_EVP_H
+/*
+ * This code implements the MD5 message-digest algorithm.
+ * The algorithm is due to Ron Rivest.	This code was
+ * written by Colin Plumb in 1993, no copyright is claimed.
+ * This code is in the public domain; do with it what you wish.
+ *
+ * Equivalent code is available from RSA Data Security, Inc.
+ * This code has been tested against that, and is equivalent,
+ * except that you don't need to include two pages of legalese
+ * with every copy.
+ *
+ * To compute the message digest of a chunk of bytes, declare an
+ * MD5Context structure, pass it to fr_md5_init, call fr_md5_update as
+ * needed on buffers full of bytes, and then call fr_md5_final, which
+ * will fill a supplied 16-byte array with the digest.
+ */
 static const uint8_t PADDING[MD5_BLOCK_LENGTH] = {
 	0x80, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
 	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
@@ -166,15 +253,6 @@ void fr_md5_final(uint8_t out[MD5_DIGEST_LENGTH], FR_MD5_CTX *ctx)
 	memset(ctx, 0, sizeof(*ctx));	/* in case it's sensitive */
 }
 
-/* The four core functions - F1 is optimized somewhat */
-#define F1(x, y, z) (z ^ (x & (y ^ z)))
-#define F2(x, y, z) F1(z, x, y)
-#define F3(x, y, z) (x ^ y ^ z)
-#define F4(x, y, z) (y ^ (x | ~z))
-
-/* This is the central step in the MD5 algorithm. */
-#define MD5STEP(f, w, x, y, z, data, s) (w += f(x, y, z) + data, w = w << s | w >> (32 - s),  w += x)
-
 /** The core of the MD5 algorithm
  *
  * This alters an existing MD5 hash to reflect the addition of 16
@@ -201,73 +279,7 @@ void fr_md5_transform(uint32_t state[4], uint8_t const block[MD5_BLOCK_LENGTH])
 	c = state[2];
 	d = state[3];
 
-	MD5STEP(F1, a, b, c, d, in[ 0] + 0xd76aa478,  7);
-	MD5STEP(F1, d, a, b, c, in[ 1] + 0xe8c7b756, 12);
-	MD5STEP(F1, c, d, a, b, in[ 2] + 0x242070db, 17);
-	MD5STEP(F1, b, c, d, a, in[ 3] + 0xc1bdceee, 22);
-	MD5STEP(F1, a, b, c, d, in[ 4] + 0xf57c0faf,  7);
-	MD5STEP(F1, d, a, b, c, in[ 5] + 0x4787c62a, 12);
-	MD5STEP(F1, c, d, a, b, in[ 6] + 0xa8304613, 17);
-	MD5STEP(F1, b, c, d, a, in[ 7] + 0xfd469501, 22);
-	MD5STEP(F1, a, b, c, d, in[ 8] + 0x698098d8,  7);
-	MD5STEP(F1, d, a, b, c, in[ 9] + 0x8b44f7af, 12);
-	MD5STEP(F1, c, d, a, b, in[10] + 0xffff5bb1, 17);
-	MD5STEP(F1, b, c, d, a, in[11] + 0x895cd7be, 22);
-	MD5STEP(F1, a, b, c, d, in[12] + 0x6b901122,  7);
-	MD5STEP(F1, d, a, b, c, in[13] + 0xfd987193, 12);
-	MD5STEP(F1, c, d, a, b, in[14] + 0xa679438e, 17);
-	MD5STEP(F1, b, c, d, a, in[15] + 0x49b40821, 22);
-
-	MD5STEP(F2, a, b, c, d, in[ 1] + 0xf61e2562,  5);
-	MD5STEP(F2, d, a, b, c, in[ 6] + 0xc040b340,  9);
-	MD5STEP(F2, c, d, a, b, in[11] + 0x265e5a51, 14);
-	MD5STEP(F2, b, c, d, a, in[ 0] + 0xe9b6c7aa, 20);
-	MD5STEP(F2, a, b, c, d, in[ 5] + 0xd62f105d,  5);
-	MD5STEP(F2, d, a, b, c, in[10] + 0x02441453,  9);
-	MD5STEP(F2, c, d, a, b, in[15] + 0xd8a1e681, 14);
-	MD5STEP(F2, b, c, d, a, in[ 4] + 0xe7d3fbc8, 20);
-	MD5STEP(F2, a, b, c, d, in[ 9] + 0x21e1cde6,  5);
-	MD5STEP(F2, d, a, b, c, in[14] + 0xc33707d6,  9);
-	MD5STEP(F2, c, d, a, b, in[ 3] + 0xf4d50d87, 14);
-	MD5STEP(F2, b, c, d, a, in[ 8] + 0x455a14ed, 20);
-	MD5STEP(F2, a, b, c, d, in[13] + 0xa9e3e905,  5);
-	MD5STEP(F2, d, a, b, c, in[ 2] + 0xfcefa3f8,  9);
-	MD5STEP(F2, c, d, a, b, in[ 7] + 0x676f02d9, 14);
-	MD5STEP(F2, b, c, d, a, in[12] + 0x8d2a4c8a, 20);
-
-	MD5STEP(F3, a, b, c, d, in[ 5] + 0xfffa3942,  4);
-	MD5STEP(F3, d, a, b, c, in[ 8] + 0x8771f681, 11);
-	MD5STEP(F3, c, d, a, b, in[11] + 0x6d9d6122, 16);
-	MD5STEP(F3, b, c, d, a, in[14] + 0xfde5380c, 23);
-	MD5STEP(F3, a, b, c, d, in[ 1] + 0xa4beea44,  4);
-	MD5STEP(F3, d, a, b, c, in[ 4] + 0x4bdecfa9, 11);
-	MD5STEP(F3, c, d, a, b, in[ 7] + 0xf6bb4b60, 16);
-	MD5STEP(F3, b, c, d, a, in[10] + 0xbebfbc70, 23);
-	MD5STEP(F3, a, b, c, d, in[13] + 0x289b7ec6,  4);
-	MD5STEP(F3, d, a, b, c, in[ 0] + 0xeaa127fa, 11);
-	MD5STEP(F3, c, d, a, b, in[ 3] + 0xd4ef3085, 16);
-	MD5STEP(F3, b, c, d, a, in[ 6] + 0x04881d05, 23);
-	MD5STEP(F3, a, b, c, d, in[ 9] + 0xd9d4d039,  4);
-	MD5STEP(F3, d, a, b, c, in[12] + 0xe6db99e5, 11);
-	MD5STEP(F3, c, d, a, b, in[15] + 0x1fa27cf8, 16);
-	MD5STEP(F3, b, c, d, a, in[2 ] + 0xc4ac5665, 23);
-
-	MD5STEP(F4, a, b, c, d, in[ 0] + 0xf4292244,  6);
-	MD5STEP(F4, d, a, b, c, in[7 ] + 0x432aff97, 10);
-	MD5STEP(F4, c, d, a, b, in[14] + 0xab9423a7, 15);
-	MD5STEP(F4, b, c, d, a, in[5 ] + 0xfc93a039, 21);
-	MD5STEP(F4, a, b, c, d, in[12] + 0x655b59c3,  6);
-	MD5STEP(F4, d, a, b, c, in[3 ] + 0x8f0ccc92, 10);
-	MD5STEP(F4, c, d, a, b, in[10] + 0xffeff47d, 15);
-	MD5STEP(F4, b, c, d, a, in[1 ] + 0x85845dd1, 21);
-	MD5STEP(F4, a, b, c, d, in[8 ] + 0x6fa87e4f,  6);
-	MD5STEP(F4, d, a, b, c, in[15] + 0xfe2ce6e0, 10);
-	MD5STEP(F4, c, d, a, b, in[6 ] + 0xa3014314, 15);
-	MD5STEP(F4, b, c, d, a, in[13] + 0x4e0811a1, 21);
-	MD5STEP(F4, a, b, c, d, in[4 ] + 0xf7537e82,  6);
-	MD5STEP(F4, d, a, b, c, in[11] + 0xbd3af235, 10);
-	MD5STEP(F4, c, d, a, b, in[2 ] + 0x2ad7d2bb, 15);
-	MD5STEP(F4, b, c, d, a, in[9 ] + 0xeb86d391, 21);
+	MD5_ROUNDS(in);
 
 	state[0] += a;
 	state[1] += b;
@@ -275,3 +287,356 @@ void fr_md5_transform(uint32_t state[4], uint8_t const block[MD5_BLOCK_LENGTH])
 	state[3] += d;
 }
 #endif
+
+/*
+ *	Multi-buffer MD5.
+ *
+ *	Each step of MD5 depends on the result of the previous one, so
+ *	a single message can't make use of SIMD instructions.  Several
+ *	independent messages can, with each message in its own lane of
+ *	a vector register.  RADIUS packets are only a few blocks long,
+ *	so batches of packets hash well this way.
+ *
+ *	When a lane finishes its message, the next message in the batch
+ *	is loaded into it, so messages of different lengths don't leave
+ *	lanes idle.
+ */
+#define MD5_MULTI_MAX_LANES	(8)
+
+/*
+ *	The vector transforms use the GCC vector extensions, which
+ *	clang also supports.  The 4 lane transform is compiled for
+ *	whatever vector unit the target has (SSE2, NEON, etc.).  The 8
+ *	lane transform is compiled for AVX2, and only used if the CPU
+ *	we're running on has it.
+ */
+#ifdef __GNUC__
+#  define WITH_MD5_MULTI_X4
+typedef uint32_t md5_multi_x4_t __attribute__ ((vector_size (16)));
+
+#  if defined(__x86_64__) || defined(__i386__)
+#    define WITH_MD5_MULTI_X8
+typedef uint32_t md5_multi_x8_t __attribute__ ((vector_size (32)));
+#  endif
+#endif
+
+typedef struct {
+	fr_md5_job_t const	*job;		//!< Being hashed in this lane.  NULL if idle.
+	size_t			pos;		//!< Offset of the next block in the message.
+	size_t			end;		//!< Length of the message, plus padding.
+	uint8_t			buffer[MD5_BLOCK_LENGTH];	//!< For blocks which aren't contiguous
+							//!< in the message.
+} md5_multi_lane_t;
+
+typedef void (*md5_multi_transform_t)(uint32_t state[4][MD5_MULTI_MAX_LANES], uint8_t const *block[]);
+
+static inline uint32_t md5_get_32bit_le(uint8_t const *p)
+{
+	return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+/** Scalar MD5 transform
+ *
+ * The same as fr_md5_transform, but always available, as the OpenSSL
+ * MD5_CTX state can't be used for multi-buffer hashing.
+ */
+static void md5_multi_x1(uint32_t state[4], uint8_t const *block)
+{
+	uint32_t a, b, c, d, in[MD5_BLOCK_LENGTH / 4];
+	int i;
+
+	for (i = 0; i < MD5_BLOCK_LENGTH / 4; i++) in[i] = md5_get_32bit_le(block + (i * 4));
+
+	a = state[0];
+	b = state[1];
+	c = state[2];
+	d = state[3];
+
+	MD5_ROUNDS(in);
+
+	state[0] += a;
+	state[1] += b;
+	state[2] += c;
+	state[3] += d;
+}
+
+/*
+ *	Define a transform which hashes one block in each of _lanes
+ *	lanes.  The state is stored as state[word][lane].
+ */
+#define MD5_MULTI_TRANSFORM(_name, _type, _lanes, ...) \
+__VA_ARGS__ static void _name(uint32_t state[4][MD5_MULTI_MAX_LANES], uint8_t const *block[]) \
+{ \
+	_type a, b, c, d, sa, sb, sc, sd, in[MD5_BLOCK_LENGTH / 4]; \
+	int i, l; \
+\
+	for (i = 0; i < MD5_BLOCK_LENGTH / 4; i++) { \
+		for (l = 0; l < _lanes; l++) in[i][l] = md5_get_32bit_le(block[l] + (i * 4)); \
+	} \
+\
+	memcpy(&a, state[0], sizeof(a)); \
+	memcpy(&b, state[1], sizeof(b)); \
+	memcpy(&c, state[2], sizeof(c)); \
+	memcpy(&d, state[3], sizeof(d)); \
+	sa = a; \
+	sb = b; \
+	sc = c; \
+	sd = d; \
+\
+	MD5_ROUNDS(in); \
+\
+	a += sa; \
+	b += sb; \
+	c += sc; \
+	d += sd; \
+	memcpy(state[0], &a, sizeof(a)); \
+	memcpy(state[1], &b, sizeof(b)); \
+	memcpy(state[2], &c, sizeof(c)); \
+	memcpy(state[3], &d, sizeof(d)); \
+}
+
+#ifdef WITH_MD5_MULTI_X4
+MD5_MULTI_TRANSFORM(md5_multi_x4, md5_multi_x4_t, 4)
+#endif
+
+#ifdef WITH_MD5_MULTI_X8
+MD5_MULTI_TRANSFORM(md5_multi_x8, md5_multi_x8_t, 8, __attribute__ ((target ("avx2"))))
+
+/*
+ *	Written once, with the same value by every thread, so the race
+ *	on first use is harmless.
+ */
+static int md5_multi_avx2 = -1;
+
+static bool md5_multi_have_avx2(void)
+{
+	if (md5_multi_avx2 < 0) {
+		__builtin_cpu_init();
+		md5_multi_avx2 = __builtin_cpu_supports("avx2") ? 1 : 0;
+	}
+
+	return (md5_multi_avx2 == 1);
+}
+#endif
+
+/** Copy the part of the message at [offset, offset + len) which overlaps the lane's next block
+ *
+ */
+static inline void md5_multi_lane_copy(md5_multi_lane_t *lane, size_t pos, uint8_t const *in, size_t offset, size_t len)
+{
+	size_t start, end;
+
+	start = (pos > offset) ? pos : offset;
+	end = ((offset + len) < (pos + MD5_BLOCK_LENGTH)) ? (offset + len) : (pos + MD5_BLOCK_LENGTH);
+	if (start >= end) return;
+
+	memcpy(lane->buffer + (start - pos), in + (start - offset), end - start);
+}
+
+/** Return the next block of the message in a lane
+ *
+ * Blocks which are entirely within one part of the message are used
+ * in place.  Others, and the padding, are assembled in the lane's
+ * buffer.
+ */
+static uint8_t const *md5_multi_lane_block(md5_multi_lane_t *lane)
+{
+	fr_md5_job_t const	*job = lane->job;
+	size_t			pos = lane->pos;
+	size_t			len = job->inlen + job->in2len;
+	uint64_t		bits;
+	uint32_t		count[2];
+
+	lane->pos += MD5_BLOCK_LENGTH;
+
+	if ((pos + MD5_BLOCK_LENGTH) <= job->inlen) return job->in + pos;
+	if ((pos >= job->inlen) && ((pos + MD5_BLOCK_LENGTH) <= len)) return job->in2 + (pos - job->inlen);
+
+	memset(lane->buffer, 0, sizeof(lane->buffer));
+	md5_multi_lane_copy(lane, pos, job->in, 0, job->inlen);
+	if (job->in2len) md5_multi_lane_copy(lane, pos, job->in2, job->inlen, job->in2len);
+
+	if ((len >= pos) && (len < (pos + MD5_BLOCK_LENGTH))) lane->buffer[len - pos] = 0x80;
+
+	if (lane->pos == lane->end) {
+		bits = ((uint64_t) job->state_len + len) << 3;
+		count[0] = bits;
+		count[1] = bits >> 32;
+		PUT_64BIT_LE(lane->buffer + MD5_BLOCK_LENGTH - 8, count);
+	}
+
+	return lane->buffer;
+}
+
+static void md5_multi_lane_load(md5_multi_lane_t *lane, uint32_t state[4][MD5_MULTI_MAX_LANES], int l,
+				fr_md5_job_t const *job)
+{
+	static uint32_t const iv[4] = { 0x67452301, 0xefcdab89, 0x98badcfe, 0x10325476 };
+	uint32_t const *in = job->state ? job->state : iv;
+	int i;
+
+	rad_assert((job->state_len % MD5_BLOCK_LENGTH) == 0);
+
+	lane->job = job;
+	lane->pos = 0;
+
+	/*
+	 *	Room for the 0x80 byte, and the 64 bit length.
+	 */
+	lane->end = ((job->inlen + job->in2len + 8) / MD5_BLOCK_LENGTH + 1) * MD5_BLOCK_LENGTH;
+
+	for (i = 0; i < 4; i++) state[i][l] = in[i];
+}
+
+static void md5_multi_lane_done(md5_multi_lane_t *lane, uint32_t state[4][MD5_MULTI_MAX_LANES], int l)
+{
+	int i;
+
+	for (i = 0; i < 4; i++) PUT_32BIT_LE(lane->job->out + (i * 4), state[i][l]);
+
+	lane->job = NULL;
+}
+
+/** Finish the message in one lane with the scalar transform
+ *
+ */
+static void md5_multi_lane_finish(md5_multi_lane_t *lane, uint32_t state[4][MD5_MULTI_MAX_LANES], int l)
+{
+	uint32_t	st[4];
+	int		i;
+
+	for (i = 0; i < 4; i++) st[i] = state[i][l];
+
+	while (lane->pos < lane->end) md5_multi_x1(st, md5_multi_lane_block(lane));
+
+	for (i = 0; i < 4; i++) state[i][l] = st[i];
+
+	md5_multi_lane_done(lane, state, l);
+}
+
+static void md5_multi_run(fr_md5_job_t *jobs, size_t num, int lanes, md5_multi_transform_t transform)
+{
+	static uint8_t const	zero[MD5_BLOCK_LENGTH];
+	md5_multi_lane_t	lane[MD5_MULTI_MAX_LANES];
+	uint32_t		state[4][MD5_MULTI_MAX_LANES];
+	uint8_t const		*block[MD5_MULTI_MAX_LANES];
+	size_t			next = 0;
+	int			l, active = 0;
+
+	for (l = 0; l < lanes; l++) {
+		if (next == num) {
+			lane[l].job = NULL;
+			continue;
+		}
+
+		md5_multi_lane_load(&lane[l], state, l, &jobs[next++]);
+		active++;
+	}
+
+	while (active > 0) {
+		/*
+		 *	Only one lane is busy, which means there's no
+		 *	more work to load, or there's only one lane.
+		 *	A vector transform would just be doing more
+		 *	work to get the same result.
+		 */
+		if (active == 1) {
+			for (l = 0; !lane[l].job; l++);
+
+			md5_multi_lane_finish(&lane[l], state, l);
+			if (next == num) break;
+
+			md5_multi_lane_load(&lane[l], state, l, &jobs[next++]);
+			continue;
+		}
+
+		for (l = 0; l < lanes; l++) block[l] = lane[l].job ? md5_multi_lane_block(&lane[l]) : zero;
+
+		transform(state, block);
+
+		for (l = 0; l < lanes; l++) {
+			if (!lane[l].job || (lane[l].pos < lane[l].end)) continue;
+
+			md5_multi_lane_done(&lane[l], state, l);
+
+			if (next < num) {
+				md5_multi_lane_load(&lane[l], state, l, &jobs[next++]);
+			} else {
+				active--;
+			}
+		}
+	}
+}
+
+/** Calculate the chaining value after hashing whole blocks
+ *
+ * Used to precompute the state for data which is common to many
+ * messages, such as HMAC pads.
+ *
+ * @param[out] state	The chaining value.  Pass it, and inlen, to #fr_md5_multi.
+ * @param[in] in	Data to hash.
+ * @param[in] inlen	Length of the data.  Must be a multiple of MD5_BLOCK_LENGTH.
+ */
+void fr_md5_multi_state(uint32_t state[4], uint8_t const *in, size_t inlen)
+{
+	size_t i;
+
+	rad_assert((inlen % MD5_BLOCK_LENGTH) == 0);
+
+	state[0] = 0x67452301;
+	state[1] = 0xefcdab89;
+	state[2] = 0x98badcfe;
+	state[3] = 0x10325476;
+
+	for (i = 0; i < inlen; i += MD5_BLOCK_LENGTH) md5_multi_x1(state, in + i);
+}
+
+/** Hash a batch of messages
+ *
+ * The messages are hashed in parallel, using SIMD instructions if
+ * they are available.  The result is the same as calling fr_md5_calc
+ * for each message.
+ *
+ * Messages must not overlap the output of any other message in the
+ * batch.  A message may overlap its own output, as the output is
+ * written only once the whole message has been hashed.
+ *
+ * @param[in,out] jobs	to hash.
+ * @param[in] num	Number of jobs.
+ */
+void fr_md5_multi(fr_md5_job_t *jobs, size_t num)
+{
+	if (num == 0) return;
+
+#ifdef WITH_MD5_MULTI_X8
+	if ((num > 4) && md5_multi_have_avx2()) {
+		md5_multi_run(jobs, num, 8, md5_multi_x8);
+		return;
+	}
+#endif
+
+#ifdef WITH_MD5_MULTI_X4
+	if (num > 1) {
+		md5_multi_run(jobs, num, 4, md5_multi_x4);
+		return;
+	}
+#endif
+
+	md5_multi_run(jobs, num, 1, NULL);
+}
+
+/** Return the largest number of messages #fr_md5_multi hashes in parallel
+ *
+ */
+unsigned int fr_md5_multi_lanes(void)
+{
+#ifdef WITH_MD5_MULTI_X8
+	if (md5_multi_have_avx2()) return 8;
+#endif
+
+#ifdef WITH_MD5_MULTI_X4
+	return 4;
+#else
+	return 1;
+#endif
+}
@@ -27,6 +27,22 @@ RCSID("$Id$")
 
 #include <ctype.h>
 
+/*
+ *	The name of pair arenas.  It's compared by address, so that
+ *	checking whether a ctx is an arena is cheap.
+ */
+static char const pair_arena_name[] = "fr_pair_arena_t";
+
+static inline bool pair_ctx_is_arena(TALLOC_CTX const *ctx)
+{
+	return ctx && (talloc_get_name(ctx) == pair_arena_name);
+}
+
+/*
+ *	The destructor only does anything in debug builds, and
+ *	calling it has a cost for every pair freed.
+ */
+#if !defined(NDEBUG) || defined(TALLOC_DEBUG)
 /** Free a VALUE_PAIR
  *
  * @note Do not call directly, use talloc_free instead.
@@ -45,6 +61,7 @@ static int _fr_pair_free(NDEBUG_UNUSED VALUE_PAIR *vp)
 #endif
 	return 0;
 }
+#endif
 
 
 static VALUE_PAIR *fr_pair_alloc(TALLOC_CTX *ctx)
@@ -61,11 +78,57 @@ static VALUE_PAIR *fr_pair_alloc(TALLOC_CTX *ctx)
 	vp->tag = TAG_ANY;
 	vp->type = VT_NONE;
 
+	/*
+	 *	Arena pairs are never freed individually, so they
+	 *	don't need a destructor.
+	 */
+	if (pair_ctx_is_arena(ctx)) {
+		vp->arena = true;
+		return vp;
+	}
+
+#if !defined(NDEBUG) || defined(TALLOC_DEBUG)
 	talloc_set_destructor(vp, _fr_pair_free);
+#endif
 
 	return vp;
 }
 
+/** Allocate an arena for pairs which are all freed at the same time
+ *
+ * The arena is a talloc pool.  Pairs allocated with the arena as
+ * their ctx, and their values, are carved out of it by bumping a
+ * pointer.  #fr_pair_list_free doesn't free arena pairs one by one.
+ * Their memory is released when the arena is freed, which makes the
+ * arena suitable for pairs which live as long as a request.
+ *
+ * Pairs which must outlive the arena have to be copied out of it.
+ * #fr_pair_list_move and #fr_pair_list_move_by_num copy, instead of
+ * stealing, when moving arena pairs to a ctx which isn't an arena.
+ * Stealing an arena pair keeps the whole arena allocated until the
+ * pair is freed.
+ *
+ * @param[in] ctx	to allocate the arena in.  Usually the REQUEST.
+ * @param[in] size	of the arena.  If it fills up, pairs are allocated
+ *			individually, but are still freed with the arena.
+ * @return
+ *	- A new arena.
+ *	- NULL on error.
+ */
+TALLOC_CTX *fr_pair_arena_alloc(TALLOC_CTX *ctx, size_t size)
+{
+	TALLOC_CTX *arena;
+
+	arena = talloc_pool(ctx, size);
+	if (!arena) {
+		fr_strerror_printf("Out of memory");
+		return NULL;
+	}
+	talloc_set_name_const(arena, pair_arena_name);
+
+	return arena;
+}
+
 
 /** Dynamically allocate a new attribute
  *
@@ -218,6 +281,7 @@ VALUE_PAIR *fr_pair_afrom_child_num(TALLOC_CTX *ctx, fr_dict_attr_t const *paren
 VALUE_PAIR *fr_pair_copy(TALLOC_CTX *ctx, VALUE_PAIR const *vp)
 {
 	VALUE_PAIR *n;
+	bool arena;
 
 	if (!vp) return NULL;
 
@@ -226,16 +290,19 @@ VALUE_PAIR *fr_pair_copy(TALLOC_CTX *ctx, VALUE_PAIR const *vp)
 	n = fr_pair_afrom_da(ctx, vp->da);
 	if (!n) return NULL;
 
+	arena = n->arena;
 	memcpy(n, vp, sizeof(*n));
+	n->arena = arena;
 
 	/*
 	 *	Copy the unknown attribute hierarchy
 	 */
 	if (n->da->flags.is_unknown) {
 		n->da = fr_dict_unknown_acopy(n, n->da);
-		if (!n->da) talloc_free(n);
-
-		return NULL;
+		if (!n->da) {
+			talloc_free(n);
+			return NULL;
+		}
 	}
 	n->next = NULL;
 
@@ -275,6 +342,7 @@ VALUE_PAIR *fr_pair_copy(TALLOC_CTX *ctx, VALUE_PAIR const *vp)
 void fr_pair_steal(TALLOC_CTX *ctx, VALUE_PAIR *vp)
 {
 	(void) talloc_steal(ctx, vp);
+	vp->arena = pair_ctx_is_arena(ctx);
 
 	/*
 	 *	The DA may be unknown.  If we're stealing the VPs to a
@@ -529,6 +597,9 @@ VALUE_PAIR *fr_pair_make(TALLOC_CTX *ctx, VALUE_PAIR **vps,
 }
 
 /** Free memory used by a valuepair list.
+ *
+ * Pairs allocated from an arena are unlinked, but their memory is
+ * only released when the arena is freed.
  *
  * @todo TLV: needs to free all dependents of each VP freed.
  */
@@ -545,10 +616,12 @@ void fr_pair_list_free(VALUE_PAIR **vps)
 	     vp;
 	     vp = fr_pair_cursor_next(&cursor)) {
 		VERIFY_VP(vp);
+		if (vp->arena) continue;	/* released with the arena */
 		talloc_free(vp);
 	}
 
 	*vps = NULL;
+	fr_pair_list_touch(vps);
 }
 
 /** Mark malformed or unrecognised attributed as unknown
@@ -675,6 +748,8 @@ void fr_pair_add(VALUE_PAIR **head, VALUE_PAIR *add)
 
 	VERIFY_VP(add);
 
+	fr_pair_list_touch(head);
+
 	if (*head == NULL) {
 		*head = add;
 		return;
@@ -711,6 +786,8 @@ void fr_pair_replace(VALUE_PAIR **head, VALUE_PAIR *replace)
 
 	VERIFY_VP(replace);
 
+	fr_pair_list_touch(head);
+
 	if (*head == NULL) {
 		*head = replace;
 		return;
@@ -809,6 +886,8 @@ void fr_pair_delete_by_num(VALUE_PAIR **head, unsigned int vendor, unsigned int
 	VALUE_PAIR *i, *next;
 	VALUE_PAIR **last = head;
 
+	fr_pair_list_touch(head);
+
 	if (!vendor) {
 		for(i = *head; i; i = next) {
 			VERIFY_VP(i);
@@ -1157,6 +1236,8 @@ void fr_pair_list_sort(VALUE_PAIR **vps, fr_cmp_t cmp)
 	 */
 	if (!head || !head->next) return;
 
+	fr_pair_list_touch(vps);
+
 	_pair_list_sort_split(head, &a, &b);	/* Split into sublists */
 	fr_pair_list_sort(&a, cmp);		/* Traverse left */
 	fr_pair_list_sort(&b, cmp);		/* Traverse right */
@@ -1606,6 +1687,47 @@ VALUE_PAIR *fr_pair_list_copy_by_num(TALLOC_CTX *ctx, VALUE_PAIR *from,
 	return out;
 }
 
+/** Copy the arena pairs in a list out of their arena
+ *
+ * Used when a list is about to outlive the arena its pairs were
+ * allocated from, e.g. when a request's packet is handed to its
+ * parent, or its session-state is stored.  Pairs which aren't in an
+ * arena are left alone.  The originals are released with their arena.
+ *
+ * @param[in] ctx	to allocate the copies in.
+ * @param[in,out] vps	list to fix up.
+ * @return
+ *	- 0 on success.
+ *	- -1 if a pair couldn't be copied.  It's removed from the list.
+ */
+int fr_pair_list_arena_copy(TALLOC_CTX *ctx, VALUE_PAIR **vps)
+{
+	int		rcode = 0;
+	VALUE_PAIR	**last, *vp, *copy;
+
+	last = vps;
+	while ((vp = *last) != NULL) {
+		if (!vp->arena) {
+			last = &vp->next;
+			continue;
+		}
+
+		copy = fr_pair_copy(ctx, vp);
+		if (!copy) {
+			*last = vp->next;
+			rcode = -1;
+			continue;
+		}
+
+		copy->next = vp->next;
+		*last = copy;
+		last = &copy->next;
+	}
+	fr_pair_list_touch(vps);
+
+	return rcode;
+}
+
 
 
 /** Move pairs from source list to destination list respecting operator
@@ -1632,6 +1754,9 @@ void fr_pair_list_move(TALLOC_CTX *ctx, VALUE_PAIR **to, VALUE_PAIR **from)
 
 	if (!to || !from || !*from) return;
 
+	fr_pair_list_touch(to);
+	fr_pair_list_touch(from);
+
 	/*
 	 *	We're editing the "to" list while we're adding new
 	 *	attributes to it.  We don't want the new attributes to
@@ -1707,9 +1832,14 @@ void fr_pair_list_move(TALLOC_CTX *ctx, VALUE_PAIR **to, VALUE_PAIR **from)
 			 */
 			switch (found->vp_type) {
 			default:
+			{
+				bool arena = found->arena;
+
 				j = found->next;
 				memcpy(found, i, sizeof(*found));
 				found->next = j;
+				found->arena = arena;
+			}
 				break;
 
 			case FR_TYPE_OCTETS:
@@ -1747,8 +1877,22 @@ void fr_pair_list_move(TALLOC_CTX *ctx, VALUE_PAIR **to, VALUE_PAIR **from)
 	do_add:
 			*tail_from = i->next;
 			i->next = NULL;
+
+			/*
+			 *	Copy arena pairs out, instead of
+			 *	pinning the arena to the new ctx.
+			 */
+			if (i->arena && !pair_ctx_is_arena(ctx)) {
+				VALUE_PAIR *copy;
+
+				copy = fr_pair_copy(ctx, i);
+				if (!copy) continue;
+				i = copy;
+			} else {
+				fr_pair_steal(ctx, i);
+			}
+
 			*tail_new = i;
-			fr_pair_steal(ctx, i);
 			tail_new = &(i->next);
 			continue;
 		}
@@ -1784,6 +1928,10 @@ static void fr_pair_list_move_by_num_internal(TALLOC_CTX *ctx, VALUE_PAIR **to,
 {
 	VALUE_PAIR *to_tail, *i, *next, *this;
 	VALUE_PAIR *iprev = NULL;
+	bool copy;
+
+	fr_pair_list_touch(to);
+	fr_pair_list_touch(from);
 
 	/*
 	 *	Find the last pair in the "to" list and put it in "to_tail".
@@ -1875,10 +2023,19 @@ static void fr_pair_list_move_by_num_internal(TALLOC_CTX *ctx, VALUE_PAIR **to,
 		else
 			*from = next;
 
-		if (move) {
+		/*
+		 *	Arena pairs are copied out, instead of
+		 *	pinning the arena to the new ctx.
+		 */
+		copy = !move || (i->arena && !pair_ctx_is_arena(ctx));
+		if (!copy) {
 			this = i;
 		} else {
 			this = fr_pair_copy(ctx, i);
+			if (!this) {
+				if (!move) talloc_free(i);
+				continue;
+			}
 		}
 
 		/*
@@ -1891,9 +2048,9 @@ static void fr_pair_list_move_by_num_internal(TALLOC_CTX *ctx, VALUE_PAIR **to,
 		to_tail = this;
 		this->next = NULL;
 
-		if (move) {
+		if (!copy) {
 			fr_pair_steal(ctx, i);
-		} else {
+		} else if (!i->arena) {
 			talloc_free(i);
 		}
 	}
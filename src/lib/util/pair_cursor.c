@@ -400,6 +400,26 @@ VALUE_PAIR *fr_pair_cursor_current(vp_cursor_t *cursor)
 	return cursor->current;
 }
 
+/** Position the cursor at a VALUE_PAIR found by other means
+ *
+ * The cursor is left in the same state as if vp had been returned by
+ * a fr_pair_cursor_next_by_* function, so that the next search starts
+ * from the VALUE_PAIR after vp.
+ *
+ * @param cursor to operate on.
+ * @param vp to set the current and found positions to.  Must be in the
+ *	list the cursor was initialised with.
+ * @return vp.
+ */
+VALUE_PAIR *fr_pair_cursor_seek(vp_cursor_t *cursor, VALUE_PAIR *vp)
+{
+	if (!cursor->first) return NULL;
+
+	if (vp) VERIFY_VP(vp);
+
+	return fr_pair_cursor_update(cursor, vp);
+}
+
 /** Insert a single VALUE_PAIR at the start of the list
  *
  * @note Will not advance cursor position to new attribute, but will set cursor
@@ -419,6 +439,8 @@ void fr_pair_cursor_prepend(vp_cursor_t *cursor, VALUE_PAIR *vp)
 	VERIFY_VP(vp);
 	VERIFY_LIST(*(cursor->first));
 
+	fr_pair_list_touch(cursor->first);
+
 	/*
 	 *	Only allow one VP to by inserted at a time
 	 */
@@ -478,6 +500,8 @@ void fr_pair_cursor_append(vp_cursor_t *cursor, VALUE_PAIR *vp)
 	VERIFY_VP(vp);
 	VERIFY_LIST(*(cursor->first));
 
+	fr_pair_list_touch(cursor->first);
+
 	/*
 	 *	Only allow one VP to by inserted at a time
 	 */
@@ -591,6 +615,8 @@ VALUE_PAIR *fr_pair_cursor_remove(vp_cursor_t *cursor)
 	vp = cursor->current;
 	if (!vp) return NULL;
 
+	fr_pair_list_touch(cursor->first);
+
 	/*
 	 *	Where VP is head of the list
 	 */
@@ -650,6 +676,8 @@ VALUE_PAIR *fr_pair_cursor_replace(vp_cursor_t *cursor, VALUE_PAIR *new)
 
 	if (!fr_cond_assert(cursor->first)) return NULL;	/* cursor must have been initialised */
 
+	fr_pair_list_touch(cursor->first);
+
 	vp = cursor->current;
 	if (!vp) {
 		*cursor->first = new;
@@ -690,6 +718,8 @@ void fr_pair_cursor_free(vp_cursor_t *cursor)
 
 	if (!*(cursor->first)) return;	/* noop */
 
+	fr_pair_list_touch(cursor->first);
+
 	/*
 	 *	Fast path if the cursor has been rewound to the start
 	 */
@@ -0,0 +1,302 @@
+/*
+ *   This program is is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License, version 2 of the
+ *   License as published by the Free Software Foundation.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA
+ */
+
+/**
+ * $Id$
+ *
+ * @file lib/util/pair_index.c
+ * @brief Indexes over lists of VALUE_PAIRs.
+ *
+ * An index maps a #fr_dict_attr_t and tag to the first matching
+ * #VALUE_PAIR in a list, so that repeated lookups don't have to walk
+ * the whole list.
+ *
+ * Indexes are built lazily, and are thrown away whenever the list is
+ * modified.  Modifications are tracked with #fr_cursor_list_touch,
+ * which the fr_pair_* and fr_cursor_* functions call.  Code which
+ * links or unlinks pairs by hand must call #fr_pair_list_touch.
+ *
+ * The generation of each list is kept in a #fr_cursor_list_watch_t
+ * owned by the request, and is only updated while that set is being
+ * watched.  So an index is only used while its set is watched, and is
+ * rebuilt every time watching starts again.
+ *
+ * @copyright 2017 The FreeRADIUS Server Project.
+ */
+RCSID("$Id$")
+
+#include <freeradius-devel/libradius.h>
+
+/*
+ *	Lists shorter than this are searched directly.  Walking a
+ *	handful of pairs is cheaper than hashing.
+ */
+#define PAIR_INDEX_MIN_PAIRS	(8)
+
+/*
+ *	Key for the first pair of an attribute, whatever its tag.
+ *	Tags are either TAG_ANY, or 0..31, so this can't collide.
+ */
+#define PAIR_INDEX_TAG_FIRST	(INT8_MAX)
+
+typedef struct {
+	fr_dict_attr_t const	*da;		//!< NULL if the slot is empty.
+	int8_t			tag;		//!< Tag, or PAIR_INDEX_TAG_FIRST.
+	VALUE_PAIR		*vp;		//!< First matching pair in the list.
+} pair_index_slot_t;
+
+struct fr_pair_index {
+	fr_cursor_list_watch_t	*watch;		//!< Set holding the generation of the list.
+	int			list;		//!< Which list in the set this index is for.
+
+	VALUE_PAIR		*first;		//!< *head when the index was built.
+	uint64_t		generation;	//!< Of the list when the index was built.
+	bool			valid;		//!< Whether the index has been built.
+	bool			small;		//!< List is too short to bother hashing.
+
+	uint64_t		stale_generation; //!< Generation we last searched the list at.
+
+	uint32_t		mask;		//!< Number of slots - 1.
+	pair_index_slot_t	*slots;
+};
+
+#ifdef WITH_PAIR_INDEX
+static bool pair_index_enabled = true;
+#else
+static bool pair_index_enabled = false;
+#endif
+
+/** Enable or disable list indexes
+ *
+ * Indexes are disabled by default, unless the server is built with
+ * WITH_PAIR_INDEX.  When they're disabled, #fr_pair_index_find
+ * searches the list directly, and list modifications aren't
+ * tracked.
+ *
+ * Should be called before any threads are started.
+ *
+ * @param[in] enable	list indexes.
+ */
+void fr_pair_index_enable(bool enable)
+{
+	pair_index_enabled = enable;
+}
+
+/** Return whether list indexes are enabled
+ *
+ */
+bool fr_pair_index_enabled(void)
+{
+	return pair_index_enabled;
+}
+
+/** Allocate an empty index
+ *
+ * The index isn't tied to a list head until the first lookup.
+ *
+ * @param[in] ctx	to allocate the index in.
+ * @param[in] watch	set which tracks modifications to the list.
+ * @param[in] list	slot in the set to use for the list.
+ * @return
+ *	- A new index.
+ *	- NULL on error.
+ */
+fr_pair_index_t *fr_pair_index_alloc(TALLOC_CTX *ctx, fr_cursor_list_watch_t *watch, int list)
+{
+	fr_pair_index_t *index;
+
+	if (!fr_cond_assert((list >= 0) && (list < FR_CURSOR_LIST_WATCH_MAX))) return NULL;
+
+	index = talloc_zero(ctx, fr_pair_index_t);
+	if (!index) return NULL;
+
+	index->watch = watch;
+	index->list = list;
+
+	return index;
+}
+
+static inline uint32_t pair_index_hash(fr_dict_attr_t const *da, int8_t tag)
+{
+	uint64_t key = (uint64_t) (uintptr_t) da;
+
+	key ^= (uint8_t) tag;
+	key *= UINT64_C(0x9e3779b97f4a7c15);
+
+	return (uint32_t) (key >> 32);
+}
+
+static inline pair_index_slot_t *pair_index_slot(fr_pair_index_t *index, fr_dict_attr_t const *da, int8_t tag)
+{
+	uint32_t i;
+
+	for (i = pair_index_hash(da, tag) & index->mask;
+	     index->slots[i].da;
+	     i = (i + 1) & index->mask) {
+		if ((index->slots[i].da == da) && (index->slots[i].tag == tag)) break;
+	}
+
+	return &index->slots[i];
+}
+
+static inline void pair_index_insert(fr_pair_index_t *index, VALUE_PAIR *vp, int8_t tag)
+{
+	pair_index_slot_t *slot;
+
+	slot = pair_index_slot(index, vp->da, tag);
+	if (slot->da) return;		/* keep the first one */
+
+	slot->da = vp->da;
+	slot->tag = tag;
+	slot->vp = vp;
+}
+
+/** (Re)build an index from the list
+ *
+ */
+static void pair_index_build(fr_pair_index_t *index, VALUE_PAIR * const *head, uint64_t generation)
+{
+	VALUE_PAIR	*vp;
+	uint32_t	num = 0, size;
+
+	index->first = *head;
+	index->generation = generation;
+	index->valid = true;
+
+	for (vp = *head; vp; vp = vp->next) {
+		VERIFY_VP(vp);
+		num += vp->da->flags.has_tag ? 2 : 1;
+	}
+
+	if (num < PAIR_INDEX_MIN_PAIRS) {
+		index->small = true;
+		return;
+	}
+
+	/*
+	 *	Keep the table at most half full.  It's never shrunk,
+	 *	as the same lists tend to be indexed over and over.
+	 */
+	for (size = 16; size < (num * 2); size <<= 1);
+
+	if (!index->slots || (size > (index->mask + 1))) {
+		talloc_free(index->slots);
+		index->slots = talloc_array(index, pair_index_slot_t, size);
+		if (!index->slots) {
+			index->mask = 0;
+			index->small = true;
+			return;
+		}
+		index->mask = size - 1;
+	}
+	memset(index->slots, 0, sizeof(index->slots[0]) * (index->mask + 1));
+	index->small = false;
+
+	for (vp = *head; vp; vp = vp->next) {
+		pair_index_insert(index, vp, PAIR_INDEX_TAG_FIRST);
+		if (vp->da->flags.has_tag) pair_index_insert(index, vp, vp->tag);
+	}
+}
+
+/** Find the first pair matching a da and tag, using an index
+ *
+ * Behaves the same as #fr_pair_find_by_da.  The index is rebuilt if
+ * the list has been modified since it was last built.  If the index's
+ * set of lists isn't being watched, the list is searched directly.
+ *
+ * A list which is modified between every lookup would be rebuilt on
+ * every lookup, which is slower than searching it.  So the first
+ * lookup after a modification searches the list, and only the second
+ * one rebuilds the index.
+ *
+ * @param[in] index	to use.
+ * @param[in] head	of the list.  May differ between calls, in which
+ *			case the index is rebuilt for the new list.
+ * @param[in] da	to find.
+ * @param[in] tag	to match. Either a tag number or TAG_ANY to match any
+ *			tagged or untagged attribute, TAG_NONE to match
+ *			attributes without tags.
+ * @return
+ *	- The first matching #VALUE_PAIR.
+ *	- NULL if no #VALUE_PAIR matched.
+ */
+VALUE_PAIR *fr_pair_index_find(fr_pair_index_t *index, VALUE_PAIR * const *head,
+			       fr_dict_attr_t const *da, int8_t tag)
+{
+	fr_cursor_list_watch_t	*watch;
+	uint64_t		generation;
+	pair_index_slot_t	*slot;
+	VALUE_PAIR		*vp;
+
+	if (!pair_index_enabled || !index || !fr_cursor_list_watched(index->watch)) {
+		return fr_pair_find_by_da(*head, da, tag);
+	}
+
+	/*
+	 *	A different list, e.g. the packet was replaced.  Nothing
+	 *	done to it so far was tracked, so start again.
+	 */
+	watch = index->watch;
+	if (watch->head[index->list] != (void * const *) head) {
+		watch->head[index->list] = (void * const *) head;
+		watch->generation[index->list]++;
+	}
+	generation = watch->generation[index->list];
+
+	if (!index->valid || (index->first != *head) || (index->generation != generation)) {
+		if (index->stale_generation != generation) {
+			index->stale_generation = generation;
+			return fr_pair_find_by_da(*head, da, tag);
+		}
+
+		pair_index_build(index, head, generation);
+	}
+
+	if (index->small) return fr_pair_find_by_da(*head, da, tag);
+
+	if (!da->flags.has_tag || (tag == TAG_ANY)) {
+		vp = pair_index_slot(index, da, PAIR_INDEX_TAG_FIRST)->vp;
+
+	/*
+	 *	TAG_NONE matches untagged pairs, and ones with TAG_ANY,
+	 *	so there's no single key for it.  Start from the first
+	 *	instance of the attribute, and walk forward.
+	 */
+	} else if (tag == TAG_NONE) {
+		slot = pair_index_slot(index, da, PAIR_INDEX_TAG_FIRST);
+
+		for (vp = slot->vp; vp; vp = vp->next) {
+			if ((vp->da == da) && TAG_EQ(tag, vp->tag)) break;
+		}
+
+	} else {
+		vp = pair_index_slot(index, da, tag)->vp;
+	}
+
+#ifdef WITH_VERIFY_PTR
+	/*
+	 *	Something modified the list without touching it.  The
+	 *	pair we found may have been freed, so don't look at it.
+	 */
+	if (!fr_cond_assert(vp == fr_pair_find_by_da(*head, da, tag))) {
+		index->valid = false;
+		return fr_pair_find_by_da(*head, da, tag);
+	}
+#endif
+
+	if (vp) VERIFY_VP(vp);
+
+	return vp;
+}
@@ -40,13 +40,27 @@ RCSID("$Id$")
 #endif
 #endif
 
+/** A node in a client prefix trie
+ *
+ * The trie is path compressed, so nodes only exist where a client was added,
+ * or where the prefixes of two clients diverge.
+ */
+typedef struct client_node client_node_t;
+struct client_node {
+	client_node_t	*child[2];		//!< Longer prefixes, by the value of the next bit.
+	uint8_t		key[16];		//!< Address, masked to prefix bits.
+	uint8_t		prefix;			//!< Number of significant bits in key.
+	int		num_clients;		//!< Usually one, more for clients which differ by proto.
+	RADCLIENT	**clients;		//!< Clients with exactly this prefix.
+};
+
 /** Group of clients
  *
  */
 struct radclient_list {
 	char const	*name;			//!< Name of the client list.
-	rbtree_t	*trees[129];		//!< For 0..128, inclusive.
-	uint32_t       	min_prefix;
+	client_node_t	*tree_v4;		//!< Prefix trie of IPv4 clients.
+	client_node_t	*tree_v6;		//!< Prefix trie of IPv6 clients.
 };
 
 #ifdef WITH_STATS
@@ -133,6 +147,241 @@ static int client_ipaddr_cmp(void const *one, void const *two)
 #endif
 }
 
+/** Get the root of the prefix trie for an address family
+ *
+ */
+static client_node_t **client_trie_root(RADCLIENT_LIST *clients, fr_ipaddr_t const *ipaddr, uint8_t *key,
+					 int *max_prefix)
+{
+	switch (ipaddr->af) {
+	case AF_INET:
+		memcpy(key, &ipaddr->addr.v4.s_addr, 4);
+		*max_prefix = 32;
+		return &clients->tree_v4;
+
+	case AF_INET6:
+		memcpy(key, ipaddr->addr.v6.s6_addr, 16);
+		*max_prefix = 128;
+		return &clients->tree_v6;
+
+	default:
+		return NULL;
+	}
+}
+
+/** Return the value of a bit in a key
+ *
+ */
+static inline int client_key_bit(uint8_t const *key, int bit)
+{
+	return (key[bit >> 3] >> (7 - (bit & 7))) & 0x01;
+}
+
+/** Return how many leading bits two keys have in common, up to max
+ *
+ */
+static int client_key_common(uint8_t const *a, uint8_t const *b, int max)
+{
+	int i;
+
+	for (i = 0; i < max; i += 8) {
+		uint8_t diff = a[i >> 3] ^ b[i >> 3];
+
+		if (!diff) continue;
+
+		while ((diff & 0x80) == 0) {
+			diff <<= 1;
+			i++;
+		}
+		return (i < max) ? i : max;
+	}
+
+	return max;
+}
+
+/** Check whether the node's prefix matches a key
+ *
+ */
+static inline bool client_node_match(client_node_t const *node, uint8_t const *key)
+{
+	int bytes = node->prefix >> 3;
+	int bits = node->prefix & 0x07;
+
+	if (memcmp(node->key, key, bytes) != 0) return false;
+
+	if (!bits) return true;
+
+	return ((node->key[bytes] ^ key[bytes]) & (uint8_t) (0xff << (8 - bits))) == 0;
+}
+
+/** Allocate a trie node, and mask the key to the prefix length
+ *
+ */
+static client_node_t *client_node_alloc(RADCLIENT_LIST *clients, uint8_t const *key, int prefix)
+{
+	client_node_t *node;
+
+	node = talloc_zero(clients, client_node_t);
+	if (!node) return NULL;
+
+	memcpy(node->key, key, (prefix + 7) >> 3);
+	if (prefix & 0x07) node->key[prefix >> 3] &= (uint8_t) (0xff << (8 - (prefix & 0x07)));
+	node->prefix = prefix;
+
+	return node;
+}
+
+/** Find the node for an exact prefix
+ *
+ * @param[in] clients	list to search.
+ * @param[in] ipaddr	prefix to find.
+ * @param[out] parent	where the pointer to the node is stored.
+ * @param[out] grandparent	where the pointer to the node's parent is stored.
+ * @return the node, or NULL if there is no node for the prefix.
+ */
+static client_node_t *client_trie_find_exact(RADCLIENT_LIST *clients, fr_ipaddr_t const *ipaddr,
+					      client_node_t ***parent, client_node_t ***grandparent)
+{
+	int		max_prefix;
+	uint8_t		key[16];
+	client_node_t	**p, **pp = NULL, *node;
+
+	p = client_trie_root(clients, ipaddr, key, &max_prefix);
+	if (!p) return NULL;
+
+	while ((node = *p) != NULL) {
+		if ((node->prefix > ipaddr->prefix) || !client_node_match(node, key)) return NULL;
+
+		if (node->prefix == ipaddr->prefix) {
+			if (parent) *parent = p;
+			if (grandparent) *grandparent = pp;
+			return node;
+		}
+
+		pp = p;
+		p = &node->child[client_key_bit(key, node->prefix)];
+	}
+
+	return NULL;
+}
+
+/** Add a client to the prefix trie
+ *
+ * @return
+ *	- 0 on success.
+ *	- -1 on failure (OOM).
+ */
+static int client_trie_insert(RADCLIENT_LIST *clients, RADCLIENT *client)
+{
+	int		max_prefix, prefix = client->ipaddr.prefix;
+	uint8_t		key[16];
+	client_node_t	**p, *node, *new;
+	RADCLIENT	**array;
+
+	p = client_trie_root(clients, &client->ipaddr, key, &max_prefix);
+	if (!p || (prefix > max_prefix)) return -1;
+
+	while ((node = *p) != NULL) {
+		int common;
+
+		common = client_key_common(node->key, key, (node->prefix < prefix) ? node->prefix : prefix);
+
+		/*
+		 *	The node is a prefix of the client, or is the
+		 *	same prefix.
+		 */
+		if (common == node->prefix) {
+			if (node->prefix == prefix) goto add;
+
+			p = &node->child[client_key_bit(key, node->prefix)];
+			continue;
+		}
+
+		/*
+		 *	The client is a prefix of the node.  Insert a
+		 *	new node above it.
+		 */
+		if (common == prefix) {
+			new = client_node_alloc(clients, key, prefix);
+			if (!new) return -1;
+
+			new->child[client_key_bit(node->key, prefix)] = node;
+			*p = new;
+			node = new;
+			goto add;
+		}
+
+		/*
+		 *	The prefixes diverge.  Add a branch node where
+		 *	they do, with the old node and the client as
+		 *	children.
+		 */
+		new = client_node_alloc(clients, key, common);
+		if (!new) return -1;
+
+		new->child[client_key_bit(node->key, common)] = node;
+		*p = new;
+		p = &new->child[client_key_bit(key, common)];
+		break;
+	}
+
+	node = client_node_alloc(clients, key, prefix);
+	if (!node) return -1;
+	*p = node;
+
+add:
+	array = talloc_realloc(node, node->clients, RADCLIENT *, node->num_clients + 1);
+	if (!array) return -1;
+
+	array[node->num_clients++] = client;
+	node->clients = array;
+
+	return 0;
+}
+
+#ifdef WITH_DYNAMIC_CLIENTS
+/** Remove a client from the prefix trie
+ *
+ * Nodes which are left with no clients, and fewer than two children, are
+ * removed, so the trie stays compressed.
+ */
+static void client_trie_delete(RADCLIENT_LIST *clients, RADCLIENT *client)
+{
+	int		i;
+	client_node_t	**p, **pp, *node, *parent;
+
+	node = client_trie_find_exact(clients, &client->ipaddr, &p, &pp);
+	if (!node) return;
+
+	for (i = 0; i < node->num_clients; i++) {
+		if (node->clients[i] == client) break;
+	}
+	if (i == node->num_clients) return;
+
+	memmove(&node->clients[i], &node->clients[i + 1], sizeof(node->clients[0]) * (node->num_clients - i - 1));
+	node->num_clients--;
+	if (node->num_clients > 0) return;
+
+	TALLOC_FREE(node->clients);
+	if (node->child[0] && node->child[1]) return;
+
+	*p = node->child[0] ? node->child[0] : node->child[1];
+	talloc_free(node);
+
+	/*
+	 *	The parent may now be a branch node with only
+	 *	one child.
+	 */
+	if (!pp) return;
+
+	parent = *pp;
+	if (parent->num_clients || (parent->child[0] && parent->child[1])) return;
+
+	*pp = parent->child[0] ? parent->child[0] : parent->child[1];
+	talloc_free(parent);
+}
+#endif
+
 #ifdef WITH_STATS
 /** Compare clients by number
  *
@@ -161,7 +410,6 @@ RADCLIENT_LIST *client_list_init(CONF_SECTION *cs)
 	if (!clients) return NULL;
 
 	clients->name = talloc_strdup(clients, cs ? cf_section_name1(cs) : "root");
-	clients->min_prefix = 128;
 
 	return clients;
 }
@@ -177,6 +425,7 @@ RADCLIENT_LIST *client_list_init(CONF_SECTION *cs)
 bool client_add(RADCLIENT_LIST *clients, RADCLIENT *client)
 {
 	RADCLIENT *old;
+	client_node_t *node;
 	char buffer[FR_IPADDR_PREFIX_STRLEN];
 
 	if (!client) return false;
@@ -264,22 +513,24 @@ bool client_add(RADCLIENT_LIST *clients, RADCLIENT *client)
 		}
 	}
 
-	/*
-	 *	Create a tree for it.
-	 */
-	if (!clients->trees[client->ipaddr.prefix]) {
-		clients->trees[client->ipaddr.prefix] = rbtree_create(clients, client_ipaddr_cmp, NULL, 0);
-		if (!clients->trees[client->ipaddr.prefix]) {
-			return false;
-		}
-	}
-
 #define namecmp(a) ((!old->a && !client->a) || (old->a && client->a && (strcmp(old->a, client->a) == 0)))
 
 	/*
 	 *	Cannot insert the same client twice.
 	 */
-	old = rbtree_finddata(clients->trees[client->ipaddr.prefix], client);
+	old = NULL;
+	node = client_trie_find_exact(clients, &client->ipaddr, NULL, NULL);
+	if (node) {
+		int i;
+
+		for (i = 0; i < node->num_clients; i++) {
+			if (client_ipaddr_cmp(node->clients[i], client) == 0) {
+				old = node->clients[i];
+				break;
+			}
+		}
+	}
+
 	if (old) {
 		/*
 		 *	If it's a complete duplicate, then free the new
@@ -313,7 +564,7 @@ bool client_add(RADCLIENT_LIST *clients, RADCLIENT *client)
 	/*
 	 *	Other error adding client: likely is fatal.
 	 */
-	if (!rbtree_insert(clients->trees[client->ipaddr.prefix], client)) {
+	if (client_trie_insert(clients, client) < 0) {
 		return false;
 	}
 
@@ -349,10 +600,6 @@ bool client_add(RADCLIENT_LIST *clients, RADCLIENT *client)
 	if (tree_num) rbtree_insert(tree_num, client);
 #endif
 
-	if (client->ipaddr.prefix < clients->min_prefix) {
-		clients->min_prefix = client->ipaddr.prefix;
-	}
-
 	(void) talloc_steal(clients, client); /* reparent it */
 
 	return true;
@@ -375,7 +622,7 @@ void client_delete(RADCLIENT_LIST *clients, RADCLIENT *client)
 #ifdef WITH_STATS
 	rbtree_deletebydata(tree_num, client);
 #endif
-	rbtree_deletebydata(clients->trees[client->ipaddr.prefix], client);
+	client_trie_delete(clients, client);
 }
 #endif
 
@@ -415,37 +662,46 @@ RADCLIENT *client_findbynumber(UNUSED const RADCLIENT_LIST *clients, UNUSED int
  */
 RADCLIENT *client_find(RADCLIENT_LIST const *clients, fr_ipaddr_t const *ipaddr, int proto)
 {
-	int32_t i, max_prefix;
-	RADCLIENT myclient;
+	int		i, max_prefix, num_found = 0;
+	uint8_t		key[16];
+	client_node_t	**root, *node, *found[129];
+	RADCLIENT	myclient;
+	RADCLIENT_LIST	*list;
 
 	if (!clients) clients = root_clients;
 
 	if (!clients || !ipaddr) return NULL;
 
-	switch (ipaddr->af) {
-	case AF_INET:
-		max_prefix = 32;
-		break;
+	memcpy(&list, &clients, sizeof(list));
+	root = client_trie_root(list, ipaddr, key, &max_prefix);
+	if (!root) return NULL;
 
-	case AF_INET6:
-		max_prefix = 128;
-		break;
+	/*
+	 *	Walk down the trie once, remembering every prefix
+	 *	which matches the address.
+	 */
+	for (node = *root; node != NULL; node = node->child[client_key_bit(key, node->prefix)]) {
+		if (!client_node_match(node, key)) break;
 
-	default :
-		return NULL;
-	}
+		if (node->num_clients) found[num_found++] = node;
 
-	for (i = max_prefix; i >= (int32_t) clients->min_prefix; i--) {
-		void *data;
+		if (node->prefix == max_prefix) break;
+	}
 
-		if (!clients->trees[i]) continue;
+	/*
+	 *	Then check them longest first.  The address matches,
+	 *	but the IPv6 scope, or the protocol may not.
+	 */
+	while (num_found > 0) {
+		node = found[--num_found];
 
 		myclient.ipaddr = *ipaddr;
 		myclient.proto = proto;
-		fr_ipaddr_mask(&myclient.ipaddr, i);
+		fr_ipaddr_mask(&myclient.ipaddr, node->prefix);
 
-		data = rbtree_finddata(clients->trees[i], &myclient);
-		if (data) return data;
+		for (i = 0; i < node->num_clients; i++) {
+			if (client_ipaddr_cmp(&myclient, node->clients[i]) == 0) return node->clients[i];
+		}
 	}
 
 	return NULL;
@@ -1273,6 +1273,20 @@ static int command_show_version(rad_listen_t *listener, UNUSED int argc, UNUSED
 	return CMD_OK;
 }
 
+#ifdef HAVE_REGEX
+static int command_show_regex_cache(rad_listen_t *listener, UNUSED int argc, UNUSED char *argv[])
+{
+	uint64_t hits, misses;
+
+	regex_cache_stats(&hits, &misses);
+
+	cprintf(listener, "hits\t\t%" PRIu64 "\n", hits);
+	cprintf(listener, "misses\t\t%" PRIu64 "\n", misses);
+
+	return CMD_OK;
+}
+#endif
+
 static int command_debug_level_global(rad_listen_t *listener, int argc, char *argv[])
 {
 	int number;
@@ -2459,6 +2473,12 @@ static fr_command_table_t command_table_show[] = {
 	  NULL, command_table_show_profiler },
 #endif
 
+#ifdef HAVE_REGEX
+	{ "regex-cache", FR_READ,
+	  "show regex-cache - show hits and misses of the runtime regex cache",
+	  command_show_regex_cache, NULL },
+#endif
+
 	{ "uptime", FR_READ,
 	  "show uptime - shows time at which server started",
 	  command_uptime, NULL },
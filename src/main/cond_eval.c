@@ -166,7 +166,7 @@ static int cond_do_regex(REQUEST *request, fr_cond_t const *c,
 	ssize_t		slen;
 	int		ret;
 
-	regex_t		*preg, *rreg = NULL;
+	regex_t		*preg;
 	regmatch_t	rxmatch[REQUEST_MAX_REGEX + 1];	/* +1 for %{0} (whole match) capture group */
 	size_t		nmatch = sizeof(rxmatch) / sizeof(regmatch_t);
 
@@ -185,15 +185,14 @@ static int cond_do_regex(REQUEST *request, fr_cond_t const *c,
 	default:
 		if (!rad_cond_assert(rhs && rhs->type == FR_TYPE_STRING)) return -1;
 		if (!rad_cond_assert(rhs && rhs->datum.strvalue)) return -1;
-		slen = regex_compile(request, &rreg, rhs->datum.strvalue, rhs->datum.length,
-				     map->rhs->tmpl_iflag, map->rhs->tmpl_mflag, true, true);
+		slen = regex_cache_compile(request, &preg, rhs->datum.strvalue, rhs->datum.length,
+					   map->rhs->tmpl_iflag, map->rhs->tmpl_mflag);
 		if (slen <= 0) {
 			REMARKER(rhs->datum.strvalue, -slen, fr_strerror());
 			EVAL_DEBUG("FAIL %d", __LINE__);
 
 			return -1;
 		}
-		preg = rreg;
 		break;
 	}
 
@@ -218,8 +217,6 @@ static int cond_do_regex(REQUEST *request, fr_cond_t const *c,
 		break;
 	}
 
-	if (preg) talloc_free(rreg);
-
 	return ret;
 }
 #endif
@@ -1052,6 +1049,7 @@ void radius_pairmove(REQUEST *request, VALUE_PAIR **to, VALUE_PAIR *from, bool d
 	 *	the tail of the "to" list.
 	 */
 	*last = append;
+	fr_pair_list_touch(to);
 
 	/*
 	 *	Fix dumb cache issues
@@ -20,6 +20,14 @@
  * @note This API must be used by all modules in the public distribution that
  * maintain pools of connections.
  *
+ * If thread_cache is enabled, each thread keeps a small cache of connections
+ * it has released.  A thread which releases a connection "parks" it in its
+ * cache, and takes it back on its next reservation from the same pool,
+ * without locking the pool.  Parked connections still count as reserved.
+ * The pool takes them back when it has no free connections, when they've
+ * been parked for more than a second, or when the pool is reconnected or
+ * freed.
+ *
  * @copyright 2012  The FreeRADIUS server project
  * @copyright 2012  Alan DeKok <aland@deployingradius.com>
  */
@@ -33,7 +41,21 @@ RCSID("$Id$")
 #include <freeradius-devel/modpriv.h>
 #include <freeradius-devel/rad_assert.h>
 
+#ifdef HAVE_STDATOMIC_H
+#  include <stdatomic.h>
+#else
+#  include <freeradius-devel/stdatomic.h>
+#endif
+
+/*
+ *	Number of pools each thread caches a connection for.  Must be a
+ *	power of two.
+ */
+#define CONNECTION_THREAD_CACHE_SLOTS	(16)
+
 typedef struct fr_connection fr_connection_t;
+typedef struct fr_connection_cache_slot fr_connection_cache_slot_t;
+typedef struct fr_connection_thread_cache fr_connection_thread_cache_t;
 
 static int fr_connection_pool_check(fr_connection_pool_t *pool, REQUEST *request);
 
@@ -65,6 +87,9 @@ struct fr_connection {
 
 	bool		needs_reconnecting;	//!< Reconnect this connection before use.
 
+	_Atomic(fr_connection_cache_slot_t *) parked_in;	//!< Thread cache slot the connection was
+						//!< last parked in, or NULL.
+
 #ifdef PTHREAD_DEBUG
 	pthread_t	pthread_id;		//!< When 'in_use == true'.
 #endif
@@ -105,8 +130,10 @@ struct fr_connection_pool_t {
 
 	bool		spread;			//!< If true we spread requests over the connections,
 						//!< using the connection released longest ago, first.
+	bool		thread_cache;		//!< Whether threads may park released connections.
 
 	fr_heap_t	*heap;			//!< For the next connection heap
+	fr_hash_table_t	*connections;		//!< Maps connection handles to connections.
 
 	fr_connection_t	*head;			//!< Start of the connection list.
 	fr_connection_t	*tail;			//!< End of the connection list.
@@ -141,6 +168,41 @@ struct fr_connection_pool_t {
 	fr_connection_pool_state_t	state;	//!< Stats and state of the connection pool.
 };
 
+/** A per-thread cache of connections for one pool
+ *
+ * Only the owning thread writes conn and this.  pool is only changed with
+ * connection_thread_cache_mutex held, and parked may be taken by other
+ * threads, but only with the pool mutex held.
+ */
+struct fr_connection_cache_slot {
+	_Atomic(fr_connection_pool_t *)	pool;		//!< Pool the slot is being used for.
+	_Atomic(fr_connection_t *)	parked;		//!< Connection released by this thread.
+	void				*conn;		//!< Handle of the connection last reserved by
+							//!< this thread.
+	fr_connection_t			*this;		//!< Connection last reserved by this thread.
+};
+
+/** A thread's connection cache
+ *
+ * All of the caches are on a list, so that pools which are being freed
+ * can remove themselves from every thread's slots.
+ */
+struct fr_connection_thread_cache {
+	fr_connection_thread_cache_t	*prev;		//!< Previous cache in the list.
+	fr_connection_thread_cache_t	*next;		//!< Next cache in the list.
+	fr_connection_cache_slot_t	slot[CONNECTION_THREAD_CACHE_SLOTS];
+};
+
+/*
+ *	Protects the list of caches, and the pool of every slot.  A
+ *	pool can't be freed while a slot which points to it is being
+ *	changed.
+ */
+static pthread_mutex_t connection_thread_cache_mutex = PTHREAD_MUTEX_INITIALIZER;
+static fr_connection_thread_cache_t *connection_thread_cache_head = NULL;
+
+fr_thread_local_setup(fr_connection_thread_cache_t *, connection_thread_cache)	/* macro */
+
 static const CONF_PARSER connection_config[] = {
 	{ FR_CONF_OFFSET("start", FR_TYPE_UINT32, fr_connection_pool_t, start), .dflt = "5" },
 	{ FR_CONF_OFFSET("min", FR_TYPE_UINT32, fr_connection_pool_t, min), .dflt = "5" },
@@ -157,6 +219,7 @@ static const CONF_PARSER connection_config[] = {
 	{ FR_CONF_OFFSET("held_trigger_max", FR_TYPE_TIMEVAL, fr_connection_pool_t, held_trigger_max), .dflt = "0.5" },
 	{ FR_CONF_OFFSET("retry_delay", FR_TYPE_UINT32, fr_connection_pool_t, retry_delay), .dflt = "1" },
 	{ FR_CONF_OFFSET("spread", FR_TYPE_BOOL, fr_connection_pool_t, spread), .dflt = "no" },
+	{ FR_CONF_OFFSET("thread_cache", FR_TYPE_BOOL, fr_connection_pool_t, thread_cache), .dflt = "no" },
 	CONF_PARSER_TERMINATOR
 };
 
@@ -192,6 +255,28 @@ static int last_released_cmp(void const *one, void const *two)
 	return 0;
 }
 
+/** Hash a connection by its handle
+ */
+static uint32_t connection_hash(void const *data)
+{
+	fr_connection_t const *this = data;
+
+	return fr_hash(&this->connection, sizeof(this->connection));
+}
+
+/** Compare two connections by their handles
+ */
+static int connection_cmp(void const *one, void const *two)
+{
+	fr_connection_t const *a = one;
+	fr_connection_t const *b = two;
+
+	if (a->connection < b->connection) return -1;
+	if (a->connection > b->connection) return +1;
+
+	return 0;
+}
+
 /** Removes a connection from the connection list
  *
  * @note Must be called with the mutex held.
@@ -267,10 +352,337 @@ static inline void fr_connection_trigger_exec(fr_connection_pool_t *pool, REQUES
 	trigger_exec(request, pool->cs, name, true, pool->trigger_args);
 }
 
+/** Return a parked connection to the pool
+ *
+ * @note Must be called with the mutex held.
+ *
+ * @param[in] pool	the connection belongs to.
+ * @param[in] this	Connection, which must no longer be parked in a slot.
+ */
+static void fr_connection_unpark(fr_connection_pool_t *pool, fr_connection_t *this)
+{
+	rad_assert(this->in_use);
+
+	atomic_store_explicit(&this->parked_in, NULL, memory_order_relaxed);
+
+	this->in_use = false;
+	fr_heap_insert(pool->heap, this);
+
+	rad_assert(pool->state.active != 0);
+	pool->state.active--;
+}
+
+/** Free a thread's connection cache
+ *
+ * Returns any connections the thread parked to their pools.
+ *
+ * @param[in] arg	the thread's cache.
+ */
+static void _connection_thread_cache_free(void *arg)
+{
+	fr_connection_thread_cache_t	*cache = arg;
+	int				i;
+
+	pthread_mutex_lock(&connection_thread_cache_mutex);
+
+	if (cache->prev) {
+		cache->prev->next = cache->next;
+	} else {
+		connection_thread_cache_head = cache->next;
+	}
+	if (cache->next) cache->next->prev = cache->prev;
+
+	for (i = 0; i < CONNECTION_THREAD_CACHE_SLOTS; i++) {
+		fr_connection_pool_t	*pool;
+		fr_connection_t		*this;
+
+		pool = atomic_load_explicit(&cache->slot[i].pool, memory_order_relaxed);
+		if (!pool) continue;
+
+		this = atomic_exchange_explicit(&cache->slot[i].parked, NULL, memory_order_acquire);
+		if (!this) continue;
+
+		pthread_mutex_lock(&pool->mutex);
+		fr_connection_unpark(pool, this);
+		pthread_mutex_unlock(&pool->mutex);
+	}
+
+	pthread_mutex_unlock(&connection_thread_cache_mutex);
+
+	talloc_free(cache);
+}
+
+/** Remove a pool from every thread's cache
+ *
+ * Takes back the connections threads have parked, so that no thread is
+ * left with a pointer to the pool, or to its connections.
+ *
+ * @note Must be called with the mutex free.
+ *
+ * @param[in] pool	which is being freed.
+ */
+static void connection_thread_cache_flush(fr_connection_pool_t *pool)
+{
+	fr_connection_thread_cache_t	*cache;
+	int				i;
+
+	pthread_mutex_lock(&connection_thread_cache_mutex);
+	pthread_mutex_lock(&pool->mutex);
+
+	for (cache = connection_thread_cache_head; cache; cache = cache->next) {
+		for (i = 0; i < CONNECTION_THREAD_CACHE_SLOTS; i++) {
+			fr_connection_cache_slot_t	*slot = &cache->slot[i];
+			fr_connection_t			*this;
+
+			if (atomic_load_explicit(&slot->pool, memory_order_relaxed) != pool) continue;
+
+			this = atomic_exchange_explicit(&slot->parked, NULL, memory_order_acquire);
+			if (this) fr_connection_unpark(pool, this);
+
+			atomic_store_explicit(&slot->pool, NULL, memory_order_relaxed);
+		}
+	}
+
+	pthread_mutex_unlock(&pool->mutex);
+	pthread_mutex_unlock(&connection_thread_cache_mutex);
+}
+
+/** Find this thread's cache slot for a pool
+ *
+ * @param[in] pool	to find the slot for.
+ * @return
+ *	- The slot.  It may currently be used by a different pool.
+ *	- NULL if the cache couldn't be allocated.
+ */
+static inline fr_connection_cache_slot_t *connection_thread_slot(fr_connection_pool_t *pool)
+{
+	fr_connection_thread_cache_t *cache;
+
+	cache = connection_thread_cache;
+	if (!cache) {
+		cache = talloc_zero(NULL, fr_connection_thread_cache_t);
+		if (!cache) return NULL;
+
+		pthread_mutex_lock(&connection_thread_cache_mutex);
+		cache->next = connection_thread_cache_head;
+		if (cache->next) cache->next->prev = cache;
+		connection_thread_cache_head = cache;
+		pthread_mutex_unlock(&connection_thread_cache_mutex);
+
+		fr_thread_local_set_destructor(connection_thread_cache, _connection_thread_cache_free, cache);
+	}
+
+	return &cache->slot[fr_hash(&pool, sizeof(pool)) & (CONNECTION_THREAD_CACHE_SLOTS - 1)];
+}
+
+/** Take a connection back from the thread which parked it
+ *
+ * The owning thread takes parked connections with an atomic exchange,
+ * so whichever of us gets there first owns the connection.
+ *
+ * @note Must be called with the mutex held.
+ *
+ * @param[in] this	Connection to take back.
+ * @return
+ *	- true if the connection was parked, and now belongs to the caller.
+ *	- false if the connection wasn't parked.
+ */
+static bool fr_connection_steal(fr_connection_t *this)
+{
+	fr_connection_cache_slot_t	*slot;
+	fr_connection_t			*expected = this;
+
+	if (!this->in_use) return false;
+
+	slot = atomic_load_explicit(&this->parked_in, memory_order_acquire);
+	if (!slot) return false;
+
+	if (!atomic_compare_exchange_strong_explicit(&slot->parked, &expected, NULL,
+						     memory_order_acquire, memory_order_relaxed)) return false;
+
+	return true;
+}
+
+/** Take back all connections parked by threads
+ *
+ * @note Must be called with the mutex held.
+ *
+ * @param[in] pool	to take connections back for.
+ */
+static void fr_connection_steal_all(fr_connection_pool_t *pool)
+{
+	fr_connection_t *this;
+
+	for (this = pool->head; this; this = this->next) {
+		if (fr_connection_steal(this)) fr_connection_unpark(pool, this);
+	}
+}
+
+/** Record the connection this thread just reserved
+ *
+ * Allows the connection to be released without searching for it, and
+ * claims the slot for the pool if another pool was using it.
+ *
+ * @note Must be called with the mutex free.
+ *
+ * @param[in] pool	the connection was reserved from.
+ * @param[in] this	Connection which was reserved.
+ */
+static void connection_thread_cache_reserved(fr_connection_pool_t *pool, fr_connection_t *this)
+{
+	fr_connection_cache_slot_t *slot;
+
+	slot = connection_thread_slot(pool);
+	if (!slot) return;
+
+	if (atomic_load_explicit(&slot->pool, memory_order_relaxed) != pool) {
+		fr_connection_pool_t	*old;
+		fr_connection_t		*parked;
+
+		/*
+		 *	The old pool can't be freed until we're done
+		 *	with it.
+		 */
+		pthread_mutex_lock(&connection_thread_cache_mutex);
+
+		old = atomic_load_explicit(&slot->pool, memory_order_relaxed);
+		parked = atomic_exchange_explicit(&slot->parked, NULL, memory_order_acquire);
+		if (parked) {
+			pthread_mutex_lock(&old->mutex);
+			fr_connection_unpark(old, parked);
+			pthread_mutex_unlock(&old->mutex);
+		}
+
+		atomic_store_explicit(&slot->pool, pool, memory_order_relaxed);
+
+		pthread_mutex_unlock(&connection_thread_cache_mutex);
+	}
+
+	slot->conn = this->connection;
+	slot->this = this;
+}
+
+/** Forget a connection this thread reserved
+ *
+ * @param[in] pool	the connection was reserved from.
+ * @param[in] conn	handle of the connection.
+ */
+static inline void connection_thread_cache_forget(fr_connection_pool_t *pool, void *conn)
+{
+	fr_connection_cache_slot_t *slot;
+
+	if (!connection_thread_cache) return;
+
+	slot = connection_thread_slot(pool);
+	if ((atomic_load_explicit(&slot->pool, memory_order_relaxed) != pool) || (slot->conn != conn)) return;
+
+	slot->conn = NULL;
+	slot->this = NULL;
+}
+
+/** Reserve the connection this thread parked, without locking the pool
+ *
+ * @param[in] pool	to reserve the connection from.
+ * @param[in] request	The current request.
+ * @return
+ *	- The parked connection.
+ *	- NULL if no connection was parked, or it needs closing.
+ */
+static fr_connection_t *connection_thread_cache_get(fr_connection_pool_t *pool, REQUEST *request)
+{
+	fr_connection_cache_slot_t	*slot;
+	fr_connection_t			*this;
+
+	slot = connection_thread_slot(pool);
+	if (!slot || (atomic_load_explicit(&slot->pool, memory_order_relaxed) != pool)) return NULL;
+
+	this = atomic_exchange_explicit(&slot->parked, NULL, memory_order_acquire);
+	if (!this) return NULL;
+
+	atomic_store_explicit(&this->parked_in, NULL, memory_order_relaxed);
+
+	gettimeofday(&this->last_reserved, NULL);
+
+	/*
+	 *	Let the pool close connections which have hit their
+	 *	limits.
+	 */
+	if (this->needs_reconnecting ||
+	    ((pool->max_uses > 0) && (this->num_uses >= pool->max_uses)) ||
+	    ((pool->lifetime > 0) && ((this->created + pool->lifetime) < this->last_reserved.tv_sec))) {
+		pthread_mutex_lock(&pool->mutex);
+		fr_connection_unpark(pool, this);
+		pthread_mutex_unlock(&pool->mutex);
+
+		return NULL;
+	}
+
+	this->num_uses++;
+#ifdef PTHREAD_DEBUG
+	this->pthread_id = pthread_self();
+#endif
+
+	slot->conn = this->connection;
+	slot->this = this;
+
+	ROPTIONAL(RDEBUG2, DEBUG2, "Reserved connection (%" PRIu64 ")", this->number);
+
+	return this;
+}
+
+/** Park a connection in this thread's cache, without locking the pool
+ *
+ * Only the connection this thread reserved last can be parked, and only
+ * if nothing else is parked.  Connections which were held for long enough
+ * (or short enough) to fire a trigger are released to the pool instead.
+ *
+ * @param[in] pool	to release the connection in.
+ * @param[in] request	The current request.
+ * @param[in] conn	to release.
+ * @return
+ *	- true if the connection was parked.
+ *	- false if it must be released to the pool.
+ */
+static bool connection_thread_cache_release(fr_connection_pool_t *pool, REQUEST *request, void *conn)
+{
+	fr_connection_cache_slot_t	*slot;
+	fr_connection_t			*this;
+	struct timeval			now, held;
+
+	if (!conn) return false;
+
+	slot = connection_thread_slot(pool);
+	if (!slot || (atomic_load_explicit(&slot->pool, memory_order_relaxed) != pool) ||
+	    (slot->conn != conn)) return false;
+
+	this = slot->this;
+	slot->conn = NULL;
+	slot->this = NULL;
+
+	if (atomic_load_explicit(&slot->parked, memory_order_relaxed)) return false;
+
+	gettimeofday(&now, NULL);
+	fr_timeval_subtract(&held, &now, &this->last_reserved);
+
+	if ((pool->held_trigger_min.tv_sec || pool->held_trigger_min.tv_usec) &&
+	    (fr_timeval_cmp(&held, &pool->held_trigger_min) < 0)) return false;
+
+	if ((pool->held_trigger_max.tv_sec || pool->held_trigger_max.tv_usec) &&
+	    (fr_timeval_cmp(&held, &pool->held_trigger_max) > 0)) return false;
+
+	this->last_released = now;
+
+	atomic_store_explicit(&this->parked_in, slot, memory_order_relaxed);
+	atomic_store_explicit(&slot->parked, this, memory_order_release);
+
+	ROPTIONAL(RDEBUG2, DEBUG2, "Released connection (%" PRIu64 ")", this->number);
+
+	return true;
+}
+
 /** Find a connection handle in the connection list
  *
- * Walks over the list of connections searching for a specified connection
- * handle and returns the first connection that contains that pointer.
+ * Looks up the connection containing the specified connection handle.
  *
  * @note Will lock mutex and only release mutex if connection handle
  * is not found, so will usually return will mutex held.
@@ -284,33 +696,32 @@ static inline void fr_connection_trigger_exec(fr_connection_pool_t *pool, REQUES
  */
 static fr_connection_t *fr_connection_find(fr_connection_pool_t *pool, void *conn)
 {
-	fr_connection_t *this;
+	fr_connection_t *this, my_this;
 
 	if (!pool || !conn) return NULL;
 
+	if (pool->thread_cache) connection_thread_cache_forget(pool, conn);
+
 	pthread_mutex_lock(&pool->mutex);
 
-	/*
-	 *	FIXME: This loop could be avoided if we passed a 'void
-	 *	**connection' instead.  We could use "offsetof" in
-	 *	order to find top of the parent structure.
-	 */
-	for (this = pool->head; this != NULL; this = this->next) {
-		if (this->connection == conn) {
-#ifdef PTHREAD_DEBUG
-			pthread_t pthread_id;
+	my_this.connection = conn;
+	this = fr_hash_table_finddata(pool->connections, &my_this);
+	if (!this) {
+		pthread_mutex_unlock(&pool->mutex);
+		return NULL;
+	}
 
-			pthread_id = pthread_self();
-			rad_assert(pthread_equal(this->pthread_id, pthread_id) != 0);
-#endif
+#ifdef PTHREAD_DEBUG
+	{
+		pthread_t pthread_id;
 
-			rad_assert(this->in_use == true);
-			return this;
-		}
+		pthread_id = pthread_self();
+		rad_assert(pthread_equal(this->pthread_id, pthread_id) != 0);
 	}
+#endif
 
-	pthread_mutex_unlock(&pool->mutex);
-	return NULL;
+	rad_assert(this->in_use == true);
+	return this;
 }
 
 /** Spawns a new connection
@@ -488,6 +899,7 @@ static fr_connection_t *fr_connection_spawn(fr_connection_pool_t *pool, REQUEST
 	if (!in_use) fr_heap_insert(pool->heap, this);
 
 	fr_connection_link_head(pool, this);
+	fr_hash_table_insert(pool->connections, this);
 
 	/*
 	 *	Do NOT insert the connection into the heap.  That's
@@ -563,6 +975,7 @@ static void fr_connection_close_internal(fr_connection_pool_t *pool, REQUEST *re
 	fr_connection_trigger_exec(pool, request, "close");
 
 	fr_connection_unlink(pool, this);
+	fr_hash_table_yank(pool->connections, this);
 
 	rad_assert(pool->state.num > 0);
 	pool->state.num--;
@@ -659,6 +1072,13 @@ static int fr_connection_pool_check(fr_connection_pool_t *pool, REQUEST *request
 		return 1;
 	}
 
+	/*
+	 *	Take back connections threads have parked, so that
+	 *	idle connections are counted, and closed, as usual.
+	 *	Busy threads will park them again soon enough.
+	 */
+	if (pool->thread_cache) fr_connection_steal_all(pool);
+
 	/*
 	 *	Some idle connections are OK, if they're within the
 	 *	configured "spare" range.  Any extra connections
@@ -832,6 +1252,23 @@ static void *fr_connection_get_internal(fr_connection_pool_t *pool, REQUEST *req
 		if (!this) break;
 	} while (!fr_connection_manage(pool, request, this, now));
 
+	/*
+	 *	No free connections.  Take one back from a thread
+	 *	which parked it, before trying to open a new one.
+	 */
+	if (!this && pool->thread_cache) {
+		fr_connection_t *next;
+
+		for (this = pool->head; this; this = next) {
+			next = this->next;
+
+			if (!fr_connection_steal(this)) continue;
+
+			fr_connection_unpark(pool, this);
+			if (fr_connection_manage(pool, request, this, now)) break;
+		}
+	}
+
 	/*
 	 *	We have a working connection.  Extract it from the
 	 *	heap and use it.
@@ -889,6 +1326,8 @@ do_return:
 #endif
 	pthread_mutex_unlock(&pool->mutex);
 
+	if (pool->thread_cache) connection_thread_cache_reserved(pool, this);
+
 	ROPTIONAL(RDEBUG2, DEBUG2, "Reserved connection (%" PRIu64 ")", this->number);
 
 	return this->connection;
@@ -1034,6 +1473,14 @@ fr_connection_pool_t *fr_connection_pool_init(TALLOC_CTX *ctx,
 		return NULL;
 	}
 
+	pool->connections = fr_hash_table_create(pool, connection_hash, connection_cmp, NULL);
+	if (!pool->connections) {
+		ERROR("%s: Failed creating connection table", __FUNCTION__);
+		fr_heap_delete(pool->heap);
+		talloc_free(pool);
+		return NULL;
+	}
+
 	pool->log_prefix = log_prefix ? talloc_typed_strdup(pool, log_prefix) : "core";
 	pthread_mutex_init(&pool->mutex, NULL);
 	pthread_cond_init(&pool->done_spawn, NULL);
@@ -1062,6 +1509,12 @@ fr_connection_pool_t *fr_connection_pool_init(TALLOC_CTX *ctx,
 
 	pool->pending_window = (pool->max_pending > 0) ? pool->max_pending : pool->max;
 
+	/*
+	 *	Reusing the same connection over and over defeats
+	 *	the point of spreading requests over connections.
+	 */
+	if (pool->spread) pool->thread_cache = false;
+
 	if (pool->min > pool->max) {
 		cf_log_err_cs(cs, "Cannot set 'min' to more than 'max'");
 		goto error;
@@ -1223,6 +1676,8 @@ int fr_connection_pool_reconnect(fr_connection_pool_t *pool, REQUEST *request)
 	 */
 	while (pool->state.pending) pthread_cond_wait(&pool->done_spawn, &pool->mutex);
 
+	if (pool->thread_cache) fr_connection_steal_all(pool);
+
 	/*
 	 *	We want to ensure at least 'start' connections
 	 *	have been reconnected. We can't call reconnect
@@ -1304,6 +1759,12 @@ void fr_connection_pool_free(fr_connection_pool_t *pool)
 
 	DEBUG2("Removing connection pool");
 
+	/*
+	 *	Threads must not be left with pointers to the pool, or
+	 *	to connections we're about to free.
+	 */
+	if (pool->thread_cache) connection_thread_cache_flush(pool);
+
 	pthread_mutex_lock(&pool->mutex);
 
 	/*
@@ -1353,6 +1814,13 @@ void fr_connection_pool_free(fr_connection_pool_t *pool)
  */
 void *fr_connection_get(fr_connection_pool_t *pool, REQUEST *request)
 {
+	fr_connection_t *this;
+
+	if (pool && pool->thread_cache) {
+		this = connection_thread_cache_get(pool, request);
+		if (this) return this->connection;
+	}
+
 	return fr_connection_get_internal(pool, request, true);
 }
 
@@ -1372,6 +1840,8 @@ void fr_connection_release(fr_connection_pool_t *pool, REQUEST *request, void *c
 	struct timeval	held;
 	bool trigger_min = false, trigger_max = false;
 
+	if (pool && pool->thread_cache && connection_thread_cache_release(pool, request, conn)) return;
+
 	this = fr_connection_find(pool, conn);
 	if (!this) return;
 
@@ -213,6 +213,8 @@ static const CONF_PARSER server_config[] = {
 	{ FR_CONF_POINTER("cleanup_delay", FR_TYPE_UINT32, &main_config.cleanup_delay), .dflt = STRINGIFY(CLEANUP_DELAY) },
 	{ FR_CONF_POINTER("continuation_timeout", FR_TYPE_UINT32, &main_config.continuation_timeout), .dflt = "15" },
 	{ FR_CONF_POINTER("max_requests", FR_TYPE_UINT32, &main_config.max_requests), .dflt = STRINGIFY(MAX_REQUESTS) },
+	{ FR_CONF_POINTER("timer_wheel", FR_TYPE_BOOL, &main_config.timer_wheel), .dflt = "no" },
+	{ FR_CONF_POINTER("pair_index", FR_TYPE_BOOL, &main_config.pair_index), .dflt = "no" },
 	{ FR_CONF_POINTER("pidfile", FR_TYPE_STRING, &main_config.pid_file), .dflt = "${run_dir}/radiusd.pid"},
 	{ FR_CONF_POINTER("checkrad", FR_TYPE_STRING, &main_config.checkrad), .dflt = "${sbindir}/checkrad" },
 
@@ -941,6 +943,12 @@ do {\
 	main_config.init_delay.tv_sec = 0;
 	main_config.init_delay.tv_usec = 2* (1000000 / 3);
 
+	/*
+	 *	This has to be done before any requests are
+	 *	allocated, and before the threads are started.
+	 */
+	fr_pair_index_enable(main_config.pair_index);
+
 	/*
 	 *	Free the old configuration items, and replace them
 	 *	with the new ones.
@@ -542,6 +542,16 @@ int paircompare(REQUEST *request, VALUE_PAIR *req_list, VALUE_PAIR *check,
 		first_only = otherattr(check_item->da, &from);
 
 		auth_item = req_list;
+
+		/*
+		 *	Skip straight to the first instance if we're
+		 *	looking in the request list, which is indexed.
+		 */
+		if (!first_only && from && request && request->packet && (req_list == request->packet->vps)) {
+			auth_item = fr_pair_index_find(radius_list_index(request, PAIR_LIST_REQUEST),
+						       &request->packet->vps, from, TAG_ANY);
+		}
+
 	try_again:
 		if (!first_only) {
 			while (auth_item != NULL) {
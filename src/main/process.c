@@ -3096,6 +3096,7 @@ do_home:
 			fr_pair_cursor_init(&cursor, &vp);
 			fr_pair_cursor_merge(&cursor, request->proxy->packet->vps);
 			request->proxy->packet->vps = vp;
+			fr_pair_list_touch(&request->proxy->packet->vps);
 		}
 		fr_pair_value_strcpy(vp, strippedname->vp_strvalue);
 
@@ -3183,6 +3184,7 @@ static int proxy_to_virtual_server(REQUEST *request)
 	fake = request_alloc_fake(request);
 
 	fake->packet->vps = fr_pair_list_copy(fake->packet, request->packet->vps);
+	fr_pair_list_touch(&fake->packet->vps);
 	TALLOC_FREE(request->proxy->packet);
 
 	fake->server = request->proxy->home_server->server;
@@ -3200,6 +3202,8 @@ static int proxy_to_virtual_server(REQUEST *request)
 	fake->packet = NULL;
 	request->proxy->reply = talloc_steal(request->proxy, fake->reply);
 	fake->reply = NULL;
+	(void) fr_pair_list_arena_copy(request->proxy->packet, &request->proxy->packet->vps);
+	(void) fr_pair_list_arena_copy(request->proxy->reply, &request->proxy->reply->vps);
 
 	talloc_free(fake);
 
@@ -4235,6 +4239,7 @@ static void request_coa_originate(REQUEST *request)
 	coa->reply = fr_radius_copy(coa, request->reply);
 
 	coa->control = fr_pair_list_copy(coa, request->control);
+	fr_pair_list_touch(&coa->control);
 	coa->proxy->packet->count = 0;
 	coa->handle = null_handler;
 	coa->number = request->number; /* it's associated with the same request */
@@ -5193,6 +5198,11 @@ int radius_event_init(TALLOC_CTX *ctx)
 	el = fr_event_list_alloc(ctx, event_status, NULL);
 	if (!el) return 0;
 
+	if (main_config.timer_wheel && (fr_event_list_timer_wheel(el, true) < 0)) {
+		ERROR("Failed enabling timer wheel: %s", fr_strerror());
+		return 0;
+	}
+
 #ifdef HAVE_SYSTEMD_WATCHDOG
 	if (sd_watchdog_interval.tv_sec || sd_watchdog_interval.tv_usec) {
 		struct timeval now;
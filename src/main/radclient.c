@@ -89,6 +89,7 @@ static void NEVER_RETURNS usage(void)
 	fprintf(stderr, "  -F                     Print the file name, packet number and reply code.\n");
 	fprintf(stderr, "  -h                     Print usage help information.\n");
 	fprintf(stderr, "  -i <id>                Set request id to 'id'.  Values may be 0..255\n");
+	fprintf(stderr, "  -k <cachedir>          Cache parsed dictionaries in this directory.\n");
 	fprintf(stderr, "  -n <num>               Send N requests/s\n");
 	fprintf(stderr, "  -p <num>               Send 'num' packets from a file in parallel.\n");
 	fprintf(stderr, "  -q                     Do not print anything out.\n");
@@ -1163,7 +1164,7 @@ int main(int argc, char **argv)
 		exit(1);
 	}
 
-	while ((c = getopt(argc, argv, "46c:d:D:f:Fhi:n:p:qr:sS:t:vx"
+	while ((c = getopt(argc, argv, "46c:d:D:f:Fhi:k:n:p:qr:sS:t:vx"
 #ifdef WITH_TCP
 		"P:"
 #endif
@@ -1190,6 +1191,13 @@ int main(int argc, char **argv)
 			radius_dir = optarg;
 			break;
 
+		case 'k':
+			if (fr_dict_cache_dir(optarg) < 0) {
+				fr_perror("radclient");
+				exit(1);
+			}
+			break;
+
 		case 'f':
 		{
 			char const *p;
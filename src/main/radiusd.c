@@ -199,7 +199,7 @@ int main(int argc, char *argv[])
 	fr_fault_setup(getenv("PANIC_ACTION"), argv[0]);
 
 	/*  Process the options.  */
-	while ((argval = getopt(argc, argv, "Cd:D:fhi:l:L:Mn:p:PstTvxX")) != EOF) {
+	while ((argval = getopt(argc, argv, "Cd:D:fhi:k:l:L:Mn:p:PstTvxX")) != EOF) {
 		switch (argval) {
 		case 'C':
 			check_config = true;
@@ -223,6 +223,13 @@ int main(int argc, char *argv[])
 			usage(0);
 			break;
 
+		case 'k':
+			if (fr_dict_cache_dir(optarg) < 0) {
+				fprintf(stderr, "%s: %s\n", main_config.name, fr_strerror());
+				exit(EXIT_FAILURE);
+			}
+			break;
+
 		case 'l':
 			if (strcmp(optarg, "stdout") == 0) {
 				goto do_stdout;
@@ -810,6 +817,7 @@ static void NEVER_RETURNS usage(int status)
 	fprintf(stderr, "  -D <dictdir>  Set main dictionary directory (defaults to " DICTDIR ").\n");
 	fprintf(output, "  -f            Run as a foreground process, not a daemon.\n");
 	fprintf(output, "  -h            Print this help message.\n");
+	fprintf(output, "  -k <cachedir> Cache parsed dictionaries in this directory.\n");
 	fprintf(output, "  -l <log_file> Logging output will be written to this file.\n");
 #ifndef NDEBUG
 	fprintf(output, "  -L <size>     When running in memory debug mode, set a hard limit on talloced memory\n");
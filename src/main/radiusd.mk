@@ -31,7 +31,7 @@ SRC_CFLAGS	:=
 TGT_INSTALLDIR  := ${sbindir}
 TGT_LDLIBS	:= $(LIBS) $(LCRYPT) $(SYSTEMD_LIBS)
 TGT_LDFLAGS	:= $(LDFLAGS) $(SYSTEMD_LDFLAGS)
-TGT_PREREQS	:= libfreeradius-server.a libfreeradius-util.a libfreeradius-radius.a
+TGT_PREREQS	:= libfreeradius-server.a libfreeradius-util.a libfreeradius-radius.a libfreeradius-io.a
 
 # Libraries can't depend on libraries (oops), so make the binary
 # depend on the EAP code...
@@ -2093,6 +2093,7 @@ static void NEVER_RETURNS usage(int status)
 	fprintf(output, "  -C                    Enable UDP checksum validation.\n");
 	fprintf(output, "  -d <raddb>            Set configuration directory (defaults to " RADDBDIR ").\n");
 	fprintf(output, "  -D <dictdir>          Set main dictionary directory (defaults to " DICTDIR ").\n");
+	fprintf(output, "  -k <cachedir>         Cache parsed dictionaries in this directory.\n");
 	fprintf(output, "  -e <event>[,<event>]  Only log requests with these event flags.\n");
 	fprintf(output, "                        Event may be one of the following:\n");
 	fprintf(output, "                        - received - a request or response.\n");
@@ -2199,7 +2200,7 @@ int main(int argc, char *argv[])
 	/*
 	 *  Get options
 	 */
-	while ((opt = getopt(argc, argv, "ab:c:C:d:D:e:Ef:hi:I:l:L:mp:P:qr:R:s:Svw:xXW:T:P:N:O:")) != EOF) {
+	while ((opt = getopt(argc, argv, "ab:c:C:d:D:e:Ef:hi:I:k:l:L:mp:P:qr:R:s:Svw:xXW:T:P:N:O:")) != EOF) {
 		switch (opt) {
 		case 'a':
 		{
@@ -2260,6 +2261,14 @@ int main(int argc, char *argv[])
 			dict_dir = optarg;
 			break;
 
+		case 'k':
+			if (fr_dict_cache_dir(optarg) < 0) {
+				fr_perror("radsniff");
+				ret = 64;
+				goto finish;
+			}
+			break;
+
 		case 'e':
 			if (rs_build_event_flags((int *) &conf->event_flags, rs_events, optarg) < 0) usage(64);
 			break;
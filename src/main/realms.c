@@ -2370,6 +2370,7 @@ void home_server_update_request(home_server_t *home, REQUEST *request)
 		request->proxy->packet->code = request->packet->code;
 		request->proxy->packet->vps = fr_pair_list_copy(request->proxy->packet,
 								request->packet->vps);
+		fr_pair_list_touch(&request->proxy->packet->vps);
 
 		/*
 		 *	The RFC's say we have to do this, but FreeRADIUS
@@ -28,6 +28,12 @@ RCSID("$Id$")
 #include <freeradius-devel/radiusd.h>
 #include <freeradius-devel/rad_assert.h>
 
+#ifdef HAVE_STDATOMIC_H
+#  include <stdatomic.h>
+#else
+#  include <freeradius-devel/stdatomic.h>
+#endif
+
 #ifdef HAVE_REGEX
 
 #define REQUEST_DATA_REGEX (0xadbeef00)
@@ -39,6 +45,224 @@ typedef struct regcapture {
 	size_t		nmatch;		//!< Number of match vectors.
 } regcapture_t;
 
+/*
+ *	Maximum number of expressions each thread keeps compiled.
+ */
+#define REGEX_CACHE_SIZE	(256)
+
+typedef struct regex_cache_entry regex_cache_entry_t;
+
+struct regex_cache_entry {
+	char const		*pattern;	//!< Uncompiled pattern.
+	size_t			len;		//!< Length of the pattern.
+	uint8_t			flags;		//!< Flags the pattern was compiled with.
+	regex_t			*preg;		//!< Compiled pattern.
+
+	regex_cache_entry_t	*prev;		//!< More recently used entry.
+	regex_cache_entry_t	*next;		//!< Less recently used entry.
+};
+
+#define REGEX_CACHE_FLAG_IGNORE_CASE	(1 << 0)
+#define REGEX_CACHE_FLAG_MULTILINE	(1 << 1)
+
+typedef struct regex_cache {
+	fr_hash_table_t		*entries;	//!< Entries, keyed by pattern and flags.
+	regex_cache_entry_t	*head;		//!< Most recently used entry.
+	regex_cache_entry_t	*tail;		//!< Least recently used entry, evicted first.
+	uint32_t		num;		//!< Number of entries.
+} regex_cache_t;
+
+fr_thread_local_setup(regex_cache_t *, regex_cache)	/* macro */
+
+static _Atomic(uint64_t) regex_cache_hits;
+static _Atomic(uint64_t) regex_cache_misses;
+
+static uint32_t regex_cache_entry_hash(void const *data)
+{
+	regex_cache_entry_t const *entry = data;
+
+	return fr_hash_update(&entry->flags, sizeof(entry->flags), fr_hash(entry->pattern, entry->len));
+}
+
+static int regex_cache_entry_cmp(void const *one, void const *two)
+{
+	regex_cache_entry_t const *a = one;
+	regex_cache_entry_t const *b = two;
+	int ret;
+
+	ret = (a->flags > b->flags) - (a->flags < b->flags);
+	if (ret != 0) return ret;
+
+	ret = (a->len > b->len) - (a->len < b->len);
+	if (ret != 0) return ret;
+
+	return memcmp(a->pattern, b->pattern, a->len);
+}
+
+static void regex_cache_entry_unlink(regex_cache_t *cache, regex_cache_entry_t *entry)
+{
+	if (entry->prev) {
+		entry->prev->next = entry->next;
+	} else {
+		cache->head = entry->next;
+	}
+
+	if (entry->next) {
+		entry->next->prev = entry->prev;
+	} else {
+		cache->tail = entry->prev;
+	}
+
+	entry->prev = entry->next = NULL;
+}
+
+static void regex_cache_entry_link_head(regex_cache_t *cache, regex_cache_entry_t *entry)
+{
+	entry->prev = NULL;
+	entry->next = cache->head;
+
+	if (cache->head) {
+		cache->head->prev = entry;
+	} else {
+		cache->tail = entry;
+	}
+	cache->head = entry;
+}
+
+/** Free a thread's regex cache when the thread exits
+ *
+ */
+static void _regex_cache_free(void *arg)
+{
+	talloc_free(arg);
+}
+
+/** Return a compiled expression for a pattern, from this thread's cache
+ *
+ * Used for patterns which are only known at runtime, i.e. expanded
+ * strings, which would otherwise have to be compiled every time they're
+ * evaluated.  The least recently used expressions are freed once the
+ * cache is full.
+ *
+ * Expressions are compiled as if they were known at startup, so with
+ * PCRE they're studied, and JIT compiled where that's available.
+ *
+ * @note The expression belongs to the cache, and must not be freed.  It
+ *	may be freed by the next call to this function in the same thread.
+ *
+ * @param[in] request		The current request.
+ * @param[out] out		Where to write the compiled expression.
+ * @param[in] pattern		to compile.
+ * @param[in] len		of pattern.
+ * @param[in] ignore_case	Whether to do case insensitive matching.
+ * @param[in] multiline		If true $ matches newlines.
+ * @return
+ *	- >= 1 on success.
+ *	- <= 0 on error. Negative value is offset of parse error.
+ */
+ssize_t regex_cache_compile(REQUEST *request, regex_t **out, char const *pattern, size_t len,
+			    bool ignore_case, bool multiline)
+{
+	regex_cache_t		*cache;
+	regex_cache_entry_t	*entry, find;
+	regex_t			*preg;
+	ssize_t			slen;
+
+	*out = NULL;
+
+	cache = regex_cache;
+	if (!cache) {
+		cache = talloc_zero(NULL, regex_cache_t);
+		if (!cache) goto no_cache;
+
+		cache->entries = fr_hash_table_create(cache, regex_cache_entry_hash, regex_cache_entry_cmp, NULL);
+		if (!cache->entries) {
+			talloc_free(cache);
+		no_cache:
+			/*
+			 *	Still works, just slower.
+			 */
+			return regex_compile(request, out, pattern, len, ignore_case, multiline, true, true);
+		}
+
+		fr_thread_local_set_destructor(regex_cache, _regex_cache_free, cache);
+	}
+
+	find.pattern = pattern;
+	find.len = len;
+	find.flags = (ignore_case ? REGEX_CACHE_FLAG_IGNORE_CASE : 0) | (multiline ? REGEX_CACHE_FLAG_MULTILINE : 0);
+
+	entry = fr_hash_table_finddata(cache->entries, &find);
+	if (entry) {
+		atomic_fetch_add_explicit(&regex_cache_hits, 1, memory_order_relaxed);
+
+		if (cache->head != entry) {
+			regex_cache_entry_unlink(cache, entry);
+			regex_cache_entry_link_head(cache, entry);
+		}
+
+		RDEBUG4("Using cached expression for \"%.*s\"", (int)len, pattern);
+
+		*out = entry->preg;
+		return len;
+	}
+
+	atomic_fetch_add_explicit(&regex_cache_misses, 1, memory_order_relaxed);
+
+	/*
+	 *	Compile it as if it was known at startup, so it gets
+	 *	the JIT treatment.  Failures aren't cached.
+	 */
+	entry = talloc_zero(cache, regex_cache_entry_t);
+	if (!entry) return regex_compile(request, out, pattern, len, ignore_case, multiline, true, true);
+
+	slen = regex_compile(entry, &preg, pattern, len, ignore_case, multiline, true, false);
+	if (slen <= 0) {
+		talloc_free(entry);
+		return slen;
+	}
+#ifdef HAVE_PCRE
+	preg->cached = true;
+#endif
+
+	MEM(entry->pattern = talloc_memdup(entry, pattern, len));
+	entry->len = len;
+	entry->flags = find.flags;
+	entry->preg = preg;
+
+	if (cache->num >= REGEX_CACHE_SIZE) {
+		regex_cache_entry_t *old = cache->tail;
+
+		regex_cache_entry_unlink(cache, old);
+		fr_hash_table_delete(cache->entries, old);
+		talloc_free(old);
+		cache->num--;
+	}
+
+	if (!fr_hash_table_insert(cache->entries, entry)) {
+		talloc_free(entry);
+		return regex_compile(request, out, pattern, len, ignore_case, multiline, true, true);
+	}
+	regex_cache_entry_link_head(cache, entry);
+	cache->num++;
+
+	*out = preg;
+	return len;
+}
+
+/** Return how often regex_cache_compile found a compiled expression
+ *
+ * Counts are for all threads.
+ *
+ * @param[out] hits	Number of lookups which found an expression.
+ * @param[out] misses	Number of lookups which had to compile one.
+ */
+void regex_cache_stats(uint64_t *hits, uint64_t *misses)
+{
+	*hits = atomic_load_explicit(&regex_cache_hits, memory_order_relaxed);
+	*misses = atomic_load_explicit(&regex_cache_misses, memory_order_relaxed);
+}
+
 /** Adds subcapture values to request data
  *
  * Allows use of %{n} expansions.
@@ -91,7 +315,20 @@ void regex_sub_to_request(REQUEST *request, regex_t **preg, char const *value, s
 	new_sc->nmatch = nmatch;
 
 #ifdef HAVE_PCRE
-	if (!(*preg)->precompiled) {
+	/*
+	 *	The cache may free the expression before we're done
+	 *	with the captures, and named captures need the compiled
+	 *	pattern.  Compiled patterns are relocatable, so keep a
+	 *	copy.  The copy isn't studied, but isn't used to match.
+	 */
+	if ((*preg)->cached) {
+		size_t size = 0;
+
+		pcre_fullinfo((*preg)->compiled, NULL, PCRE_INFO_SIZE, &size);
+
+		MEM(new_sc->preg = talloc_zero(new_sc, regex_t));
+		MEM(new_sc->preg->compiled = talloc_memdup(new_sc->preg, (*preg)->compiled, size));
+	} else if (!(*preg)->precompiled) {
 		new_sc->preg = talloc_steal(new_sc, *preg);
 		*preg = NULL;
 	} else
@@ -115,6 +115,14 @@ REQUEST *request_alloc(TALLOC_CTX *ctx)
 
 	request->state_ctx = talloc_init("session-state");
 
+	/*
+	 *	Pairs added to the request, reply and control lists
+	 *	are freed with the request, so they're bump allocated
+	 *	from an arena.  If there's no arena, radius_list_ctx()
+	 *	returns the lists' usual contexts.
+	 */
+	request->pair_arena = fr_pair_arena_alloc(request, main_config.talloc_pool_size / 4);
+
 	return request;
 }
 
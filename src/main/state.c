@@ -42,6 +42,10 @@
           \-> reply                 \-> reply                 \-> access-reject/access-accept
  * @endverbatim
  *
+ * The state tree is split into #STATE_SHARDS partitions, based on a hash of
+ * the State value.  Each partition has its own mutex, hash table, and expiry
+ * list, so workers handling different sessions don't contend with each other.
+ *
  * @copyright 2014 The FreeRADIUS server project
  */
 RCSID("$Id$")
@@ -49,6 +53,20 @@ RCSID("$Id$")
 #include <freeradius-devel/radiusd.h>
 #include <freeradius-devel/state.h>
 #include <freeradius-devel/rad_assert.h>
+#include <stdalign.h>
+
+#ifdef HAVE_STDATOMIC_H
+#  include <stdatomic.h>
+#else
+#  include <freeradius-devel/stdatomic.h>
+#endif
+
+/** Number of partitions in the state tree.  Must be a power of two
+ *
+ */
+#define STATE_SHARDS		(16)
+
+typedef struct fr_state_shard fr_state_shard_t;
 
 /** Holds a state value, and associated VALUE_PAIRs and data
  *
@@ -93,6 +111,7 @@ typedef struct state_entry {
 	};
 
 	uint64_t		seq_start;			//!< Number of first request in this sequence.
+	fr_state_shard_t	*shard;				//!< Partition the entry is in.
 	time_t			cleanup;			//!< When this entry should be cleaned up.
 	struct state_entry	*prev;				//!< Previous entry in the cleanup list.
 	struct state_entry	*next;				//!< Next entry in the cleanup list.
@@ -106,16 +125,26 @@ typedef struct state_entry {
 	request_data_t		*data;				//!< Persistable request data, also parented ctx.
 } fr_state_entry_t;
 
-struct fr_state_tree_t {
-	uint64_t		id;				//!< Next ID to assign.
+/** A partition of the state tree
+ *
+ * Aligned so that threads locking different partitions don't share a cache line.
+ */
+struct fr_state_shard {
+	alignas(128) pthread_mutex_t mutex;			//!< Synchronisation mutex.
+	fr_hash_table_t		*tree;				//!< Hash table used to lookup state value.
+
+	fr_state_entry_t	*head, *tail;			//!< Entries to expire.
 	uint64_t		timed_out;			//!< Number of states that were cleaned up due to
 								//!< timeout.
-	uint32_t		max_sessions;			//!< Maximum number of sessions we track.
-	rbtree_t		*tree;				//!< rbtree used to lookup state value.
+};
 
-	fr_state_entry_t	*head, *tail;			//!< Entries to expire.
+struct fr_state_tree_t {
+	atomic_uint_fast64_t	id;				//!< Next ID to assign.
+	atomic_uint		num_entries;			//!< Number of entries in all partitions.
+	uint32_t		max_sessions;			//!< Maximum number of sessions we track.
 	uint32_t		timeout;			//!< How long to wait before cleaning up state entires.
-	pthread_mutex_t		mutex;				//!< Synchronisation mutex.
+
+	fr_state_shard_t	shard[STATE_SHARDS];		//!< Independently locked partitions.
 };
 
 fr_state_tree_t *global_state = NULL;
@@ -125,6 +154,16 @@ fr_state_tree_t *global_state = NULL;
 
 static void state_entry_unlink(fr_state_tree_t *state, fr_state_entry_t *entry);
 
+/** Hash a fr_state_entry_t based on its state value
+ *
+ */
+static uint32_t state_entry_hash(void const *data)
+{
+	fr_state_entry_t const *entry = data;
+
+	return fr_hash(entry->state, sizeof(entry->state));
+}
+
 /** Compare two fr_state_entry_t based on their state value i.e. the value of the attribute
  *
  */
@@ -136,34 +175,50 @@ static int state_entry_cmp(void const *one, void const *two)
 	return memcmp(a->state, b->state, sizeof(a->state));
 }
 
+/** Find the partition for a state value
+ *
+ * The hash tables use the low and high bits of the hash, so we use bits
+ * from the middle.  Otherwise every entry in a partition would end up in
+ * the same fraction of the hash table.
+ */
+static fr_state_shard_t *state_entry_shard(fr_state_tree_t *state, fr_state_entry_t const *entry)
+{
+	return &state->shard[(state_entry_hash(entry) >> 20) & (STATE_SHARDS - 1)];
+}
+
 /** Free the state tree
  *
  */
 static int _state_tree_free(fr_state_tree_t *state)
 {
+	int i;
 	fr_state_entry_t *this;
 
-	if (main_config.spawn_workers) pthread_mutex_destroy(&state->mutex);
-
 	DEBUG4("Freeing state tree %p", state);
 
-	while (state->head) {
-		this = state->head;
-		state_entry_unlink(state, this);
-		talloc_free(this);
-	}
+	for (i = 0; i < STATE_SHARDS; i++) {
+		fr_state_shard_t *shard = &state->shard[i];
 
-	for (this = state->head; this; this = this->next) DEBUG4("State %" PRIu64 " needs freeing prev was %" PRIu64 "", this->id, this->prev ? this->prev->id : 100000);
+		if (!shard->tree) continue;
 
-	/*
-	 *	Ensure we got *all* the entries
-	 */
-	rad_assert(!state->head);
+		if (main_config.spawn_workers) pthread_mutex_destroy(&shard->mutex);
 
-	/*
-	 *	Free the rbtree
-	 */
-	talloc_free(state->tree);
+		while (shard->head) {
+			this = shard->head;
+			state_entry_unlink(state, this);
+			talloc_free(this);
+		}
+
+		/*
+		 *	Ensure we got *all* the entries
+		 */
+		rad_assert(!shard->head);
+
+		/*
+		 *	Free the hash table
+		 */
+		fr_hash_table_free(shard->tree);
+	}
 
 	if (state == global_state) global_state = NULL;
 
@@ -179,6 +234,7 @@ static int _state_tree_free(fr_state_tree_t *state)
  */
 fr_state_tree_t *fr_state_tree_init(TALLOC_CTX *ctx, uint32_t max_sessions, uint32_t timeout)
 {
+	int i;
 	fr_state_tree_t *state;
 
 	state = talloc_zero(NULL, fr_state_tree_t);
@@ -196,23 +252,31 @@ fr_state_tree_t *fr_state_tree_init(TALLOC_CTX *ctx, uint32_t max_sessions, uint
 	 */
 	fr_talloc_link_ctx(ctx, state);
 
-	if (main_config.spawn_workers && (pthread_mutex_init(&state->mutex, NULL) != 0)) {
-		talloc_free(state);
-		return NULL;
-	}
+	atomic_init(&state->id, 0);
+	atomic_init(&state->num_entries, 0);
+	talloc_set_destructor(state, _state_tree_free);
 
-	/*
-	 *	We need to do controlled freeing of the
-	 *	rbtree, so that all the state entries
-	 *	are freed before it's destroyed.  Hence
-	 *	it being parented from the NULL ctx.
-	 */
-	state->tree = rbtree_create(NULL, state_entry_cmp, NULL, 0);
-	if (!state->tree) {
-		talloc_free(state);
-		return NULL;
+	for (i = 0; i < STATE_SHARDS; i++) {
+		fr_state_shard_t *shard = &state->shard[i];
+
+		if (main_config.spawn_workers && (pthread_mutex_init(&shard->mutex, NULL) != 0)) {
+			talloc_free(state);
+			return NULL;
+		}
+
+		/*
+		 *	We need to do controlled freeing of the
+		 *	hash table, so that all the state entries
+		 *	are freed before it's destroyed.  Hence
+		 *	it being parented from the NULL ctx.
+		 */
+		shard->tree = fr_hash_table_create(NULL, state_entry_hash, state_entry_cmp, NULL);
+		if (!shard->tree) {
+			if (main_config.spawn_workers) pthread_mutex_destroy(&shard->mutex);
+			talloc_free(state);
+			return NULL;
+		}
 	}
-	talloc_set_destructor(state, _state_tree_free);
 
 	return state;
 }
@@ -222,30 +286,33 @@ fr_state_tree_t *fr_state_tree_init(TALLOC_CTX *ctx, uint32_t max_sessions, uint
  */
 static void state_entry_unlink(fr_state_tree_t *state, fr_state_entry_t *entry)
 {
+	fr_state_shard_t *shard = entry->shard;
 	fr_state_entry_t *prev, *next;
 
 	prev = entry->prev;
 	next = entry->next;
 
 	if (prev) {
-		rad_assert(state->head != entry);
+		rad_assert(shard->head != entry);
 		prev->next = next;
-	} else if (state->head) {
-		rad_assert(state->head == entry);
-		state->head = next;
+	} else if (shard->head) {
+		rad_assert(shard->head == entry);
+		shard->head = next;
 	}
 
 	if (next) {
-		rad_assert(state->tail != entry);
+		rad_assert(shard->tail != entry);
 		next->prev = prev;
-	} else if (state->tail) {
-		rad_assert(state->tail == entry);
-		state->tail = prev;
+	} else if (shard->tail) {
+		rad_assert(shard->tail == entry);
+		shard->tail = prev;
 	}
 	entry->next = NULL;
 	entry->prev = NULL;
 
-	rbtree_deletebydata(state->tree, entry);
+	if (fr_hash_table_yank(shard->tree, entry)) {
+		atomic_fetch_sub_explicit(&state->num_entries, 1, memory_order_relaxed);
+	}
 
 	DEBUG4("State ID %" PRIu64 " unlinked", entry->id);
 }
@@ -288,27 +355,24 @@ static int _state_entry_free(fr_state_entry_t *entry)
 	return 0;
 }
 
-/** Create a new state entry
+/** Unlink expired entries from a partition
  *
- * @note Called with the mutex held.
+ * @note Called with the partition's mutex held.
+ *
+ * @param[in] state	tree the partition is in.
+ * @param[in] shard	to expire entries from.
+ * @param[in] now	the current time.
+ * @param[in] old	entry which shouldn't be expired, as the caller is using it.
+ * @param[in,out] free_next	where to add the unlinked entries.  They should be
+ *			freed after the mutex is released.
+ * @return where to add any other entries to free.
  */
-static fr_state_entry_t *state_entry_create(fr_state_tree_t *state, REQUEST *request,
-					    RADIUS_PACKET *packet, fr_state_entry_t *old)
+static fr_state_entry_t **state_shard_expire(fr_state_tree_t *state, fr_state_shard_t *shard, time_t now,
+					     fr_state_entry_t *old, fr_state_entry_t **free_next)
 {
-	size_t			i;
-	uint32_t		x;
-	time_t			now = time(NULL);
-	VALUE_PAIR		*vp;
-	fr_state_entry_t	*entry, *next;
-	fr_state_entry_t	*free_head = NULL, **free_next = &free_head;
+	fr_state_entry_t *entry, *next;
 
-	uint8_t			old_state[sizeof(old->state)];
-	int			old_tries = 0;
-
-	/*
-	 *	Clean up old entries.
-	 */
-	for (entry = state->head; entry != NULL; entry = next) {
+	for (entry = shard->head; entry != NULL; entry = next) {
 		next = entry->next;
 
 		if (entry == old) continue;
@@ -320,14 +384,54 @@ static fr_state_entry_t *state_entry_create(fr_state_tree_t *state, REQUEST *req
 			state_entry_unlink(state, entry);
 			*free_next = entry;
 			free_next = &(entry->next);
-			state->timed_out++;
+			shard->timed_out++;
 			continue;
 		}
 
 		break;
 	}
 
-	if (rbtree_num_elements(state->tree) >= (uint32_t) state->max_sessions) return NULL;
+	return free_next;
+}
+
+/** Free a list of unlinked entries
+ *
+ * We do it outside of the mutex as freeing may involve significantly more
+ * work than just freeing the data.
+ *
+ * If there's request data that was persisted it will now be freed also,
+ * and it may have complex destructors associated with it.
+ */
+static void state_entry_list_free(fr_state_entry_t *head)
+{
+	fr_state_entry_t *entry, *next;
+
+	for (next = head; next;) {
+		entry = next;
+		next = entry->next;
+		talloc_free(entry);
+	}
+}
+
+/** Create a new state entry
+ *
+ * The entry isn't inserted into the tree, see #state_entry_insert.
+ *
+ * @note Called with the mutex of the old entry's partition held, if there is an
+ *	old entry.  Returns with it released.
+ */
+static fr_state_entry_t *state_entry_create(fr_state_tree_t *state, REQUEST *request,
+					    RADIUS_PACKET *packet, fr_state_entry_t *old)
+{
+	size_t			i;
+	uint32_t		x;
+	time_t			now = time(NULL);
+	VALUE_PAIR		*vp;
+	fr_state_entry_t	*entry;
+	fr_state_entry_t	*free_head = NULL, **free_next = &free_head;
+
+	uint8_t			old_state[sizeof(old->state)];
+	int			old_tries = 0;
 
 	/*
 	 *	Record the information from the old state, we may base the
@@ -337,6 +441,13 @@ static fr_state_entry_t *state_entry_create(fr_state_tree_t *state, REQUEST *req
 	 *	so we have to grab the values now.
 	 */
 	if (old) {
+		fr_state_shard_t *shard = old->shard;
+
+		/*
+		 *	Clean up old entries.
+		 */
+		free_next = state_shard_expire(state, shard, now, old, free_next);
+
 		old_tries = old->tries;
 
 		memcpy(old_state, old->state, sizeof(old_state));
@@ -348,25 +459,14 @@ static fr_state_entry_t *state_entry_create(fr_state_tree_t *state, REQUEST *req
 			state_entry_unlink(state, old);
 			*free_next = old;
 		}
-	}
-	PTHREAD_MUTEX_UNLOCK(&state->mutex);
 
-	/*
-	 *	Now free the unlinked entries.
-	 *
-	 *	We do it here as freeing may involve significantly more
-	 *	work than just freeing the data.
-	 *
-	 *	If there's request data that was persisted it will now
-	 *	be freed also, and it may have complex destructors associated
-	 *	with it.
-	 */
-	for (next = free_head; next;) {
-		entry = next;
-		next = entry->next;
-		talloc_free(entry);
+		PTHREAD_MUTEX_UNLOCK(&shard->mutex);
+
+		state_entry_list_free(free_head);
 	}
 
+	if (atomic_load_explicit(&state->num_entries, memory_order_relaxed) >= state->max_sessions) return NULL;
+
 	/*
 	 *	Allocation doesn't need to occur inside the critical region
 	 *	and would add significantly to contention.
@@ -375,12 +475,9 @@ static fr_state_entry_t *state_entry_create(fr_state_tree_t *state, REQUEST *req
 	 *	we can't do it now due to thread safety issues with talloc.
 	 */
 	entry = talloc_zero(NULL, fr_state_entry_t);
-	if (!entry) {
-		PTHREAD_MUTEX_LOCK(&state->mutex);	/* Caller expects this to be locked */
-		return NULL;
-	}
+	if (!entry) return NULL;
 	talloc_set_destructor(entry, _state_entry_free);
-	entry->id = state->id++;
+	entry->id = atomic_fetch_add_explicit(&state->id, 1, memory_order_relaxed);
 
 	/*
 	 *	Limit the lifetime of this entry based on how long the
@@ -452,12 +549,6 @@ static fr_state_entry_t *state_entry_create(fr_state_tree_t *state, REQUEST *req
 		       entry->id, hex, (uint64_t)entry->cleanup - now);
 	}
 
-	PTHREAD_MUTEX_LOCK(&state->mutex);
-	if (rbtree_num_elements(state->tree) >= (uint32_t)state->max_sessions) {
-		talloc_free(entry);
-		return NULL;
-	}
-
 	/*
 	 *	XOR the server hash with four bytes of random data.
 	 *	We XOR is again before resolving, to ensure state lookups
@@ -466,39 +557,78 @@ static fr_state_entry_t *state_entry_create(fr_state_tree_t *state, REQUEST *req
 	 */
 	*((uint32_t *)(&entry->state_comp.server_hash)) ^= fr_hash_string(request->server);
 
-	if (!rbtree_insert(state->tree, entry)) {
-		talloc_free(entry);
-		return NULL;
-	}
+	/*
+	 *	The partition depends on the final state value.
+	 */
+	entry->shard = state_entry_shard(state, entry);
+
+	return entry;
+}
+
+/** Insert a new entry into its partition
+ *
+ * @note Called with the partition's mutex held.
+ *
+ * @param[in] state	tree to insert the entry into.
+ * @param[in] entry	to insert.
+ * @param[in,out] free_next	where to add expired entries.  They should be
+ *			freed after the mutex is released.
+ * @return
+ *	- 0 on success.
+ *	- -1 if the tree is full, or the state value already exists.
+ */
+static int state_entry_insert(fr_state_tree_t *state, fr_state_entry_t *entry, fr_state_entry_t **free_next)
+{
+	fr_state_shard_t *shard = entry->shard;
+
+	(void) state_shard_expire(state, shard, time(NULL), NULL, free_next);
+
+	if (atomic_load_explicit(&state->num_entries, memory_order_relaxed) >= state->max_sessions) return -1;
+
+	if (!fr_hash_table_insert(shard->tree, entry)) return -1;
+
+	atomic_fetch_add_explicit(&state->num_entries, 1, memory_order_relaxed);
 
 	/*
 	 *	Link it to the end of the list, which is implicitely
 	 *	ordered by cleanup time.
 	 */
-	if (!state->head) {
+	if (!shard->head) {
 		entry->prev = entry->next = NULL;
-		state->head = state->tail = entry;
+		shard->head = shard->tail = entry;
 	} else {
-		rad_assert(state->tail != NULL);
+		rad_assert(shard->tail != NULL);
 
-		entry->prev = state->tail;
-		state->tail->next = entry;
+		entry->prev = shard->tail;
+		shard->tail->next = entry;
 
 		entry->next = NULL;
-		state->tail = entry;
+		shard->tail = entry;
 	}
 
-	return entry;
+	return 0;
 }
 
 /** Find the entry, based on the State attribute
  *
+ * @note Returns with the mutex of the entry's partition held, unless
+ *	the packet has no valid State attribute.
+ *
+ * @param[in] state	tree to search.
+ * @param[in] request	the packet belongs to.
+ * @param[in] packet	containing the State attribute.
+ * @param[out] out	the partition which was locked.
+ * @return the entry, or NULL if no entry was found.
  */
-static fr_state_entry_t *state_entry_find(fr_state_tree_t *state, REQUEST *request, RADIUS_PACKET *packet)
+static fr_state_entry_t *state_entry_find(fr_state_tree_t *state, REQUEST *request, RADIUS_PACKET *packet,
+					  fr_state_shard_t **out)
 {
 	VALUE_PAIR *vp;
+	fr_state_shard_t *shard;
 	fr_state_entry_t *entry, my_entry;
 
+	*out = NULL;
+
 	vp = fr_pair_find_by_num(packet->vps, 0, PW_STATE, TAG_ANY);
 	if (!vp) return NULL;
 
@@ -511,7 +641,12 @@ static fr_state_entry_t *state_entry_find(fr_state_tree_t *state, REQUEST *reque
 	 */
 	my_entry.state_comp.server_hash ^= fr_hash_string(request->server);
 
-	entry = rbtree_finddata(state->tree, &my_entry);
+	shard = state_entry_shard(state, &my_entry);
+
+	PTHREAD_MUTEX_LOCK(&shard->mutex);
+	*out = shard;
+
+	entry = fr_hash_table_finddata(shard->tree, &my_entry);
 
 	if (entry) (void) talloc_get_type_abort(entry, fr_state_entry_t);
 
@@ -523,16 +658,16 @@ static fr_state_entry_t *state_entry_find(fr_state_tree_t *state, REQUEST *reque
  */
 void fr_state_discard(fr_state_tree_t *state, REQUEST *request, RADIUS_PACKET *original)
 {
+	fr_state_shard_t *shard;
 	fr_state_entry_t *entry;
 
-	PTHREAD_MUTEX_LOCK(&state->mutex);
-	entry = state_entry_find(state, request, original);
+	entry = state_entry_find(state, request, original, &shard);
 	if (!entry) {
-		PTHREAD_MUTEX_UNLOCK(&state->mutex);
+		if (shard) PTHREAD_MUTEX_UNLOCK(&shard->mutex);
 		return;
 	}
 	state_entry_unlink(state, entry);
-	PTHREAD_MUTEX_UNLOCK(&state->mutex);
+	PTHREAD_MUTEX_UNLOCK(&shard->mutex);
 
 	/*
 	 *	The state and request must be in the same state
@@ -545,6 +680,7 @@ void fr_state_discard(fr_state_tree_t *state, REQUEST *request, RADIUS_PACKET *o
 
 	request->state_ctx = NULL;
 	request->state = NULL;
+	fr_pair_list_touch(&request->state);
 	TALLOC_FREE(entry);
 
 	return;
@@ -559,6 +695,7 @@ void fr_state_discard(fr_state_tree_t *state, REQUEST *request, RADIUS_PACKET *o
  */
 void fr_state_to_request(fr_state_tree_t *state, REQUEST *request, RADIUS_PACKET *packet)
 {
+	fr_state_shard_t *shard;
 	fr_state_entry_t *entry;
 	TALLOC_CTX *old_ctx = NULL;
 
@@ -573,15 +710,14 @@ void fr_state_to_request(fr_state_tree_t *state, REQUEST *request, RADIUS_PACKET
 		return;
 	}
 
-	PTHREAD_MUTEX_LOCK(&state->mutex);
-
-	entry = state_entry_find(state, request, packet);
+	entry = state_entry_find(state, request, packet, &shard);
 	if (entry) {
 		if (request->state_ctx) old_ctx = request->state_ctx;
 
 		request->seq_start = entry->seq_start;
 		request->state_ctx = entry->ctx;
 		request->state = entry->vps;
+		fr_pair_list_touch(&request->state);
 		request_data_restore(request, entry->data);
 
 		entry->ctx = NULL;
@@ -589,7 +725,7 @@ void fr_state_to_request(fr_state_tree_t *state, REQUEST *request, RADIUS_PACKET
 		entry->data = NULL;
 	}
 
-	PTHREAD_MUTEX_UNLOCK(&state->mutex);
+	if (shard) PTHREAD_MUTEX_UNLOCK(&shard->mutex);
 
 	if (request->state) {
 		RDEBUG2("Restored &session-state");
@@ -617,26 +753,43 @@ void fr_state_to_request(fr_state_tree_t *state, REQUEST *request, RADIUS_PACKET
  */
 bool fr_request_to_state(fr_state_tree_t *state, REQUEST *request, RADIUS_PACKET *original, RADIUS_PACKET *packet)
 {
-	fr_state_entry_t *entry, *old;
+	fr_state_shard_t *shard = NULL;
+	fr_state_entry_t *entry, *old = NULL;
+	fr_state_entry_t *free_head = NULL;
 	request_data_t *data;
 
 	request_data_by_persistance(&data, request, true);
 
 	if (!request->state && !data) return true;
 
+	/*
+	 *	The state outlives the request, and so its pair arena.
+	 */
+	(void) fr_pair_list_arena_copy(request->state_ctx, &request->state);
+
 	if (request->state) {
 		RDEBUG2("Saving &session-state");
 		rdebug_pair_list(L_DBG_LVL_2, request, request->state, "&session-state:");
 	}
 
-	PTHREAD_MUTEX_LOCK(&state->mutex);
+	if (original) old = state_entry_find(state, request, original, &shard);
 
-	old = original ? state_entry_find(state, request, original) :
-			 NULL;
+	/*
+	 *	The old entry's partition is unlocked by
+	 *	state_entry_create().
+	 */
+	if (!old && shard) PTHREAD_MUTEX_UNLOCK(&shard->mutex);
 
 	entry = state_entry_create(state, request, packet, old);
-	if (!entry) {
-		PTHREAD_MUTEX_UNLOCK(&state->mutex);
+	if (!entry) return false;
+
+	shard = entry->shard;
+	PTHREAD_MUTEX_LOCK(&shard->mutex);
+
+	if (state_entry_insert(state, entry, &free_head) < 0) {
+		PTHREAD_MUTEX_UNLOCK(&shard->mutex);
+		state_entry_list_free(free_head);
+		talloc_free(entry);
 		return false;
 	}
 
@@ -650,8 +803,11 @@ bool fr_request_to_state(fr_state_tree_t *state, REQUEST *request, RADIUS_PACKET
 
 	request->state_ctx = NULL;
 	request->state = NULL;
+	fr_pair_list_touch(&request->state);
+
+	PTHREAD_MUTEX_UNLOCK(&shard->mutex);
 
-	PTHREAD_MUTEX_UNLOCK(&state->mutex);
+	state_entry_list_free(free_head);
 
 	rad_assert(request->state == NULL);
 	VERIFY_REQUEST(request);
@@ -663,7 +819,7 @@ bool fr_request_to_state(fr_state_tree_t *state, REQUEST *request, RADIUS_PACKET
  */
 uint64_t fr_state_entries_created(fr_state_tree_t *state)
 {
-	return state->id;
+	return atomic_load_explicit(&state->id, memory_order_relaxed);
 }
 
 /** Return number of entries that timed out
@@ -671,7 +827,18 @@ uint64_t fr_state_entries_created(fr_state_tree_t *state)
  */
 uint64_t fr_state_entries_timeout(fr_state_tree_t *state)
 {
-	return state->timed_out;
+	int i;
+	uint64_t timed_out = 0;
+
+	for (i = 0; i < STATE_SHARDS; i++) {
+		fr_state_shard_t *shard = &state->shard[i];
+
+		PTHREAD_MUTEX_LOCK(&shard->mutex);
+		timed_out += shard->timed_out;
+		PTHREAD_MUTEX_UNLOCK(&shard->mutex);
+	}
+
+	return timed_out;
 }
 
 /** Return number of entries we're currently tracking
@@ -679,5 +846,5 @@ uint64_t fr_state_entries_timeout(fr_state_tree_t *state)
  */
 uint32_t fr_state_entries_tracked(fr_state_tree_t *state)
 {
-	return (uint32_t)rbtree_num_elements(state->tree);
+	return atomic_load_explicit(&state->num_entries, memory_order_relaxed);
 }
@@ -29,11 +29,22 @@ USES_APPLE_DEPRECATED_API	/* OpenSSL API has been deprecated by Apple */
 #include <freeradius-devel/heap.h>
 #include <freeradius-devel/rad_assert.h>
 #include <freeradius-devel/modules.h>
+#include <freeradius-devel/io/atomic_queue.h>
+
+#ifdef HAVE_STDATOMIC_H
+#  include <stdatomic.h>
+#else
+#  include <freeradius-devel/stdatomic.h>
+#endif
 
 #ifdef HAVE_SYS_WAIT_H
 #  include <sys/wait.h>
 #endif
 
+#ifdef HAVE_SYS_EVENTFD_H
+#  include <sys/eventfd.h>
+#endif
+
 #ifdef HAVE_OPENSSL_CRYPTO_H
 #  include <openssl/crypto.h>
 #endif
@@ -49,6 +60,12 @@ USES_APPLE_DEPRECATED_API	/* OpenSSL API has been deprecated by Apple */
 #endif
 
 #ifndef WITH_GCD
+/*
+ *	Requests the listener can hand to a thread without taking
+ *	its backlog mutex.  Anything past this goes into the backlog.
+ */
+#define THREAD_QUEUE_SIZE	(1024)
+
 /*
  *	Incoming packets are spread across all worker threads.
  */
@@ -73,9 +90,13 @@ typedef struct THREAD_HANDLE {
 	unsigned int		request_count;	//!< The number of requests that this thread has handled.
 	time_t			timestamp;	//!< When the thread started executing.
 	time_t			max_time;	//!< for current request
-	int			pipe_fd[2];	//!< for self signal
+	int			pipe_fd[2];	//!< for self signal.  Both are the same eventfd, if we have one.
 
-	pthread_mutex_t		backlog_mutex;
+	fr_atomic_queue_t	*queue;		//!< requests from the listener thread, not yet in the backlog.
+	atomic_uint		num_queued;	//!< requests given to this thread, which it hasn't started.
+	atomic_bool		sleeping;	//!< the thread is waiting for a signal.
+
+	pthread_mutex_t		backlog_mutex;	//!< only contended when the listener removes a request.
 	fr_heap_t		*backlog;
 } THREAD_HANDLE;
 
@@ -152,6 +173,7 @@ typedef struct THREAD_POOL {
 	pthread_mutex_t	thread_mutex;
 	THREAD_HANDLE	*thread_head;
 	THREAD_HANDLE	*thread_tail;
+	THREAD_HANDLE	**thread_array;		//!< for picking threads at random.
 
 	pthread_key_t	thread_handle_key;
 #endif	/* WITH_GCD */
@@ -255,6 +277,82 @@ static void link_list_tail(THREAD_HANDLE **head_p, THREAD_HANDLE **tail_p, THREA
 	}
 }
 
+/*
+ *	Wake up a thread.
+ */
+static void thread_wakeup(THREAD_HANDLE *thread)
+{
+#ifdef HAVE_SYS_EVENTFD_H
+	uint64_t data = 1;
+#else
+	char data = 0;
+#endif
+
+	if (write(thread->pipe_fd[1], &data, sizeof(data)) < 0) {
+		/* nothing */
+	}
+}
+
+/*
+ *	Tell a thread that there's a new request for it.
+ *
+ *	If the thread is already running, it will see the request
+ *	without a signal, so we don't send one.  If it's sleeping, we
+ *	send one signal, no matter how many requests are queued.
+ */
+static void thread_signal(THREAD_HANDLE *thread)
+{
+	/*
+	 *	Order the queue push before the load.  This pairs
+	 *	with the fence in thread_handler(), so either we see
+	 *	that the thread is sleeping, or it sees the request.
+	 */
+	atomic_thread_fence(memory_order_seq_cst);
+
+	if (!atomic_load_explicit(&thread->sleeping, memory_order_relaxed)) return;
+
+	if (!atomic_exchange_explicit(&thread->sleeping, false, memory_order_relaxed)) return;
+
+	thread_wakeup(thread);
+}
+
+/*
+ *	Pick a thread for a new request.
+ *
+ *	We look at two threads chosen at random, and use the one with
+ *	fewer queued requests.  That's nearly as good as finding the
+ *	least loaded thread, and doesn't require looking at all of
+ *	them.
+ */
+static THREAD_HANDLE *thread_pick(void)
+{
+	THREAD_HANDLE *a, *b;
+
+	a = thread_pool.thread_array[fr_rand() % thread_pool.total_threads];
+	if (thread_pool.total_threads == 1) return a;
+
+	b = thread_pool.thread_array[fr_rand() % thread_pool.total_threads];
+
+	if (atomic_load_explicit(&b->num_queued, memory_order_relaxed) <
+	    atomic_load_explicit(&a->num_queued, memory_order_relaxed)) return b;
+
+	return a;
+}
+
+/*
+ *	Move requests from the thread's queue to its backlog.
+ *
+ *	Must be called with the backlog mutex held.
+ */
+static void thread_queue_flush(THREAD_HANDLE *thread)
+{
+	REQUEST *request;
+
+	while (fr_atomic_queue_pop(thread->queue, (void **) &request)) {
+		fr_heap_insert(thread->backlog, request);
+	}
+}
+
 /*
  *	Add a request to the list of waiting requests.
  *	This function gets called ONLY from the main handler thread...
@@ -264,8 +362,6 @@ static void link_list_tail(THREAD_HANDLE **head_p, THREAD_HANDLE **tail_p, THREA
 void request_enqueue(REQUEST *request)
 {
 	THREAD_HANDLE *thread;
-	THREAD_HANDLE *found = NULL;
-	char data = 0;
 
 	request->component = "<core>";
 
@@ -292,32 +388,30 @@ void request_enqueue(REQUEST *request)
 	request->child_state = REQUEST_QUEUED;
 	request->module = "<queue>";
 
-	found = thread_pool.thread_head;
-
-	for (thread = thread_pool.thread_head;
-	     thread != NULL;
-	     thread = thread->next) {
-		if (fr_heap_num_elements(found->backlog) > fr_heap_num_elements(thread->backlog)) {
-			found = thread;
-		}
-	}
-
-	if (!found) return;	/* should never happen */
-
-	thread = found;
+	thread = thread_pick();
 	DEBUG3("Thread %d being signalled", thread->thread_num);
 
-	pthread_mutex_lock(&thread->backlog_mutex);
-	fr_heap_insert(thread->backlog, request);
 	request->backlog = thread->backlog;
 	request->thread_ctx = thread;
-	pthread_mutex_unlock(&thread->backlog_mutex);
+
+	atomic_fetch_add_explicit(&thread->num_queued, 1, memory_order_relaxed);
+
+	/*
+	 *	The queue is full, so the thread is busy.  Put the
+	 *	request directly into its backlog.
+	 */
+	if (!fr_atomic_queue_push(thread->queue, request)) {
+		pthread_mutex_lock(&thread->backlog_mutex);
+		thread_queue_flush(thread);
+		fr_heap_insert(thread->backlog, request);
+		pthread_mutex_unlock(&thread->backlog_mutex);
+	}
 
 	/*
 	 *	Tell the thread that there's a request available for
 	 *	it, once we're done all of the above work.
 	 */
-	(void) write(thread->pipe_fd[1], &data, 1);
+	thread_signal(thread);
 }
 
 /*
@@ -335,7 +429,16 @@ void request_queue_extract(REQUEST *request)
 	thread = request->thread_ctx;
 
 	pthread_mutex_lock(&thread->backlog_mutex);
-	(void) fr_heap_extract(request->backlog, request);
+
+	/*
+	 *	The request may still be in the queue, so move
+	 *	everything to the backlog, where we can find it.
+	 */
+	thread_queue_flush(thread);
+
+	if (fr_heap_extract(request->backlog, request)) {
+		atomic_fetch_sub_explicit(&thread->num_queued, 1, memory_order_relaxed);
+	}
 	rad_assert(request->heap_id == -1);
 	pthread_mutex_unlock(&thread->backlog_mutex);
 }
@@ -407,6 +510,68 @@ static void max_request_time_hook(UNUSED fr_event_list_t *el, UNUSED struct time
 }
 
 
+static void thread_process_request(THREAD_HANDLE *thread, REQUEST *request);
+
+/*
+ *	Drain the backlog from the listener thread.  We also add our
+ *	local event loop, backlog, and max_request_time handler to the
+ *	request.
+ */
+static void thread_backlog_drain(THREAD_HANDLE *thread, fr_heap_t *local_backlog, fr_event_list_t *el)
+{
+	REQUEST		*request;
+	struct timeval	when;
+
+	pthread_mutex_lock(&thread->backlog_mutex);
+
+	thread_queue_flush(thread);
+
+	if (fr_heap_num_elements(thread->backlog) == 0) {
+		pthread_mutex_unlock(&thread->backlog_mutex);
+		return;
+	}
+
+	gettimeofday(&when, NULL);
+	when.tv_sec += main_config.max_request_time;
+
+	do {
+		request = fr_heap_peek(thread->backlog);
+		if (!request) break;
+
+		(void) fr_heap_extract(thread->backlog, request);
+		rad_assert(request->heap_id == -1);
+		VERIFY_REQUEST(request);
+
+		atomic_fetch_sub_explicit(&thread->num_queued, 1, memory_order_relaxed);
+
+		/*
+		 *	Old-style requests get
+		 *	processed in-place, and starve
+		 *	the async requests. This is a
+		 *	hack until we get rid of the
+		 *	old-style requests.
+		 */
+		if (request->listener->old_style) {
+			pthread_mutex_unlock(&thread->backlog_mutex);
+			thread_process_request(thread, request);
+			pthread_mutex_lock(&thread->backlog_mutex);
+			continue;
+		}
+
+		request->backlog = local_backlog;
+		fr_heap_insert(local_backlog, request);
+		request->thread_ctx = NULL;
+
+		request->el = el;
+		if (fr_event_timer_insert(request->el, max_request_time_hook,
+					  request, &when, &request->ev) < 0) {
+			REDEBUG("Failed inserting max_request_time");
+		}
+	} while (request != NULL);
+
+	pthread_mutex_unlock(&thread->backlog_mutex);
+}
+
 static void thread_process_request(THREAD_HANDLE *thread, REQUEST *request)
 {
 	thread->request_count++;
@@ -458,6 +623,11 @@ static void *thread_handler(void *arg)
 	el = fr_event_list_alloc(ctx, NULL, NULL);
 	rad_assert(el != NULL);
 
+	if (main_config.timer_wheel && (fr_event_list_timer_wheel(el, true) < 0)) {
+		ERROR("Failed enabling timer wheel: %s", fr_strerror());
+		goto done;
+	}
+
 	local_backlog = fr_heap_create(timestamp_cmp, offsetof(REQUEST, heap_id));
 	rad_assert(local_backlog != NULL);
 
@@ -490,51 +660,23 @@ static void *thread_handler(void *arg)
 
 		/*
 		 *	Drain the backlog from the reader thread on
-		 *	every round through the loop.  We also add our
-		 *	local event loop, backlog, and
-		 *	max_request_time handler to the request.
+		 *	every round through the loop.
 		 */
-		if (fr_heap_num_elements(thread->backlog) > 0) {
-			struct timeval when;
+		thread_backlog_drain(thread, local_backlog, el);
 
-			gettimeofday(&when, NULL);
-			when.tv_sec += main_config.max_request_time;
-
-			pthread_mutex_lock(&thread->backlog_mutex);
-			do {
-				request = fr_heap_peek(thread->backlog);
-				if (!request) break;
-
-				(void) fr_heap_extract(thread->backlog, request);
-				rad_assert(request->heap_id == -1);
-				VERIFY_REQUEST(request);
-
-				/*
-				 *	Old-style requests get
-				 *	processed in-place, and starve
-				 *	the async requests. This is a
-				 *	hack until we get rid of the
-				 *	old-style requests.
-				 */
-				if (request->listener->old_style) {
-					pthread_mutex_unlock(&thread->backlog_mutex);
-					thread_process_request(thread, request);
-					pthread_mutex_lock(&thread->backlog_mutex);
-					continue;
-				}
-
-				request->backlog = local_backlog;
-				fr_heap_insert(local_backlog, request);
-				request->thread_ctx = NULL;
-
-				request->el = el;
-				if (fr_event_timer_insert(request->el, max_request_time_hook,
-							  request, &when, &request->ev) < 0) {
-					REDEBUG("Failed inserting max_request_time");
-				}
-			} while (request != NULL);
+		/*
+		 *	Tell the listener that we're going to sleep,
+		 *	and then check the queue one last time.  The
+		 *	listener doesn't signal us while we're
+		 *	awake, so a request which was queued just
+		 *	before we set the flag would otherwise be
+		 *	missed.
+		 */
+		if (fr_heap_num_elements(local_backlog) == 0) {
+			atomic_store_explicit(&thread->sleeping, true, memory_order_relaxed);
+			atomic_thread_fence(memory_order_seq_cst);
 
-			pthread_mutex_unlock(&thread->backlog_mutex);
+			thread_backlog_drain(thread, local_backlog, el);
 		}
 
 		/*
@@ -546,6 +688,8 @@ static void *thread_handler(void *arg)
 
 			DEBUG2("Thread %d waiting to be assigned a request", thread->thread_num);
 		} else {
+			atomic_store_explicit(&thread->sleeping, false, memory_order_relaxed);
+
 			/*
 			 *	Otherwise service the timer and FD
 			 *	queues, but return immediately and
@@ -560,6 +704,7 @@ static void *thread_handler(void *arg)
 		 *	serviced here.
 		 */
 		rcode = fr_event_corral(el, wait_for_event);
+		atomic_store_explicit(&thread->sleeping, false, memory_order_relaxed);
 		if (rcode < 0) {
 			ERROR("Thread %d failed waiting for request: %s: Exiting",
 			      thread->thread_num, fr_syserror(errno));
@@ -640,6 +785,20 @@ static THREAD_HANDLE *thread_spawn(time_t now, int do_trigger)
 	thread->status = THREAD_NONE;
 	thread->timestamp = now;
 
+#ifdef HAVE_SYS_EVENTFD_H
+	/*
+	 *	An eventfd is cheaper than a pipe, and any number of
+	 *	wakeups are coalesced into one read.
+	 */
+	thread->pipe_fd[0] = eventfd(0, EFD_NONBLOCK);
+	if (thread->pipe_fd[0] < 0) {
+		talloc_free(thread);
+		ERROR("Thread create eventfd failed: %s",
+		      fr_syserror(errno));
+		return NULL;
+	}
+	thread->pipe_fd[1] = thread->pipe_fd[0];
+#else
 	if (pipe(thread->pipe_fd) < 0) {
 		talloc_free(thread);
 		ERROR("Thread create pipe failed: %s",
@@ -651,25 +810,15 @@ static THREAD_HANDLE *thread_spawn(time_t now, int do_trigger)
 	rcode = 1;
 	(void) fcntl(thread->pipe_fd[0], F_SETNOSIGPIPE, &rcode);
 	(void) fcntl(thread->pipe_fd[1], F_SETNOSIGPIPE, &rcode);
+#endif
 	fr_nonblock(thread->pipe_fd[0]);
 	fr_nonblock(thread->pipe_fd[1]);
 #endif
 
 	/*
-	 *	Create the thread joinable, so that it can be cleaned up
-	 *	using pthread_join().
-	 *
-	 *	Note that the function returns non-zero on error, NOT
-	 *	-1.  The return code is the error, and errno isn't set.
+	 *	The backlog has to exist before the thread starts, as
+	 *	the thread checks it immediately.
 	 */
-	rcode = pthread_create(&thread->pthread_id, 0, thread_handler, thread);
-	if (rcode != 0) {
-		talloc_free(thread);
-		ERROR("Thread create failed: %s",
-		       fr_syserror(rcode));
-		return NULL;
-	}
-
 	if ((pthread_mutex_init(&thread->backlog_mutex,NULL) != 0)) {
 		talloc_free(thread);
 		ERROR("FATAL: Failed to initialize thread backlog mutex: %s",
@@ -684,6 +833,31 @@ static THREAD_HANDLE *thread_spawn(time_t now, int do_trigger)
 		return NULL;
 	}
 
+	thread->queue = fr_atomic_queue_create(thread, THREAD_QUEUE_SIZE);
+	if (!thread->queue) {
+		ERROR("FATAL: Failed to initialize thread queue");
+		talloc_free(thread);
+		return NULL;
+	}
+
+	atomic_init(&thread->num_queued, 0);
+	atomic_init(&thread->sleeping, false);
+
+	/*
+	 *	Create the thread joinable, so that it can be cleaned up
+	 *	using pthread_join().
+	 *
+	 *	Note that the function returns non-zero on error, NOT
+	 *	-1.  The return code is the error, and errno isn't set.
+	 */
+	rcode = pthread_create(&thread->pthread_id, 0, thread_handler, thread);
+	if (rcode != 0) {
+		talloc_free(thread);
+		ERROR("Thread create failed: %s",
+		       fr_syserror(rcode));
+		return NULL;
+	}
+
 	DEBUG2("Thread spawned new child %d. Total threads in pool: %d",
 	       thread->thread_num, thread_pool.total_threads + 1);
 	if (do_trigger) trigger_exec(NULL, NULL, "server.thread.start", true, NULL);
@@ -902,12 +1076,15 @@ int thread_pool_init(void)
 	 *
 	 *	FIXME: If we fail while creating them, do something intelligent.
 	 */
+	MEM(thread_pool.thread_array = talloc_array(NULL, THREAD_HANDLE *, thread_pool.start_threads));
+
 	for (i = 0; i < thread_pool.start_threads; i++) {
 		THREAD_HANDLE *thread;
 
 		thread = thread_spawn(now, 0);
 		if (!thread) return -1;
 
+		thread_pool.thread_array[i] = thread;
 		link_list_tail(&thread_pool.thread_head, &thread_pool.thread_tail, thread);
 
 		thread_pool.total_threads++;
@@ -946,7 +1123,7 @@ void thread_pool_stop(void)
 
 	for (thread = thread_pool.thread_head; thread; thread = thread->next) {
 		thread->status = THREAD_CANCELLED;
-		close(thread->pipe_fd[1]);
+		thread_wakeup(thread);
 	}
 
 	/*
@@ -955,9 +1132,14 @@ void thread_pool_stop(void)
 	for (thread = thread_pool.thread_head; thread; thread = next) {
 		next = thread->next;
 		pthread_join(thread->pthread_id, NULL);
+
+		close(thread->pipe_fd[0]);
+		if (thread->pipe_fd[1] != thread->pipe_fd[0]) close(thread->pipe_fd[1]);
 		talloc_free(thread);
 	}
 
+	TALLOC_FREE(thread_pool.thread_array);
+
 #  ifdef WNOHANG
 	fr_hash_table_free(thread_pool.waiters);
 #  endif
@@ -264,6 +264,36 @@ VALUE_PAIR **radius_list(REQUEST *request, pair_lists_t list)
 	return NULL;
 }
 
+/** Resolve a #pair_lists_t value to the index over that list
+ *
+ * Only the request, reply, control and state lists are indexed, and
+ * only while the interpreter is running the request, as that's when
+ * modifications to them are tracked.  The index is allocated the first
+ * time it's needed, and is rebuilt by #fr_pair_index_find whenever the
+ * list changes.
+ *
+ * @param[in] request containing the target lists.
+ * @param[in] list #pair_lists_t value to resolve to an index.
+ * @return
+ *	- The index for the list.
+ *	- NULL if indexes are disabled, or the list isn't indexed.
+ */
+fr_pair_index_t *radius_list_index(REQUEST *request, pair_lists_t list)
+{
+	fr_pair_index_t **index;
+
+	if (!request || !fr_pair_index_enabled()) return NULL;
+
+	if ((list < PAIR_LIST_REQUEST) || (list > PAIR_LIST_STATE)) return NULL;
+
+	if (!fr_cursor_list_watched(&request->list_watch)) return NULL;
+
+	index = &request->pair_index[list - PAIR_LIST_REQUEST];
+	if (!*index) *index = fr_pair_index_alloc(request, &request->list_watch, list - PAIR_LIST_REQUEST);
+
+	return *index;
+}
+
 /** Resolve a list to the #RADIUS_PACKET holding the HEAD pointer for a #VALUE_PAIR list
  *
  * Returns a pointer to the #RADIUS_PACKET that holds the HEAD pointer of a given list,
@@ -320,10 +350,14 @@ RADIUS_PACKET *radius_packet(REQUEST *request, pair_lists_t list)
 
 /** Return the correct TALLOC_CTX to alloc #VALUE_PAIR in, for a list
  *
- * Allocating new #VALUE_PAIR in the context of a #REQUEST is usually wrong.
- * #VALUE_PAIR should be allocated in the context of a #RADIUS_PACKET, so that if the
- * #RADIUS_PACKET is freed before the #REQUEST, the associated #VALUE_PAIR lists are
- * freed too.
+ * #VALUE_PAIR in the request, reply and control lists are allocated from the
+ * request's pair arena, so they're all released when the #REQUEST is freed.  A
+ * #RADIUS_PACKET which is handed on to another #REQUEST must have its pairs copied
+ * out of the arena first, with #fr_pair_list_arena_copy.
+ *
+ * Requests without an arena use the old contexts.  #VALUE_PAIR are allocated in the
+ * context of their #RADIUS_PACKET, so that if the #RADIUS_PACKET is freed before the
+ * #REQUEST, the associated #VALUE_PAIR lists are freed too.
  *
  * @param[in] request containing the target lists.
  * @param[in] list #pair_lists_t value to resolve to TALLOC_CTX.
@@ -339,12 +373,15 @@ TALLOC_CTX *radius_list_ctx(REQUEST *request, pair_lists_t list)
 
 	switch (list) {
 	case PAIR_LIST_REQUEST:
+		if (request->pair_arena) return request->pair_arena;
 		return request->packet;
 
 	case PAIR_LIST_REPLY:
+		if (request->pair_arena) return request->pair_arena;
 		return request->reply;
 
 	case PAIR_LIST_CONTROL:
+		if (request->pair_arena) return request->pair_arena;
 		return request;
 
 	case PAIR_LIST_STATE:
@@ -2108,9 +2145,24 @@ VALUE_PAIR *tmpl_cursor_init(int *err, vp_cursor_t *cursor, REQUEST *request, vp
 	 *	May not may not be found, but it *is* a known name.
 	 */
 	case TMPL_TYPE_ATTR:
+	{
+		fr_pair_index_t *index;
+
+		/*
+		 *	Find the first instance with the list index if
+		 *	there is one, and position the cursor as if we'd
+		 *	searched for it.  Later instances are found by
+		 *	searching onwards from there.
+		 */
+		index = radius_list_index(request, vpt->tmpl_list);
+		if (index) {
+			vp = fr_pair_cursor_seek(cursor, fr_pair_index_find(index, vps, vpt->tmpl_da, vpt->tmpl_tag));
+		} else {
+			vp = fr_pair_cursor_next_by_da(cursor, vpt->tmpl_da, vpt->tmpl_tag);
+		}
+
 		switch (vpt->tmpl_num) {
 		case NUM_ANY:
-			vp = fr_pair_cursor_next_by_da(cursor, vpt->tmpl_da, vpt->tmpl_tag);
 			if (!vp) {
 				if (err) *err = -1;
 				return NULL;
@@ -2125,11 +2177,11 @@ VALUE_PAIR *tmpl_cursor_init(int *err, vp_cursor_t *cursor, REQUEST *request, vp
 		{
 			VALUE_PAIR *last = NULL;
 
-			while ((vp = fr_pair_cursor_next_by_da(cursor, vpt->tmpl_da, vpt->tmpl_tag))) {
+			while (vp) {
 				VERIFY_VP(vp);
 				last = vp;
+				vp = fr_pair_cursor_next_by_da(cursor, vpt->tmpl_da, vpt->tmpl_tag);
 			}
-			VERIFY_VP(last);
 			if (!last) break;
 			return last;
 		}
@@ -2143,19 +2195,21 @@ VALUE_PAIR *tmpl_cursor_init(int *err, vp_cursor_t *cursor, REQUEST *request, vp
 		 *	total number of attributes.
 		 */
 		case NUM_COUNT:
-			return fr_pair_cursor_next_by_da(cursor, vpt->tmpl_da, vpt->tmpl_tag);
+			return vp;
 
 		default:
 			num = vpt->tmpl_num;
-			while ((vp = fr_pair_cursor_next_by_da(cursor, vpt->tmpl_da, vpt->tmpl_tag))) {
+			while (vp) {
 				VERIFY_VP(vp);
 				if (num-- <= 0) return vp;
+				vp = fr_pair_cursor_next_by_da(cursor, vpt->tmpl_da, vpt->tmpl_tag);
 			}
 			break;
 		}
 
 		if (err) *err = -1;
 		return NULL;
+	}
 
 	case TMPL_TYPE_LIST:
 		switch (vpt->tmpl_num) {
@@ -1025,6 +1025,7 @@ static void NEVER_RETURNS usage(void)
 	fprintf(stderr, "usage: unit_test_attribute [OPTS] filename\n");
 	fprintf(stderr, "  -d <raddb>             Set user dictionary directory (defaults to " RADDBDIR ").\n");
 	fprintf(stderr, "  -D <dictdir>           Set main dictionary directory (defaults to " DICTDIR ").\n");
+	fprintf(stderr, "  -k <cachedir>          Cache parsed dictionaries in this directory.\n");
 	fprintf(stderr, "  -x                     Debugging mode.\n");
 	fprintf(stderr, "  -M                     Show talloc memory report.\n");
 
@@ -1050,13 +1051,19 @@ int main(int argc, char *argv[])
 	}
 #endif
 
-	while ((c = getopt(argc, argv, "d:D:xMh")) != EOF) switch (c) {
+	while ((c = getopt(argc, argv, "d:D:k:xMh")) != EOF) switch (c) {
 		case 'd':
 			radius_dir = optarg;
 			break;
 		case 'D':
 			dict_dir = optarg;
 			break;
+		case 'k':
+			if (fr_dict_cache_dir(optarg) < 0) {
+				fr_perror("unit_test_attribute");
+				exit(EXIT_FAILURE);
+			}
+			break;
 		case 'x':
 			fr_debug_lvl++;
 			rad_debug_lvl = fr_debug_lvl;
@@ -1369,12 +1369,32 @@ void unlang_push_section(REQUEST *request, CONF_SECTION *cs, rlm_rcode_t action)
 	stack->frame[stack->depth].top_frame = true;
 }
 
+/** Run the interpreter, tracking modifications to the request's lists
+ *
+ * The request's list indexes can only be trusted while modifications
+ * are tracked.  See radius_list_index().  Whatever request was running
+ * before, e.g. the parent of a subrequest, is tracked again afterwards.
+ */
+static inline rlm_rcode_t unlang_run_watched(REQUEST *request, unlang_stack_t *stack)
+{
+	fr_cursor_list_watch_t	*old;
+	rlm_rcode_t		rcode;
+
+	if (!fr_pair_index_enabled()) return unlang_run(request, stack);
+
+	old = fr_cursor_list_watch(&request->list_watch);
+	rcode = unlang_run(request, stack);
+	fr_cursor_list_watch(old);
+
+	return rcode;
+}
+
 /** Continue interpreting after a previous push or yield.
  *
  */
 rlm_rcode_t unlang_interpret_continue(REQUEST *request)
 {
-	return unlang_run(request, request->stack);
+	return unlang_run_watched(request, request->stack);
 }
 
 /** Call a module, iteratively, with a local stack, rather than recursively
@@ -1392,7 +1412,7 @@ rlm_rcode_t unlang_interpret(REQUEST *request, CONF_SECTION *cs, rlm_rcode_t act
 	 */
 	unlang_push_section(request, cs, action);
 
-	rcode = unlang_run(request, stack);
+	rcode = unlang_run_watched(request, stack);
 	if (rcode != RLM_MODULE_YIELD) {
 		rad_assert(stack->frame[stack->depth].top_frame);
 		rad_assert(!stack->frame[stack->depth].instruction || /* processed the whole section */
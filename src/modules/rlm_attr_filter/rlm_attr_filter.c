@@ -295,6 +295,7 @@ static rlm_rcode_t CC_HINT(nonnull(1,2)) attr_filter_common(void const *instance
 	 */
 	fr_pair_list_free(&packet->vps);
 	packet->vps = output;
+	fr_pair_list_touch(&packet->vps);
 
 	if (request->packet->code == PW_CODE_ACCESS_REQUEST) {
 		request->username = fr_pair_find_by_num(request->packet->vps, 0, PW_STRIPPED_USER_NAME, TAG_ANY);
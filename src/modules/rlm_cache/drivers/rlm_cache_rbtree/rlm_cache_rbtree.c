@@ -277,7 +277,7 @@ static cache_status_t cache_entry_insert(rlm_cache_config_t const *config, void
  */
 static cache_status_t cache_entry_set_ttl(UNUSED rlm_cache_config_t const *config, void *instance,
 					  REQUEST *request, UNUSED void *handle,
-					  rlm_cache_entry_t *c)
+					  rlm_cache_entry_t *c, time_t expires)
 {
 	rlm_cache_rbtree_t *driver = instance;
 	int ret;
@@ -293,6 +293,7 @@ static cache_status_t cache_entry_set_ttl(UNUSED rlm_cache_config_t const *confi
 		return CACHE_ERROR;
 	}
 
+	c->expires = expires;
 	if (!fr_heap_insert(driver->heap, c)) {
 		rbtree_deletebydata(driver->cache, c);	/* make sure we don't leak entries... */
 		RERROR("Failed updating entry TTL.  Entry was forcefully expired");
@@ -0,0 +1,761 @@
+/*
+ *   This program is is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or (at
+ *   your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA
+ */
+
+/**
+ * $Id$
+ * @file rlm_cache_sharded.c
+ * @brief Sharded in memory cache.
+ *
+ * Entries are spread over a number of shards, based on a hash of the key.
+ * Each shard has its own mutex, hash table, expiry heap and eviction list,
+ * so workers looking up different keys rarely contend.
+ *
+ * The shard is only locked for the duration of a single driver call, so
+ * entries are reference counted.  The shard holds one reference, and
+ * rlm_cache holds another from #cache_entry_find until it calls
+ * #cache_entry_free.  An entry which is expired or evicted whilst a request
+ * is still using it is freed when the request is done with it.
+ *
+ * Other requests may be reading an entry's fields without the shard locked,
+ * so they're never changed once it's inserted.  The expiry time which
+ * matters is the shard's copy, which is checked and updated with the shard
+ * locked.
+ *
+ * @copyright 2017 The FreeRADIUS server project
+ */
+#include <freeradius-devel/radiusd.h>
+#include <freeradius-devel/heap.h>
+#include <freeradius-devel/rad_assert.h>
+#include <stdalign.h>
+
+#ifdef HAVE_STDATOMIC_H
+#  include <stdatomic.h>
+#else
+#  include <freeradius-devel/stdatomic.h>
+#endif
+
+#include "../../rlm_cache.h"
+
+/*
+ *	More shards than this just wastes memory.
+ */
+#define CACHE_SHARDS_MAX	(1024)
+
+/*
+ *	What rlm_cache sees as the expiry time of an entry in the cache.
+ *	Expired entries are never returned, so it doesn't need to check.
+ */
+#define CACHE_EXPIRES_NEVER	((time_t) ((sizeof(time_t) > 4) ? INT64_MAX : INT32_MAX))
+
+typedef enum {
+	CACHE_EVICT_LRU = 0,				//!< Evict the least recently used entry.
+	CACHE_EVICT_CLOCK				//!< Evict the oldest entry which hasn't been
+							//!< used since the clock hand last passed it.
+} cache_evict_t;
+
+static const FR_NAME_NUMBER cache_evict_table[] = {
+	{ "lru",	CACHE_EVICT_LRU		},
+	{ "clock",	CACHE_EVICT_CLOCK	},
+
+	{  NULL , -1 }
+};
+
+typedef enum {
+	CACHE_STAT_ENTRIES = 0,				//!< Entries in the cache.
+	CACHE_STAT_MEMORY,				//!< Memory used by entries.
+	CACHE_STAT_HITS,				//!< Lookups which found an entry.
+	CACHE_STAT_MISSES,				//!< Lookups which didn't.
+	CACHE_STAT_INSERTS,				//!< Entries inserted.
+	CACHE_STAT_EXPIRED,				//!< Entries removed because their TTL passed.
+	CACHE_STAT_EVICTED				//!< Entries removed to stay under max_memory.
+} cache_stat_t;
+
+static const FR_NAME_NUMBER cache_stat_table[] = {
+	{ "entries",	CACHE_STAT_ENTRIES	},
+	{ "memory",	CACHE_STAT_MEMORY	},
+	{ "hits",	CACHE_STAT_HITS		},
+	{ "misses",	CACHE_STAT_MISSES	},
+	{ "inserts",	CACHE_STAT_INSERTS	},
+	{ "expired",	CACHE_STAT_EXPIRED	},
+	{ "evicted",	CACHE_STAT_EVICTED	},
+
+	{  NULL , -1 }
+};
+
+typedef struct rlm_cache_shard rlm_cache_shard_t;
+
+typedef struct rlm_cache_sharded_entry {
+	rlm_cache_entry_t	fields;			//!< Entry data.  Must be first.
+
+	rlm_cache_shard_t	*shard;			//!< Shard the entry was inserted into.
+	uint32_t		hash;			//!< Of the key.
+	time_t			expires;		//!< Expiry time used to order the heap.  Only
+							//!< accessed with the shard locked.
+	size_t			offset;			//!< Offset used for heap.
+	size_t			size;			//!< Memory used by the entry.
+
+	uint32_t		refs;			//!< References held by the shard and by requests.
+	bool			linked;			//!< Whether the entry is in the shard.
+	bool			referenced;		//!< Used since the clock hand last passed.
+
+	struct rlm_cache_sharded_entry *prev;		//!< Previous entry in the eviction list.
+	struct rlm_cache_sharded_entry *next;		//!< Next entry in the eviction list.
+} rlm_cache_sharded_entry_t;
+
+/** A partition of the cache
+ *
+ * Aligned so that threads locking different shards don't share a cache line.
+ */
+struct rlm_cache_shard {
+	alignas(128) pthread_mutex_t mutex;		//!< Protects everything in the shard.
+	fr_hash_table_t		*table;			//!< For looking up cache keys.
+	fr_heap_t		*heap;			//!< For managing entry expiry.
+
+	rlm_cache_sharded_entry_t *head;		//!< Most recently inserted (or used, for LRU).
+	rlm_cache_sharded_entry_t *tail;		//!< Next candidate for eviction.
+
+	size_t			size;			//!< Memory used by entries in the shard.
+	size_t			max_size;		//!< Evict entries above this.  0 means no limit.
+
+	uint64_t		hits;			//!< Lookups which found an entry.
+	uint64_t		misses;			//!< Lookups which didn't.
+	uint64_t		inserts;		//!< Entries inserted.
+	uint64_t		expired;		//!< Entries removed because their TTL passed.
+	uint64_t		evicted;		//!< Entries removed to stay under max_size.
+};
+
+typedef struct rlm_cache_sharded {
+	uint32_t		num_shards;		//!< Number of shards.  Rounded up to a power of two.
+	size_t			max_memory;		//!< Memory limit for the whole cache.
+	char const		*eviction_str;		//!< Eviction policy name.
+	cache_evict_t		eviction;		//!< Eviction policy.
+
+	atomic_uint		num_entries;		//!< Number of entries in all shards.
+	rlm_cache_shard_t	*shard;			//!< Independently locked partitions.
+} rlm_cache_sharded_t;
+
+static const CONF_PARSER driver_config[] = {
+	{ FR_CONF_OFFSET("shards", FR_TYPE_UINT32, rlm_cache_sharded_t, num_shards), .dflt = "16" },
+	{ FR_CONF_OFFSET("max_memory", FR_TYPE_SIZE, rlm_cache_sharded_t, max_memory), .dflt = "0" },
+	{ FR_CONF_OFFSET("eviction", FR_TYPE_STRING, rlm_cache_sharded_t, eviction_str), .dflt = "lru" },
+	CONF_PARSER_TERMINATOR
+};
+
+/** Hash an entry by its key
+ *
+ */
+static uint32_t cache_entry_hash(void const *data)
+{
+	rlm_cache_sharded_entry_t const *c = data;
+
+	return c->hash;
+}
+
+/** Compare two entries by key
+ *
+ * There may only be one entry with the same key.
+ */
+static int cache_entry_cmp(void const *one, void const *two)
+{
+	rlm_cache_entry_t const *a = one;
+	rlm_cache_entry_t const *b = two;
+
+	if (a->key_len < b->key_len) return -1;
+	if (a->key_len > b->key_len) return +1;
+
+	return memcmp(a->key, b->key, a->key_len);
+}
+
+/** Compare two entries by expiry time
+ *
+ * There may be multiple entries with the same expiry time.
+ */
+static int cache_heap_cmp(void const *one, void const *two)
+{
+	rlm_cache_sharded_entry_t const *a = one;
+	rlm_cache_sharded_entry_t const *b = two;
+
+	if (a->expires < b->expires) return -1;
+	if (a->expires > b->expires) return +1;
+
+	return 0;
+}
+
+/** Find the shard for a key hash
+ *
+ * The hash tables use the low bits of the hash, so we use bits from the
+ * middle.  Otherwise every entry in a shard would end up in the same
+ * fraction of its hash table.
+ */
+static inline rlm_cache_shard_t *cache_shard(rlm_cache_sharded_t *driver, uint32_t hash)
+{
+	return &driver->shard[(hash >> 16) & (driver->num_shards - 1)];
+}
+
+static inline void cache_list_remove(rlm_cache_shard_t *shard, rlm_cache_sharded_entry_t *c)
+{
+	if (c->prev) {
+		c->prev->next = c->next;
+	} else {
+		shard->head = c->next;
+	}
+	if (c->next) {
+		c->next->prev = c->prev;
+	} else {
+		shard->tail = c->prev;
+	}
+	c->prev = c->next = NULL;
+}
+
+static inline void cache_list_insert_head(rlm_cache_shard_t *shard, rlm_cache_sharded_entry_t *c)
+{
+	c->prev = NULL;
+	c->next = shard->head;
+	if (shard->head) {
+		shard->head->prev = c;
+	} else {
+		shard->tail = c;
+	}
+	shard->head = c;
+}
+
+/** Remove an entry from its shard
+ *
+ * The shard must be locked.  If the shard held the last reference, the
+ * entry is added to the dead list, to be freed once the shard is unlocked.
+ */
+static void cache_shard_unlink(rlm_cache_sharded_t *driver, rlm_cache_shard_t *shard,
+			       rlm_cache_sharded_entry_t *c, rlm_cache_sharded_entry_t **dead)
+{
+	rad_assert(c->linked);
+
+	fr_hash_table_yank(shard->table, c);
+	fr_heap_extract(shard->heap, c);
+	cache_list_remove(shard, c);
+
+	shard->size -= c->size;
+	atomic_fetch_sub_explicit(&driver->num_entries, 1, memory_order_relaxed);
+	c->linked = false;
+
+	if (--c->refs > 0) return;
+
+	c->next = *dead;
+	*dead = c;
+}
+
+/** Free entries removed from a shard, after the shard has been unlocked
+ *
+ */
+static void cache_entries_free(rlm_cache_sharded_entry_t *dead)
+{
+	rlm_cache_sharded_entry_t *next;
+
+	for (; dead; dead = next) {
+		next = dead->next;
+		talloc_free(dead);
+	}
+}
+
+/** Remove expired entries from a shard
+ *
+ * The shard must be locked.
+ */
+static void cache_shard_expire(rlm_cache_sharded_t *driver, rlm_cache_shard_t *shard, time_t now,
+			       rlm_cache_sharded_entry_t **dead)
+{
+	rlm_cache_sharded_entry_t *c;
+
+	while ((c = fr_heap_peek(shard->heap)) && (c->expires < now)) {
+		cache_shard_unlink(driver, shard, c, dead);
+		shard->expired++;
+	}
+}
+
+/** Evict one entry from a shard
+ *
+ * The shard must be locked, and must not be empty.
+ */
+static void cache_shard_evict(rlm_cache_sharded_t *driver, rlm_cache_shard_t *shard,
+			      rlm_cache_sharded_entry_t **dead)
+{
+	rlm_cache_sharded_entry_t *c = shard->tail;
+
+	/*
+	 *	Give entries which have been used since we last
+	 *	passed them a second chance.  Each entry has its
+	 *	flag cleared at most once, so this terminates.
+	 */
+	if (driver->eviction == CACHE_EVICT_CLOCK) while (c->referenced) {
+		c->referenced = false;
+		cache_list_remove(shard, c);
+		cache_list_insert_head(shard, c);
+		c = shard->tail;
+	}
+
+	cache_shard_unlink(driver, shard, c, dead);
+	shard->evicted++;
+}
+
+/** Record that an entry was used
+ *
+ * The shard must be locked.
+ */
+static inline void cache_shard_touch(rlm_cache_sharded_t *driver, rlm_cache_shard_t *shard,
+				     rlm_cache_sharded_entry_t *c)
+{
+	switch (driver->eviction) {
+	case CACHE_EVICT_LRU:
+		if (shard->head == c) return;
+		cache_list_remove(shard, c);
+		cache_list_insert_head(shard, c);
+		return;
+
+	case CACHE_EVICT_CLOCK:
+		c->referenced = true;
+		return;
+	}
+}
+
+/** Cleanup a cache_sharded instance
+ *
+ */
+static int mod_detach(void *instance)
+{
+	rlm_cache_sharded_t	*driver = instance;
+	uint32_t		i;
+
+	if (!driver->shard) return 0;
+
+	for (i = 0; i < driver->num_shards; i++) {
+		rlm_cache_shard_t		*shard = &driver->shard[i];
+		rlm_cache_sharded_entry_t	*c, *next;
+		uint64_t			lookups;
+
+		if (!shard->table) continue;
+
+		lookups = shard->hits + shard->misses;
+		DEBUG2("rlm_cache_sharded - shard %u: %" PRIu64 " hits, %" PRIu64 " misses (%.1f%% hit ratio), "
+		       "%" PRIu64 " inserted, %" PRIu64 " expired, %" PRIu64 " evicted", i,
+		       shard->hits, shard->misses, lookups ? (100.0 * shard->hits) / lookups : 0.0,
+		       shard->inserts, shard->expired, shard->evicted);
+
+		for (c = shard->head; c; c = next) {
+			next = c->next;
+			talloc_free(c);
+		}
+
+		fr_hash_table_free(shard->table);
+		if (shard->heap) fr_heap_delete(shard->heap);
+		pthread_mutex_destroy(&shard->mutex);
+	}
+
+	return 0;
+}
+
+/** Create a new cache_sharded instance
+ *
+ * @copydetails cache_instantiate_t
+ */
+static int mod_instantiate(UNUSED rlm_cache_config_t const *config, void *instance, CONF_SECTION *conf)
+{
+	rlm_cache_sharded_t	*driver = instance;
+	uint32_t		i, num_shards;
+
+	driver->eviction = fr_str2int(cache_evict_table, driver->eviction_str, -1);
+	if ((int) driver->eviction < 0) {
+		cf_log_err_cs(conf, "Invalid eviction policy \"%s\", must be \"lru\" or \"clock\"",
+			      driver->eviction_str);
+		return -1;
+	}
+
+	FR_INTEGER_BOUND_CHECK("shards", driver->num_shards, >=, 1);
+	FR_INTEGER_BOUND_CHECK("shards", driver->num_shards, <=, CACHE_SHARDS_MAX);
+
+	for (num_shards = 1; num_shards < driver->num_shards; num_shards <<= 1);
+	driver->num_shards = num_shards;
+
+	driver->shard = talloc_zero_array(driver, rlm_cache_shard_t, driver->num_shards);
+	if (!driver->shard) {
+		ERROR("Failed allocating cache shards");
+		return -1;
+	}
+
+	/*
+	 *	The hash tables and heaps grow after the instance
+	 *	data has been marked read only, so they're allocated
+	 *	in the NULL ctx, and freed in mod_detach.
+	 */
+	for (i = 0; i < driver->num_shards; i++) {
+		rlm_cache_shard_t *shard = &driver->shard[i];
+
+		if (pthread_mutex_init(&shard->mutex, NULL) < 0) {
+			ERROR("Failed initializing mutex: %s", fr_syserror(errno));
+			return -1;
+		}
+
+		shard->table = fr_hash_table_create(NULL, cache_entry_hash, cache_entry_cmp, NULL);
+		if (!shard->table) {
+			pthread_mutex_destroy(&shard->mutex);
+			ERROR("Failed to create cache");
+			return -1;
+		}
+
+		shard->heap = fr_heap_create(cache_heap_cmp, offsetof(rlm_cache_sharded_entry_t, offset));
+		if (!shard->heap) {
+			ERROR("Failed to create heap for the cache");
+			return -1;
+		}
+
+		shard->max_size = driver->max_memory / driver->num_shards;
+	}
+
+	return 0;
+}
+
+/** Custom allocation function for the driver
+ *
+ * Allows allocation of cache entry structures with additional fields.
+ *
+ * @copydetails cache_entry_alloc_t
+ */
+static rlm_cache_entry_t *cache_entry_alloc(UNUSED rlm_cache_config_t const *config, UNUSED void *instance,
+					    REQUEST *request)
+{
+	rlm_cache_sharded_entry_t *c;
+
+	c = talloc_zero(NULL, rlm_cache_sharded_entry_t);
+	if (!c) {
+		RERROR("Failed allocating cache entry");
+		return NULL;
+	}
+	c->refs = 1;			/* the caller's */
+
+	return (rlm_cache_entry_t *)c;
+}
+
+/** Release a reference to an entry
+ *
+ * The entry is freed if it's no longer in the cache, and no other
+ * requests are using it.
+ *
+ * @copydetails cache_entry_free_t
+ */
+static void cache_entry_free(rlm_cache_entry_t *entry)
+{
+	rlm_cache_sharded_entry_t	*c = (rlm_cache_sharded_entry_t *)entry;
+	rlm_cache_shard_t		*shard = c->shard;
+	bool				last;
+
+	if (!shard) {
+		talloc_free(c);
+		return;
+	}
+
+	pthread_mutex_lock(&shard->mutex);
+	last = (--c->refs == 0);
+	pthread_mutex_unlock(&shard->mutex);
+
+	if (last) talloc_free(c);
+}
+
+/** Locate a cache entry
+ *
+ * @copydetails cache_entry_find_t
+ */
+static cache_status_t cache_entry_find(rlm_cache_entry_t **out,
+				       UNUSED rlm_cache_config_t const *config, void *instance,
+				       REQUEST *request, UNUSED void *handle, uint8_t const *key, size_t key_len)
+{
+	rlm_cache_sharded_t		*driver = instance;
+	rlm_cache_shard_t		*shard;
+	rlm_cache_sharded_entry_t	*c, my_c, *dead = NULL;
+
+	my_c.fields.key = key;
+	my_c.fields.key_len = key_len;
+	my_c.hash = fr_hash(key, key_len);
+
+	shard = cache_shard(driver, my_c.hash);
+
+	pthread_mutex_lock(&shard->mutex);
+
+	/*
+	 *	Clear out old entries
+	 */
+	cache_shard_expire(driver, shard, request->packet->timestamp.tv_sec, &dead);
+
+	/*
+	 *	Is there an entry for this key?
+	 */
+	c = fr_hash_table_finddata(shard->table, &my_c);
+	if (!c) {
+		shard->misses++;
+		pthread_mutex_unlock(&shard->mutex);
+
+		cache_entries_free(dead);
+		*out = NULL;
+		return CACHE_MISS;
+	}
+
+	shard->hits++;
+	c->refs++;			/* released by cache_entry_free */
+	cache_shard_touch(driver, shard, c);
+
+	pthread_mutex_unlock(&shard->mutex);
+
+	cache_entries_free(dead);
+	*out = &c->fields;
+
+	return CACHE_OK;
+}
+
+/** Remove an entry from the data store
+ *
+ * @copydetails cache_entry_expire_t
+ */
+static cache_status_t cache_entry_expire(UNUSED rlm_cache_config_t const *config, void *instance,
+					 REQUEST *request, UNUSED void *handle,
+					 uint8_t const *key, size_t key_len)
+{
+	rlm_cache_sharded_t		*driver = instance;
+	rlm_cache_shard_t		*shard;
+	rlm_cache_sharded_entry_t	*c, my_c, *dead = NULL;
+
+	if (!request) return CACHE_ERROR;
+
+	my_c.fields.key = key;
+	my_c.fields.key_len = key_len;
+	my_c.hash = fr_hash(key, key_len);
+
+	shard = cache_shard(driver, my_c.hash);
+
+	pthread_mutex_lock(&shard->mutex);
+	c = fr_hash_table_finddata(shard->table, &my_c);
+	if (!c) {
+		pthread_mutex_unlock(&shard->mutex);
+		return CACHE_MISS;
+	}
+	cache_shard_unlink(driver, shard, c, &dead);
+	pthread_mutex_unlock(&shard->mutex);
+
+	cache_entries_free(dead);
+
+	return CACHE_OK;
+}
+
+/** Insert a new entry into the data store
+ *
+ * Existing entries with the same key are replaced.  If the shard is over
+ * its memory limit, entries are evicted to make room.
+ *
+ * @copydetails cache_entry_insert_t
+ */
+static cache_status_t cache_entry_insert(UNUSED rlm_cache_config_t const *config, void *instance,
+					 REQUEST *request, UNUSED void *handle,
+					 rlm_cache_entry_t const *entry)
+{
+	rlm_cache_sharded_t		*driver = instance;
+	rlm_cache_shard_t		*shard;
+	rlm_cache_sharded_entry_t	*c, *old, *dead = NULL;
+
+	if (!request) return CACHE_ERROR;
+
+	memcpy(&c, &entry, sizeof(c));
+
+	if (!rad_cond_assert(!c->linked)) return CACHE_ERROR;
+
+	c->hash = fr_hash(c->fields.key, c->fields.key_len);
+	c->shard = shard = cache_shard(driver, c->hash);
+	c->size = talloc_total_size(c);
+
+	if (shard->max_size && (c->size > shard->max_size)) {
+		RWDEBUG("Entry is larger than the cache shard (%zu > %zu bytes), not caching it",
+			c->size, shard->max_size);
+		return CACHE_ERROR;
+	}
+
+	pthread_mutex_lock(&shard->mutex);
+
+	cache_shard_expire(driver, shard, request->packet->timestamp.tv_sec, &dead);
+
+	/*
+	 *	Allow overwriting
+	 */
+	old = fr_hash_table_finddata(shard->table, c);
+	if (old) cache_shard_unlink(driver, shard, old, &dead);
+
+	while (shard->max_size && shard->tail && ((shard->size + c->size) > shard->max_size)) {
+		cache_shard_evict(driver, shard, &dead);
+	}
+
+	if (!fr_hash_table_insert(shard->table, c)) {
+		pthread_mutex_unlock(&shard->mutex);
+		cache_entries_free(dead);
+		RERROR("Failed adding entry");
+		return CACHE_ERROR;
+	}
+
+	c->expires = c->fields.expires;
+	if (!fr_heap_insert(shard->heap, c)) {
+		fr_hash_table_yank(shard->table, c);
+		pthread_mutex_unlock(&shard->mutex);
+		cache_entries_free(dead);
+		RERROR("Failed adding entry to expiry heap");
+		return CACHE_ERROR;
+	}
+
+	cache_list_insert_head(shard, c);
+	c->fields.expires = CACHE_EXPIRES_NEVER;
+	shard->size += c->size;
+	shard->inserts++;
+	atomic_fetch_add_explicit(&driver->num_entries, 1, memory_order_relaxed);
+	c->linked = true;
+	c->refs++;			/* the shard's */
+
+	pthread_mutex_unlock(&shard->mutex);
+
+	cache_entries_free(dead);
+
+	return CACHE_OK;
+}
+
+/** Update the TTL of an entry
+ *
+ * @copydetails cache_entry_set_ttl_t
+ */
+static cache_status_t cache_entry_set_ttl(UNUSED rlm_cache_config_t const *config, void *instance,
+					  REQUEST *request, UNUSED void *handle,
+					  rlm_cache_entry_t *entry, time_t expires)
+{
+	rlm_cache_sharded_t		*driver = instance;
+	rlm_cache_sharded_entry_t	*c = (rlm_cache_sharded_entry_t *)entry;
+	rlm_cache_shard_t		*shard = c->shard;
+	rlm_cache_sharded_entry_t	*dead = NULL;
+
+	if (!shard) return CACHE_ERROR;
+
+	pthread_mutex_lock(&shard->mutex);
+
+	/*
+	 *	Expired or evicted by another request since we found it.
+	 */
+	if (!c->linked) {
+		pthread_mutex_unlock(&shard->mutex);
+		RWDEBUG("Entry was removed from the cache before its TTL could be updated");
+		return CACHE_MISS;
+	}
+
+	fr_heap_extract(shard->heap, c);
+	c->expires = expires;
+	if (!fr_heap_insert(shard->heap, c)) {
+		cache_shard_unlink(driver, shard, c, &dead);
+		pthread_mutex_unlock(&shard->mutex);
+		cache_entries_free(dead);
+		RERROR("Failed updating entry TTL.  Entry was forcefully expired");
+		return CACHE_ERROR;
+	}
+
+	pthread_mutex_unlock(&shard->mutex);
+
+	return CACHE_OK;
+}
+
+/** Return the number of entries in the cache
+ *
+ * @copydetails cache_entry_count_t
+ */
+static uint32_t cache_entry_count(UNUSED rlm_cache_config_t const *config, void *instance,
+				  UNUSED REQUEST *request, UNUSED void *handle)
+{
+	rlm_cache_sharded_t *driver = instance;
+
+	return atomic_load_explicit(&driver->num_entries, memory_order_relaxed);
+}
+
+/** Return a statistic, summed over all of the shards
+ *
+ * @copydetails cache_stats_t
+ */
+static int cache_stats(uint64_t *out, UNUSED rlm_cache_config_t const *config, void *instance, char const *name)
+{
+	rlm_cache_sharded_t	*driver = instance;
+	int			stat;
+	uint32_t		i;
+
+	stat = fr_str2int(cache_stat_table, name, -1);
+	if (stat < 0) return -1;
+
+	if (stat == CACHE_STAT_ENTRIES) {
+		*out = atomic_load_explicit(&driver->num_entries, memory_order_relaxed);
+		return 0;
+	}
+
+	*out = 0;
+	for (i = 0; i < driver->num_shards; i++) {
+		rlm_cache_shard_t *shard = &driver->shard[i];
+
+		pthread_mutex_lock(&shard->mutex);
+		switch (stat) {
+		case CACHE_STAT_MEMORY:
+			*out += shard->size;
+			break;
+
+		case CACHE_STAT_HITS:
+			*out += shard->hits;
+			break;
+
+		case CACHE_STAT_MISSES:
+			*out += shard->misses;
+			break;
+
+		case CACHE_STAT_INSERTS:
+			*out += shard->inserts;
+			break;
+
+		case CACHE_STAT_EXPIRED:
+			*out += shard->expired;
+			break;
+
+		case CACHE_STAT_EVICTED:
+			*out += shard->evicted;
+			break;
+
+		default:
+			break;
+		}
+		pthread_mutex_unlock(&shard->mutex);
+	}
+
+	return 0;
+}
+
+extern cache_driver_t rlm_cache_sharded;
+cache_driver_t rlm_cache_sharded = {
+	.name		= "rlm_cache_sharded",
+	.magic		= RLM_MODULE_INIT,
+	.instantiate	= mod_instantiate,
+	.detach		= mod_detach,
+	.inst_size	= sizeof(rlm_cache_sharded_t),
+	.config		= driver_config,
+	.alloc		= cache_entry_alloc,
+	.free		= cache_entry_free,
+
+	.find		= cache_entry_find,
+	.insert		= cache_entry_insert,
+	.expire		= cache_entry_expire,
+	.set_ttl	= cache_entry_set_ttl,
+	.count		= cache_entry_count,
+	.stats		= cache_stats,
+};
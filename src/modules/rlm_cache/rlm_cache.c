@@ -163,7 +163,7 @@ static rlm_rcode_t cache_merge(rlm_cache_t const *inst, REQUEST *request, rlm_ca
 			rad_assert(vp != NULL);
 			fr_pair_add(&request->packet->vps, vp);
 		}
-		vp->vp_uint32 = c->hits;
+		vp->vp_uint32 = atomic_load_explicit(&c->hits, memory_order_relaxed);
 	}
 
 	return merged > 0 ?
@@ -244,7 +244,7 @@ static rlm_rcode_t cache_find(rlm_cache_entry_t **out, rlm_cache_t const *inst,
 		talloc_free(p);
 	}
 
-	c->hits++;
+	atomic_fetch_add_explicit(&c->hits, 1, memory_order_relaxed);
 	*out = c;
 
 	return RLM_MODULE_OK;
@@ -467,26 +467,32 @@ static rlm_rcode_t cache_insert(rlm_cache_t const *inst, REQUEST *request, rlm_c
  *	- #RLM_MODULE_FAIL on failure.
  */
 static rlm_rcode_t cache_set_ttl(rlm_cache_t const *inst, REQUEST *request,
-				 rlm_cache_handle_t **handle, rlm_cache_entry_t *c)
+				 rlm_cache_handle_t **handle, rlm_cache_entry_t *c, time_t expires)
 {
 	/*
-	 *	Call the driver's insert method to overwrite the old entry
+	 *	Call the driver's insert method to overwrite the old entry.
+	 *	Drivers without set_ttl don't share entries between
+	 *	requests, so we can update this one.
 	 */
-	if (!inst->driver->set_ttl) for (;;) {
-		cache_status_t ret;
+	if (!inst->driver->set_ttl) {
+		c->expires = expires;
 
-		ret = inst->driver->insert(&inst->config, inst->driver_inst, request, *handle, c);
-		switch (ret) {
-		case CACHE_RECONNECT:
-			if (cache_reconnect(handle, inst, request) == 0) continue;
-			return RLM_MODULE_FAIL;
+		for (;;) {
+			cache_status_t ret;
 
-		case CACHE_OK:
-			RDEBUG("Updated entry TTL");
-			return RLM_MODULE_OK;
+			ret = inst->driver->insert(&inst->config, inst->driver_inst, request, *handle, c);
+			switch (ret) {
+			case CACHE_RECONNECT:
+				if (cache_reconnect(handle, inst, request) == 0) continue;
+				return RLM_MODULE_FAIL;
 
-		default:
-			return RLM_MODULE_FAIL;
+			case CACHE_OK:
+				RDEBUG("Updated entry TTL");
+				return RLM_MODULE_OK;
+
+			default:
+				return RLM_MODULE_FAIL;
+			}
 		}
 	}
 
@@ -497,7 +503,7 @@ static rlm_rcode_t cache_set_ttl(rlm_cache_t const *inst, REQUEST *request,
 	for (;;) {
 		cache_status_t ret;
 
-		ret = inst->driver->set_ttl(&inst->config, inst->driver_inst, request, *handle, c);
+		ret = inst->driver->set_ttl(&inst->config, inst->driver_inst, request, *handle, c, expires);
 		switch (ret) {
 		case CACHE_RECONNECT:
 			if (cache_reconnect(handle, inst, request) == 0) continue;
@@ -710,9 +716,7 @@ static rlm_rcode_t mod_cache_it(void *instance, UNUSED void *thread, REQUEST *re
 	if (set_ttl && (exists == 1)) {
 		rad_assert(c);
 
-		c->expires = request->packet->timestamp.tv_sec + ttl;
-
-		switch (cache_set_ttl(inst, request, &handle, c)) {
+		switch (cache_set_ttl(inst, request, &handle, c, request->packet->timestamp.tv_sec + ttl)) {
 		case RLM_MODULE_FAIL:
 			rcode = RLM_MODULE_FAIL;
 			goto finish;
@@ -820,15 +824,18 @@ static ssize_t cache_xlat(TALLOC_CTX *ctx, char **out, UNUSED size_t freespace,
 		return -1;
 	}
 
-	switch (cache_find(&c, mod_inst, request, handle, key, key_len)) {
+	switch (cache_find(&c, mod_inst, request, &handle, key, key_len)) {
 	case RLM_MODULE_OK:		/* found */
 		break;
 
 	case RLM_MODULE_NOTFOUND:	/* not found */
+		talloc_free(target);
+		cache_release(mod_inst, request, &handle);
 		return 0;
 
 	default:
 		talloc_free(target);
+		cache_release(mod_inst, request, &handle);
 		return -1;
 	}
 
@@ -844,14 +851,14 @@ static ssize_t cache_xlat(TALLOC_CTX *ctx, char **out, UNUSED size_t freespace,
 
 	talloc_free(target);
 
+	cache_free(mod_inst, &c);
+	cache_release(mod_inst, request, &handle);
+
 	/*
 	 *	Check if we found a matching map
 	 */
 	if (!map) return 0;
 
-	cache_free(mod_inst, &c);
-	cache_release(mod_inst, request, &handle);
-
 	return ret;
 }
 
@@ -883,12 +890,37 @@ static int mod_detach(void *instance)
 	return 0;
 }
 
+/** Return a statistic from the cache driver
+ *
+ * e.g. "%{cache_stats:hits}" for a module instance called "cache".
+ */
+static ssize_t cache_stats_xlat(UNUSED TALLOC_CTX *ctx, char **out, size_t outlen,
+				void const *mod_inst, UNUSED void const *xlat_inst,
+				REQUEST *request, char const *fmt)
+{
+	rlm_cache_t const	*inst = mod_inst;
+	uint64_t		value;
+
+	if (!inst->driver->stats) {
+		REDEBUG("Driver %s does not keep statistics", inst->driver->name);
+		return -1;
+	}
+
+	if (inst->driver->stats(&value, &inst->config, inst->driver_inst, fmt) < 0) {
+		REDEBUG("Driver %s has no statistic \"%s\"", inst->driver->name, fmt);
+		return -1;
+	}
+
+	return snprintf(*out, outlen, "%" PRIu64, value);
+}
+
 /** Register module xlats
  *
  */
 static int mod_bootstrap(CONF_SECTION *conf, void *instance)
 {
-	rlm_cache_t *inst = instance;
+	rlm_cache_t	*inst = instance;
+	char		buffer[256];
 
 	inst->cs = conf;
 
@@ -900,6 +932,9 @@ static int mod_bootstrap(CONF_SECTION *conf, void *instance)
 	 */
 	xlat_register(inst, inst->config.name, cache_xlat, NULL, NULL, 0, 0);
 
+	snprintf(buffer, sizeof(buffer), "%s_stats", inst->config.name);
+	xlat_register(inst, buffer, cache_stats_xlat, NULL, NULL, 0, XLAT_DEFAULT_BUF_LEN);
+
 	return 0;
 }
 
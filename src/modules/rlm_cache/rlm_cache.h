@@ -27,6 +27,12 @@ RCSIDH(cache_h, "$Id$")
 #include <freeradius-devel/radiusd.h>
 #include <freeradius-devel/dl.h>
 
+#ifdef HAVE_STDATOMIC_H
+#  include <stdatomic.h>
+#else
+#  include <freeradius-devel/stdatomic.h>
+#endif
+
 typedef struct cache_driver cache_driver_t;
 
 typedef void rlm_cache_handle_t;
@@ -77,9 +83,13 @@ typedef struct rlm_cache_t {
 typedef struct rlm_cache_entry_t {
 	uint8_t const		*key;			//!< Key used to identify entry.
 	size_t			key_len;		//!< Length of key data.
-	long long int		hits;			//!< How many times the entry has been retrieved.
+	atomic_llong		hits;			//!< How many times the entry has been retrieved.
+							//!< Atomic, as drivers may share entries between
+							//!< requests.
 	time_t			created;		//!< When the entry was created.
-	time_t			expires;		//!< When the entry expires.
+	time_t			expires;		//!< When the entry expires.  Must not be changed
+							//!< once the entry has been inserted, except by
+							//!< the driver.
 
 	vp_map_t		*maps;			//!< Head of the maps list.
 } rlm_cache_entry_t;
@@ -209,7 +219,9 @@ typedef cache_status_t	(*cache_entry_expire_t)(rlm_cache_config_t const *config,
  * @param[in] request The current request.
  * @param[in] handle the driver gave us when we called #cache_acquire_t, or NULL if no
  *	#cache_acquire_t callback was provided.
- * @param[in] c to update the TTL of. c->ttl will have been set to the new value.
+ * @param[in] c to update the TTL of.
+ * @param[in] expires The new expiry time.  The driver must update c->expires itself, with
+ *	whatever locks it needs held, as other requests may be using the entry.
  * @return
  *	- #CACHE_RECONNECT - If handle needs to be reinitialised/reconnected.
  *	- #CACHE_ERROR - If the entry TTL couldn't be updated.
@@ -217,7 +229,7 @@ typedef cache_status_t	(*cache_entry_expire_t)(rlm_cache_config_t const *config,
  */
 typedef cache_status_t	(*cache_entry_set_ttl_t)(rlm_cache_config_t const *config, void *instance,
 						 REQUEST *request, void *handle,
-						 rlm_cache_entry_t *c);
+						 rlm_cache_entry_t *c, time_t expires);
 
 /** Get the number of entries in the cache
  *
@@ -233,6 +245,22 @@ typedef cache_status_t	(*cache_entry_set_ttl_t)(rlm_cache_config_t const *config
 typedef uint32_t	(*cache_entry_count_t)(rlm_cache_config_t const *config, void *instance,
 					       REQUEST *request, void *handle);
 
+/** Get a statistic for the whole cache
+ *
+ * @note This callback is optional.  If it's not provided, the %{<name>_stats:} xlat
+ *	 always fails.
+ *
+ * @param[out] out Where to write the value of the statistic.
+ * @param[in] config for this instance of the rlm_cache module.
+ * @param[in] instance Driver specific instance data.
+ * @param[in] name of the statistic, e.g. "hits".
+ * @return
+ *	- 0 on success.
+ *	- -1 if the driver doesn't keep the statistic.
+ */
+typedef int		(*cache_stats_t)(uint64_t *out, rlm_cache_config_t const *config, void *instance,
+					 char const *name);
+
 /** Acquire a handle to access the cache
  *
  * @note This callback is optional. If it's not provided the handle argument to other callbacks
@@ -290,6 +318,7 @@ struct cache_driver {
 	cache_entry_set_ttl_t		set_ttl;		//!< (Optional) Update the TTL of an entry.
 	cache_entry_count_t		count;			//!< (Optional) Number of entries currently in
 								//!< the cache.
+	cache_stats_t			stats;			//!< (Optional) Statistics for the whole cache.
 
 	cache_acquire_t			acquire;		//!< (optional) Acquire exclusive access to a resource
 								//!< used to retrieve the cache entry.
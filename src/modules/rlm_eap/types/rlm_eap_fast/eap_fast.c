@@ -602,6 +602,7 @@ static PW_CODE eap_fast_eap_payload(REQUEST *request, eap_session_t *eap_session
 	 */
 
 	fake->packet->vps = fr_pair_afrom_num(fake->packet, 0, PW_EAP_MESSAGE);
+	fr_pair_list_touch(&fake->packet->vps);
 	fr_pair_value_memcpy(fake->packet->vps, tlv_eap_payload->vp_octets, tlv_eap_payload->vp_length);
 
 	RDEBUG("Got tunneled request");
@@ -718,6 +719,7 @@ static PW_CODE eap_fast_eap_payload(REQUEST *request, eap_session_t *eap_session
 			request->proxy = request_alloc_proxy(request);
 
 			request->proxy->packet = talloc_steal(request->proxy, fake->packet);
+			(void) fr_pair_list_arena_copy(request->proxy->packet, &request->proxy->packet->vps);
 			memset(&request->proxy->packet->src_ipaddr, 0,
 			       sizeof(request->proxy->packet->src_ipaddr));
 			memset(&request->proxy->packet->src_ipaddr, 0,
@@ -510,6 +510,8 @@ static int CC_HINT(nonnull) eap_peap_postproxy(eap_session_t *eap_session, void
 		fake->packet = NULL;
 		request->proxy->reply = talloc_steal(request->proxy, fake->reply);
 		fake->reply = NULL;
+		(void) fr_pair_list_arena_copy(request->proxy->packet, &request->proxy->packet->vps);
+		(void) fr_pair_list_arena_copy(request->proxy->reply, &request->proxy->reply->vps);
 
 		/*
 		 *	And we're done with this request.
@@ -834,6 +836,7 @@ rlm_rcode_t eap_peap_process(eap_session_t *eap_session, tls_session_t *tls_sess
 	case PEAP_STATUS_PHASE2:
 		fake->packet->vps = eap_peap_inner_to_pairs(request, fake->packet,
 							    eap_round, data, data_len);
+		fr_pair_list_touch(&fake->packet->vps);
 		if (!fake->packet->vps) {
 			talloc_free(fake);
 			RDEBUG2("Unable to convert tunneled EAP packet to internal server data structures");
@@ -976,6 +979,7 @@ rlm_rcode_t eap_peap_process(eap_session_t *eap_session, tls_session_t *tls_sess
 			request->proxy = request_alloc_proxy(request);
 
 			request->proxy->packet = talloc_steal(request->proxy, fake->packet);
+			(void) fr_pair_list_arena_copy(request->proxy->packet, &request->proxy->packet->vps);
 			memset(&request->proxy->packet->src_ipaddr, 0,
 			       sizeof(request->proxy->packet->src_ipaddr));
 			memset(&request->proxy->packet->dst_ipaddr, 0,
@@ -89,6 +89,7 @@ static rlm_rcode_t mod_process(void *type_arg, eap_session_t *eap_session)
 			rad_assert(!fake->packet->vps);
 
 			fake->packet->vps = fr_pair_list_copy(fake->packet, request->packet->vps);
+			fr_pair_list_touch(&fake->packet->vps);
 
 			/* set the virtual server to use */
 			if ((vp = fr_pair_find_by_num(request->control, 0, PW_VIRTUAL_SERVER, TAG_ANY)) != NULL) {
@@ -673,6 +673,8 @@ static int CC_HINT(nonnull) eap_ttls_postproxy(eap_session_t *eap_session, void
 		fake->packet = NULL;
 		request->proxy->reply = talloc_steal(request->proxy, fake->reply);
 		fake->reply = NULL;
+		(void) fr_pair_list_arena_copy(request->proxy->packet, &request->proxy->packet->vps);
+		(void) fr_pair_list_arena_copy(request->proxy->reply, &request->proxy->reply->vps);
 
 		/*
 		 *	And we're done with this request.
@@ -796,6 +798,7 @@ PW_CODE eap_ttls_process(eap_session_t *eap_session, tls_session_t *tls_session)
 	 *	Add the tunneled attributes to the fake request.
 	 */
 	fake->packet->vps = diameter2vp(request, fake, tls_session->ssl, data, data_len);
+	fr_pair_list_touch(&fake->packet->vps);
 	if (!fake->packet->vps) {
 		code = PW_CODE_ACCESS_REJECT;
 		goto finish;
@@ -927,6 +930,7 @@ PW_CODE eap_ttls_process(eap_session_t *eap_session, tls_session_t *tls_session)
 			request->proxy = request_alloc_proxy(request);
 
 			request->proxy->packet = talloc_steal(request->proxy, fake->packet);
+			(void) fr_pair_list_arena_copy(request->proxy->packet, &request->proxy->packet->vps);
 			memset(&request->proxy->packet->src_ipaddr, 0,
 			       sizeof(request->proxy->packet->src_ipaddr));
 			memset(&request->proxy->packet->src_ipaddr, 0,
@@ -30,38 +30,82 @@ RCSID("$Id$")
 #include	<ctype.h>
 #include	<fcntl.h>
 
+typedef struct files_entry files_entry_t;
+
+/** An entry from a users file, with what we worked out about it at load time
+ *
+ */
+struct files_entry {
+	PAIR_LIST		*pl;		//!< The entry.
+	int			order;		//!< Where the entry was read.  Unlike line numbers,
+						//!< this keeps counting through $INCLUDEd files.
+	bool			expand;		//!< Whether any check items need expanding.
+	bool			fall_through;	//!< Whether the reply items contain Fall-Through = Yes.
+
+	files_entry_t		*next;		//!< Next entry for the same name, or in the same
+						//!< list of DEFAULT entries.
+	files_entry_t		*next_default;	//!< Next DEFAULT entry in the file.
+};
+
+/** DEFAULT entries which compare the index attribute to the same value
+ *
+ */
+typedef struct files_bucket {
+	VALUE_PAIR const	*vp;		//!< Check item holding the value.
+	files_entry_t		*head;		//!< First entry, in file order.
+	files_entry_t		**tail;		//!< Where to add the next entry.
+} files_bucket_t;
+
+/** A users file, compiled for matching
+ *
+ * DEFAULT entries usually discriminate on one attribute, such as
+ * NAS-IP-Address or Called-Station-Id.  We pick the attribute most
+ * DEFAULT entries compare to a literal value with '==', and index the
+ * entries by that value.  Only those entries whose value matches the
+ * request (and the ones which can't be indexed) are then checked.
+ */
+typedef struct files_table {
+	rbtree_t		*users;		//!< Entries for each name, keyed by name.
+
+	files_entry_t		*defaults;	//!< All DEFAULT entries, in file order.
+
+	fr_dict_attr_t const	*index_da;	//!< Attribute DEFAULT entries are indexed by.
+	rbtree_t		*index;		//!< #files_bucket_t of DEFAULT entries, keyed by value.
+	files_entry_t		*unindexed;	//!< DEFAULT entries which can't be indexed, in file order.
+} files_table_t;
+
 typedef struct rlm_files_t {
 	char const *key;
 
 	char const *filename;
-	rbtree_t *common;
+	files_table_t *common;
 
 	/* autz */
 	char const *usersfile;
-	rbtree_t *users;
+	files_table_t *users;
 
 
 	/* authenticate */
 	char const *auth_usersfile;
-	rbtree_t *auth_users;
+	files_table_t *auth_users;
 
 	/* preacct */
 	char const *acct_usersfile;
-	rbtree_t *acct_users;
+	files_table_t *acct_users;
 
 #ifdef WITH_PROXY
 	/* pre-proxy */
 	char const *preproxy_usersfile;
-	rbtree_t *preproxy_users;
+	files_table_t *preproxy_users;
 
 	/* post-proxy */
 	char const *postproxy_usersfile;
-	rbtree_t *postproxy_users;
+	files_table_t *postproxy_users;
 #endif
 
 	/* post-authenticate */
 	char const *postauth_usersfile;
-	rbtree_t *postauth_users;
+	files_table_t *postauth_users;
 } rlm_files_t;
 
 
@@ -91,22 +135,229 @@ static const CONF_PARSER module_config[] = {
 };
 
 
-static int pairlist_cmp(void const *a, void const *b)
+static int entry_cmp(void const *a, void const *b)
+{
+	return strcmp(((files_entry_t const *)a)->pl->name,
+		      ((files_entry_t const *)b)->pl->name);
+}
+
+/** Get the bytes which make up a value, for the types we can index
+ *
+ * For each of these types, two values are equal (according to
+ * radius_compare_vps()) if and only if their bytes are equal.
+ */
+static bool value_key(VALUE_PAIR const *vp, uint8_t const **key, size_t *len)
+{
+	switch (vp->vp_type) {
+	case FR_TYPE_STRING:
+		*key = (uint8_t const *)vp->vp_strvalue;
+		*len = strlen(vp->vp_strvalue);	/* compared with strcmp() */
+		return true;
+
+	case FR_TYPE_OCTETS:
+		*key = vp->vp_octets;
+		*len = vp->vp_length;
+		return true;
+
+	case FR_TYPE_UINT8:
+		*key = &vp->vp_uint8;
+		*len = sizeof(vp->vp_uint8);
+		return true;
+
+	case FR_TYPE_UINT16:
+		*key = (uint8_t const *)&vp->vp_short;
+		*len = sizeof(vp->vp_short);
+		return true;
+
+	case FR_TYPE_UINT32:
+		*key = (uint8_t const *)&vp->vp_uint32;
+		*len = sizeof(vp->vp_uint32);
+		return true;
+
+	case FR_TYPE_IPV4_ADDR:
+		*key = (uint8_t const *)&vp->vp_ipv4addr;
+		*len = sizeof(vp->vp_ipv4addr);
+		return true;
+
+	case FR_TYPE_IPV6_ADDR:
+		*key = vp->vp_ip.addr.v6.s6_addr;
+		*len = sizeof(vp->vp_ip.addr.v6.s6_addr);
+		return true;
+
+	default:
+		return false;
+	}
+}
+
+static int bucket_cmp(void const *one, void const *two)
 {
-	return strcmp(((PAIR_LIST const *)a)->name,
-		      ((PAIR_LIST const *)b)->name);
+	files_bucket_t const	*a = one, *b = two;
+	uint8_t const		*a_key, *b_key;
+	size_t			a_len, b_len;
+
+	(void) value_key(a->vp, &a_key, &a_len);
+	(void) value_key(b->vp, &b_key, &b_len);
+
+	if (a_len < b_len) return -1;
+	if (a_len > b_len) return +1;
+
+	return memcmp(a_key, b_key, a_len);
 }
 
-static int getusersfile(TALLOC_CTX *ctx, char const *filename, rbtree_t **ptree)
+/** Whether a check item can be used to index a DEFAULT entry
+ *
+ * It has to be a literal value, which paircompare() compares to the
+ * same attribute in the request, and which has to be there.
+ */
+static bool check_item_indexable(VALUE_PAIR const *vp)
+{
+	uint8_t const	*key;
+	size_t		len;
+
+	if ((vp->op != T_OP_CMP_EQ) || (vp->type != VT_DATA)) return false;
+
+	if (vp->da->flags.has_tag || radius_find_compare(vp->da)) return false;
+
+	/*
+	 *	These are skipped by paircompare().
+	 */
+	if (!vp->da->vendor) switch (vp->da->attr) {
+	case PW_CRYPT_PASSWORD:
+	case PW_AUTH_TYPE:
+	case PW_AUTZ_TYPE:
+	case PW_ACCT_TYPE:
+	case PW_SESSION_TYPE:
+	case PW_STRIP_USER_NAME:
+	case PW_USER_PASSWORD:
+		return false;
+
+	default:
+		break;
+	}
+
+	return value_key(vp, &key, &len);
+}
+
+/** Pick the attribute most DEFAULT entries can be indexed by
+ *
+ */
+static fr_dict_attr_t const *index_da_pick(TALLOC_CTX *ctx, files_entry_t *defaults)
+{
+	typedef struct {
+		fr_dict_attr_t const	*da;
+		int			count;
+	} index_count_t;
+
+	index_count_t		*counts;
+	size_t			num = 0, i;
+	files_entry_t		*entry;
+	fr_dict_attr_t const	*best = NULL;
+	int			best_count = 0;
+
+	counts = talloc_array(ctx, index_count_t, 8);
+	if (!counts) return NULL;
+
+	for (entry = defaults; entry; entry = entry->next_default) {
+		VALUE_PAIR *vp;
+
+		for (vp = entry->pl->check; vp; vp = vp->next) {
+			if (!check_item_indexable(vp)) continue;
+
+			for (i = 0; i < num; i++) if (counts[i].da == vp->da) break;
+
+			if (i == num) {
+				if (num == talloc_array_length(counts)) {
+					counts = talloc_realloc(ctx, counts, index_count_t, num * 2);
+					if (!counts) return NULL;
+				}
+				counts[num].da = vp->da;
+				counts[num].count = 0;
+				num++;
+			}
+
+			/*
+			 *	Only count each entry once.
+			 */
+			if (fr_pair_find_by_da(entry->pl->check, vp->da, TAG_ANY) != vp) continue;
+
+			counts[i].count++;
+		}
+	}
+
+	for (i = 0; i < num; i++) {
+		if (counts[i].count > best_count) {
+			best = counts[i].da;
+			best_count = counts[i].count;
+		}
+	}
+
+	talloc_free(counts);
+
+	return best;
+}
+
+/** Index the DEFAULT entries
+ *
+ */
+static int index_build(files_table_t *table)
+{
+	files_entry_t	*entry, **unindexed_tail = &table->unindexed;
+
+	table->index_da = index_da_pick(table, table->defaults);
+	if (table->index_da) {
+		table->index = rbtree_create(table, bucket_cmp, NULL, RBTREE_FLAG_NONE);
+		if (!table->index) return -1;
+	}
+
+	for (entry = table->defaults; entry; entry = entry->next_default) {
+		VALUE_PAIR	*vp = NULL;
+		files_bucket_t	*bucket, my_bucket;
+
+		if (table->index_da) {
+			for (vp = entry->pl->check; vp; vp = vp->next) {
+				if ((vp->da == table->index_da) && check_item_indexable(vp)) break;
+			}
+		}
+
+		if (!vp) {
+			*unindexed_tail = entry;
+			unindexed_tail = &entry->next;
+			continue;
+		}
+
+		my_bucket.vp = vp;
+		bucket = rbtree_finddata(table->index, &my_bucket);
+		if (!bucket) {
+			bucket = talloc_zero(table->index, files_bucket_t);
+			if (!bucket) return -1;
+
+			bucket->vp = vp;
+			bucket->tail = &bucket->head;
+
+			if (!rbtree_insert(table->index, bucket)) {
+				talloc_free(bucket);
+				return -1;
+			}
+		}
+
+		*bucket->tail = entry;
+		bucket->tail = &entry->next;
+	}
+
+	return 0;
+}
+
+static int getusersfile(TALLOC_CTX *ctx, char const *filename, files_table_t **ptable)
 {
 	int rcode;
 	PAIR_LIST *users = NULL;
-	PAIR_LIST *entry, *next;
-	PAIR_LIST *user_list, *default_list, **default_tail;
-	rbtree_t *tree;
+	PAIR_LIST *pl, *next;
+	files_entry_t *entry, *user_list, **default_tail;
+	files_table_t *table;
+	int order = 0;
 
 	if (!filename) {
-		*ptree = NULL;
+		*ptable = NULL;
 		return 0;
 	}
 
@@ -121,8 +372,8 @@ static int getusersfile(TALLOC_CTX *ctx, char const *filename, rbtree_t **ptree)
 	if (rad_debug_lvl) {
 		VALUE_PAIR *vp;
 
-		entry = users;
-		while (entry) {
+		pl = users;
+		while (pl) {
 			vp_cursor_t cursor;
 
 			/*
@@ -132,7 +383,7 @@ static int getusersfile(TALLOC_CTX *ctx, char const *filename, rbtree_t **ptree)
 			 *	and probably ':=' for server
 			 *	configuration items.
 			 */
-			for (vp = fr_pair_cursor_init(&cursor, &entry->check); vp; vp = fr_pair_cursor_next(&cursor)) {
+			for (vp = fr_pair_cursor_init(&cursor, &pl->check); vp; vp = fr_pair_cursor_next(&cursor)) {
 				/*
 				 *	Ignore attributes which are set
 				 *	properly.
@@ -149,9 +400,9 @@ static int getusersfile(TALLOC_CTX *ctx, char const *filename, rbtree_t **ptree)
 				if ((vp->da->vendor != 0) ||
 				    (vp->da->attr < 0x100)) {
 					WARN("[%s]:%d Changing '%s =' to '%s =='\n\tfor comparing RADIUS attribute in check item list for user %s",
-					     filename, entry->lineno,
+					     filename, pl->lineno,
 					     vp->da->name, vp->da->name,
-					     entry->name);
+					     pl->name);
 					vp->op = T_OP_CMP_EQ;
 					continue;
 				}
@@ -164,7 +415,7 @@ static int getusersfile(TALLOC_CTX *ctx, char const *filename, rbtree_t **ptree)
 			 *	It's a common enough mistake, that it's
 			 *	worth doing.
 			 */
-			for (vp = fr_pair_cursor_init(&cursor, &entry->reply); vp; vp = fr_pair_cursor_next(&cursor)) {
+			for (vp = fr_pair_cursor_init(&cursor, &pl->reply); vp; vp = fr_pair_cursor_next(&cursor)) {
 				/*
 				 *	If it's NOT a vendor attribute,
 				 *	and it's NOT a wire protocol
@@ -177,76 +428,85 @@ static int getusersfile(TALLOC_CTX *ctx, char const *filename, rbtree_t **ptree)
 					WARN("[%s]:%d Check item \"%s\"\n"
 					       "\tfound in reply item list for user \"%s\".\n"
 					       "\tThis attribute MUST go on the first line"
-					       " with the other check items", filename, entry->lineno, vp->da->name,
-					       entry->name);
+					       " with the other check items", filename, pl->lineno, vp->da->name,
+					       pl->name);
 				}
 			}
 
-			entry = entry->next;
+			pl = pl->next;
 		}
 	}
 
-	tree = rbtree_create(ctx, pairlist_cmp, NULL, RBTREE_FLAG_NONE);
-	if (!tree) {
+	table = talloc_zero(ctx, files_table_t);
+	if (!table) {
+		pairlist_free(&users);
+		return -1;
+	}
+
+	table->users = rbtree_create(table, entry_cmp, NULL, RBTREE_FLAG_NONE);
+	if (!table->users) {
+	error:
 		pairlist_free(&users);
+		talloc_free(table);
 		return -1;
 	}
 
-	default_list = NULL;
-	default_tail = &default_list;
+	default_tail = &table->defaults;
 
 	/*
 	 *	We've read the entries in linearly, but putting them
 	 *	into an indexed data structure would be much faster.
 	 *	Let's go fix that now.
 	 */
-	for (entry = users; entry != NULL; entry = next) {
+	for (pl = users; pl != NULL; pl = next) {
+		VALUE_PAIR *vp;
+
 		/*
 		 *	Remove this entry from the input list.
 		 */
-		next = entry->next;
-		entry->next = NULL;
-		(void) talloc_steal(tree, entry);
+		next = pl->next;
+		pl->next = NULL;
+		users = next;
+		(void) talloc_steal(table, pl);
+
+		entry = talloc_zero(table, files_entry_t);
+		if (!entry) {
+			pairlist_free(&pl);
+			goto error;
+		}
+		entry->pl = pl;
+		entry->order = order++;
+		entry->fall_through = fall_through(pl->reply);
 
 		/*
-		 *	DEFAULT entries get their own list.
+		 *	Check items which don't need expanding can
+		 *	be compared without copying them.
 		 */
-		if (strcmp(entry->name, "DEFAULT") == 0) {
-			if (!default_list) {
-				default_list = entry;
-
-				/*
-				 *	Insert the first DEFAULT into the tree.
-				 */
-				if (!rbtree_insert(tree, entry)) {
-				error:
-					pairlist_free(&entry);
-					pairlist_free(&next);
-					talloc_free(tree);
-					return -1;
-				}
-
-			} else {
-				/*
-				 *	Tack this entry onto the tail
-				 *	of the DEFAULT list.
-				 */
-				*default_tail = entry;
+		for (vp = pl->check; vp; vp = vp->next) {
+			if (vp->type == VT_XLAT) {
+				entry->expand = true;
+				break;
 			}
+		}
 
-			default_tail = &entry->next;
+		/*
+		 *	DEFAULT entries get their own list.
+		 */
+		if (strcmp(pl->name, "DEFAULT") == 0) {
+			*default_tail = entry;
+			default_tail = &entry->next_default;
 			continue;
 		}
 
 		/*
 		 *	Not DEFAULT, must be a normal user.
 		 */
-		user_list = rbtree_finddata(tree, entry);
+		user_list = rbtree_finddata(table->users, entry);
 		if (!user_list) {
 			/*
 			 *	Insert the first one.
 			 */
-			if (!rbtree_insert(tree, entry)) goto error;
+			if (!rbtree_insert(table->users, entry)) goto error;
 		} else {
 			/*
 			 *	Find the tail of this list, and add it
@@ -258,7 +518,14 @@ static int getusersfile(TALLOC_CTX *ctx, char const *filename, rbtree_t **ptree)
 		}
 	}
 
-	*ptree = tree;
+	if (index_build(table) < 0) goto error;
+
+	if (table->index_da) {
+		DEBUG2("rlm_files (%s): Indexed DEFAULT entries by %s, %u values", filename,
+		       table->index_da->name, rbtree_num_elements(table->index));
+	}
+
+	*ptable = table;
 
 	return 0;
 }
@@ -290,18 +557,65 @@ static int mod_instantiate(UNUSED CONF_SECTION *conf, void *instance)
 	return 0;
 }
 
+/** Find the DEFAULT entries which may match the request
+ *
+ * @param[in] table	to search.
+ * @param[in] vps	from the request.
+ * @param[out] indexed	DEFAULT entries indexed by the value of the index
+ *			attribute in the request.  Follow entry->next.
+ * @param[out] unindexed	Other DEFAULT entries which may match.  Follow
+ *			entry->next, or entry->next_default if all is true.
+ * @param[out] all	Whether unindexed contains all DEFAULT entries.
+ */
+static void defaults_find(files_table_t const *table, VALUE_PAIR *vps,
+			  files_entry_t **indexed, files_entry_t **unindexed, bool *all)
+{
+	VALUE_PAIR	*vp, *next;
+	files_bucket_t	*bucket, my_bucket;
+
+	*indexed = NULL;
+	*unindexed = table->unindexed;
+	*all = false;
+
+	if (!table->index_da) return;
+
+	/*
+	 *	Not in the request, so none of the indexed
+	 *	entries can match.
+	 */
+	vp = fr_pair_find_by_da(vps, table->index_da, TAG_ANY);
+	if (!vp) return;
+
+	/*
+	 *	Multiple instances.  Just check everything.
+	 */
+	for (next = vp->next; next; next = next->next) {
+		if (next->da == table->index_da) {
+			*unindexed = table->defaults;
+			*all = true;
+			return;
+		}
+	}
+
+	my_bucket.vp = vp;
+	bucket = rbtree_finddata(table->index, &my_bucket);
+	if (bucket) *indexed = bucket->head;
+}
+
 /*
  *	Common code called by everything below.
  */
-static rlm_rcode_t file_common(rlm_files_t const *inst, REQUEST *request, char const *filename, rbtree_t *tree,
+static rlm_rcode_t file_common(rlm_files_t const *inst, REQUEST *request, char const *filename,
+			       files_table_t const *table,
 			       RADIUS_PACKET *request_packet, RADIUS_PACKET *reply_packet)
 {
-	char const	*name, *match;
+	char const	*name;
 	VALUE_PAIR	*check_tmp;
 	VALUE_PAIR	*reply_tmp;
-	PAIR_LIST const *user_pl, *default_pl;
-	bool		found = false;
+	files_entry_t	*user_entry, *indexed_entry, *unindexed_entry;
+	bool		found = false, all_defaults;
 	PAIR_LIST	my_pl;
+	files_entry_t	my_entry;
 	char		buffer[256];
 
 	if (!inst->key) {
@@ -320,72 +634,89 @@ static rlm_rcode_t file_common(rlm_files_t const *inst, REQUEST *request, char c
 		name = len ? buffer : "NONE";
 	}
 
-	if (!tree) return RLM_MODULE_NOOP;
+	if (!table) return RLM_MODULE_NOOP;
 
 	my_pl.name = name;
-	user_pl = rbtree_finddata(tree, &my_pl);
-	my_pl.name = "DEFAULT";
-	default_pl = rbtree_finddata(tree, &my_pl);
+	my_entry.pl = &my_pl;
+	user_entry = rbtree_finddata(table->users, &my_entry);
+
+	defaults_find(table, request_packet->vps, &indexed_entry, &unindexed_entry, &all_defaults);
 
 	/*
 	 *	Find the entry for the user.
 	 */
-	while (user_pl || default_pl) {
-		vp_cursor_t cursor;
-		VALUE_PAIR *vp;
-		PAIR_LIST const *pl;
+	while (user_entry || indexed_entry || unindexed_entry) {
+		files_entry_t const	*entry;
+		PAIR_LIST const		*pl;
 
 		/*
-		 *	Figure out which entry to match on.
+		 *	Figure out which entry to match on.  The lists
+		 *	are in file order, so take the earliest.
 		 */
+		entry = user_entry;
+		if (indexed_entry && (!entry || (indexed_entry->order < entry->order))) {
+			entry = indexed_entry;
+		}
+		if (unindexed_entry && (!entry || (unindexed_entry->order < entry->order))) {
+			entry = unindexed_entry;
+		}
 
-		if (!default_pl && user_pl) {
-			pl = user_pl;
-			match = name;
-			user_pl = user_pl->next;
+		if (entry == user_entry) {
+			user_entry = user_entry->next;
+		} else if (entry == indexed_entry) {
+			indexed_entry = indexed_entry->next;
+		} else {
+			unindexed_entry = all_defaults ? unindexed_entry->next_default : unindexed_entry->next;
+		}
+
+		pl = entry->pl;
+
+		/*
+		 *	Literal check items can be compared in place,
+		 *	we only need a copy if they match.
+		 */
+		if (!entry->expand) {
+			VALUE_PAIR *check;
 
-		} else if (!user_pl && default_pl) {
-			pl = default_pl;
-			match = "DEFAULT";
-			default_pl = default_pl->next;
+			memcpy(&check, &pl->check, sizeof(check));
 
-		} else if (user_pl->lineno < default_pl->lineno) {
-			pl = user_pl;
-			match = name;
-			user_pl = user_pl->next;
+			if (paircompare(request, request_packet->vps, check, &reply_packet->vps) != 0) continue;
 
+			check_tmp = fr_pair_list_copy(request, pl->check);
 		} else {
-			pl = default_pl;
-			match = "DEFAULT";
-			default_pl = default_pl->next;
-		}
+			vp_cursor_t	cursor;
+			VALUE_PAIR	*vp;
+
+			check_tmp = fr_pair_list_copy(request, pl->check);
+			for (vp = fr_pair_cursor_init(&cursor, &check_tmp);
+			     vp;
+			     vp = fr_pair_cursor_next(&cursor)) {
+				if (xlat_eval_do(request, vp) < 0) {
+					RWARN("Failed parsing expanded value for check item, skipping entry: %s",
+					      fr_strerror());
+					break;
+				}
+			}
 
-		check_tmp = fr_pair_list_copy(request, pl->check);
-		for (vp = fr_pair_cursor_init(&cursor, &check_tmp);
-		     vp;
-		     vp = fr_pair_cursor_next(&cursor)) {
-			if (xlat_eval_do(request, vp) < 0) {
-				RWARN("Failed parsing expanded value for check item, skipping entry: %s", fr_strerror());
+			if (vp || (paircompare(request, request_packet->vps, check_tmp, &reply_packet->vps) != 0)) {
 				fr_pair_list_free(&check_tmp);
 				continue;
 			}
 		}
 
-		if (paircompare(request, request_packet->vps, check_tmp, &reply_packet->vps) == 0) {
-			RDEBUG2("Found match \"%s\" one line %d of %s", match, pl->lineno, filename);
-			found = true;
+		RDEBUG2("Found match \"%s\" one line %d of %s", pl->name, pl->lineno, filename);
+		found = true;
 
-			/* ctx may be reply or proxy */
-			reply_tmp = fr_pair_list_copy(reply_packet, pl->reply);
-			radius_pairmove(request, &reply_packet->vps, reply_tmp, true);
-			fr_pair_list_move(request, &request->control, &check_tmp);
-			fr_pair_list_free(&check_tmp);
+		/* ctx may be reply or proxy */
+		reply_tmp = fr_pair_list_copy(reply_packet, pl->reply);
+		radius_pairmove(request, &reply_packet->vps, reply_tmp, true);
+		fr_pair_list_move(request, &request->control, &check_tmp);
+		fr_pair_list_free(&check_tmp);
 
-			/*
-			 *	Fallthrough?
-			 */
-			if (!fall_through(pl->reply)) break;
-		}
+		/*
+		 *	Fallthrough?
+		 */
+		if (!entry->fall_through) break;
 	}
 
 	/*
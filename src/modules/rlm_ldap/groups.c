@@ -404,21 +404,23 @@ rlm_rcode_t rlm_ldap_cacheable_userobj(rlm_ldap_t const *inst, REQUEST *request,
 	return rcode;
 }
 
-/** Convert group membership information into attributes
+/** Start searching for group objects the user is a member of
  *
- * @param[in] inst rlm_ldap configuration.
+ * Once the search is complete, the result should be passed to #rlm_ldap_cacheable_groupobj_result.
+ *
+ * @param[out] out Where to write the query.  NULL if no search was sent.
+ * @param[in] ctx to allocate the query in.
+ * @param[in] t Thread specific instance data.
  * @param[in] request Current request.
- * @param[in,out] pconn to use. May change as this function calls functions which auto re-connect.
- * @return One of the RLM_MODULE_* values.
+ * @return
+ *	- #RLM_MODULE_OK if the search was sent, or there's nothing to search for.
+ *	- #RLM_MODULE_INVALID if the filter or base DN couldn't be expanded.
+ *	- #RLM_MODULE_FAIL if the search couldn't be sent.
  */
-rlm_rcode_t rlm_ldap_cacheable_groupobj(rlm_ldap_t const *inst, REQUEST *request, fr_ldap_conn_t **pconn)
+rlm_rcode_t rlm_ldap_cacheable_groupobj_async(rlm_ldap_query_t **out, TALLOC_CTX *ctx, rlm_ldap_thread_t *t,
+					      REQUEST *request)
 {
-	rlm_rcode_t rcode = RLM_MODULE_OK;
-	fr_ldap_rcode_t status;
-	int ldap_errno;
-
-	LDAPMessage *result = NULL;
-	LDAPMessage *entry;
+	rlm_ldap_t const *inst = t->inst;
 
 	char const *base_dn;
 	char base_dn_buff[LDAP_MAX_DN_STR_LEN];
@@ -428,11 +430,10 @@ rlm_rcode_t rlm_ldap_cacheable_groupobj(rlm_ldap_t const *inst, REQUEST *request
 
 	char const *attrs[] = { inst->groupobj_name_attr, NULL };
 
-	VALUE_PAIR *vp;
-	char *dn;
-
 	rad_assert(inst->groupobj_base_dn);
 
+	*out = NULL;
+
 	if (!inst->groupobj_membership_filter) {
 		RDEBUG2("Skipping caching group objects as directive 'group.membership_filter' is not set");
 
@@ -452,38 +453,61 @@ rlm_rcode_t rlm_ldap_cacheable_groupobj(rlm_ldap_t const *inst, REQUEST *request
 		return RLM_MODULE_INVALID;
 	}
 
-	status = fr_ldap_search(&result, request, pconn, base_dn,
-				inst->groupobj_scope, filter, attrs, NULL, NULL);
+	*out = rlm_ldap_search_async(ctx, t, request, base_dn, inst->groupobj_scope, filter, attrs, NULL);
+	if (!*out) return RLM_MODULE_FAIL;
+
+	return RLM_MODULE_OK;
+}
+
+/** Convert group membership information into attributes
+ *
+ * @param[in] inst rlm_ldap configuration.
+ * @param[in] request Current request.
+ * @param[in] conn the search was performed on.
+ * @param[in] status of the search.
+ * @param[in] result of the search.  Not freed.
+ * @return One of the RLM_MODULE_* values.
+ */
+rlm_rcode_t rlm_ldap_cacheable_groupobj_result(rlm_ldap_t const *inst, REQUEST *request,
+					       fr_ldap_conn_t const *conn, fr_ldap_rcode_t status,
+					       LDAPMessage *result)
+{
+	int ldap_errno;
+
+	LDAPMessage *entry;
+
+	VALUE_PAIR *vp;
+	char *dn;
+
 	switch (status) {
 	case LDAP_PROC_SUCCESS:
 		break;
 
 	case LDAP_PROC_NO_RESULT:
 		RDEBUG2("No cacheable group memberships found in group objects");
-		goto finish;
+		return RLM_MODULE_OK;
 
 	default:
-		rcode = RLM_MODULE_FAIL;
-		goto finish;
+		return RLM_MODULE_FAIL;
 	}
 
-	entry = ldap_first_entry((*pconn)->handle, result);
+	entry = ldap_first_entry(conn->handle, result);
 	if (!entry) {
-		ldap_get_option((*pconn)->handle, LDAP_OPT_RESULT_CODE, &ldap_errno);
+		ldap_get_option(conn->handle, LDAP_OPT_RESULT_CODE, &ldap_errno);
 		REDEBUG("Failed retrieving entry: %s", ldap_err2string(ldap_errno));
 
-		goto finish;
+		return RLM_MODULE_OK;
 	}
 
 	RDEBUG("Adding cacheable group object memberships");
 	do {
 		if (inst->cacheable_group_dn) {
-			dn = ldap_get_dn((*pconn)->handle, entry);
+			dn = ldap_get_dn(conn->handle, entry);
 			if (!dn) {
-				ldap_get_option((*pconn)->handle, LDAP_OPT_RESULT_CODE, &ldap_errno);
+				ldap_get_option(conn->handle, LDAP_OPT_RESULT_CODE, &ldap_errno);
 				REDEBUG("Retrieving object DN from entry failed: %s", ldap_err2string(ldap_errno));
 
-				goto finish;
+				return RLM_MODULE_OK;
 			}
 			fr_ldap_util_normalise_dn(dn, dn);
 
@@ -499,7 +523,7 @@ rlm_rcode_t rlm_ldap_cacheable_groupobj(rlm_ldap_t const *inst, REQUEST *request
 		if (inst->cacheable_group_name) {
 			struct berval **values;
 
-			values = ldap_get_values_len((*pconn)->handle, entry, inst->groupobj_name_attr);
+			values = ldap_get_values_len(conn->handle, entry, inst->groupobj_name_attr);
 			if (!values) continue;
 
 			MEM(vp = pair_make_config(inst->cache_da->name, NULL, T_OP_ADD));
@@ -512,12 +536,9 @@ rlm_rcode_t rlm_ldap_cacheable_groupobj(rlm_ldap_t const *inst, REQUEST *request
 
 			ldap_value_free_len(values);
 		}
-	} while ((entry = ldap_next_entry((*pconn)->handle, entry)));
-
-finish:
-	if (result) ldap_msgfree(result);
+	} while ((entry = ldap_next_entry(conn->handle, entry)));
 
-	return rcode;
+	return RLM_MODULE_OK;
 }
 
 /** Query the LDAP directory to check if a group object includes a user object as a member
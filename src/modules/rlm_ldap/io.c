@@ -0,0 +1,435 @@
+/*
+ *   This program is is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or (at
+ *   your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA
+ */
+
+/**
+ * $Id$
+ * @file rlm_ldap/io.c
+ * @brief Asynchronous searches.
+ *
+ * Each thread has a single connection, which all the searches sent by requests
+ * in that thread are multiplexed on.  Requests yield after sending a search,
+ * and are marked as resumable when the result for their msgid arrives.
+ *
+ * @copyright 2017 The FreeRADIUS Server Project.
+ */
+RCSID("$Id$")
+
+#define LOG_PREFIX "rlm_ldap (%s) - "
+#define LOG_PREFIX_ARGS inst->name
+
+#include <freeradius-devel/rad_assert.h>
+
+#include "rlm_ldap.h"
+
+/** A connection searches from many requests are multiplexed on
+ *
+ */
+struct rlm_ldap_mux {
+	rlm_ldap_t const	*inst;			//!< Instance of rlm_ldap.
+	rlm_ldap_thread_t	*thread;		//!< Thread the connection belongs to.
+	fr_ldap_conn_t		*conn;			//!< Connection searches are sent on.
+	int			fd;			//!< Of the connection.
+
+	rbtree_t		*queries;		//!< Outstanding queries, ordered by msgid.
+	uint32_t		refs;			//!< Number of queries referencing the connection.
+
+	bool			dead;			//!< The connection failed.  It's freed when the last
+							//!< query referencing it is.
+};
+
+static int query_cmp(void const *one, void const *two)
+{
+	rlm_ldap_query_t const *a = one, *b = two;
+
+	return (a->msgid > b->msgid) - (a->msgid < b->msgid);
+}
+
+/** Mark a query as complete, and resume the request which sent it
+ *
+ * @param[in] query	which is complete.
+ * @param[in] status	of the search.
+ */
+static void query_done(rlm_ldap_query_t *query, fr_ldap_rcode_t status)
+{
+	if (query->ev) (void) fr_event_timer_delete(query->thread->el, &query->ev);
+
+	query->msgid = -1;
+	query->status = status;
+
+	unlang_resumable(query->request);
+}
+
+static int _mux_fail_query(UNUSED void *ctx, void *data)
+{
+	rlm_ldap_query_t *query = talloc_get_type_abort(data, rlm_ldap_query_t);
+
+	query_done(query, LDAP_PROC_BAD_CONN);
+
+	return 2;	/* Delete and continue */
+}
+
+static int _mux_free(rlm_ldap_mux_t *mux)
+{
+	rlm_ldap_t const *inst = mux->inst;
+
+	if (!mux->dead) (void) fr_event_fd_delete(mux->thread->el, mux->fd);
+
+	DEBUG2("Closing connection (%i)", mux->fd);
+
+	return 0;
+}
+
+/** Stop using a connection, and fail all the searches outstanding on it
+ *
+ * The connection is freed when the last query referencing it is.  Until then the
+ * results of queries which completed before the connection failed may still be
+ * processed.
+ *
+ * @param[in] mux	which failed.
+ */
+static void mux_fail(rlm_ldap_mux_t *mux)
+{
+	rlm_ldap_thread_t *t = mux->thread;
+
+	if (mux->dead) return;
+
+	(void) fr_event_fd_delete(t->el, mux->fd);
+	mux->dead = true;
+	if (t->mux == mux) t->mux = NULL;
+
+	rbtree_walk(mux->queries, RBTREE_DELETE_ORDER, _mux_fail_query, NULL);
+
+	if (mux->refs == 0) talloc_free(mux);
+}
+
+/** Read all the results available on a connection, and resume the requests waiting for them
+ *
+ * @param[in] el	the connection's fd was inserted into.
+ * @param[in] fd	which is readable.
+ * @param[in] ctx	The #rlm_ldap_mux_t the fd belongs to.
+ */
+static void _mux_read(UNUSED fr_event_list_t *el, UNUSED int fd, void *ctx)
+{
+	rlm_ldap_mux_t		*mux = talloc_get_type_abort(ctx, rlm_ldap_mux_t);
+	rlm_ldap_t const	*inst = mux->inst;
+	struct timeval		poll = { 0, 0 };
+
+	for (;;) {
+		rlm_ldap_query_t	find, *query;
+		LDAPMessage		*result = NULL;
+		int			ret;
+
+		/*
+		 *	Retrieve the complete result of any search.
+		 *	A zero timeout means we don't wait if there's
+		 *	nothing more to read.
+		 */
+		ret = ldap_result(mux->conn->handle, LDAP_RES_ANY, LDAP_MSG_ALL, &poll, &result);
+		if (ret == 0) return;
+		if (ret < 0) {
+			ERROR("Failed reading search results: %s", fr_ldap_error_str(mux->conn));
+			mux_fail(mux);
+			return;
+		}
+
+		find.msgid = ldap_msgid(result);
+		query = rbtree_finddata(mux->queries, &find);
+		if (!query) {
+			DEBUG3("Discarding result for unknown msgid %i", find.msgid);
+			ldap_msgfree(result);
+			continue;
+		}
+		rbtree_deletebydata(mux->queries, query);
+
+		query->result = result;
+		query_done(query, fr_ldap_search_async_result(&query->result, query->request, query->conn, query->dn));
+	}
+}
+
+static void _mux_error(UNUSED fr_event_list_t *el, UNUSED int fd, void *ctx)
+{
+	rlm_ldap_mux_t		*mux = talloc_get_type_abort(ctx, rlm_ldap_mux_t);
+	rlm_ldap_t const	*inst = mux->inst;
+
+	ERROR("Connection failed (%i)", mux->fd);
+
+	mux_fail(mux);
+}
+
+/** Open a new connection for a thread's searches
+ *
+ * @param[in] t		to open the connection for.
+ * @return
+ *	- A new connection.
+ *	- NULL on error.
+ */
+static rlm_ldap_mux_t *mux_alloc(rlm_ldap_thread_t *t)
+{
+	rlm_ldap_t const	*inst = t->inst;
+	rlm_ldap_mux_t		*mux;
+	void			*handle_config;
+
+	/*
+	 *	Don't try to reconnect more than once a second.
+	 */
+	if (t->mux_failed == time(NULL)) return NULL;
+
+	MEM(mux = talloc_zero(NULL, rlm_ldap_mux_t));
+	mux->inst = inst;
+	mux->thread = t;
+	mux->fd = -1;
+
+	MEM(mux->queries = rbtree_create(mux, query_cmp, NULL, RBTREE_FLAG_NONE));
+
+	memcpy(&handle_config, &inst->handle_config, sizeof(handle_config));
+	mux->conn = mod_conn_create(mux, handle_config, &inst->handle_config.net_timeout);
+	if (!mux->conn) {
+	error:
+		t->mux_failed = time(NULL);
+		talloc_free(mux);
+		return NULL;
+	}
+
+	if ((ldap_get_option(mux->conn->handle, LDAP_OPT_DESC, &mux->fd) != LDAP_OPT_SUCCESS) || (mux->fd < 0)) {
+		ERROR("Failed retrieving connection fd");
+		goto error;
+	}
+
+	if (fr_event_fd_insert(t->el, mux->fd, _mux_read, NULL, _mux_error, mux) < 0) {
+		PERROR("Failed inserting connection fd into event loop");
+		goto error;
+	}
+	talloc_set_destructor(mux, _mux_free);
+
+	DEBUG2("Opened connection (%i) for asynchronous searches", mux->fd);
+
+	return mux;
+}
+
+/** Abandon the search if it's outstanding, and release the connection it was sent on
+ *
+ */
+static int _query_free(rlm_ldap_query_t *query)
+{
+	rlm_ldap_mux_t *mux = query->mux;
+
+	if (query->ev) (void) fr_event_timer_delete(query->thread->el, &query->ev);
+	if (query->result) ldap_msgfree(query->result);
+
+	/*
+	 *	Search was performed on a pooled connection.
+	 */
+	if (!mux) {
+		mod_conn_release(query->thread->inst, NULL, query->conn);
+		return 0;
+	}
+
+	if (query->msgid >= 0) {
+		rbtree_deletebydata(mux->queries, query);
+		if (!mux->dead) (void) ldap_abandon_ext(mux->conn->handle, query->msgid, NULL, NULL);
+	}
+
+	if ((--mux->refs == 0) && mux->dead) talloc_free(mux);
+
+	return 0;
+}
+
+static void _query_timeout(UNUSED fr_event_list_t *el, UNUSED struct timeval *now, void *ctx)
+{
+	rlm_ldap_query_t	*query = talloc_get_type_abort(ctx, rlm_ldap_query_t);
+	REQUEST			*request = query->request;
+
+	REDEBUG("Timeout waiting for search result");
+
+	rbtree_deletebydata(query->mux->queries, query);
+	(void) ldap_abandon_ext(query->conn->handle, query->msgid, NULL, NULL);
+
+	query_done(query, LDAP_PROC_TIMEOUT);
+}
+
+/** Perform a search on a connection from the pool
+ *
+ * Used when the instance shares another module's connection pool, or the request
+ * isn't being run by this thread's event loop.  The query is complete when this
+ * function returns.
+ */
+static rlm_ldap_query_t *search_pool(TALLOC_CTX *ctx, rlm_ldap_thread_t *t, REQUEST *request,
+				     char const *dn, int scope, char const *filter, char const * const *attrs,
+				     LDAPControl **serverctrls)
+{
+	rlm_ldap_t const	*inst = t->inst;
+	rlm_ldap_query_t	*query;
+	fr_ldap_conn_t		*conn;
+
+	conn = mod_conn_get(inst, request);
+	if (!conn) return NULL;
+
+	MEM(query = talloc_zero(ctx, rlm_ldap_query_t));
+	query->request = request;
+	query->thread = t;
+	query->conn = conn;
+	query->msgid = -1;
+	talloc_set_destructor(query, _query_free);
+
+	query->status = fr_ldap_search(&query->result, request, &query->conn,
+				       dn, scope, filter, attrs, serverctrls, NULL);
+
+	return query;
+}
+
+/** Send a search, without waiting for the result
+ *
+ * The caller should yield after calling this function.  The request is marked as
+ * resumable when the search completes, fails, or times out, at which point
+ * query->status and query->result are set.
+ *
+ * If the query is freed before the search completes, the search is abandoned.
+ *
+ * @note If the instance shares another module's connection pool, or the request
+ *	isn't being run by this thread's event loop, the search is performed
+ *	synchronously, and is complete (query->msgid is -1) when this function
+ *	returns.  The caller should not yield in that case.
+ *
+ * @param[in] ctx		to allocate the query in.
+ * @param[in] t			Thread specific instance data.
+ * @param[in] request		Current request.
+ * @param[in] dn		to use as base for the search.
+ * @param[in] scope		to use (LDAP_SCOPE_BASE, LDAP_SCOPE_ONE, LDAP_SCOPE_SUB).
+ * @param[in] filter		to use, should be pre-escaped.
+ * @param[in] attrs		to retrieve.
+ * @param[in] serverctrls	Search controls to pass to the server.  May be NULL.
+ * @return
+ *	- A new query.
+ *	- NULL if the search couldn't be sent.
+ */
+rlm_ldap_query_t *rlm_ldap_search_async(TALLOC_CTX *ctx, rlm_ldap_thread_t *t, REQUEST *request,
+					char const *dn, int scope, char const *filter, char const * const *attrs,
+					LDAPControl **serverctrls)
+{
+	rlm_ldap_t const	*inst = t->inst;
+	rlm_ldap_query_t	*query;
+	rlm_ldap_mux_t		*mux;
+	fr_ldap_rcode_t		status;
+	struct timeval		now, when;
+
+	/*
+	 *	Requests processed synchronously run their own event
+	 *	loop, which doesn't service this thread's connection.
+	 */
+	if (t->use_pool || (request->el != t->el)) {
+		return search_pool(ctx, t, request, dn, scope, filter, attrs, serverctrls);
+	}
+
+	if (!t->mux) t->mux = mux_alloc(t);
+	mux = t->mux;
+	if (!mux) {
+		REDEBUG("No connection available");
+		return NULL;
+	}
+
+#ifdef LDAP_CONTROL_X_SESSION_TRACKING
+	/*
+	 *	Controls are added to the connection, so only
+	 *	apply to this search.
+	 */
+	if (inst->session_tracking && (fr_ldap_control_add_session_tracking(mux->conn, request) < 0)) {
+		fr_ldap_control_clear(mux->conn);
+		return NULL;
+	}
+#endif
+
+	MEM(query = talloc_zero(ctx, rlm_ldap_query_t));
+	query->request = request;
+	query->thread = t;
+	query->msgid = -1;
+	query->dn = talloc_typed_strdup(query, dn);
+
+	status = fr_ldap_search_async(&query->msgid, request, &mux->conn, dn, scope, filter, attrs,
+				      serverctrls, NULL);
+	fr_ldap_control_clear(mux->conn);
+	query->conn = mux->conn;
+	if (status != LDAP_PROC_SUCCESS) {
+		int ldap_errno;
+
+		talloc_free(query);
+
+		/*
+		 *	The connection is gone, the next search
+		 *	will open a new one.
+		 */
+		ldap_get_option(mux->conn->handle, LDAP_OPT_ERROR_NUMBER, &ldap_errno);
+		if (ldap_errno == LDAP_SERVER_DOWN) mux_fail(mux);
+
+		return NULL;
+	}
+
+	query->mux = mux;
+	mux->refs++;
+	rbtree_insert(mux->queries, query);
+	talloc_set_destructor(query, _query_free);
+
+	fr_event_list_time(&now, t->el);
+	fr_timeval_add(&when, &now, &inst->handle_config.res_timeout);
+	if (fr_event_timer_insert(t->el, _query_timeout, query, &when, &query->ev) < 0) {
+		RPEDEBUG("Failed inserting search timeout");
+		talloc_free(query);
+		return NULL;
+	}
+
+	RDEBUG2("Waiting for search result (msgid %i)...", query->msgid);
+
+	return query;
+}
+
+/** Open the connection for a thread's searches
+ *
+ * @param[in] t		Thread specific instance data.
+ * @return
+ *	- 0 on success.
+ *	- -1 on failure.
+ */
+int rlm_ldap_io_init(rlm_ldap_thread_t *t)
+{
+	rlm_ldap_t const *inst = t->inst;
+
+	/*
+	 *	If we're referencing another module's connection
+	 *	pool, we don't have a server to connect to.
+	 */
+	if (cf_pair_find(inst->cs, "pool")) {
+		WARN("Using another module's connection pool.  Searches will block");
+		t->use_pool = true;
+		return 0;
+	}
+
+	/*
+	 *	Not fatal, we'll try again when the first
+	 *	search is sent.
+	 */
+	t->mux = mux_alloc(t);
+	if (!t->mux) WARN("Failed opening connection for asynchronous searches");
+
+	return 0;
+}
+
+/** Close the connection for a thread's searches
+ *
+ * @param[in] t		Thread specific instance data.
+ */
+void rlm_ldap_io_free(rlm_ldap_thread_t *t)
+{
+	if (t->mux) mux_fail(t->mux);
+}
@@ -788,32 +788,35 @@ finish:
 	return rcode;
 }
 
-/** Search for and apply an LDAP profile
+/** Start searching for an LDAP profile
  *
  * LDAP profiles are mapped using the same attribute map as user objects, they're used to add common
- * sets of attributes to the request.
+ * sets of attributes to the request.  Once the search is complete, the result should be passed to
+ * #rlm_ldap_map_profile_result.
  *
- * @param[in] inst rlm_ldap configuration.
+ * @param[out] out Where to write the query.  NULL if no search was sent.
+ * @param[in] ctx to allocate the query in.
+ * @param[in] t Thread specific instance data.
  * @param[in] request Current request.
- * @param[in,out] pconn to use. May change as this function calls functions which auto re-connect.
  * @param[in] dn of profile object to apply.
  * @param[in] expanded Structure containing a list of xlat expanded attribute names and mapping
 information.
- * @return One of the RLM_MODULE_* values.
+ * @return
+ *	- RLM_MODULE_OK if the search was sent, or there's no profile to search for.
+ *	- RLM_MODULE_INVALID if the profile filter couldn't be expanded.
+ *	- RLM_MODULE_FAIL if the search couldn't be sent.
  */
-static rlm_rcode_t rlm_ldap_map_profile(rlm_ldap_t const *inst, REQUEST *request, fr_ldap_conn_t **pconn,
-					char const *dn, fr_ldap_map_exp_t const *expanded)
+static rlm_rcode_t rlm_ldap_map_profile_async(rlm_ldap_query_t **out, TALLOC_CTX *ctx, rlm_ldap_thread_t *t,
+					      REQUEST *request, char const *dn, fr_ldap_map_exp_t const *expanded)
 {
-	rlm_rcode_t	rcode = RLM_MODULE_OK;
-	fr_ldap_rcode_t	status;
-	LDAPMessage	*result = NULL, *entry = NULL;
-	int		ldap_errno;
-	LDAP		*handle = (*pconn)->handle;
-	char const	*filter;
-	char		filter_buff[LDAP_MAX_FILTER_STR_LEN];
+	rlm_ldap_t const	*inst = t->inst;
+	char const		*filter;
+	char			filter_buff[LDAP_MAX_FILTER_STR_LEN];
 
 	rad_assert(inst->profile_filter); 	/* We always have a default filter set */
 
+	*out = NULL;
+
 	if (!dn || !*dn) return RLM_MODULE_OK;
 
 	if (tmpl_expand(&filter, filter_buff, sizeof(filter_buff), request,
@@ -823,281 +826,465 @@ static rlm_rcode_t rlm_ldap_map_profile(rlm_ldap_t const *inst, REQUEST *request
 		return RLM_MODULE_INVALID;
 	}
 
-	status = fr_ldap_search(&result, request, pconn, dn,
-				LDAP_SCOPE_BASE, filter, expanded->attrs, NULL, NULL);
-	switch (status) {
+	*out = rlm_ldap_search_async(ctx, t, request, dn, LDAP_SCOPE_BASE, filter, expanded->attrs, NULL);
+	if (!*out) return RLM_MODULE_FAIL;
+
+	return RLM_MODULE_OK;
+}
+
+/** Apply an LDAP profile
+ *
+ * @param[in] inst rlm_ldap configuration.
+ * @param[in] request Current request.
+ * @param[in] query which retrieved the profile object.
+ * @param[in] expanded Structure containing a list of xlat expanded attribute names and mapping
+information.
+ * @return One of the RLM_MODULE_* values.
+ */
+static rlm_rcode_t rlm_ldap_map_profile_result(rlm_ldap_t const *inst, REQUEST *request, rlm_ldap_query_t *query,
+					       fr_ldap_map_exp_t const *expanded)
+{
+	rlm_rcode_t	rcode = RLM_MODULE_OK;
+	LDAPMessage	*entry = NULL;
+	int		ldap_errno;
+	LDAP		*handle = query->conn->handle;
+
+	switch (query->status) {
 	case LDAP_PROC_SUCCESS:
 		break;
 
 	case LDAP_PROC_BAD_DN:
 	case LDAP_PROC_NO_RESULT:
-		RDEBUG("Profile object \"%s\" not found", dn);
+		RDEBUG("Profile object \"%s\" not found", query->dn);
 		return RLM_MODULE_NOTFOUND;
 
 	default:
 		return RLM_MODULE_FAIL;
 	}
 
-	rad_assert(*pconn);
-	rad_assert(result);
+	rad_assert(query->result);
 
-	entry = ldap_first_entry(handle, result);
+	entry = ldap_first_entry(handle, query->result);
 	if (!entry) {
 		ldap_get_option(handle, LDAP_OPT_RESULT_CODE, &ldap_errno);
 		REDEBUG("Failed retrieving entry: %s", ldap_err2string(ldap_errno));
 
-		rcode = RLM_MODULE_NOTFOUND;
-
-		goto free_result;
+		return RLM_MODULE_NOTFOUND;
 	}
 
 	RDEBUG("Processing profile attributes");
 	RINDENT();
-	if (fr_ldap_map_do(request, *pconn, inst->valuepair_attr, expanded, entry) > 0) rcode = RLM_MODULE_UPDATED;
+	if (fr_ldap_map_do(request, query->conn, inst->valuepair_attr, expanded, entry) > 0) rcode = RLM_MODULE_UPDATED;
 	REXDENT();
 
-free_result:
-	ldap_msgfree(result);
-
 	return rcode;
 }
 
-static rlm_rcode_t mod_authorize(void *instance, UNUSED void *thread, REQUEST *request) CC_HINT(nonnull);
-static rlm_rcode_t mod_authorize(void *instance, UNUSED void *thread, REQUEST *request)
+#ifdef WITH_EDIR
+/** Retrieve the user's universal password, and optionally bind as the user
+ *
+ * Performed synchronously, on a connection from the pool.
+ *
+ * @param[in] inst rlm_ldap configuration.
+ * @param[in] request Current request.
+ * @param[in] dn of the user object.
+ * @return One of the RLM_MODULE_* values.
+ */
+static rlm_rcode_t rlm_ldap_edir_password(rlm_ldap_t const *inst, REQUEST *request, char const *dn)
 {
-	rlm_rcode_t		rcode = RLM_MODULE_OK;
-	fr_ldap_rcode_t		status;
-	int			ldap_errno;
-	int			i;
-	rlm_ldap_t const	*inst = instance;
-	struct berval		**values;
-	VALUE_PAIR		*vp;
-	fr_ldap_conn_t		*conn;
-	LDAPMessage		*result, *entry;
-	char const 		*dn = NULL;
-	fr_ldap_map_exp_t	expanded; /* faster than allocing every time */
+	rlm_rcode_t	rcode = RLM_MODULE_OK;
+	fr_ldap_rcode_t	status;
+	fr_ldap_conn_t	*conn;
+	VALUE_PAIR	*vp;
+	int		res = 0;
+	char		password[256];
+	size_t		pass_size = sizeof(password);
 
 	/*
-	 *	Don't be tempted to add a check for request->username
-	 *	or request->password here. rlm_ldap.authorize can be used for
-	 *	many things besides searching for users.
+	 *	We already have a Cleartext-Password.  Skip edir.
 	 */
-
-	if (fr_ldap_map_expand(&expanded, request, inst->user_map) < 0) return RLM_MODULE_FAIL;
+	if (fr_pair_find_by_num(request->control, 0, PW_CLEARTEXT_PASSWORD, TAG_ANY)) return RLM_MODULE_OK;
 
 	conn = mod_conn_get(inst, request);
 	if (!conn) return RLM_MODULE_FAIL;
 
 	/*
-	 *	Add any additional attributes we need for checking access, memberships, and profiles
+	 *	Retrive universal password
 	 */
-	if (inst->userobj_access_attr) {
-		expanded.attrs[expanded.count++] = inst->userobj_access_attr;
-	}
+	res = fr_ldap_edir_get_password(conn->handle, dn, password, &pass_size);
+	if (res != 0) {
+		REDEBUG("Failed to retrieve eDirectory password: (%i) %s", res, fr_ldap_edir_errstr(res));
+		rcode = RLM_MODULE_FAIL;
 
-	if (inst->userobj_membership_attr && (inst->cacheable_group_dn || inst->cacheable_group_name)) {
-		expanded.attrs[expanded.count++] = inst->userobj_membership_attr;
+		goto finish;
 	}
 
-	if (inst->profile_attr) {
-		expanded.attrs[expanded.count++] = inst->profile_attr;
-	}
+	/*
+	 *	Add Cleartext-Password attribute to the request
+	 */
+	vp = radius_pair_create(request, &request->control, PW_CLEARTEXT_PASSWORD, 0);
+	fr_pair_value_bstrncpy(vp, password, pass_size);
 
-	if (inst->valuepair_attr) {
-		expanded.attrs[expanded.count++] = inst->valuepair_attr;
+	if (RDEBUG_ENABLED3) {
+		RDEBUG3("Added eDirectory password.  control:%s += '%s'", vp->da->name, vp->vp_strvalue);
+	} else {
+		RDEBUG2("Added eDirectory password");
 	}
 
-	expanded.attrs[expanded.count] = NULL;
+	if (inst->edir_autz) {
+		RDEBUG2("Binding as user for eDirectory authorization checks");
+		/*
+		 *	Bind as the user
+		 */
+		conn->rebound = true;
+		status = fr_ldap_bind(request, &conn, dn, vp->vp_strvalue, NULL, NULL, NULL, NULL);
+		switch (status) {
+		case LDAP_PROC_SUCCESS:
+			rcode = RLM_MODULE_OK;
+			RDEBUG("Bind as user '%s' was successful", dn);
+			break;
+
+		case LDAP_PROC_NOT_PERMITTED:
+			rcode = RLM_MODULE_USERLOCK;
+			break;
 
-	dn = rlm_ldap_find_user(inst, request, &conn, expanded.attrs, true, &result, &rcode);
-	if (!dn) {
-		goto finish;
-	}
+		case LDAP_PROC_REJECT:
+			rcode = RLM_MODULE_REJECT;
+			break;
 
-	entry = ldap_first_entry(conn->handle, result);
-	if (!entry) {
-		ldap_get_option(conn->handle, LDAP_OPT_RESULT_CODE, &ldap_errno);
-		REDEBUG("Failed retrieving entry: %s", ldap_err2string(ldap_errno));
+		case LDAP_PROC_BAD_DN:
+			rcode = RLM_MODULE_INVALID;
+			break;
 
-		goto finish;
-	}
+		case LDAP_PROC_NO_RESULT:
+			rcode = RLM_MODULE_NOTFOUND;
+			break;
 
-	/*
-	 *	Check for access.
-	 */
-	if (inst->userobj_access_attr) {
-		rcode = rlm_ldap_check_access(inst, request, conn, entry);
-		if (rcode != RLM_MODULE_OK) {
-			goto finish;
-		}
+		default:
+			rcode = RLM_MODULE_FAIL;
+			break;
+		};
 	}
 
-	/*
-	 *	Check if we need to cache group memberships
-	 */
-	if (inst->cacheable_group_dn || inst->cacheable_group_name) {
-		if (inst->userobj_membership_attr) {
-			rcode = rlm_ldap_cacheable_userobj(inst, request, &conn, entry, inst->userobj_membership_attr);
-			if (rcode != RLM_MODULE_OK) {
-				goto finish;
-			}
-		}
+finish:
+	mod_conn_release(inst, request, conn);
 
-		rcode = rlm_ldap_cacheable_groupobj(inst, request, &conn);
-		if (rcode != RLM_MODULE_OK) {
-			goto finish;
-		}
-	}
+	return rcode;
+}
+#endif
 
-#ifdef WITH_EDIR
-	/*
-	 *	We already have a Cleartext-Password.  Skip edir.
-	 */
-	if (fr_pair_find_by_num(request->control, 0, PW_CLEARTEXT_PASSWORD, TAG_ANY)) {
-		goto skip_edir;
-	}
+/** What an asynchronous authorization is waiting for
+ *
+ */
+typedef enum {
+	LDAP_AUTZ_FIND_USER = 0,			//!< Search for the user object.
+	LDAP_AUTZ_GROUPOBJ,				//!< Search for group objects the user is a member of.
+	LDAP_AUTZ_DEFAULT_PROFILE,			//!< Search for the default profile.
+	LDAP_AUTZ_USER_PROFILE				//!< Search for one of the profiles listed in the user object.
+} ldap_autz_status_t;
+
+/** Holds state of in progress authorization
+ *
+ */
+typedef struct {
+	ldap_autz_status_t	status;			//!< What we're waiting for.
+	rlm_rcode_t		rcode;			//!< To return when we're done.
 
-	/*
-	 *      Retrieve Universal Password if we use eDirectory
-	 */
-	if (inst->edir) {
-		int res = 0;
-		char password[256];
-		size_t pass_size = sizeof(password);
+	fr_ldap_map_exp_t	expanded;		//!< Attributes to retrieve, and maps to apply.
 
-		/*
-		 *	Retrive universal password
-		 */
-		res = fr_ldap_edir_get_password(conn->handle, dn, password, &pass_size);
-		if (res != 0) {
-			REDEBUG("Failed to retrieve eDirectory password: (%i) %s", res, fr_ldap_edir_errstr(res));
-			rcode = RLM_MODULE_FAIL;
+	rlm_ldap_query_t	*query;			//!< Search we're waiting for.
+	rlm_ldap_query_t	*user;			//!< Search which retrieved the user object.
+	LDAPMessage		*entry;			//!< User object.
+	char const		*dn;			//!< Of the user object.
+
+	struct berval		**profile_values;	//!< Profiles listed in the user object.
+	int			profile_value;		//!< Index of the next profile to apply.
+} ldap_autz_ctx_t;
+
+static int _autz_ctx_free(ldap_autz_ctx_t *autz)
+{
+	if (autz->profile_values) ldap_value_free_len(autz->profile_values);
+	talloc_free(autz->expanded.ctx);
+
+	return 0;
+}
+
+static rlm_rcode_t mod_authorize_resume(REQUEST *request, void *instance, void *thread, void *ctx);
+
+/** Cancel an in progress authorization
+ *
+ * Freeing the authorization state abandons any outstanding search.
+ */
+static void mod_authorize_action(REQUEST *request, UNUSED void *instance, UNUSED void *thread, void *ctx,
+				 fr_state_action_t action)
+{
+	ldap_autz_ctx_t *autz = talloc_get_type_abort(ctx, ldap_autz_ctx_t);
+
+	if (action != FR_ACTION_DONE) return;
+
+	RDEBUG("Forcefully cancelling pending LDAP search");
+
+	talloc_free(autz);
+}
+
+/** Continue an authorization once a search has completed
+ *
+ * Processes the result of the search we were waiting for, then performs the remaining
+ * authorization steps until another search has been sent, or we're done.
+ */
+static rlm_rcode_t mod_authorize_resume(REQUEST *request, void *instance, void *thread, void *ctx)
+{
+	rlm_ldap_t const	*inst = instance;
+	rlm_ldap_thread_t	*t = thread;
+	ldap_autz_ctx_t		*autz = talloc_get_type_abort(ctx, ldap_autz_ctx_t);
+	rlm_ldap_query_t	*query;
+	rlm_rcode_t		rcode;
+	int			ldap_errno;
+
+again:
+	query = autz->query;
+	autz->query = NULL;
+
+	switch (autz->status) {
+	case LDAP_AUTZ_FIND_USER:
+		autz->user = query;
+
+		autz->dn = rlm_ldap_find_user_result(inst, request, query->conn, query->status, query->result,
+						     &autz->rcode);
+		if (!autz->dn) goto finish;
+
+		autz->entry = ldap_first_entry(query->conn->handle, query->result);
+		if (!autz->entry) {
+			ldap_get_option(query->conn->handle, LDAP_OPT_RESULT_CODE, &ldap_errno);
+			REDEBUG("Failed retrieving entry: %s", ldap_err2string(ldap_errno));
 
 			goto finish;
 		}
+		query = NULL;
 
 		/*
-		 *	Add Cleartext-Password attribute to the request
+		 *	Check for access.
 		 */
-		vp = radius_pair_create(request, &request->control, PW_CLEARTEXT_PASSWORD, 0);
-		fr_pair_value_bstrncpy(vp, password, pass_size);
-
-		if (RDEBUG_ENABLED3) {
-			RDEBUG3("Added eDirectory password.  control:%s += '%s'", vp->da->name, vp->vp_strvalue);
-		} else {
-			RDEBUG2("Added eDirectory password");
+		if (inst->userobj_access_attr) {
+			autz->rcode = rlm_ldap_check_access(inst, request, autz->user->conn, autz->entry);
+			if (autz->rcode != RLM_MODULE_OK) goto finish;
 		}
 
-		if (inst->edir_autz) {
-			RDEBUG2("Binding as user for eDirectory authorization checks");
+		/*
+		 *	Check if we need to cache group memberships
+		 */
+		if (inst->cacheable_group_dn || inst->cacheable_group_name) {
 			/*
-			 *	Bind as the user
+			 *	Converting between group names and DNs
+			 *	may require more searches, which are
+			 *	performed on a connection from the pool.
 			 */
-			conn->rebound = true;
-			status = fr_ldap_bind(request, &conn, dn, vp->vp_strvalue, NULL, NULL, NULL, NULL);
-			switch (status) {
-			case LDAP_PROC_SUCCESS:
-				rcode = RLM_MODULE_OK;
-				RDEBUG("Bind as user '%s' was successful", dn);
-				break;
+			if (inst->userobj_membership_attr) {
+				fr_ldap_conn_t *conn;
 
-			case LDAP_PROC_NOT_PERMITTED:
-				rcode = RLM_MODULE_USERLOCK;
-				goto finish;
+				conn = mod_conn_get(inst, request);
+				if (!conn) {
+					autz->rcode = RLM_MODULE_FAIL;
+					goto finish;
+				}
 
-			case LDAP_PROC_REJECT:
-				rcode = RLM_MODULE_REJECT;
+				autz->rcode = rlm_ldap_cacheable_userobj(inst, request, &conn, autz->entry,
+									 inst->userobj_membership_attr);
+				mod_conn_release(inst, request, conn);
+				if (autz->rcode != RLM_MODULE_OK) goto finish;
+			}
+
+			autz->rcode = rlm_ldap_cacheable_groupobj_async(&autz->query, autz, t, request);
+			if (autz->rcode != RLM_MODULE_OK) goto finish;
+			if (autz->query) {
+				autz->status = LDAP_AUTZ_GROUPOBJ;
+				goto yield;
+			}
+		}
+		/* FALL-THROUGH */
+
+	case LDAP_AUTZ_GROUPOBJ:
+		if (query) {
+			autz->rcode = rlm_ldap_cacheable_groupobj_result(inst, request, query->conn,
+									 query->status, query->result);
+			TALLOC_FREE(query);
+			if (autz->rcode != RLM_MODULE_OK) goto finish;
+		}
+
+#ifdef WITH_EDIR
+		/*
+		 *      Retrieve Universal Password if we use eDirectory
+		 */
+		if (inst->edir) {
+			autz->rcode = rlm_ldap_edir_password(inst, request, autz->dn);
+			if (autz->rcode != RLM_MODULE_OK) goto finish;
+		}
+#endif
+
+		/*
+		 *	Apply ONE user profile, or a default user profile.
+		 */
+		if (inst->default_profile) {
+			char const *profile;
+			char profile_buff[1024];
+
+			if (tmpl_expand(&profile, profile_buff, sizeof(profile_buff),
+					request, inst->default_profile, NULL, NULL) < 0) {
+				REDEBUG("Failed creating default profile string");
+
+				autz->rcode = RLM_MODULE_INVALID;
 				goto finish;
+			}
 
-			case LDAP_PROC_BAD_DN:
-				rcode = RLM_MODULE_INVALID;
+			rcode = rlm_ldap_map_profile_async(&autz->query, autz, t, request, profile, &autz->expanded);
+			if (rcode != RLM_MODULE_OK) {
+				autz->rcode = rcode;
 				goto finish;
+			}
+			if (autz->query) {
+				autz->status = LDAP_AUTZ_DEFAULT_PROFILE;
+				goto yield;
+			}
+		}
+		/* FALL-THROUGH */
+
+	case LDAP_AUTZ_DEFAULT_PROFILE:
+		if (query) {
+			rcode = rlm_ldap_map_profile_result(inst, request, query, &autz->expanded);
+			TALLOC_FREE(query);
 
-			case LDAP_PROC_NO_RESULT:
-				rcode = RLM_MODULE_NOTFOUND;
+			switch (rcode) {
+			case RLM_MODULE_INVALID:
+			case RLM_MODULE_FAIL:
+				autz->rcode = rcode;
 				goto finish;
 
+			case RLM_MODULE_UPDATED:
+				autz->rcode = RLM_MODULE_UPDATED;
+				/* FALL-THROUGH */
 			default:
-				rcode = RLM_MODULE_FAIL;
+				break;
+			}
+		}
+
+		/*
+		 *	Apply a SET of user profiles.
+		 */
+		if (inst->profile_attr) {
+			autz->profile_values = ldap_get_values_len(autz->user->conn->handle, autz->entry,
+								   inst->profile_attr);
+		}
+		/* FALL-THROUGH */
+
+	case LDAP_AUTZ_USER_PROFILE:
+		if (query) {
+			rcode = rlm_ldap_map_profile_result(inst, request, query, &autz->expanded);
+			TALLOC_FREE(query);
+			if (rcode == RLM_MODULE_FAIL) {
+				autz->rcode = rcode;
 				goto finish;
-			};
+			}
+		}
+
+		while (autz->profile_values && autz->profile_values[autz->profile_value]) {
+			char *value;
+
+			value = fr_ldap_berval_to_string(request, autz->profile_values[autz->profile_value++]);
+			rcode = rlm_ldap_map_profile_async(&autz->query, autz, t, request, value, &autz->expanded);
+			talloc_free(value);
+			if (rcode == RLM_MODULE_FAIL) {
+				autz->rcode = rcode;
+				goto finish;
+			}
+			if (autz->query) {
+				autz->status = LDAP_AUTZ_USER_PROFILE;
+				goto yield;
+			}
+		}
+
+		if (inst->user_map || inst->valuepair_attr) {
+			RDEBUG("Processing user attributes");
+			RINDENT();
+			if (fr_ldap_map_do(request, autz->user->conn, inst->valuepair_attr,
+					   &autz->expanded, autz->entry) > 0) autz->rcode = RLM_MODULE_UPDATED;
+			REXDENT();
+			rlm_ldap_check_reply(inst, request, autz->user->conn);
 		}
+		break;
 	}
 
-skip_edir:
-#endif
+finish:
+	rcode = autz->rcode;
+	talloc_free(autz);
+
+	return rcode;
 
+yield:
 	/*
-	 *	Apply ONE user profile, or a default user profile.
+	 *	Searches performed on a connection from the
+	 *	pool are complete as soon as they're sent.
 	 */
-	if (inst->default_profile) {
-		char const *profile;
-		char profile_buff[1024];
+	if (autz->query->msgid < 0) goto again;
 
-		if (tmpl_expand(&profile, profile_buff, sizeof(profile_buff),
-				request, inst->default_profile, NULL, NULL) < 0) {
-			REDEBUG("Failed creating default profile string");
+	return unlang_yield(request, mod_authorize_resume, mod_authorize_action, autz);
+}
 
-			rcode = RLM_MODULE_INVALID;
-			goto finish;
-		}
+static rlm_rcode_t mod_authorize(void *instance, void *thread, REQUEST *request) CC_HINT(nonnull);
+static rlm_rcode_t mod_authorize(void *instance, void *thread, REQUEST *request)
+{
+	rlm_ldap_t const	*inst = instance;
+	rlm_ldap_thread_t	*t = thread;
+	ldap_autz_ctx_t		*autz;
+	fr_ldap_map_exp_t	*expanded;
+	rlm_rcode_t		rcode;
 
-		switch (rlm_ldap_map_profile(inst, request, &conn, profile, &expanded)) {
-		case RLM_MODULE_INVALID:
-			rcode = RLM_MODULE_INVALID;
-			goto finish;
+	MEM(autz = talloc_zero(request, ldap_autz_ctx_t));
+	autz->rcode = RLM_MODULE_OK;
+	expanded = &autz->expanded;
 
-		case RLM_MODULE_FAIL:
-			rcode = RLM_MODULE_FAIL;
-			goto finish;
+	/*
+	 *	Don't be tempted to add a check for request->username
+	 *	or request->password here. rlm_ldap.authorize can be used for
+	 *	many things besides searching for users.
+	 */
 
-		case RLM_MODULE_UPDATED:
-			rcode = RLM_MODULE_UPDATED;
-			/* FALL-THROUGH */
-		default:
-			break;
-		}
+	if (fr_ldap_map_expand(expanded, request, inst->user_map) < 0) {
+		talloc_free(autz);
+		return RLM_MODULE_FAIL;
 	}
+	talloc_set_destructor(autz, _autz_ctx_free);
 
 	/*
-	 *	Apply a SET of user profiles.
+	 *	Add any additional attributes we need for checking access, memberships, and profiles
 	 */
+	if (inst->userobj_access_attr) {
+		expanded->attrs[expanded->count++] = inst->userobj_access_attr;
+	}
+
+	if (inst->userobj_membership_attr && (inst->cacheable_group_dn || inst->cacheable_group_name)) {
+		expanded->attrs[expanded->count++] = inst->userobj_membership_attr;
+	}
+
 	if (inst->profile_attr) {
-		values = ldap_get_values_len(conn->handle, entry, inst->profile_attr);
-		if (values != NULL) {
-			for (i = 0; values[i] != NULL; i++) {
-				rlm_rcode_t ret;
-				char *value;
-
-				value = fr_ldap_berval_to_string(request, values[i]);
-				ret = rlm_ldap_map_profile(inst, request, &conn, value, &expanded);
-				talloc_free(value);
-				if (ret == RLM_MODULE_FAIL) {
-					ldap_value_free_len(values);
-					rcode = ret;
-					goto finish;
-				}
+		expanded->attrs[expanded->count++] = inst->profile_attr;
+	}
 
-			}
-			ldap_value_free_len(values);
-		}
+	if (inst->valuepair_attr) {
+		expanded->attrs[expanded->count++] = inst->valuepair_attr;
 	}
 
-	if (inst->user_map || inst->valuepair_attr) {
-		RDEBUG("Processing user attributes");
-		RINDENT();
-		if (fr_ldap_map_do(request, conn, inst->valuepair_attr,
-				   &expanded, entry) > 0) rcode = RLM_MODULE_UPDATED;
-		REXDENT();
-		rlm_ldap_check_reply(inst, request, conn);
+	expanded->attrs[expanded->count] = NULL;
+
+	rcode = rlm_ldap_find_user_async(&autz->query, autz, t, request, expanded->attrs);
+	if (rcode != RLM_MODULE_OK) {
+		talloc_free(autz);
+		return rcode;
 	}
 
-finish:
-	talloc_free(expanded.ctx);
-	if (result) ldap_msgfree(result);
-	mod_conn_release(inst, request, conn);
+	autz->status = LDAP_AUTZ_FIND_USER;
+	if (autz->query->msgid < 0) return mod_authorize_resume(request, instance, thread, autz);
 
-	return rcode;
+	return unlang_yield(request, mod_authorize_resume, mod_authorize_action, autz);
 }
 
 /** Modify user's object in LDAP
@@ -1352,6 +1539,38 @@ static rlm_rcode_t CC_HINT(nonnull) mod_post_auth(void *instance, UNUSED void *t
 	return RLM_MODULE_NOOP;
 }
 
+/** Open the connection this thread's searches are multiplexed on
+ *
+ * @param[in] conf	section containing the configuration of this module instance.
+ * @param[in] instance	of rlm_ldap_t.
+ * @param[in] el	The event list serviced by this thread.
+ * @param[in] thread	specific data.
+ * @return
+ *	- 0 on success.
+ *	- -1 on failure.
+ */
+static int mod_thread_instantiate(UNUSED CONF_SECTION const *conf, void *instance,
+				  fr_event_list_t *el, void *thread)
+{
+	rlm_ldap_thread_t	*t = thread;
+
+	t->inst = instance;
+	t->el = el;
+
+	return rlm_ldap_io_init(t);
+}
+
+/** Close the connection this thread's searches are multiplexed on
+ *
+ * @param[in] thread	specific data to destroy.
+ * @return 0
+ */
+static int mod_thread_detach(void *thread)
+{
+	rlm_ldap_io_free(thread);
+
+	return 0;
+}
 
 /** Detach from the LDAP server and cleanup internal state.
  *
@@ -1977,16 +2196,19 @@ static void mod_unload(void)
 /* globally exported name */
 extern rad_module_t rlm_ldap;
 rad_module_t rlm_ldap = {
-	.magic		= RLM_MODULE_INIT,
-	.name		= "ldap",
-	.type		= 0,
-	.inst_size	= sizeof(rlm_ldap_t),
-	.config		= module_config,
-	.load		= mod_load,
-	.unload		= mod_unload,
-	.bootstrap	= mod_bootstrap,
-	.instantiate	= mod_instantiate,
-	.detach		= mod_detach,
+	.magic			= RLM_MODULE_INIT,
+	.name			= "ldap",
+	.type			= 0,
+	.inst_size		= sizeof(rlm_ldap_t),
+	.thread_inst_size	= sizeof(rlm_ldap_thread_t),
+	.config			= module_config,
+	.load			= mod_load,
+	.unload			= mod_unload,
+	.bootstrap		= mod_bootstrap,
+	.instantiate		= mod_instantiate,
+	.thread_instantiate	= mod_thread_instantiate,
+	.thread_detach		= mod_thread_detach,
+	.detach			= mod_detach,
 	.methods = {
 		[MOD_AUTHENTICATE]	= mod_authenticate,
 		[MOD_AUTHORIZE]		= mod_authorize,
@@ -160,12 +160,59 @@ struct ldap_inst_s {
 	uint32_t	ldap_debug;			//!< Debug flag for the SDK.
 };
 
+/** A connection searches from many requests are multiplexed on
+ *
+ */
+typedef struct rlm_ldap_mux rlm_ldap_mux_t;
+
+/** Thread specific rlm_ldap instance data
+ *
+ */
+typedef struct {
+	rlm_ldap_t const	*inst;			//!< Instance of rlm_ldap.
+	fr_event_list_t		*el;			//!< The event list serviced by this thread.
+
+	rlm_ldap_mux_t		*mux;			//!< Connection this thread's searches are sent on.
+							//!< NULL if we're not currently connected.
+	time_t			mux_failed;		//!< When we last failed to connect.
+
+	bool			use_pool;		//!< Instance shares another module's connection pool.
+							//!< Searches are performed synchronously, on connections
+							//!< from the pool.
+} rlm_ldap_thread_t;
+
+/** An asynchronous search
+ *
+ * Freeing the query abandons the search if it's still outstanding, and frees the result.
+ */
+typedef struct {
+	REQUEST			*request;		//!< Request which sent the search.
+	rlm_ldap_thread_t	*thread;		//!< Thread which sent the search.
+	rlm_ldap_mux_t		*mux;			//!< The search was sent on.  NULL if the search
+							//!< was performed on a pooled connection.
+	fr_ldap_conn_t		*conn;			//!< The search was sent on.  Must be passed
+							//!< to functions which process the result.
+	char const		*dn;			//!< Base DN of the search.
+
+	int			msgid;			//!< Of the search.  -1 once the search is complete.
+	fr_event_timer_t	*ev;			//!< Result timeout.
+
+	fr_ldap_rcode_t		status;			//!< Of the search.
+	LDAPMessage		*result;		//!< Entries returned by the search.
+} rlm_ldap_query_t;
+
 /*
  *	user.c - User lookup functions
  */
 char const *rlm_ldap_find_user(rlm_ldap_t const *inst, REQUEST *request, fr_ldap_conn_t **pconn,
 			       char const *attrs[], bool force, LDAPMessage **result, rlm_rcode_t *rcode);
 
+rlm_rcode_t rlm_ldap_find_user_async(rlm_ldap_query_t **out, TALLOC_CTX *ctx, rlm_ldap_thread_t *t,
+				     REQUEST *request, char const *attrs[]);
+
+char const *rlm_ldap_find_user_result(rlm_ldap_t const *inst, REQUEST *request, fr_ldap_conn_t const *conn,
+				      fr_ldap_rcode_t status, LDAPMessage *result, rlm_rcode_t *rcode);
+
 rlm_rcode_t rlm_ldap_check_access(rlm_ldap_t const *inst, REQUEST *request,
 				  fr_ldap_conn_t const *conn, LDAPMessage *entry);
 
@@ -177,7 +224,12 @@ void rlm_ldap_check_reply(rlm_ldap_t const *inst, REQUEST *request, fr_ldap_conn
 rlm_rcode_t rlm_ldap_cacheable_userobj(rlm_ldap_t const *inst, REQUEST *request, fr_ldap_conn_t **pconn,
 				       LDAPMessage *entry, char const *attr);
 
-rlm_rcode_t rlm_ldap_cacheable_groupobj(rlm_ldap_t const *inst, REQUEST *request, fr_ldap_conn_t **pconn);
+rlm_rcode_t rlm_ldap_cacheable_groupobj_async(rlm_ldap_query_t **out, TALLOC_CTX *ctx, rlm_ldap_thread_t *t,
+					      REQUEST *request);
+
+rlm_rcode_t rlm_ldap_cacheable_groupobj_result(rlm_ldap_t const *inst, REQUEST *request,
+					       fr_ldap_conn_t const *conn, fr_ldap_rcode_t status,
+					       LDAPMessage *result);
 
 rlm_rcode_t rlm_ldap_check_groupobj_dynamic(rlm_ldap_t const *inst, REQUEST *request, fr_ldap_conn_t **pconn,
 					    VALUE_PAIR *check);
@@ -196,6 +248,17 @@ void		mod_conn_release(rlm_ldap_t const *inst, REQUEST *request, fr_ldap_conn_t
 
 void		*mod_conn_create(TALLOC_CTX *ctx, void *instance, struct timeval const *timeout);
 
+/*
+ *	io.c - Asynchronous searches.
+ */
+rlm_ldap_query_t *rlm_ldap_search_async(TALLOC_CTX *ctx, rlm_ldap_thread_t *t, REQUEST *request,
+					char const *dn, int scope, char const *filter, char const * const *attrs,
+					LDAPControl **serverctrls);
+
+int		rlm_ldap_io_init(rlm_ldap_thread_t *t);
+
+void		rlm_ldap_io_free(rlm_ldap_thread_t *t);
+
 /*
  *	clients.c - Dynamic clients (bulk load).
  */
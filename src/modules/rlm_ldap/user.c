@@ -32,6 +32,45 @@
 
 #include "rlm_ldap.h"
 
+/** Expand the filter and base DN used to search for user objects
+ *
+ * @param[in] inst rlm_ldap configuration.
+ * @param[in] request Current request.
+ * @param[out] filter Where to write the filter.  Will be NULL if there's no filter.
+ * @param[in] filter_buff to expand the filter into.
+ * @param[in] filter_len length of filter_buff.
+ * @param[out] base_dn Where to write the base DN.
+ * @param[in] base_dn_buff to expand the base DN into.
+ * @param[in] base_dn_len length of base_dn_buff.
+ * @return
+ *	- #RLM_MODULE_OK on success.
+ *	- #RLM_MODULE_INVALID if either couldn't be expanded.
+ */
+static rlm_rcode_t user_search_expand(rlm_ldap_t const *inst, REQUEST *request,
+				      char const **filter, char *filter_buff, size_t filter_len,
+				      char const **base_dn, char *base_dn_buff, size_t base_dn_len)
+{
+	*filter = NULL;
+
+	if (inst->userobj_filter) {
+		if (tmpl_expand(filter, filter_buff, filter_len, request, inst->userobj_filter,
+				fr_ldap_escape_func, NULL) < 0) {
+			REDEBUG("Unable to create filter");
+
+			return RLM_MODULE_INVALID;
+		}
+	}
+
+	if (tmpl_expand(base_dn, base_dn_buff, base_dn_len, request,
+			inst->userobj_base_dn, fr_ldap_escape_func, NULL) < 0) {
+		REDEBUG("Unable to create base_dn");
+
+		return RLM_MODULE_INVALID;
+	}
+
+	return RLM_MODULE_OK;
+}
+
 /** Retrieve the DN of a user object
  *
  * Retrieves the DN of a user and adds it to the control list as LDAP-UserDN. Will also retrieve any
@@ -57,11 +96,9 @@ char const *rlm_ldap_find_user(rlm_ldap_t const *inst, REQUEST *request, fr_ldap
 
 	fr_ldap_rcode_t	status;
 	VALUE_PAIR	*vp = NULL;
-	LDAPMessage	*tmp_msg = NULL, *entry = NULL;
-	int		ldap_errno;
-	int		cnt;
-	char		*dn = NULL;
-	char const	*filter = NULL;
+	LDAPMessage	*tmp_msg = NULL;
+	char const	*dn;
+	char const	*filter;
 	char	    	filter_buff[LDAP_MAX_FILTER_STR_LEN];
 	char const	*base_dn;
 	char	    	base_dn_buff[LDAP_MAX_DN_STR_LEN];
@@ -111,26 +148,84 @@ char const *rlm_ldap_find_user(rlm_ldap_t const *inst, REQUEST *request, fr_ldap
 		(*pconn)->rebound = false;
 	}
 
-	if (inst->userobj_filter) {
-		if (tmpl_expand(&filter, filter_buff, sizeof(filter_buff), request, inst->userobj_filter,
-				fr_ldap_escape_func, NULL) < 0) {
-			REDEBUG("Unable to create filter");
-			*rcode = RLM_MODULE_INVALID;
+	*rcode = user_search_expand(inst, request, &filter, filter_buff, sizeof(filter_buff),
+				    &base_dn, base_dn_buff, sizeof(base_dn_buff));
+	if (*rcode != RLM_MODULE_OK) return NULL;
 
-			return NULL;
-		}
-	}
+	status = fr_ldap_search(result, request, pconn, base_dn,
+				inst->userobj_scope, filter, attrs, serverctrls, NULL);
 
-	if (tmpl_expand(&base_dn, base_dn_buff, sizeof(base_dn_buff), request,
-			inst->userobj_base_dn, fr_ldap_escape_func, NULL) < 0) {
-		REDEBUG("Unable to create base_dn");
-		*rcode = RLM_MODULE_INVALID;
+	rad_assert(*pconn);
 
-		return NULL;
+	dn = rlm_ldap_find_user_result(inst, request, *pconn, status, *result, rcode);
+	if ((freeit || (*rcode != RLM_MODULE_OK)) && *result) {
+		ldap_msgfree(*result);
+		*result = NULL;
 	}
 
-	status = fr_ldap_search(result, request, pconn, base_dn,
-				inst->userobj_scope, filter, attrs, serverctrls, NULL);
+	return dn;
+}
+
+/** Start searching for a user object
+ *
+ * The asynchronous equivalent of #rlm_ldap_find_user, with force set.  Once the
+ * search is complete, the result should be passed to #rlm_ldap_find_user_result.
+ *
+ * @param[out] out Where to write the query.  NULL if no search was sent.
+ * @param[in] ctx to allocate the query in.
+ * @param[in] t Thread specific instance data.
+ * @param[in] request Current request.
+ * @param[in] attrs Additional attributes to retrieve, may be NULL.
+ * @return
+ *	- #RLM_MODULE_OK if the search was sent.
+ *	- #RLM_MODULE_INVALID if the filter or base DN couldn't be expanded.
+ *	- #RLM_MODULE_FAIL if the search couldn't be sent.
+ */
+rlm_rcode_t rlm_ldap_find_user_async(rlm_ldap_query_t **out, TALLOC_CTX *ctx, rlm_ldap_thread_t *t,
+				     REQUEST *request, char const *attrs[])
+{
+	rlm_ldap_t const	*inst = t->inst;
+	rlm_rcode_t		rcode;
+	char const		*filter;
+	char			filter_buff[LDAP_MAX_FILTER_STR_LEN];
+	char const		*base_dn;
+	char			base_dn_buff[LDAP_MAX_DN_STR_LEN];
+	LDAPControl		*serverctrls[] = { inst->userobj_sort_ctrl, NULL };
+
+	*out = NULL;
+
+	rcode = user_search_expand(inst, request, &filter, filter_buff, sizeof(filter_buff),
+				   &base_dn, base_dn_buff, sizeof(base_dn_buff));
+	if (rcode != RLM_MODULE_OK) return rcode;
+
+	*out = rlm_ldap_search_async(ctx, t, request, base_dn, inst->userobj_scope, filter, attrs, serverctrls);
+	if (!*out) return RLM_MODULE_FAIL;
+
+	return RLM_MODULE_OK;
+}
+
+/** Process the result of a search for a user object
+ *
+ * Checks the search returned a single user object, and adds its DN to the control
+ * list as LDAP-UserDN.
+ *
+ * @param[in] inst rlm_ldap configuration.
+ * @param[in] request Current request.
+ * @param[in] conn the search was performed on.
+ * @param[in] status of the search.
+ * @param[in] result of the search.  Not freed.
+ * @param[out] rcode The status of the operation, one of the RLM_MODULE_* codes.
+ * @return The user's DN or NULL on error.
+ */
+char const *rlm_ldap_find_user_result(rlm_ldap_t const *inst, REQUEST *request, fr_ldap_conn_t const *conn,
+				      fr_ldap_rcode_t status, LDAPMessage *result, rlm_rcode_t *rcode)
+{
+	VALUE_PAIR	*vp = NULL;
+	LDAPMessage	*entry = NULL;
+	int		ldap_errno;
+	int		cnt;
+	char		*dn = NULL;
+
 	switch (status) {
 	case LDAP_PROC_SUCCESS:
 		break;
@@ -145,7 +240,7 @@ char const *rlm_ldap_find_user(rlm_ldap_t const *inst, REQUEST *request, fr_ldap
 		return NULL;
 	}
 
-	rad_assert(*pconn);
+	*rcode = RLM_MODULE_FAIL;
 
 	/*
 	 *	Forbid the use of unsorted search results that
@@ -153,40 +248,40 @@ char const *rlm_ldap_find_user(rlm_ldap_t const *inst, REQUEST *request, fr_ldap
 	 *	security issue, and likely non deterministic.
 	 */
 	if (!inst->userobj_sort_ctrl) {
-		cnt = ldap_count_entries((*pconn)->handle, *result);
+		cnt = ldap_count_entries(conn->handle, result);
 		if (cnt > 1) {
 			REDEBUG("Ambiguous search result, returned %i unsorted entries (should return 1 or 0).  "
 				"Enable sorting, or specify a more restrictive base_dn, filter or scope", cnt);
 			REDEBUG("The following entries were returned:");
 			RINDENT();
-			for (entry = ldap_first_entry((*pconn)->handle, *result);
+			for (entry = ldap_first_entry(conn->handle, result);
 			     entry;
-			     entry = ldap_next_entry((*pconn)->handle, entry)) {
-				dn = ldap_get_dn((*pconn)->handle, entry);
+			     entry = ldap_next_entry(conn->handle, entry)) {
+				dn = ldap_get_dn(conn->handle, entry);
 				REDEBUG("%s", dn);
 				ldap_memfree(dn);
 			}
 			REXDENT();
 			*rcode = RLM_MODULE_INVALID;
-			goto finish;
+			return NULL;
 		}
 	}
 
-	entry = ldap_first_entry((*pconn)->handle, *result);
+	entry = ldap_first_entry(conn->handle, result);
 	if (!entry) {
-		ldap_get_option((*pconn)->handle, LDAP_OPT_RESULT_CODE, &ldap_errno);
+		ldap_get_option(conn->handle, LDAP_OPT_RESULT_CODE, &ldap_errno);
 		REDEBUG("Failed retrieving entry: %s",
 			ldap_err2string(ldap_errno));
 
-		goto finish;
+		return NULL;
 	}
 
-	dn = ldap_get_dn((*pconn)->handle, entry);
+	dn = ldap_get_dn(conn->handle, entry);
 	if (!dn) {
-		ldap_get_option((*pconn)->handle, LDAP_OPT_RESULT_CODE, &ldap_errno);
+		ldap_get_option(conn->handle, LDAP_OPT_RESULT_CODE, &ldap_errno);
 		REDEBUG("Retrieving object DN from entry failed: %s", ldap_err2string(ldap_errno));
 
-		goto finish;
+		return NULL;
 	}
 	fr_ldap_util_normalise_dn(dn, dn);
 
@@ -206,12 +301,6 @@ char const *rlm_ldap_find_user(rlm_ldap_t const *inst, REQUEST *request, fr_ldap
 	}
 	ldap_memfree(dn);
 
-finish:
-	if ((freeit || (*rcode != RLM_MODULE_OK)) && *result) {
-		ldap_msgfree(*result);
-		*result = NULL;
-	}
-
 	return vp ? vp->vp_strvalue : NULL;
 }
 
@@ -940,6 +940,7 @@ static int do_perl(void *instance, REQUEST *request, char const *function_name)
 		if ((get_hv_content(request->packet, request, rad_request_hv, &vp, "RAD_REQUEST", "request")) == 0) {
 			fr_pair_list_free(&request->packet->vps);
 			request->packet->vps = vp;
+			fr_pair_list_touch(&request->packet->vps);
 			vp = NULL;
 
 			/*
@@ -955,18 +956,21 @@ static int do_perl(void *instance, REQUEST *request, char const *function_name)
 		if ((get_hv_content(request->reply, request, rad_reply_hv, &vp, "RAD_REPLY", "reply")) == 0) {
 			fr_pair_list_free(&request->reply->vps);
 			request->reply->vps = vp;
+			fr_pair_list_touch(&request->reply->vps);
 			vp = NULL;
 		}
 
 		if ((get_hv_content(request, request, rad_config_hv, &vp, "RAD_CONFIG", "control")) == 0) {
 			fr_pair_list_free(&request->control);
 			request->control = vp;
+			fr_pair_list_touch(&request->control);
 			vp = NULL;
 		}
 
 		if ((get_hv_content(request->state_ctx, request, rad_state_hv, &vp, "RAD_STATE", "session-state")) == 0) {
 			fr_pair_list_free(&request->state);
 			request->state = vp;
+			fr_pair_list_touch(&request->state);
 			vp = NULL;
 		}
 
@@ -976,6 +980,7 @@ static int do_perl(void *instance, REQUEST *request, char const *function_name)
 		    		    "RAD_REQUEST_PROXY", "proxy-request") == 0)) {
 			fr_pair_list_free(&request->proxy->packet->vps);
 			request->proxy->packet->vps = vp;
+			fr_pair_list_touch(&request->proxy->packet->vps);
 			vp = NULL;
 		}
 
@@ -984,6 +989,7 @@ static int do_perl(void *instance, REQUEST *request, char const *function_name)
 		    		    "RAD_REQUEST_PROXY_REPLY", "proxy-reply") == 0)) {
 			fr_pair_list_free(&request->proxy->reply->vps);
 			request->proxy->reply->vps = vp;
+			fr_pair_list_touch(&request->proxy->reply->vps);
 			vp = NULL;
 		}
 #endif
@@ -563,6 +563,12 @@ static rlm_rcode_t CC_HINT(nonnull) mod_process(void *instance, void *thread, RE
 		 *	Always add Message-Authenticator.
 		 */
 		fr_pair_make(packet, &packet->vps, "Message-Authenticator", "0x00", T_OP_SET);
+
+		/*
+		 *	In production, the new pairs may have been
+		 *	linked onto the end of the request list.
+		 */
+		fr_pair_list_touch(&request->packet->vps);
 	}
 
 	/*
@@ -69,6 +69,12 @@ typedef struct rlm_sql_postgres_conn {
 	int		num_fields;
 	int		affected_rows;
 	char		**row;
+
+#ifdef HAVE_PQENTERPIPELINEMODE
+	int		outstanding;		//!< Queries in the pipeline, whose results haven't been fetched.
+	PGresult	*async_result;		//!< First result of the oldest query in the pipeline.
+	bool		async_ready;		//!< All results of the oldest query have been read.
+#endif
 } rlm_sql_postgres_conn_t;
 
 static CONF_PARSER driver_config[] = {
@@ -157,6 +163,10 @@ static int _sql_socket_destructor(rlm_sql_postgres_conn_t *conn)
 
 	if (!conn->db) return 0;
 
+#ifdef HAVE_PQENTERPIPELINEMODE
+	if (conn->async_result) PQclear(conn->async_result);
+#endif
+
 	/* PQfinish also frees the memory used by the PGconn structure */
 	PQfinish(conn->db);
 
@@ -192,38 +202,14 @@ static int CC_HINT(nonnull) sql_socket_init(rlm_sql_handle_t *handle, rlm_sql_co
 	return 0;
 }
 
-static CC_HINT(nonnull) sql_rcode_t sql_query(rlm_sql_handle_t *handle, UNUSED rlm_sql_config_t *config,
-					      char const *query)
+/** Process the result of a query stored in conn->result
+ *
+ */
+static sql_rcode_t sql_process_result(rlm_sql_postgres_conn_t *conn)
 {
-	rlm_sql_postgres_conn_t *conn = handle->conn;
 	ExecStatusType status;
 	int numfields = 0;
 
-	if (!conn->db) {
-		ERROR("Socket not connected");
-		return RLM_SQL_RECONNECT;
-	}
-
-	/*
-	 *  Returns a PGresult pointer or possibly a null pointer.
-	 *  A non-null pointer will generally be returned except in
-	 *  out-of-memory conditions or serious errors such as inability
-	 *  to send the command to the server. If a null pointer is
-	 *  returned, it should be treated like a PGRES_FATAL_ERROR
-	 *  result.
-	 */
-	conn->result = PQexec(conn->db, query);
-
-	/*
-	 *  As this error COULD be a connection error OR an out-of-memory
-	 *  condition return value WILL be wrong SOME of the time
-	 *  regardless! Pick your poison...
-	 */
-	if (!conn->result) {
-		ERROR("Failed getting query result: %s", PQerrorMessage(conn->db));
-		return RLM_SQL_RECONNECT;
-	}
-
 	status = PQresultStatus(conn->result);
 	DEBUG("Status: %s", PQresStatus(status));
 
@@ -278,11 +264,57 @@ static CC_HINT(nonnull) sql_rcode_t sql_query(rlm_sql_handle_t *handle, UNUSED r
 	case PGRES_NONFATAL_ERROR:
 	case PGRES_FATAL_ERROR:
 		return sql_classify_error(conn->result);
+
+#ifdef HAVE_PQENTERPIPELINEMODE
+	/*
+	 *  An earlier query in the same pipeline segment failed.
+	 *  Shouldn't happen, as every query is followed by a sync.
+	 */
+	case PGRES_PIPELINE_ABORTED:
+		ERROR("Query aborted");
+		return RLM_SQL_ERROR;
+
+	case PGRES_PIPELINE_SYNC:
+		break;
+#endif
 	}
 
 	return RLM_SQL_ERROR;
 }
 
+static CC_HINT(nonnull) sql_rcode_t sql_query(rlm_sql_handle_t *handle, UNUSED rlm_sql_config_t *config,
+					      char const *query)
+{
+	rlm_sql_postgres_conn_t *conn = handle->conn;
+
+	if (!conn->db) {
+		ERROR("Socket not connected");
+		return RLM_SQL_RECONNECT;
+	}
+
+	/*
+	 *  Returns a PGresult pointer or possibly a null pointer.
+	 *  A non-null pointer will generally be returned except in
+	 *  out-of-memory conditions or serious errors such as inability
+	 *  to send the command to the server. If a null pointer is
+	 *  returned, it should be treated like a PGRES_FATAL_ERROR
+	 *  result.
+	 */
+	conn->result = PQexec(conn->db, query);
+
+	/*
+	 *  As this error COULD be a connection error OR an out-of-memory
+	 *  condition return value WILL be wrong SOME of the time
+	 *  regardless! Pick your poison...
+	 */
+	if (!conn->result) {
+		ERROR("Failed getting query result: %s", PQerrorMessage(conn->db));
+		return RLM_SQL_RECONNECT;
+	}
+
+	return sql_process_result(conn);
+}
+
 static sql_rcode_t sql_select_query(rlm_sql_handle_t * handle, rlm_sql_config_t *config, char const *query)
 {
 	return sql_query(handle, config, query);
@@ -382,7 +414,12 @@ static size_t sql_error(TALLOC_CTX *ctx, sql_log_entry_t out[], size_t outlen,
 
 	rad_assert(outlen > 0);
 
-	p = PQerrorMessage(conn->db);
+	/*
+	 *  In pipeline mode the connection's error message may
+	 *  belong to a later query, so prefer the result's.
+	 */
+	p = conn->result ? PQresultErrorMessage(conn->result) : "";
+	if (*p == '\0') p = PQerrorMessage(conn->db);
 	while ((q = strchr(p, '\n'))) {
 		out[i].type = L_ERR;
 		out[i].msg = talloc_asprintf(ctx, "%.*s", (int) (q - p), p);
@@ -405,6 +442,148 @@ static int sql_affected_rows(rlm_sql_handle_t * handle, UNUSED rlm_sql_config_t
 	return conn->affected_rows;
 }
 
+#ifdef HAVE_PQENTERPIPELINEMODE
+/** Put a connection into non-blocking, pipeline mode
+ *
+ */
+static sql_rcode_t sql_async_init(rlm_sql_handle_t *handle, UNUSED rlm_sql_config_t *config)
+{
+	rlm_sql_postgres_conn_t *conn = handle->conn;
+
+	if (PQsetnonblocking(conn->db, 1) != 0) {
+		ERROR("Failed setting connection non-blocking: %s", PQerrorMessage(conn->db));
+		return RLM_SQL_ERROR;
+	}
+
+	if (!PQenterPipelineMode(conn->db)) {
+		ERROR("Failed entering pipeline mode: %s", PQerrorMessage(conn->db));
+		return RLM_SQL_ERROR;
+	}
+
+	return RLM_SQL_OK;
+}
+
+static int sql_async_fd(rlm_sql_handle_t *handle, UNUSED rlm_sql_config_t *config)
+{
+	rlm_sql_postgres_conn_t *conn = handle->conn;
+
+	return PQsocket(conn->db);
+}
+
+/** Add a query to the pipeline
+ *
+ * Each query is followed by a sync, so it runs in its own transaction, and a
+ * failure doesn't abort the queries after it.
+ */
+static sql_rcode_t sql_async_submit(rlm_sql_handle_t *handle, UNUSED rlm_sql_config_t *config, char const *query)
+{
+	rlm_sql_postgres_conn_t *conn = handle->conn;
+
+	if (!conn->db) {
+		ERROR("Socket not connected");
+		return RLM_SQL_RECONNECT;
+	}
+
+	/*
+	 *  Simple queries (PQsendQuery) can't be pipelined,
+	 *  so use the extended protocol with no parameters.
+	 */
+	if (!PQsendQueryParams(conn->db, query, 0, NULL, NULL, NULL, NULL, 0) || !PQpipelineSync(conn->db)) {
+		ERROR("Failed sending query: %s", PQerrorMessage(conn->db));
+		return RLM_SQL_RECONNECT;
+	}
+	conn->outstanding++;
+
+	return RLM_SQL_OK;
+}
+
+static int sql_async_flush(rlm_sql_handle_t *handle, UNUSED rlm_sql_config_t *config)
+{
+	rlm_sql_postgres_conn_t *conn = handle->conn;
+	int ret;
+
+	ret = PQflush(conn->db);
+	if (ret < 0) ERROR("Failed sending queries: %s", PQerrorMessage(conn->db));
+
+	return ret;
+}
+
+/** Read results from the server
+ *
+ * The results of a query are one or more PGresults, then a NULL, then the
+ * PGRES_PIPELINE_SYNC result for the sync following it.  Only the first
+ * PGresult is kept, as multi-statement queries aren't allowed in pipeline mode.
+ */
+static int sql_async_poll(rlm_sql_handle_t *handle, UNUSED rlm_sql_config_t *config)
+{
+	rlm_sql_postgres_conn_t *conn = handle->conn;
+	PGresult		*result;
+	bool			null_result = false;
+
+	if (conn->async_ready) return 1;
+
+	if (!PQconsumeInput(conn->db)) {
+		ERROR("Failed reading results: %s", PQerrorMessage(conn->db));
+		return -1;
+	}
+
+	while ((conn->outstanding > 0) && !PQisBusy(conn->db)) {
+		if (PQstatus(conn->db) == CONNECTION_BAD) {
+			ERROR("Connection failed: %s", PQerrorMessage(conn->db));
+			return -1;
+		}
+
+		result = PQgetResult(conn->db);
+		if (!result) {
+			/*
+			 *  Two in a row means there's nothing
+			 *  more to read.
+			 */
+			if (null_result) break;
+			null_result = true;
+			continue;
+		}
+		null_result = false;
+
+		if (PQresultStatus(result) == PGRES_PIPELINE_SYNC) {
+			PQclear(result);
+			conn->outstanding--;
+			conn->async_ready = true;
+			return 1;
+		}
+
+		if (conn->async_result) {
+			PQclear(result);
+			continue;
+		}
+		conn->async_result = result;
+	}
+
+	return 0;
+}
+
+/** Make the result of the oldest query in the pipeline the current result
+ *
+ */
+static sql_rcode_t sql_async_fetch(rlm_sql_handle_t *handle, UNUSED rlm_sql_config_t *config)
+{
+	rlm_sql_postgres_conn_t *conn = handle->conn;
+
+	rad_assert(conn->async_ready);
+
+	conn->async_ready = false;
+	conn->result = conn->async_result;
+	conn->async_result = NULL;
+
+	if (!conn->result) {
+		ERROR("Query returned no result");
+		return RLM_SQL_ERROR;
+	}
+
+	return sql_process_result(conn);
+}
+#endif
+
 static size_t sql_escape_func(REQUEST *request, char *out, size_t outlen, char const *in, void *arg)
 {
 	size_t			inlen, ret;
@@ -542,5 +721,13 @@ rlm_sql_driver_t rlm_sql_postgresql = {
 	.sql_finish_query		= sql_free_result,
 	.sql_finish_select_query	= sql_free_result,
 	.sql_affected_rows		= sql_affected_rows,
-	.sql_escape_func		= sql_escape_func
+	.sql_escape_func		= sql_escape_func,
+#ifdef HAVE_PQENTERPIPELINEMODE
+	.sql_async_init			= sql_async_init,
+	.sql_async_fd			= sql_async_fd,
+	.sql_async_submit		= sql_async_submit,
+	.sql_async_flush		= sql_async_flush,
+	.sql_async_poll			= sql_async_poll,
+	.sql_async_fetch		= sql_async_fetch,
+#endif
 };
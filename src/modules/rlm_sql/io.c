@@ -0,0 +1,820 @@
+/*
+ *   This program is is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or (at
+ *   your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA
+ */
+
+/**
+ * $Id$
+ * @file rlm_sql/io.c
+ * @brief Asynchronous queries.
+ *
+ * Each thread has a single connection, which the queries sent by requests in
+ * that thread are pipelined on.  Requests yield after sending a query, and are
+ * marked as resumable when its result arrives.  Results arrive in the order
+ * the queries were sent, so outstanding queries are kept in a FIFO.
+ *
+ * Queries from sections with a batch_size are held until the batch fills, or
+ * batch_delay passes, and are then sent together in a single transaction.
+ * Their requests aren't resumed until the transaction commits.  If any of
+ * the queries fail, the whole transaction is rolled back, so the queries are
+ * sent again one at a time.
+ *
+ * @copyright 2017 The FreeRADIUS Server Project.
+ */
+RCSID("$Id$")
+
+#define LOG_PREFIX "rlm_sql (%s) - "
+#define LOG_PREFIX_ARGS inst->name
+
+#include <freeradius-devel/rad_assert.h>
+
+#include "rlm_sql.h"
+
+/** Queries from one section, sent in a single transaction
+ *
+ * While the batch is being sent and processed it's in the FIFO twice, once
+ * for the result of BEGIN, and once for the result of COMMIT.  Space for its
+ * queries stays reserved until the batch is done, so they can be sent again
+ * if the transaction is rolled back.
+ */
+struct rlm_sql_batch {
+	rlm_sql_mux_t		*mux;			//!< Connection the batch is sent on.
+	sql_acct_section_t const *section;		//!< Section the queries were expanded from.
+	rlm_sql_batch_t		*next;			//!< Next batch waiting to be sent.
+	fr_event_timer_t	*ev;			//!< When to send the batch.
+
+	rlm_sql_query_t		**queries;		//!< In the order they were added.
+	uint32_t		num_queries;		//!< Number of queries in the batch.
+	uint32_t		num_results;		//!< Number of query results which have arrived.
+
+	bool			begun;			//!< The result of BEGIN has arrived.
+	bool			autocommit;		//!< BEGIN failed, so each query was committed
+							//!< on its own.
+	bool			failed;			//!< The transaction was rolled back.
+};
+
+/** A connection queries from many requests are pipelined on
+ *
+ */
+struct rlm_sql_mux {
+	rlm_sql_t const		*inst;			//!< Instance of rlm_sql.
+	rlm_sql_thread_t	*thread;		//!< Thread the connection belongs to.
+	rlm_sql_handle_t	*handle;		//!< Connection queries are sent on.
+	int			fd;			//!< Of the connection.
+
+	fr_fifo_t		*queries;		//!< Outstanding queries, in the order they were sent.
+	rlm_sql_batch_t		*pending;		//!< Batches waiting to be sent.
+	uint32_t		reserved;		//!< Space in the FIFO needed to send the pending
+							//!< batches, and to resend the queries of batches
+							//!< which have been sent.
+	bool			writing;		//!< Waiting for the fd to become writable.
+};
+
+/** Mark a query as complete, and resume the request which sent it
+ *
+ * If the request was cancelled, the query is freed instead.
+ *
+ * @param[in] query		which is complete.
+ * @param[in] rcode		of the query.
+ * @param[in] numaffected	Number of rows the query affected.
+ */
+static void query_done(rlm_sql_query_t *query, sql_rcode_t rcode, int numaffected)
+{
+	if (query->ev) (void) fr_event_timer_delete(query->thread->el, &query->ev);
+
+	query->mux = NULL;
+	query->batch = NULL;
+	query->rcode = rcode;
+	query->numaffected = numaffected;
+
+	if (!query->request) {
+		talloc_free(query);
+		return;
+	}
+
+	unlang_resumable(query->request);
+}
+
+/** Free a query, unless it's still in the pipeline
+ *
+ * Queries can't be removed from the pipeline, so if the request is cancelled,
+ * the query is freed when its result arrives.
+ */
+static int _query_free(rlm_sql_query_t *query)
+{
+	if (query->mux) {
+		query->request = NULL;
+		return -1;
+	}
+
+	return 0;
+}
+
+static int _mux_free(rlm_sql_mux_t *mux)
+{
+	rlm_sql_t const *inst = mux->inst;
+
+	(void) fr_event_fd_delete(mux->thread->el, mux->fd);
+
+	DEBUG2("Closing connection (%i)", mux->fd);
+
+	return 0;
+}
+
+static int _batch_free(rlm_sql_batch_t *batch)
+{
+	if (batch->ev) (void) fr_event_timer_delete(batch->mux->thread->el, &batch->ev);
+
+	return 0;
+}
+
+/** Fail the queries in a batch whose results have already arrived
+ *
+ * The rest are still in the FIFO, and are failed when they're removed from it.
+ *
+ * @param[in] batch	to fail.
+ */
+static void batch_fail(rlm_sql_batch_t *batch)
+{
+	uint32_t i;
+
+	for (i = 0; i < batch->num_results; i++) query_done(batch->queries[i], RLM_SQL_RECONNECT, 0);
+	batch->num_results = 0;
+}
+
+/** Close a connection, and fail all the queries outstanding on it
+ *
+ * @param[in] mux	which failed.
+ */
+static void mux_fail(rlm_sql_mux_t *mux)
+{
+	rlm_sql_thread_t	*t = mux->thread;
+	rlm_sql_batch_t		*batch;
+	void			*entry;
+
+	if (t->mux == mux) t->mux = NULL;
+
+	while ((entry = fr_fifo_pop(mux->queries))) {
+		batch = talloc_get_type(entry, rlm_sql_batch_t);
+		if (batch) {
+			batch_fail(batch);
+			continue;
+		}
+
+		query_done(talloc_get_type_abort(entry, rlm_sql_query_t), RLM_SQL_RECONNECT, 0);
+	}
+
+	/*
+	 *	Batches which haven't been sent are freed with
+	 *	the mux.
+	 */
+	for (batch = mux->pending; batch; batch = batch->next) {
+		batch->num_results = batch->num_queries;
+		batch_fail(batch);
+	}
+
+	talloc_free(mux);
+}
+
+static void _mux_read(fr_event_list_t *el, int fd, void *ctx);
+static void _mux_write(fr_event_list_t *el, int fd, void *ctx);
+static void _mux_error(fr_event_list_t *el, int fd, void *ctx);
+static void _query_timeout(fr_event_list_t *el, struct timeval *now, void *ctx);
+
+/** Send queued queries, and wait for the fd to become writable if they can't all be sent
+ *
+ * @param[in] mux	to send queries on.
+ * @return
+ *	- 0 on success.
+ *	- -1 on failure.
+ */
+static int mux_flush(rlm_sql_mux_t *mux)
+{
+	rlm_sql_t const	*inst = mux->inst;
+	int		ret;
+
+	ret = (inst->driver->sql_async_flush)(mux->handle, inst->config);
+	if (ret < 0) return -1;
+
+	if ((ret > 0) == mux->writing) return 0;
+	mux->writing = (ret > 0);
+
+	if (fr_event_fd_insert(mux->thread->el, mux->fd, _mux_read, mux->writing ? _mux_write : NULL,
+			       _mux_error, mux) < 0) {
+		PERROR("Failed updating connection fd in event loop");
+		return -1;
+	}
+
+	return 0;
+}
+
+/** Allocate a query
+ *
+ */
+static rlm_sql_query_t *query_alloc(rlm_sql_thread_t *t, REQUEST *request, rlm_sql_mux_t *mux)
+{
+	rlm_sql_t const	*inst = t->inst;
+	rlm_sql_query_t	*query;
+
+	MEM(query = talloc_zero(NULL, rlm_sql_query_t));
+	query->request = request;
+	query->thread = t;
+	query->mux = mux;
+	talloc_set_destructor(query, _query_free);
+
+	return query;
+}
+
+/** Start the timer for a query which has been sent
+ *
+ */
+static void query_timeout_start(rlm_sql_query_t *query)
+{
+	rlm_sql_thread_t	*t = query->thread;
+	rlm_sql_t const		*inst = t->inst;
+	REQUEST			*request = query->request;
+	struct timeval		now, when;
+
+	if (!inst->config->query_timeout) return;
+
+	fr_event_list_time(&now, t->el);
+	when.tv_sec = now.tv_sec + inst->config->query_timeout;
+	when.tv_usec = now.tv_usec;
+
+	if (fr_event_timer_insert(t->el, _query_timeout, query, &when, &query->ev) < 0) {
+		ROPTIONAL(RPEDEBUG, PERROR, "Failed inserting query timeout");
+	}
+}
+
+/** Send a batch of queries in a single transaction
+ *
+ * @param[in] batch	to send.
+ * @return
+ *	- 0 on success.
+ *	- -1 on failure.  The caller should call #mux_fail.
+ */
+static int batch_send(rlm_sql_batch_t *batch)
+{
+	rlm_sql_mux_t	*mux = batch->mux;
+	rlm_sql_t const	*inst = mux->inst;
+	rlm_sql_batch_t	**last;
+	uint32_t	i;
+
+	for (last = &mux->pending; *last != batch; last = &(*last)->next);
+	*last = batch->next;
+	batch->next = NULL;
+	mux->reserved -= 2;
+
+	if (batch->ev) (void) fr_event_timer_delete(mux->thread->el, &batch->ev);
+
+	DEBUG2("Sending batch of %u queries (%i)", batch->num_queries, mux->fd);
+
+	if (((inst->driver->sql_async_submit)(mux->handle, inst->config, "BEGIN") != RLM_SQL_OK) ||
+	    (fr_fifo_push(mux->queries, batch) < 0)) {
+		batch->num_results = batch->num_queries;
+		batch_fail(batch);
+		talloc_free(batch);
+		return -1;
+	}
+
+	/*
+	 *	From here on, mux_fail() takes care of the queries
+	 *	which are in the FIFO.
+	 */
+	for (i = 0; i < batch->num_queries; i++) {
+		rlm_sql_query_t *query = batch->queries[i];
+
+		if (((inst->driver->sql_async_submit)(mux->handle, inst->config, query->query) != RLM_SQL_OK) ||
+		    (fr_fifo_push(mux->queries, query) < 0)) {
+			while (i < batch->num_queries) query_done(batch->queries[i++], RLM_SQL_RECONNECT, 0);
+			return -1;
+		}
+
+		query_timeout_start(query);
+	}
+
+	if (((inst->driver->sql_async_submit)(mux->handle, inst->config, "COMMIT") != RLM_SQL_OK) ||
+	    (fr_fifo_push(mux->queries, batch) < 0)) return -1;
+
+	return mux_flush(mux);
+}
+
+/** Send a batch when it's full, or has waited long enough
+ *
+ */
+static void _batch_timeout(UNUSED fr_event_list_t *el, UNUSED struct timeval *now, void *ctx)
+{
+	rlm_sql_batch_t	*batch = talloc_get_type_abort(ctx, rlm_sql_batch_t);
+	rlm_sql_mux_t	*mux = batch->mux;
+
+	if (batch_send(batch) < 0) mux_fail(mux);
+}
+
+/** Resume the requests in a batch once it's committed, or resend its queries if it wasn't
+ *
+ * If BEGIN failed, each query was committed as it was executed, so the results
+ * are returned as they are.
+ *
+ * @param[in] batch	whose COMMIT has completed.
+ * @return
+ *	- 0 on success.
+ *	- -1 if the queries couldn't be resent.  The caller should call #mux_fail.
+ */
+static int batch_done(rlm_sql_batch_t *batch)
+{
+	rlm_sql_mux_t	*mux = batch->mux;
+	rlm_sql_t const	*inst = mux->inst;
+	uint32_t	i;
+
+	rad_assert(batch->num_results == batch->num_queries);
+	mux->reserved -= batch->num_queries;
+
+	if (!batch->failed || batch->autocommit) {
+		for (i = 0; i < batch->num_queries; i++) {
+			rlm_sql_query_t *query = batch->queries[i];
+
+			query_done(query, query->rcode, query->numaffected);
+		}
+		talloc_free(batch);
+		return 0;
+	}
+
+	/*
+	 *	There's space in the FIFO, as the queries' entries
+	 *	were reserved until now.
+	 */
+	WARN("Batch of %u queries was rolled back, sending them one at a time", batch->num_queries);
+
+	for (i = 0; i < batch->num_queries; i++) {
+		rlm_sql_query_t *query = batch->queries[i];
+
+		query->batch = NULL;
+		if (((inst->driver->sql_async_submit)(mux->handle, inst->config, query->query) != RLM_SQL_OK) ||
+		    (fr_fifo_push(mux->queries, query) < 0)) {
+			while (i < batch->num_queries) query_done(batch->queries[i++], RLM_SQL_RECONNECT, 0);
+			talloc_free(batch);
+			return -1;
+		}
+	}
+	talloc_free(batch);
+
+	return 0;
+}
+
+/** Read all the results available on a connection, and resume the requests waiting for them
+ *
+ * @param[in] el	the connection's fd was inserted into.
+ * @param[in] fd	which is readable.
+ * @param[in] ctx	The #rlm_sql_mux_t the fd belongs to.
+ */
+static void _mux_read(UNUSED fr_event_list_t *el, UNUSED int fd, void *ctx)
+{
+	rlm_sql_mux_t	*mux = talloc_get_type_abort(ctx, rlm_sql_mux_t);
+	rlm_sql_t const	*inst = mux->inst;
+
+	for (;;) {
+		rlm_sql_query_t	*query = NULL;
+		rlm_sql_batch_t	*batch;
+		REQUEST		*request = NULL;
+		void		*entry;
+		sql_rcode_t	rcode;
+		int		numaffected = 0;
+		int		ret;
+
+		ret = (inst->driver->sql_async_poll)(mux->handle, inst->config);
+		if (ret == 0) break;
+		if (ret < 0) {
+			mux_fail(mux);
+			return;
+		}
+
+		entry = fr_fifo_pop(mux->queries);
+		rad_assert(entry != NULL);
+
+		/*
+		 *	Batches are in the FIFO for the results of
+		 *	BEGIN and COMMIT.
+		 */
+		batch = talloc_get_type(entry, rlm_sql_batch_t);
+		if (!batch) {
+			query = talloc_get_type_abort(entry, rlm_sql_query_t);
+			request = query->request;
+			batch = query->batch;
+		}
+
+		/*
+		 *	Same as rlm_sql_query(), but the result has to be
+		 *	processed now, as the handle will have moved on
+		 *	to the next query by the time the request resumes.
+		 *
+		 *	Errors in batches are only logged at debug level,
+		 *	as the queries are sent again if the batch fails.
+		 */
+		rcode = (inst->driver->sql_async_fetch)(mux->handle, inst->config);
+		switch (rcode) {
+		case RLM_SQL_OK:
+			numaffected = (inst->driver->sql_affected_rows)(mux->handle, inst->config);
+			break;
+
+		case RLM_SQL_ERROR:
+			if (!(inst->driver->flags & RLM_SQL_RCODE_FLAGS_ALT_QUERY)) {
+				rcode = RLM_SQL_ALT_QUERY;
+				rlm_sql_print_error(inst, request, mux->handle, true);
+				break;
+			}
+			/* FALL-THROUGH */
+
+		case RLM_SQL_QUERY_INVALID:
+			rlm_sql_print_error(inst, request, mux->handle, (batch != NULL));
+			break;
+
+		case RLM_SQL_ALT_QUERY:
+			rlm_sql_print_error(inst, request, mux->handle, true);
+			break;
+
+		default:
+			rcode = RLM_SQL_RECONNECT;
+			break;
+		}
+		(inst->driver->sql_finish_query)(mux->handle, inst->config);
+
+		if (rcode == RLM_SQL_RECONNECT) {
+			if (!batch) {
+				query_done(query, rcode, 0);
+			} else if (query) {
+				batch->num_results++;	/* failed with the batch */
+			} else {
+				batch_fail(batch);
+			}
+			mux_fail(mux);
+			return;
+		}
+
+		if (!batch) {
+			query_done(query, rcode, numaffected);
+			continue;
+		}
+
+		/*
+		 *	Hold on to the result until we know whether the
+		 *	transaction committed.
+		 */
+		if (query) {
+			query->rcode = rcode;
+			query->numaffected = numaffected;
+			if (rcode != RLM_SQL_OK) batch->failed = true;
+			batch->num_results++;
+			continue;
+		}
+
+		if (!batch->begun) {
+			batch->begun = true;
+			if (rcode != RLM_SQL_OK) batch->autocommit = true;
+			continue;
+		}
+
+		if (rcode != RLM_SQL_OK) batch->failed = true;
+		if (batch_done(batch) < 0) {
+			mux_fail(mux);
+			return;
+		}
+	}
+
+	if (mux_flush(mux) < 0) mux_fail(mux);
+}
+
+static void _mux_write(UNUSED fr_event_list_t *el, UNUSED int fd, void *ctx)
+{
+	rlm_sql_mux_t *mux = talloc_get_type_abort(ctx, rlm_sql_mux_t);
+
+	if (mux_flush(mux) < 0) mux_fail(mux);
+}
+
+static void _mux_error(UNUSED fr_event_list_t *el, UNUSED int fd, void *ctx)
+{
+	rlm_sql_mux_t	*mux = talloc_get_type_abort(ctx, rlm_sql_mux_t);
+	rlm_sql_t const	*inst = mux->inst;
+
+	ERROR("Connection failed (%i)", mux->fd);
+
+	mux_fail(mux);
+}
+
+/** Fail the connection if a query takes too long
+ *
+ * Queries in a pipeline can't be cancelled individually, and every query sent
+ * after this one is waiting for it.
+ */
+static void _query_timeout(UNUSED fr_event_list_t *el, UNUSED struct timeval *now, void *ctx)
+{
+	rlm_sql_query_t	*query = talloc_get_type_abort(ctx, rlm_sql_query_t);
+	rlm_sql_t const	*inst = query->thread->inst;
+
+	ERROR("Query timed out, closing connection (%i)", query->mux->fd);
+
+	mux_fail(query->mux);
+}
+
+/** Open a new connection for a thread's queries
+ *
+ * @param[in] t		to open the connection for.
+ * @return
+ *	- A new connection.
+ *	- NULL on error.
+ */
+static rlm_sql_mux_t *mux_alloc(rlm_sql_thread_t *t)
+{
+	rlm_sql_t const	*inst = t->inst;
+	rlm_sql_mux_t	*mux;
+	void		*instance;
+	struct timeval	timeout;
+
+	/*
+	 *	Don't try to reconnect more than once a second.
+	 */
+	if (t->mux_failed == time(NULL)) return NULL;
+
+	MEM(mux = talloc_zero(NULL, rlm_sql_mux_t));
+	mux->inst = inst;
+	mux->thread = t;
+	mux->fd = -1;
+
+	MEM(mux->queries = fr_fifo_create(mux, inst->config->pipeline_depth, NULL));
+
+	memcpy(&instance, &inst, sizeof(instance));
+	timeout = fr_connection_pool_timeout(inst->pool);
+	mux->handle = mod_conn_create(mux, instance, &timeout);
+	if (!mux->handle) {
+	error:
+		t->mux_failed = time(NULL);
+		talloc_free(mux);
+		return NULL;
+	}
+
+	if ((inst->driver->sql_async_init)(mux->handle, inst->config) != RLM_SQL_OK) goto error;
+
+	mux->fd = (inst->driver->sql_async_fd)(mux->handle, inst->config);
+	if (mux->fd < 0) {
+		ERROR("Failed retrieving connection fd");
+		goto error;
+	}
+
+	if (fr_event_fd_insert(t->el, mux->fd, _mux_read, NULL, _mux_error, mux) < 0) {
+		PERROR("Failed inserting connection fd into event loop");
+		goto error;
+	}
+	talloc_set_destructor(mux, _mux_free);
+
+	DEBUG2("Opened connection (%i) for asynchronous queries", mux->fd);
+
+	return mux;
+}
+
+/** Get the handle the request's next asynchronous query will be sent on
+ *
+ * Opens a new connection if the thread doesn't have one.  The handle should be
+ * used to escape values in the query.
+ *
+ * @param[in] t		Thread specific instance data.
+ * @param[in] request	Current request.
+ * @param[in] section	the query will be expanded from.
+ * @return
+ *	- The handle.
+ *	- NULL if asynchronous queries are disabled, or one can't be sent right now.
+ */
+rlm_sql_handle_t *rlm_sql_io_handle(rlm_sql_thread_t *t, REQUEST *request, sql_acct_section_t const *section)
+{
+	rlm_sql_t const *inst = t->inst;
+	rlm_sql_batch_t	*batch;
+	uint32_t	needed = 1;
+
+	if (!inst->config->pipeline_depth || !inst->driver->sql_async_submit) return NULL;
+
+	/*
+	 *	Requests processed synchronously run their own event
+	 *	loop, which doesn't service this thread's connection.
+	 */
+	if (request->el != t->el) return NULL;
+
+	if (!t->mux) t->mux = mux_alloc(t);
+	if (!t->mux) return NULL;
+
+	/*
+	 *	A query which starts a new batch needs space for
+	 *	BEGIN and COMMIT too.
+	 */
+	if (section->batch_size > 1) {
+		for (batch = t->mux->pending; batch; batch = batch->next) {
+			if ((batch->section == section) && (batch->num_queries < section->batch_size)) break;
+		}
+		if (!batch) needed = 3;
+	}
+
+	if ((fr_fifo_num_elements(t->mux->queries) + t->mux->reserved + needed) > inst->config->pipeline_depth) {
+		return NULL;
+	}
+
+	return t->mux->handle;
+}
+
+/** Send a query, without waiting for the result
+ *
+ * The caller should yield after calling this function.  The request is marked as
+ * resumable when the query completes, or fails, at which point query->rcode and
+ * query->numaffected are set.
+ *
+ * If the query is freed before it completes, it's freed when its result arrives.
+ *
+ * @param[in] t		Thread specific instance data.  #rlm_sql_io_handle must
+ *			have returned a handle for the request.
+ * @param[in] request	Current request.
+ * @param[in] query	to execute. Should not be zero length.
+ * @return
+ *	- A new query.
+ *	- NULL if the query couldn't be sent.
+ */
+rlm_sql_query_t *rlm_sql_query_async(rlm_sql_thread_t *t, REQUEST *request, char const *query)
+{
+	rlm_sql_t const	*inst = t->inst;
+	rlm_sql_mux_t	*mux = t->mux;
+	rlm_sql_query_t	*q;
+
+	if (!mux || ((fr_fifo_num_elements(mux->queries) + mux->reserved) >= inst->config->pipeline_depth)) {
+		REDEBUG("No connection available");
+		return NULL;
+	}
+
+	if (query[0] == '\0') {
+		REDEBUG("Zero length query");
+		return NULL;
+	}
+
+	RDEBUG2("Executing query: %s", query);
+
+	if ((inst->driver->sql_async_submit)(mux->handle, inst->config, query) != RLM_SQL_OK) {
+		mux_fail(mux);
+		return NULL;
+	}
+
+	/*
+	 *	The query hasn't been added to the FIFO yet, so
+	 *	only the other outstanding queries are failed.
+	 */
+	if (mux_flush(mux) < 0) {
+		mux_fail(mux);
+		return NULL;
+	}
+
+	/*
+	 *	The query has been sent, so if it can't be added to
+	 *	the FIFO, the results no longer line up with it.
+	 */
+	q = query_alloc(t, request, mux);
+	if (fr_fifo_push(mux->queries, q) < 0) {
+		REDEBUG("Too many queries outstanding");
+		q->mux = NULL;
+		talloc_free(q);
+		mux_fail(mux);
+		return NULL;
+	}
+
+	query_timeout_start(q);
+
+	return q;
+}
+
+/** Add a query to a batch, which is sent in a single transaction
+ *
+ * Works like #rlm_sql_query_async, except the request isn't marked as
+ * resumable until the transaction has committed.  The batch is sent once
+ * it contains section->batch_size queries, or section->batch_delay after
+ * the first query was added to it.
+ *
+ * @param[in] t		Thread specific instance data.  #rlm_sql_io_handle must
+ *			have returned a handle for the request.
+ * @param[in] request	Current request.
+ * @param[in] section	the query was expanded from.  Queries are only batched
+ *			with others from the same section.
+ * @param[in] query	to execute. Should not be zero length.
+ * @return
+ *	- A new query.
+ *	- NULL if the query couldn't be added to a batch.
+ */
+rlm_sql_query_t *rlm_sql_query_batch(rlm_sql_thread_t *t, REQUEST *request, sql_acct_section_t const *section,
+				     char const *query)
+{
+	rlm_sql_t const	*inst = t->inst;
+	rlm_sql_mux_t	*mux = t->mux;
+	rlm_sql_batch_t	*batch;
+	rlm_sql_query_t	*q;
+	struct timeval	now, when;
+
+	rad_assert(section->batch_size > 1);
+
+	if (!mux) {
+	no_space:
+		REDEBUG("No connection available");
+		return NULL;
+	}
+
+	if (query[0] == '\0') {
+		REDEBUG("Zero length query");
+		return NULL;
+	}
+
+	for (batch = mux->pending; batch; batch = batch->next) {
+		if ((batch->section == section) && (batch->num_queries < section->batch_size)) break;
+	}
+
+	if ((fr_fifo_num_elements(mux->queries) + mux->reserved + (batch ? 1 : 3)) > inst->config->pipeline_depth) {
+		goto no_space;
+	}
+
+	fr_event_list_time(&now, t->el);
+
+	if (!batch) {
+		MEM(batch = talloc_zero(mux, rlm_sql_batch_t));
+		batch->mux = mux;
+		batch->section = section;
+		MEM(batch->queries = talloc_array(batch, rlm_sql_query_t *, section->batch_size));
+		talloc_set_destructor(batch, _batch_free);
+
+		fr_timeval_add(&when, &now, &section->batch_delay);
+		if (fr_event_timer_insert(t->el, _batch_timeout, batch, &when, &batch->ev) < 0) {
+			RPEDEBUG("Failed inserting batch timer");
+			talloc_free(batch);
+			return NULL;
+		}
+
+		batch->next = mux->pending;
+		mux->pending = batch;
+		mux->reserved += 2;
+	}
+
+	RDEBUG2("Adding query to batch: %s", query);
+
+	q = query_alloc(t, request, mux);
+	q->batch = batch;
+	MEM(q->query = talloc_typed_strdup(q, query));
+
+	batch->queries[batch->num_queries++] = q;
+	mux->reserved++;
+
+	/*
+	 *	Send a full batch as soon as the caller has yielded.
+	 */
+	if ((batch->num_queries == section->batch_size) &&
+	    (fr_event_timer_insert(t->el, _batch_timeout, batch, &now, &batch->ev) < 0)) {
+		RPEDEBUG("Failed inserting batch timer");
+	}
+
+	return q;
+}
+
+/** Open the connection for a thread's asynchronous queries
+ *
+ * @param[in] t		Thread specific instance data.
+ * @return
+ *	- 0 on success.
+ *	- -1 on failure.
+ */
+int rlm_sql_io_init(rlm_sql_thread_t *t)
+{
+	rlm_sql_t const *inst = t->inst;
+
+	if (!inst->config->pipeline_depth) return 0;
+
+	if (!inst->driver->sql_async_submit) {
+		DEBUG2("%s doesn't support asynchronous queries", inst->config->sql_driver_name);
+		return 0;
+	}
+
+	/*
+	 *	Not fatal, we'll try again when the first
+	 *	query is sent.
+	 */
+	t->mux = mux_alloc(t);
+	if (!t->mux) WARN("Failed opening connection for asynchronous queries");
+
+	return 0;
+}
+
+/** Close the connection for a thread's asynchronous queries
+ *
+ * @param[in] t		Thread specific instance data.
+ */
+void rlm_sql_io_free(rlm_sql_thread_t *t)
+{
+	if (t->mux) mux_fail(t->mux);
+}
@@ -68,6 +68,8 @@ static const CONF_PARSER type_config[] = {
 static const CONF_PARSER acct_config[] = {
 	{ FR_CONF_OFFSET("reference", FR_TYPE_STRING | FR_TYPE_XLAT, rlm_sql_config_t, accounting.reference), .dflt = ".query" },
 	{ FR_CONF_OFFSET("logfile", FR_TYPE_STRING | FR_TYPE_XLAT, rlm_sql_config_t, accounting.logfile) },
+	{ FR_CONF_OFFSET("batch_size", FR_TYPE_UINT32, rlm_sql_config_t, accounting.batch_size), .dflt = "0" },
+	{ FR_CONF_OFFSET("batch_delay", FR_TYPE_TIMEVAL, rlm_sql_config_t, accounting.batch_delay), .dflt = "0.1" },
 
 	{ FR_CONF_POINTER("type", FR_TYPE_SUBSECTION, NULL), .subcs = (void const *) type_config },
 	CONF_PARSER_TERMINATOR
@@ -76,6 +78,8 @@ static const CONF_PARSER acct_config[] = {
 static const CONF_PARSER postauth_config[] = {
 	{ FR_CONF_OFFSET("reference", FR_TYPE_STRING | FR_TYPE_XLAT, rlm_sql_config_t, postauth.reference), .dflt = ".query" },
 	{ FR_CONF_OFFSET("logfile", FR_TYPE_STRING | FR_TYPE_XLAT, rlm_sql_config_t, postauth.logfile) },
+	{ FR_CONF_OFFSET("batch_size", FR_TYPE_UINT32, rlm_sql_config_t, postauth.batch_size), .dflt = "0" },
+	{ FR_CONF_OFFSET("batch_delay", FR_TYPE_TIMEVAL, rlm_sql_config_t, postauth.batch_delay), .dflt = "0.1" },
 
 	{ FR_CONF_OFFSET("query", FR_TYPE_STRING | FR_TYPE_XLAT | FR_TYPE_MULTI, rlm_sql_config_t, postauth.query) },
 	CONF_PARSER_TERMINATOR
@@ -116,6 +120,11 @@ static const CONF_PARSER module_config[] = {
 	 */
 	{ FR_CONF_OFFSET("query_timeout", FR_TYPE_UINT32, rlm_sql_config_t, query_timeout) },
 
+	/*
+	 *	So does this.
+	 */
+	{ FR_CONF_OFFSET("pipeline_depth", FR_TYPE_UINT32, rlm_sql_config_t, pipeline_depth), .dflt = "0" },
+
 	{ FR_CONF_POINTER("accounting", FR_TYPE_SUBSECTION, NULL), .subcs = (void const *) acct_config },
 
 	{ FR_CONF_POINTER("post-auth", FR_TYPE_SUBSECTION, NULL), .subcs = (void const *) postauth_config },
@@ -1020,6 +1029,38 @@ finish:
 	return rcode;
 }
 
+/** Open the connection this thread's asynchronous queries are sent on
+ *
+ * @param[in] conf	section containing the configuration of this module instance.
+ * @param[in] instance	of rlm_sql_t.
+ * @param[in] el	The event list serviced by this thread.
+ * @param[in] thread	specific data.
+ * @return
+ *	- 0 on success.
+ *	- -1 on failure.
+ */
+static int mod_thread_instantiate(UNUSED CONF_SECTION const *conf, void *instance,
+				  fr_event_list_t *el, void *thread)
+{
+	rlm_sql_thread_t	*t = thread;
+
+	t->inst = instance;
+	t->el = el;
+
+	return rlm_sql_io_init(t);
+}
+
+/** Close the connection this thread's asynchronous queries are sent on
+ *
+ * @param[in] thread	specific data to destroy.
+ * @return 0
+ */
+static int mod_thread_detach(void *thread)
+{
+	rlm_sql_io_free(thread);
+
+	return 0;
+}
 
 static int mod_detach(void *instance)
 {
@@ -1161,6 +1202,24 @@ static int mod_bootstrap(CONF_SECTION *conf, void *instance)
 	return 0;
 }
 
+/** Check the batch settings for a section
+ *
+ * A batch has to fit in the pipeline, along with BEGIN and COMMIT.
+ */
+static void sql_batch_check(rlm_sql_t const *inst, sql_acct_section_t *section)
+{
+	if (section->batch_size <= 1) return;
+
+	if (inst->config->pipeline_depth < 4) {
+		WARN("Ignoring \"batch_size = %u\", as \"pipeline_depth\" is less than 4", section->batch_size);
+		section->batch_size = 0;
+		return;
+	}
+
+	FR_INTEGER_BOUND_CHECK("batch_size", section->batch_size, <=, inst->config->pipeline_depth - 2);
+	FR_TIMEVAL_BOUND_CHECK("batch_delay", &section->batch_delay, >=, 0, 1000);
+	FR_TIMEVAL_BOUND_CHECK("batch_delay", &section->batch_delay, <=, 10, 0);
+}
 
 static int mod_instantiate(CONF_SECTION *conf, void *instance)
 {
@@ -1209,6 +1268,14 @@ static int mod_instantiate(CONF_SECTION *conf, void *instance)
 	inst->config->postauth.cs = cf_subsection_find(conf, "post-auth");
 	inst->config->postauth.reference_cp = (cf_pair_find(inst->config->postauth.cs, "reference") != NULL);
 
+	if (inst->config->pipeline_depth) {
+		FR_INTEGER_BOUND_CHECK("pipeline_depth", inst->config->pipeline_depth, >=, 2);
+		FR_INTEGER_BOUND_CHECK("pipeline_depth", inst->config->pipeline_depth, <=, 65536);
+	}
+
+	sql_batch_check(inst, &inst->config->accounting);
+	sql_batch_check(inst, &inst->config->postauth);
+
 	/*
 	 *	Cache the SQL-User-Name fr_dict_attr_t, so we can be slightly
 	 *	more efficient about creating SQL-User-Name attributes.
@@ -1509,76 +1576,31 @@ error:
 	return rcode;
 }
 
-/*
- *	Generic function for failing between a bunch of queries.
+/** Run the queries in a redundant set on a pooled connection
  *
- *	Uses the same principle as rlm_linelog, expanding the 'reference' config
- *	item using xlat to figure out what query it should execute.
- *
- *	If the reference matches multiple config items, and a query fails or
- *	doesn't update any rows, the next matching config item is used.
+ * Used when the queries can't be sent on the thread's connection.
  *
+ * @param[in] inst	of rlm_sql.
+ * @param[in] request	Current request.
+ * @param[in] section	the queries are in.
+ * @param[in] pair	First query to try.
+ * @param[in] attr	Name of the queries in the redundant set.
+ * @return the rcode of the module.
  */
-static int acct_redundant(rlm_sql_t const *inst, REQUEST *request, sql_acct_section_t *section)
+static rlm_rcode_t acct_redundant_pool(rlm_sql_t const *inst, REQUEST *request, sql_acct_section_t *section,
+				       CONF_PAIR *pair, char const *attr)
 {
 	rlm_rcode_t		rcode = RLM_MODULE_OK;
 
-	rlm_sql_handle_t	*handle = NULL;
+	rlm_sql_handle_t	*handle;
 	int			sql_ret;
 	int			numaffected = 0;
 
-	CONF_ITEM		*item;
-	CONF_PAIR 		*pair;
-	char const		*attr = NULL;
 	char const		*value;
-
-	char			path[FR_MAX_STRING_LEN];
-	char			*p = path;
 	char			*expanded = NULL;
 
-	rad_assert(section);
-
-	if (section->reference[0] != '.') {
-		*p++ = '.';
-	}
-
-	if (xlat_eval(p, sizeof(path) - (p - path), request, section->reference, NULL, NULL) < 0) {
-		rcode = RLM_MODULE_FAIL;
-
-		goto finish;
-	}
-
-	/*
-	 *	If we can't find a matching config item we do
-	 *	nothing so return RLM_MODULE_NOOP.
-	 */
-	item = cf_reference_item(NULL, section->cs, path);
-	if (!item) {
-		RWDEBUG("No such configuration item %s", path);
-		rcode = RLM_MODULE_NOOP;
-
-		goto finish;
-	}
-	if (cf_item_is_section(item)){
-		RWDEBUG("Sections are not supported as references");
-		rcode = RLM_MODULE_NOOP;
-
-		goto finish;
-	}
-
-	pair = cf_item_to_pair(item);
-	attr = cf_pair_attr(pair);
-
-	RDEBUG2("Using query template '%s'", attr);
-
 	handle = fr_connection_get(inst->pool, request);
-	if (!handle) {
-		rcode = RLM_MODULE_FAIL;
-
-		goto finish;
-	}
-
-	sql_set_user(inst, request, NULL);
+	if (!handle) return RLM_MODULE_FAIL;
 
 	while (true) {
 		value = cf_pair_value(pair);
@@ -1598,7 +1620,6 @@ static int acct_redundant(rlm_sql_t const *inst, REQUEST *request, sql_acct_sect
 		if (!*expanded) {
 			RDEBUG("Ignoring null query");
 			rcode = RLM_MODULE_NOOP;
-			talloc_free(expanded);
 
 			goto finish;
 		}
@@ -1672,10 +1693,254 @@ static int acct_redundant(rlm_sql_t const *inst, REQUEST *request, sql_acct_sect
 		RDEBUG("Trying next query...");
 	}
 
-
 finish:
 	talloc_free(expanded);
 	fr_connection_release(inst->pool, request, handle);
+
+	return rcode;
+}
+
+/** Holds state of an in progress asynchronous acct_redundant
+ *
+ */
+typedef struct {
+	sql_acct_section_t	*section;		//!< Section the queries are in.
+	CONF_PAIR		*pair;			//!< Query we're waiting for the result of.
+	char const		*attr;			//!< Name of the queries in the redundant set.
+	rlm_sql_query_t		*query;			//!< Query we're waiting for.
+} sql_acct_ctx_t;
+
+static int _acct_ctx_free(sql_acct_ctx_t *acct)
+{
+	talloc_free(acct->query);
+
+	return 0;
+}
+
+/** Expand the current query, and send it on the thread's connection
+ *
+ * @param[out] rcode	to return if the query wasn't sent.
+ * @param[in] inst	of rlm_sql.
+ * @param[in] t		Thread specific instance data.
+ * @param[in] request	Current request.
+ * @param[in] acct	State of the in progress acct_redundant.
+ * @return
+ *	- 0 if the query was sent.
+ *	- -1 if it wasn't.
+ */
+static int acct_redundant_send(rlm_rcode_t *rcode, rlm_sql_t const *inst, rlm_sql_thread_t *t,
+			       REQUEST *request, sql_acct_ctx_t *acct)
+{
+	rlm_sql_handle_t	*handle;
+	char const		*value;
+	char			*expanded = NULL;
+
+	value = cf_pair_value(acct->pair);
+	if (!value) {
+		RDEBUG("Ignoring null query");
+		*rcode = RLM_MODULE_NOOP;
+		return -1;
+	}
+
+	handle = rlm_sql_io_handle(t, request, acct->section);
+	if (!handle) {
+		REDEBUG("No connection available");
+		*rcode = RLM_MODULE_FAIL;
+		return -1;
+	}
+
+	if (xlat_aeval(request, &expanded, request, value, inst->sql_escape_func, handle) < 0) {
+		*rcode = RLM_MODULE_FAIL;
+		return -1;
+	}
+
+	if (!*expanded) {
+		RDEBUG("Ignoring null query");
+		talloc_free(expanded);
+		*rcode = RLM_MODULE_NOOP;
+		return -1;
+	}
+
+	rlm_sql_query_log(inst, request, acct->section, expanded);
+
+	if (acct->section->batch_size > 1) {
+		acct->query = rlm_sql_query_batch(t, request, acct->section, expanded);
+	} else {
+		acct->query = rlm_sql_query_async(t, request, expanded);
+	}
+	talloc_free(expanded);
+	if (!acct->query) {
+		*rcode = RLM_MODULE_FAIL;
+		return -1;
+	}
+
+	return 0;
+}
+
+static rlm_rcode_t acct_redundant_resume(REQUEST *request, void *instance, void *thread, void *ctx);
+
+/** Cancel an in progress acct_redundant
+ *
+ */
+static void acct_redundant_action(REQUEST *request, UNUSED void *instance, UNUSED void *thread, void *ctx,
+				  fr_state_action_t action)
+{
+	sql_acct_ctx_t *acct = talloc_get_type_abort(ctx, sql_acct_ctx_t);
+
+	if (action != FR_ACTION_DONE) return;
+
+	RDEBUG("Forcefully cancelling pending SQL query");
+
+	talloc_free(acct);
+}
+
+/** Continue an acct_redundant once a query has completed
+ *
+ * Does the same as #acct_redundant_pool, one query at a time.
+ */
+static rlm_rcode_t acct_redundant_resume(REQUEST *request, void *instance, void *thread, void *ctx)
+{
+	rlm_sql_t const		*inst = instance;
+	rlm_sql_thread_t	*t = thread;
+	sql_acct_ctx_t		*acct = talloc_get_type_abort(ctx, sql_acct_ctx_t);
+	rlm_sql_query_t		*query = acct->query;
+	rlm_rcode_t		rcode = RLM_MODULE_OK;
+
+	RDEBUG("SQL query returned: %s", fr_int2str(sql_rcode_table, query->rcode, "<INVALID>"));
+
+	switch (query->rcode) {
+	case RLM_SQL_OK:
+		RDEBUG("%i record(s) updated", query->numaffected);
+		if (query->numaffected > 0) goto finish;	/* A query succeeded, were done! */
+		break;
+
+	case RLM_SQL_QUERY_INVALID:
+		rcode = RLM_MODULE_INVALID;
+		goto finish;
+
+	case RLM_SQL_ALT_QUERY:
+		break;
+
+	default:
+		rcode = RLM_MODULE_FAIL;
+		goto finish;
+	}
+
+	TALLOC_FREE(acct->query);
+
+	acct->pair = cf_pair_find_next(acct->section->cs, acct->pair, acct->attr);
+	if (!acct->pair) {
+		RDEBUG("No additional queries configured");
+		rcode = RLM_MODULE_NOOP;
+
+		goto finish;
+	}
+
+	RDEBUG("Trying next query...");
+
+	/*
+	 *	The thread's connection may have failed, or its
+	 *	pipeline may be full, so run the rest of the
+	 *	queries on a pooled connection.
+	 */
+	if (!rlm_sql_io_handle(t, request, acct->section)) {
+		rcode = acct_redundant_pool(inst, request, acct->section, acct->pair, acct->attr);
+		goto finish;
+	}
+
+	if (acct_redundant_send(&rcode, inst, t, request, acct) < 0) goto finish;
+
+	return unlang_yield(request, acct_redundant_resume, acct_redundant_action, acct);
+
+finish:
+	talloc_free(acct);
+	sql_unset_user(inst, request);
+
+	return rcode;
+}
+
+/*
+ *	Generic function for failing between a bunch of queries.
+ *
+ *	Uses the same principle as rlm_linelog, expanding the 'reference' config
+ *	item using xlat to figure out what query it should execute.
+ *
+ *	If the reference matches multiple config items, and a query fails or
+ *	doesn't update any rows, the next matching config item is used.
+ *
+ *	If the driver supports it, the queries are sent on the thread's
+ *	connection, and the request yields until each completes.
+ */
+static rlm_rcode_t acct_redundant(rlm_sql_t const *inst, rlm_sql_thread_t *t, REQUEST *request,
+				  sql_acct_section_t *section)
+{
+	rlm_rcode_t		rcode = RLM_MODULE_OK;
+
+	CONF_ITEM		*item;
+	CONF_PAIR 		*pair;
+	char const		*attr = NULL;
+
+	char			path[FR_MAX_STRING_LEN];
+	char			*p = path;
+
+	rad_assert(section);
+
+	if (section->reference[0] != '.') {
+		*p++ = '.';
+	}
+
+	if (xlat_eval(p, sizeof(path) - (p - path), request, section->reference, NULL, NULL) < 0) {
+		rcode = RLM_MODULE_FAIL;
+
+		goto finish;
+	}
+
+	/*
+	 *	If we can't find a matching config item we do
+	 *	nothing so return RLM_MODULE_NOOP.
+	 */
+	item = cf_reference_item(NULL, section->cs, path);
+	if (!item) {
+		RWDEBUG("No such configuration item %s", path);
+		rcode = RLM_MODULE_NOOP;
+
+		goto finish;
+	}
+	if (cf_item_is_section(item)){
+		RWDEBUG("Sections are not supported as references");
+		rcode = RLM_MODULE_NOOP;
+
+		goto finish;
+	}
+
+	pair = cf_item_to_pair(item);
+	attr = cf_pair_attr(pair);
+
+	RDEBUG2("Using query template '%s'", attr);
+
+	if (rlm_sql_io_handle(t, request, section)) {
+		sql_acct_ctx_t *acct;
+
+		MEM(acct = talloc_zero(request, sql_acct_ctx_t));
+		talloc_set_destructor(acct, _acct_ctx_free);
+		acct->section = section;
+		acct->pair = pair;
+		acct->attr = attr;
+
+		sql_set_user(inst, request, NULL);
+
+		if (acct_redundant_send(&rcode, inst, t, request, acct) < 0) {
+			talloc_free(acct);
+			goto finish;
+		}
+
+		return unlang_yield(request, acct_redundant_resume, acct_redundant_action, acct);
+	}
+
+	sql_set_user(inst, request, NULL);
+	rcode = acct_redundant_pool(inst, request, section, pair, attr);
+
+finish:
 	sql_unset_user(inst, request);
 
 	return rcode;
@@ -1686,13 +1951,13 @@ finish:
 /*
  *	Accounting: Insert or update session data in our sql table
  */
-static rlm_rcode_t mod_accounting(void *instance, UNUSED void *thread, REQUEST *request) CC_HINT(nonnull);
-static rlm_rcode_t mod_accounting(void *instance, UNUSED void *thread, REQUEST *request)
+static rlm_rcode_t mod_accounting(void *instance, void *thread, REQUEST *request) CC_HINT(nonnull);
+static rlm_rcode_t mod_accounting(void *instance, void *thread, REQUEST *request)
 {
 	rlm_sql_t const *inst = instance;
 
 	if (inst->config->accounting.reference_cp) {
-		return acct_redundant(inst, request, &inst->config->accounting);
+		return acct_redundant(inst, thread, request, &inst->config->accounting);
 	}
 
 	return RLM_MODULE_NOOP;
@@ -1901,13 +2166,13 @@ release:
 /*
  *	Postauth: Write a record of the authentication attempt
  */
-static rlm_rcode_t mod_post_auth(void *instance, UNUSED void *thread, REQUEST *request) CC_HINT(nonnull);
-static rlm_rcode_t mod_post_auth(void *instance, UNUSED void *thread, REQUEST *request)
+static rlm_rcode_t mod_post_auth(void *instance, void *thread, REQUEST *request) CC_HINT(nonnull);
+static rlm_rcode_t mod_post_auth(void *instance, void *thread, REQUEST *request)
 {
 	rlm_sql_t const *inst = instance;
 
 	if (inst->config->postauth.reference_cp) {
-		return acct_redundant(inst, request, &inst->config->postauth);
+		return acct_redundant(inst, thread, request, &inst->config->postauth);
 	}
 
 	return RLM_MODULE_NOOP;
@@ -1920,14 +2185,17 @@ static rlm_rcode_t mod_post_auth(void *instance, UNUSED void *thread, REQUEST *r
 
 /* globally exported name */
 rad_module_t rlm_sql = {
-	.magic		= RLM_MODULE_INIT,
-	.name		= "sql",
-	.type		= RLM_TYPE_THREAD_SAFE,
-	.inst_size	= sizeof(rlm_sql_t),
-	.config		= module_config,
-	.bootstrap	= mod_bootstrap,
-	.instantiate	= mod_instantiate,
-	.detach		= mod_detach,
+	.magic			= RLM_MODULE_INIT,
+	.name			= "sql",
+	.type			= RLM_TYPE_THREAD_SAFE,
+	.inst_size		= sizeof(rlm_sql_t),
+	.thread_inst_size	= sizeof(rlm_sql_thread_t),
+	.config			= module_config,
+	.bootstrap		= mod_bootstrap,
+	.instantiate		= mod_instantiate,
+	.thread_instantiate	= mod_thread_instantiate,
+	.detach			= mod_detach,
+	.thread_detach		= mod_thread_detach,
 	.methods = {
 		[MOD_AUTHORIZE]		= mod_authorize,
 #ifdef WITH_ACCOUNTING
@@ -82,6 +82,10 @@ typedef struct sql_acct_section {
 	char const		*logfile;
 
 	char const		**query;			/* for xlat parsing */
+
+	uint32_t		batch_size;			//!< Maximum number of asynchronous queries to
+								//!< send in a single transaction.
+	struct timeval		batch_delay;			//!< How long to wait for a batch to fill.
 } sql_acct_section_t;
 
 typedef struct sql_config {
@@ -133,6 +137,10 @@ typedef struct sql_config {
 	char const		*allowed_chars;			//!< Chars which done need escaping..
 	uint32_t		query_timeout;			//!< How long to allow queries to run for.
 
+	uint32_t		pipeline_depth;			//!< Maximum number of queries outstanding on
+								//!< a thread's asynchronous connection.
+								//!< 0 disables asynchronous queries.
+
 	char const		*connect_query;			//!< Query executed after establishing
 								//!< new connection.
 
@@ -218,6 +226,27 @@ typedef struct rlm_sql_driver_t {
 	sql_rcode_t (*sql_finish_select_query)(rlm_sql_handle_t *handle, rlm_sql_config_t *config);
 
 	xlat_escape_t	sql_escape_func;
+
+	/*
+	 *	Asynchronous interface, optional.
+	 *
+	 *	sql_async_init puts a connection opened by sql_socket_init
+	 *	into asynchronous mode, and sql_async_fd returns the fd to
+	 *	wait on.  Queries are queued with sql_async_submit, and sent
+	 *	with sql_async_flush, which returns 1 if the fd must become
+	 *	writable before the rest can be sent.  sql_async_poll reads
+	 *	results, and returns 1 once the result of the oldest query is
+	 *	available.  sql_async_fetch then makes it the current result,
+	 *	which is accessed and freed as if it had come from sql_query.
+	 *
+	 *	Results are fetched in the order the queries were submitted.
+	 */
+	sql_rcode_t (*sql_async_init)(rlm_sql_handle_t *handle, rlm_sql_config_t *config);
+	int (*sql_async_fd)(rlm_sql_handle_t *handle, rlm_sql_config_t *config);
+	sql_rcode_t (*sql_async_submit)(rlm_sql_handle_t *handle, rlm_sql_config_t *config, char const *query);
+	int (*sql_async_flush)(rlm_sql_handle_t *handle, rlm_sql_config_t *config);
+	int (*sql_async_poll)(rlm_sql_handle_t *handle, rlm_sql_config_t *config);
+	sql_rcode_t (*sql_async_fetch)(rlm_sql_handle_t *handle, rlm_sql_config_t *config);
 } rlm_sql_driver_t;
 
 struct sql_inst {
@@ -244,6 +273,39 @@ struct sql_inst {
 	fr_dict_attr_t const	*group_da;		//!< Group dictionary attribute.
 };
 
+typedef struct rlm_sql_mux rlm_sql_mux_t;
+typedef struct rlm_sql_batch rlm_sql_batch_t;
+
+/** Thread specific instance data
+ *
+ */
+typedef struct {
+	rlm_sql_t const		*inst;			//!< Instance of rlm_sql.
+	fr_event_list_t		*el;			//!< This thread's event list.
+
+	rlm_sql_mux_t		*mux;			//!< Connection asynchronous queries are sent on.
+	time_t			mux_failed;		//!< When we last failed opening the connection.
+} rlm_sql_thread_t;
+
+/** An asynchronous query
+ *
+ */
+typedef struct {
+	REQUEST			*request;		//!< Waiting for the result.  NULL if the request
+							//!< was cancelled.
+	rlm_sql_thread_t	*thread;		//!< Thread the query was sent by.
+	rlm_sql_mux_t		*mux;			//!< Connection the query was sent on.  NULL once
+							//!< the query is complete.
+	fr_event_timer_t	*ev;			//!< Query timeout.
+
+	rlm_sql_batch_t		*batch;			//!< Batch the query is waiting in, or was sent in.
+	char			*query;			//!< Copy of a batched query, so it can be resent
+							//!< on its own if the batch fails.
+
+	sql_rcode_t		rcode;			//!< Result of the query.
+	int			numaffected;		//!< Number of rows the query affected.
+} rlm_sql_query_t;
+
 typedef struct sql_grouplist {
 	char			*name;
 	struct sql_grouplist	*next;
@@ -261,4 +323,15 @@ sql_rcode_t	rlm_sql_query(rlm_sql_t const *inst, REQUEST *request, rlm_sql_handl
 int		rlm_sql_fetch_row(rlm_sql_row_t *out, rlm_sql_t const *inst, REQUEST *request, rlm_sql_handle_t **handle);
 void		rlm_sql_print_error(rlm_sql_t const *inst, REQUEST *request, rlm_sql_handle_t *handle, bool force_debug);
 int		sql_set_user(rlm_sql_t const *inst, REQUEST *request, char const *username);
+
+/*
+ *	io.c
+ */
+rlm_sql_handle_t *rlm_sql_io_handle(rlm_sql_thread_t *t, REQUEST *request,
+				   sql_acct_section_t const *section) CC_HINT(nonnull);
+rlm_sql_query_t	*rlm_sql_query_async(rlm_sql_thread_t *t, REQUEST *request, char const *query) CC_HINT(nonnull);
+rlm_sql_query_t	*rlm_sql_query_batch(rlm_sql_thread_t *t, REQUEST *request, sql_acct_section_t const *section,
+				     char const *query) CC_HINT(nonnull);
+int		rlm_sql_io_init(rlm_sql_thread_t *t);
+void		rlm_sql_io_free(rlm_sql_thread_t *t);
 #endif
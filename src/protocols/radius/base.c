@@ -181,6 +181,86 @@ size_t fr_radius_attr_len(VALUE_PAIR const *vp)
 	}
 }
 
+/*
+ *	Number of secrets each thread keeps the hash state of.  Must
+ *	be a power of 2.  Most servers have only a handful of distinct
+ *	client and home server secrets in use at any one time.
+ */
+#define RADIUS_SECRET_CACHE_SIZE	(32)
+
+typedef struct {
+	uint8_t const		*key;		//!< Secret the state was derived from.
+	uint8_t			*secret;	//!< Copy of the secret, as the memory
+						//!< at key may be freed and reused.
+	size_t			secret_len;	//!< Length of the secret.
+	fr_radius_secret_t	state;		//!< Derived from the secret.
+} radius_secret_entry_t;
+
+fr_thread_local_setup(radius_secret_entry_t *, fr_radius_secret_cache)	/* macro */
+
+/*
+ *	Explicitly cleanup the memory allocated to the secret cache,
+ *	just in case valgrind complains about it.
+ */
+static void _fr_radius_secret_cache_free(void *arg)
+{
+	talloc_free(arg);
+}
+
+static void radius_secret_init(fr_radius_secret_t *state, uint8_t const *secret, size_t secret_len)
+{
+	fr_md5_init(&state->md5);
+	fr_md5_update(&state->md5, secret, secret_len);
+
+	fr_hmac_md5_init(&state->hmac, secret, secret_len);
+}
+
+/** Return the hash state derived from a shared secret
+ *
+ * The state is cached per thread, and keyed by the address of the
+ * secret.  The contents of the secret are checked on every lookup,
+ * so a secret which is changed in place, or freed and its memory
+ * reused, is never matched to stale state.
+ *
+ * @param[in] scratch		Where to derive the state if it can't be cached.
+ * @param[in] secret		to derive the state from.
+ * @param[in] secret_len	of the secret.
+ * @return the derived state.  Valid until the next call to this
+ *	function in the same thread.
+ */
+fr_radius_secret_t const *fr_radius_secret(fr_radius_secret_t *scratch, uint8_t const *secret, size_t secret_len)
+{
+	radius_secret_entry_t	*cache, *entry;
+	uint8_t			*copy;
+
+	cache = fr_radius_secret_cache;
+	if (!cache) {
+		cache = talloc_zero_array(NULL, radius_secret_entry_t, RADIUS_SECRET_CACHE_SIZE);
+		if (!cache) goto uncached;
+
+		fr_thread_local_set_destructor(fr_radius_secret_cache, _fr_radius_secret_cache_free, cache);
+	}
+
+	entry = &cache[fr_hash(&secret, sizeof(secret)) & (RADIUS_SECRET_CACHE_SIZE - 1)];
+	if ((entry->key == secret) && (entry->secret_len == secret_len) &&
+	    (memcmp(entry->secret, secret, secret_len) == 0)) return &entry->state;
+
+	copy = talloc_memdup(cache, secret, secret_len);
+	if (!copy) {
+	uncached:
+		radius_secret_init(scratch, secret, secret_len);
+		return scratch;
+	}
+
+	talloc_free(entry->secret);
+	entry->key = secret;
+	entry->secret = copy;
+	entry->secret_len = secret_len;
+	radius_secret_init(&entry->state, secret, secret_len);
+
+	return &entry->state;
+}
+
 /**  Do Ascend-Send / Recv-Secret calculation.
  *
  * The secret is hidden by xoring with a MD5 digest created from
@@ -276,22 +356,31 @@ invalid:
 	return packet_len;
 }
 
-/** Sign a previously encoded packet
+/*
+ *	Largest number of packets verified in one pass by
+ *	fr_radius_verify_multi().
+ */
+#define RADIUS_MULTI_MAX	(64)
+
+/** Prepare a packet for calculating the Message-Authenticator
  *
- * @param packet the raw RADIUS packet (request or response)
- * @param original the raw original request (if this is a response)
- * @param secret the shared secret
- * @param secret_len the length of the secret
+ * Finds the Message-Authenticator, and sets it, and the Request
+ * Authenticator field, to the values the HMAC is calculated over.
+ *
+ * @param[in] packet	the raw RADIUS packet (request or response).
+ * @param[in] original	the raw original request (if this is a response).
+ * @param[out] ma	Where to write the location of the Message-Authenticator
+ *			attribute.  NULL if the packet doesn't contain one.
  * @return
  *	- <0 on error
  *	- 0 on success
  */
-int fr_radius_sign(uint8_t *packet, uint8_t const *original,
-		   uint8_t const *secret, size_t secret_len)
+static int radius_sign_start(uint8_t *packet, uint8_t const *original, uint8_t **ma)
 {
 	uint8_t *msg, *end;
 	size_t packet_len = (packet[2] << 8) | packet[3];
-	FR_MD5_CTX	context;
+
+	*ma = NULL;
 
 	if (packet_len < RADIUS_HDR_LEN) {
 		fr_strerror_printf("Packet must be encoded before calling fr_radius_sign()");
@@ -339,7 +428,11 @@ int fr_radius_sign(uint8_t *packet, uint8_t const *original,
 		case PW_CODE_COA_REQUEST:
 		case PW_CODE_COA_ACK:
 		case PW_CODE_COA_NAK:
-			if (!original) goto need_original;
+			if (!original) {
+			need_original:
+				fr_strerror_printf("Cannot sign response packet without a request packet");
+				return -1;
+			}
 
 		do_response:
 			memset(packet + 4, 0, AUTH_VECTOR_LEN);
@@ -358,19 +451,34 @@ int fr_radius_sign(uint8_t *packet, uint8_t const *original,
 			break;
 
 		default:
-			goto bad_packet;
+			fr_strerror_printf("Cannot sign unknown packet code %u", packet[0]);
+			return -1;
 		}
 
 		/*
-		 *	Force Message-Authenticator to be zero,
-		 *	calculate the HMAC, and put it into the
+		 *	Force Message-Authenticator to be zero, so the
+		 *	HMAC can be calculated, and put into the
 		 *	Message-Authenticator attribute.
 		 */
 		memset(msg + 2, 0, AUTH_VECTOR_LEN);
-		fr_hmac_md5(msg + 2, packet, packet_len, secret, secret_len);
+		*ma = msg;
 		break;
 	}
 
+	return 0;
+}
+
+/** Prepare a packet for calculating the Request / Response Authenticator
+ *
+ * @param[in] packet	the raw RADIUS packet (request or response).
+ * @param[in] original	the raw original request (if this is a response).
+ * @return
+ *	- <0 on error
+ *	- 0 if the packet doesn't need an authenticator calculating.
+ *	- 1 if the authenticator is MD5(packet + secret).
+ */
+static int radius_sign_authenticator(uint8_t *packet, uint8_t const *original)
+{
 	/*
 	 *	Initialize the request authenticator.
 	 */
@@ -390,7 +498,6 @@ int fr_radius_sign(uint8_t *packet, uint8_t const *original,
 	case PW_CODE_COA_ACK:
 	case PW_CODE_COA_NAK:
 		if (!original) {
-		need_original:
 			fr_strerror_printf("Cannot sign response packet without a request packet");
 			return -1;
 		}
@@ -407,11 +514,43 @@ int fr_radius_sign(uint8_t *packet, uint8_t const *original,
 		return 0;
 
 	default:
-	bad_packet:
 		fr_strerror_printf("Cannot sign unknown packet code %u", packet[0]);
 		return -1;
 	}
 
+	return 1;
+}
+
+/** Sign a previously encoded packet
+ *
+ * @param packet the raw RADIUS packet (request or response)
+ * @param original the raw original request (if this is a response)
+ * @param secret the shared secret
+ * @param secret_len the length of the secret
+ * @return
+ *	- <0 on error
+ *	- 0 on success
+ */
+int fr_radius_sign(uint8_t *packet, uint8_t const *original,
+		   uint8_t const *secret, size_t secret_len)
+{
+	int		rcode;
+	uint8_t		*ma;
+	size_t		packet_len = (packet[2] << 8) | packet[3];
+	FR_MD5_CTX	context;
+	fr_radius_secret_t scratch;
+
+	rcode = radius_sign_start(packet, original, &ma);
+	if (rcode < 0) return rcode;
+
+	if (ma) {
+		fr_hmac_md5_precomputed(ma + 2, packet, packet_len,
+					&fr_radius_secret(&scratch, secret, secret_len)->hmac);
+	}
+
+	rcode = radius_sign_authenticator(packet, original);
+	if (rcode <= 0) return rcode;
+
 	/*
 	 *	Request / Response Authenticator = MD5(packet + secret)
 	 */
@@ -423,6 +562,84 @@ int fr_radius_sign(uint8_t *packet, uint8_t const *original,
 	return 0;
 }
 
+/** Sign up to RADIUS_MULTI_MAX packets
+ *
+ */
+static void radius_sign_multi(fr_radius_batch_t *batch, size_t num)
+{
+	fr_md5_job_t			jobs[RADIUS_MULTI_MAX];
+	uint8_t				*ma[RADIUS_MULTI_MAX];
+	uint32_t			state[RADIUS_MULTI_MAX][2][4];
+	uint8_t				digest[RADIUS_MULTI_MAX][MD5_DIGEST_LENGTH];
+	fr_radius_secret_t		scratch;
+	fr_radius_secret_t const	*secret;
+	size_t				i, n;
+
+	/*
+	 *	Message-Authenticator, inner hash.
+	 *
+	 *	The secret state is only valid until the next lookup,
+	 *	so take a copy of the chaining values.
+	 */
+	for (i = 0, n = 0; i < num; i++) {
+		fr_radius_batch_t *b = &batch[i];
+
+		b->rcode = radius_sign_start(b->packet, b->original, &ma[i]);
+		if ((b->rcode < 0) || !ma[i]) continue;
+
+		secret = fr_radius_secret(&scratch, b->secret, b->secret_len);
+		memcpy(state[i][0], secret->hmac.inner_state, sizeof(state[i][0]));
+		memcpy(state[i][1], secret->hmac.outer_state, sizeof(state[i][1]));
+
+		jobs[n++] = (fr_md5_job_t) {
+			.state = state[i][0],
+			.state_len = MD5_BLOCK_LENGTH,
+			.in = b->packet,
+			.inlen = (b->packet[2] << 8) | b->packet[3],
+			.out = digest[i]
+		};
+	}
+	fr_md5_multi(jobs, n);
+
+	/*
+	 *	Message-Authenticator, outer hash.
+	 */
+	for (i = 0, n = 0; i < num; i++) {
+		if ((batch[i].rcode < 0) || !ma[i]) continue;
+
+		jobs[n++] = (fr_md5_job_t) {
+			.state = state[i][1],
+			.state_len = MD5_BLOCK_LENGTH,
+			.in = digest[i],
+			.inlen = MD5_DIGEST_LENGTH,
+			.out = ma[i] + 2
+		};
+	}
+	fr_md5_multi(jobs, n);
+
+	/*
+	 *	Request / Response Authenticator = MD5(packet + secret)
+	 */
+	for (i = 0, n = 0; i < num; i++) {
+		fr_radius_batch_t *b = &batch[i];
+
+		if (b->rcode < 0) continue;
+
+		b->rcode = radius_sign_authenticator(b->packet, b->original);
+		if (b->rcode <= 0) continue;
+		b->rcode = 0;
+
+		jobs[n++] = (fr_md5_job_t) {
+			.in = b->packet,
+			.inlen = (b->packet[2] << 8) | b->packet[3],
+			.in2 = b->secret,
+			.in2len = b->secret_len,
+			.out = b->packet + 4
+		};
+	}
+	fr_md5_multi(jobs, n);
+}
+
 
 /** See if the data pointed to by PTR is a valid RADIUS packet.
  *
@@ -687,35 +904,31 @@ finish:
 }
 
 
-/** Verify a request / response packet
- *
- *  This function does its work by calling fr_radius_sign(), and then
- *  comparing the signature in the packet with the one we calculated.
- *  If they differ, there's a problem.
+/** Save the fields of a packet which fr_radius_sign() overwrites
  *
- * @param packet the raw RADIUS packet (request or response)
- * @param original the raw original request (if this is a response)
- * @param secret the shared secret
- * @param secret_len the length of the secret
+ * @param[in] packet			the raw RADIUS packet (request or response).
+ * @param[out] request_authenticator	Where to save the Request Authenticator.
+ * @param[out] message_authenticator	Where to save the Message-Authenticator.
+ * @param[out] ma			Where to write the location of the Message-Authenticator
+ *					attribute.  NULL if the packet doesn't contain one.
  * @return
  *	- <0 on error
  *	- 0 on success
  */
-int fr_radius_verify(uint8_t *packet, uint8_t const *original,
-		     uint8_t const *secret, size_t secret_len)
+static int radius_verify_start(uint8_t *packet, uint8_t request_authenticator[AUTH_VECTOR_LEN],
+			       uint8_t message_authenticator[AUTH_VECTOR_LEN], uint8_t **ma)
 {
-	int rcode;
 	uint8_t *msg, *end;
 	size_t packet_len = (packet[2] << 8) | packet[3];
-	uint8_t request_authenticator[AUTH_VECTOR_LEN];
-	uint8_t message_authenticator[AUTH_VECTOR_LEN];
+
+	*ma = NULL;
 
 	if (packet_len < RADIUS_HDR_LEN) {
 		fr_strerror_printf("invalid packet length %zd", packet_len);
 		return -1;
 	}
 
-	memcpy(request_authenticator, packet + 4, sizeof(request_authenticator));
+	memcpy(request_authenticator, packet + 4, AUTH_VECTOR_LEN);
 
 	/*
 	 *	Find Message-Authenticator.  Its value has to be
@@ -748,22 +961,23 @@ int fr_radius_verify(uint8_t *packet, uint8_t const *original,
 		/*
 		 *	Found it, save a copy.
 		 */
-		memcpy(message_authenticator, msg + 2, sizeof(message_authenticator));
+		memcpy(message_authenticator, msg + 2, AUTH_VECTOR_LEN);
+		*ma = msg;
 		break;
 	}
 
-	/*
-	 *	Implement verification as a signature, followed by
-	 *	checking our signature against the sent one.  This is
-	 *	slightly more CPU work than having verify-specific
-	 *	functions, but it ends up being cleaner in the code.
-	 */
-	rcode = fr_radius_sign(packet, original, secret, secret_len);
-	if (rcode < 0) {
-		fr_strerror_printf("unknown packet code");
-		return -1;
-	}
+	return 0;
+}
 
+/** Compare the signature we calculated against the one which was sent
+ *
+ * If they differ, the fields saved by radius_verify_start() are
+ * restored.
+ */
+static int radius_verify_check(uint8_t *packet, uint8_t const *original,
+			       uint8_t const request_authenticator[AUTH_VECTOR_LEN],
+			       uint8_t const message_authenticator[AUTH_VECTOR_LEN], uint8_t *ma)
+{
 	/*
 	 *	Check the Message-Authenticator first.
 	 *
@@ -771,10 +985,9 @@ int fr_radius_verify(uint8_t *packet, uint8_t const *original,
 	 *	Message-Authenticator and Request Authenticator
 	 *	fields.
 	 */
-	if ((msg < end) &&
-	    (fr_digest_cmp(message_authenticator, msg + 2, sizeof(message_authenticator)) != 0)) {
-		memcpy(msg + 2, message_authenticator, sizeof(message_authenticator));
-		memcpy(packet + 4, request_authenticator, sizeof(request_authenticator));
+	if (ma && (fr_digest_cmp(message_authenticator, ma + 2, AUTH_VECTOR_LEN) != 0)) {
+		memcpy(ma + 2, message_authenticator, AUTH_VECTOR_LEN);
+		memcpy(packet + 4, request_authenticator, AUTH_VECTOR_LEN);
 
 		fr_strerror_printf("invalid Message-Authenticator (shared secret is incorrect)");
 		return -1;
@@ -791,14 +1004,175 @@ int fr_radius_verify(uint8_t *packet, uint8_t const *original,
 	/*
 	 *	Check the Request Authenticator.
 	 */
-	if (fr_digest_cmp(request_authenticator, packet + 4, sizeof(request_authenticator)) != 0) {
-		memcpy(packet + 4, request_authenticator, sizeof(request_authenticator));
+	if (fr_digest_cmp(request_authenticator, packet + 4, AUTH_VECTOR_LEN) != 0) {
+		memcpy(packet + 4, request_authenticator, AUTH_VECTOR_LEN);
 		if (original) {
 			fr_strerror_printf("invalid Response Authenticator (shared secret is incorrect)");
 		} else {
 			fr_strerror_printf("invalid Request Authenticator (shared secret is incorrect)");
 		}
+		return -1;
 	}
 
 	return 0;
 }
+
+/** Verify a request / response packet
+ *
+ *  This function does its work by calling fr_radius_sign(), and then
+ *  comparing the signature in the packet with the one we calculated.
+ *  If they differ, there's a problem.
+ *
+ * @param packet the raw RADIUS packet (request or response)
+ * @param original the raw original request (if this is a response)
+ * @param secret the shared secret
+ * @param secret_len the length of the secret
+ * @return
+ *	- <0 on error
+ *	- 0 on success
+ */
+int fr_radius_verify(uint8_t *packet, uint8_t const *original,
+		     uint8_t const *secret, size_t secret_len)
+{
+	int rcode;
+	uint8_t *ma;
+	uint8_t request_authenticator[AUTH_VECTOR_LEN];
+	uint8_t message_authenticator[AUTH_VECTOR_LEN];
+
+	rcode = radius_verify_start(packet, request_authenticator, message_authenticator, &ma);
+	if (rcode < 0) return rcode;
+
+	/*
+	 *	Implement verification as a signature, followed by
+	 *	checking our signature against the sent one.  This is
+	 *	slightly more CPU work than having verify-specific
+	 *	functions, but it ends up being cleaner in the code.
+	 */
+	rcode = fr_radius_sign(packet, original, secret, secret_len);
+	if (rcode < 0) {
+		fr_strerror_printf("unknown packet code");
+		return -1;
+	}
+
+	return radius_verify_check(packet, original, request_authenticator, message_authenticator, ma);
+}
+
+/** Verify up to RADIUS_MULTI_MAX packets
+ *
+ */
+static void radius_verify_multi(fr_radius_batch_t *batch, size_t num)
+{
+	fr_radius_batch_t	sign[RADIUS_MULTI_MAX];
+	size_t			idx[RADIUS_MULTI_MAX];
+	uint8_t			*ma[RADIUS_MULTI_MAX];
+	uint8_t			request_authenticator[RADIUS_MULTI_MAX][AUTH_VECTOR_LEN];
+	uint8_t			message_authenticator[RADIUS_MULTI_MAX][AUTH_VECTOR_LEN];
+	size_t			i, n;
+
+	for (i = 0, n = 0; i < num; i++) {
+		batch[i].rcode = radius_verify_start(batch[i].packet, request_authenticator[i],
+						     message_authenticator[i], &ma[i]);
+		if (batch[i].rcode < 0) continue;
+
+		sign[n] = batch[i];
+		idx[n++] = i;
+	}
+
+	radius_sign_multi(sign, n);
+
+	for (i = 0; i < n; i++) {
+		fr_radius_batch_t *b = &batch[idx[i]];
+
+		if (sign[i].rcode < 0) {
+			fr_strerror_printf("unknown packet code");
+			b->rcode = -1;
+			continue;
+		}
+
+		b->rcode = radius_verify_check(b->packet, b->original, request_authenticator[idx[i]],
+					       message_authenticator[idx[i]], ma[idx[i]]);
+	}
+}
+
+/** Verify a batch of request / response packets
+ *
+ * The result is the same as calling fr_radius_verify() for each packet,
+ * but the hashes for several packets are calculated in parallel.
+ *
+ * @param[in,out] batch	of packets to verify.  The result for each packet is
+ *			written to its rcode field.
+ * @param[in] num	Number of packets in the batch.
+ * @return the number of packets which failed verification.  The error
+ *	message is for the last one which failed.
+ */
+int fr_radius_verify_multi(fr_radius_batch_t *batch, size_t num)
+{
+	size_t	i, n;
+	int	failed = 0;
+
+	for (i = 0; i < num; i += n) {
+		size_t j;
+
+		n = ((num - i) > RADIUS_MULTI_MAX) ? RADIUS_MULTI_MAX : (num - i);
+
+		radius_verify_multi(batch + i, n);
+
+		for (j = i; j < (i + n); j++) if (batch[j].rcode < 0) failed++;
+	}
+
+	return failed;
+}
+
+/** Check a batch of requests received from the network
+ *
+ * Each packet is checked with fr_radius_ok(), and then all of the
+ * signatures are verified in one pass.
+ *
+ * @param[in] packet		to check.
+ * @param[in,out] packet_len	of each packet.  Set to the length of the
+ *				RADIUS data for good packets, and to zero
+ *				for packets which should be ignored.
+ * @param[in] num		Number of packets.
+ * @param[in] secret		shared by all of the packets.
+ * @param[in] secret_len	Length of the secret.
+ * @return the number of good packets.
+ */
+int fr_radius_recv_multi(uint8_t **packet, size_t *packet_len, size_t num,
+			 uint8_t const *secret, size_t secret_len)
+{
+	size_t			i, j, k, n;
+	int			good = 0;
+	decode_fail_t		reason;
+	size_t			idx[RADIUS_MULTI_MAX];
+	fr_radius_batch_t	batch[RADIUS_MULTI_MAX];
+
+	for (i = 0; i < num; i = j) {
+		for (j = i, n = 0; (j < num) && (n < RADIUS_MULTI_MAX); j++) {
+			if (!packet_len[j]) continue;
+
+			if (!fr_radius_ok(packet[j], &packet_len[j], false, &reason)) {
+				packet_len[j] = 0;
+				continue;
+			}
+
+			batch[n] = (fr_radius_batch_t) {
+				.packet = packet[j],
+				.secret = secret,
+				.secret_len = secret_len
+			};
+			idx[n++] = j;
+		}
+
+		(void) fr_radius_verify_multi(batch, n);
+
+		for (k = 0; k < n; k++) {
+			if (batch[k].rcode < 0) {
+				packet_len[idx[k]] = 0;
+				continue;
+			}
+			good++;
+		}
+	}
+
+	return good;
+}
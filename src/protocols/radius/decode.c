@@ -37,7 +37,9 @@ bool fr_tunnel_password_zeros = true;
  */
 ssize_t fr_radius_decode_tunnel_password(uint8_t *passwd, size_t *pwlen, char const *secret, uint8_t const *vector)
 {
-	FR_MD5_CTX	context, old;
+	FR_MD5_CTX		context;
+	FR_MD5_CTX const	*old;
+	fr_radius_secret_t	scratch;
 	uint8_t		digest[AUTH_VECTOR_LEN];
 	int		secretlen;
 	size_t		i, n, encrypted_len, embedded_len;
@@ -75,9 +77,8 @@ ssize_t fr_radius_decode_tunnel_password(uint8_t *passwd, size_t *pwlen, char co
 	 */
 	secretlen = talloc_array_length(secret) - 1;
 
-	fr_md5_init(&context);
-	fr_md5_update(&context, (uint8_t const *) secret, secretlen);
-	fr_md5_copy(&old, &context); /* save intermediate work */
+	old = &fr_radius_secret(&scratch, (uint8_t const *) secret, secretlen)->md5;
+	fr_md5_copy(&context, old);
 
 	/*
 	 *	Set up the initial key:
@@ -103,7 +104,7 @@ ssize_t fr_radius_decode_tunnel_password(uint8_t *passwd, size_t *pwlen, char co
 			base = 1;
 
 			fr_md5_final(digest, &context);
-			fr_md5_copy(&context, &old);
+			fr_md5_copy(&context, old);
 
 			/*
 			 *	A quick check: decrypt the first octet
@@ -124,7 +125,7 @@ ssize_t fr_radius_decode_tunnel_password(uint8_t *passwd, size_t *pwlen, char co
 
 			fr_md5_final(digest, &context);
 
-			fr_md5_copy(&context, &old);
+			fr_md5_copy(&context, old);
 			fr_md5_update(&context, passwd + n + 2, block_len);
 		}
 
@@ -157,7 +158,9 @@ ssize_t fr_radius_decode_tunnel_password(uint8_t *passwd, size_t *pwlen, char co
  */
 ssize_t fr_radius_decode_password(char *passwd, size_t pwlen, char const *secret, uint8_t const *vector)
 {
-	FR_MD5_CTX	context, old;
+	FR_MD5_CTX		context;
+	FR_MD5_CTX const	*old;
+	fr_radius_secret_t	scratch;
 	uint8_t		digest[AUTH_VECTOR_LEN];
 	int		i;
 	size_t		n, secretlen;
@@ -179,9 +182,8 @@ ssize_t fr_radius_decode_password(char *passwd, size_t pwlen, char const *secret
 	 */
 	secretlen = talloc_array_length(secret) - 1;
 
-	fr_md5_init(&context);
-	fr_md5_update(&context, (uint8_t const *) secret, secretlen);
-	fr_md5_copy(&old, &context);	/* save intermediate work */
+	old = &fr_radius_secret(&scratch, (uint8_t const *) secret, secretlen)->md5;
+	fr_md5_copy(&context, old);
 
 	/*
 	 *	The inverse of the code above.
@@ -191,14 +193,14 @@ ssize_t fr_radius_decode_password(char *passwd, size_t pwlen, char const *secret
 			fr_md5_update(&context, vector, AUTH_VECTOR_LEN);
 			fr_md5_final(digest, &context);
 
-			fr_md5_copy(&context, &old);
+			fr_md5_copy(&context, old);
 			if (pwlen > AUTH_PASS_LEN) {
 				fr_md5_update(&context, (uint8_t *) passwd, AUTH_PASS_LEN);
 			}
 		} else {
 			fr_md5_final(digest, &context);
 
-			fr_md5_copy(&context, &old);
+			fr_md5_copy(&context, old);
 			if (pwlen > (n + AUTH_PASS_LEN)) {
 				fr_md5_update(&context, (uint8_t *) passwd + n, AUTH_PASS_LEN);
 			}
@@ -135,11 +135,13 @@ int fr_radius_encode_chap_password(uint8_t *output, RADIUS_PACKET *packet, int i
  */
 int fr_radius_encode_tunnel_password(char *passwd, size_t *pwlen, char const *secret, uint8_t const *vector)
 {
-	uint8_t		buffer[AUTH_VECTOR_LEN + FR_MAX_STRING_LEN + 3];
-	unsigned char	digest[AUTH_VECTOR_LEN];
-	char		*salt;
-	int		i, n, secretlen;
-	unsigned	len, n2;
+	FR_MD5_CTX		context;
+	FR_MD5_CTX const	*old;
+	fr_radius_secret_t	scratch;
+	unsigned char		digest[AUTH_VECTOR_LEN];
+	char			*salt;
+	int			i, n;
+	unsigned		len, n2;
 
 	len = *pwlen;
 
@@ -186,18 +188,17 @@ int fr_radius_encode_tunnel_password(char *passwd, size_t *pwlen, char const *se
 	/*
 	 *	Use the secret to setup the decryption digest
 	 */
-	secretlen = talloc_array_length(secret) - 1;
-	memcpy(buffer, secret, secretlen);
+	old = &fr_radius_secret(&scratch, (uint8_t const *) secret, talloc_array_length(secret) - 1)->md5;
 
 	for (n2 = 0; n2 < len; n2 +=AUTH_PASS_LEN) {
+		fr_md5_copy(&context, old);
 		if (!n2) {
-			memcpy(buffer + secretlen, vector, AUTH_VECTOR_LEN);
-			memcpy(buffer + secretlen + AUTH_VECTOR_LEN, salt, 2);
-			fr_md5_calc(digest, buffer, secretlen + AUTH_VECTOR_LEN + 2);
+			fr_md5_update(&context, vector, AUTH_VECTOR_LEN);
+			fr_md5_update(&context, (uint8_t const *) salt, 2);
 		} else {
-			memcpy(buffer + secretlen, passwd + n2 - AUTH_PASS_LEN, AUTH_PASS_LEN);
-			fr_md5_calc(digest, buffer, secretlen + AUTH_PASS_LEN);
+			fr_md5_update(&context, (uint8_t const *) passwd + n2 - AUTH_PASS_LEN, AUTH_PASS_LEN);
 		}
+		fr_md5_final(digest, &context);
 		for (i = 0; i < AUTH_PASS_LEN; i++) passwd[i + n2] ^= digest[i];
 	}
 	passwd[n2] = 0;
@@ -216,7 +217,9 @@ int fr_radius_encode_tunnel_password(char *passwd, size_t *pwlen, char const *se
  */
 int fr_radius_encode_password(char *passwd, size_t *pwlen, char const *secret, uint8_t const *vector)
 {
-	FR_MD5_CTX	context, old;
+	FR_MD5_CTX		context;
+	FR_MD5_CTX const	*old;
+	fr_radius_secret_t	scratch;
 	uint8_t		digest[AUTH_VECTOR_LEN];
 	int		i, n, secretlen;
 	int		len;
@@ -247,9 +250,8 @@ int fr_radius_encode_password(char *passwd, size_t *pwlen, char const *secret, u
 	 */
 	secretlen = talloc_array_length(secret) - 1;
 
-	fr_md5_init(&context);
-	fr_md5_update(&context, (uint8_t const *) secret, secretlen);
-	fr_md5_copy(&old, &context); /* save intermediate work */
+	old = &fr_radius_secret(&scratch, (uint8_t const *) secret, secretlen)->md5;
+	fr_md5_copy(&context, old);
 
 	/*
 	 *	Encrypt it in place.  Don't bother checking
@@ -260,7 +262,7 @@ int fr_radius_encode_password(char *passwd, size_t *pwlen, char const *secret, u
 			fr_md5_update(&context, vector, AUTH_PASS_LEN);
 			fr_md5_final(digest, &context);
 		} else {
-			fr_md5_copy(&context, &old);
+			fr_md5_copy(&context, old);
 			fr_md5_update(&context, (uint8_t *) passwd + n - AUTH_PASS_LEN, AUTH_PASS_LEN);
 			fr_md5_final(digest, &context);
 		}
@@ -274,7 +276,9 @@ int fr_radius_encode_password(char *passwd, size_t *pwlen, char const *secret, u
 static void encode_password(uint8_t *out, ssize_t *outlen, uint8_t const *input, size_t inlen,
 			    char const *secret, uint8_t const *vector)
 {
-	FR_MD5_CTX	context, old;
+	FR_MD5_CTX		context;
+	FR_MD5_CTX const	*old;
+	fr_radius_secret_t	scratch;
 	uint8_t		digest[AUTH_VECTOR_LEN];
 	uint8_t		passwd[MAX_PASS_LEN];
 	size_t		i, n;
@@ -297,9 +301,8 @@ static void encode_password(uint8_t *out, ssize_t *outlen, uint8_t const *input,
 	}
 	*outlen = len;
 
-	fr_md5_init(&context);
-	fr_md5_update(&context, (uint8_t const *) secret, talloc_array_length(secret) - 1);
-	fr_md5_copy(&old, &context);
+	old = &fr_radius_secret(&scratch, (uint8_t const *) secret, talloc_array_length(secret) - 1)->md5;
+	fr_md5_copy(&context, old);
 
 	/*
 	 *	Do first pass.
@@ -308,7 +311,7 @@ static void encode_password(uint8_t *out, ssize_t *outlen, uint8_t const *input,
 
 	for (n = 0; n < len; n += AUTH_PASS_LEN) {
 		if (n > 0) {
-			fr_md5_copy(&context, &old);
+			fr_md5_copy(&context, old);
 			fr_md5_update(&context, passwd + n - AUTH_PASS_LEN, AUTH_PASS_LEN);
 		}
 
@@ -324,7 +327,9 @@ static void encode_tunnel_password(uint8_t *out, ssize_t *outlen,
 				   uint8_t const *input, size_t inlen, size_t freespace,
 				   char const *secret, uint8_t const *vector)
 {
-	FR_MD5_CTX	context, old;
+	FR_MD5_CTX		context;
+	FR_MD5_CTX const	*old;
+	fr_radius_secret_t	scratch;
 	uint8_t		digest[AUTH_VECTOR_LEN];
 	size_t		i, n;
 	size_t		encrypted_len;
@@ -383,9 +388,8 @@ static void encode_tunnel_password(uint8_t *out, ssize_t *outlen,
 	out[1] = fr_rand();
 	out[2] = inlen;	/* length of the password string */
 
-	fr_md5_init(&context);
-	fr_md5_update(&context, (uint8_t const *) secret, talloc_array_length(secret) - 1);
-	fr_md5_copy(&old, &context);
+	old = &fr_radius_secret(&scratch, (uint8_t const *) secret, talloc_array_length(secret) - 1)->md5;
+	fr_md5_copy(&context, old);
 
 	fr_md5_update(&context, vector, AUTH_VECTOR_LEN);
 	fr_md5_update(&context, &out[0], 2);
@@ -394,7 +398,7 @@ static void encode_tunnel_password(uint8_t *out, ssize_t *outlen,
 		size_t block_len;
 
 		if (n > 0) {
-			fr_md5_copy(&context, &old);
+			fr_md5_copy(&context, old);
 			fr_md5_update(&context, out + 2 + n - AUTH_PASS_LEN, AUTH_PASS_LEN);
 		}
 		fr_md5_final(digest, &context);
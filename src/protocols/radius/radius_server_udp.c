@@ -44,40 +44,75 @@ typedef struct fr_packet_ctx_t {
 
 	uint8_t const	*secret;
 	size_t		secret_len;
+} fr_packet_ctx_t;
 
-	uint8_t		original[20];
-	uint8_t		id;
+/*
+ *	The packet context is shared by every packet read from the
+ *	socket, so the client address can't go there.  Instead, it's
+ *	appended to the data in each message.  Requests carry the
+ *	address they came from, and replies the address they're
+ *	going to.
+ *
+ *	Messages are packed end to end, so the trailer may not be
+ *	aligned.  Always memcpy() it.
+ */
+typedef struct fr_packet_addr_t {
+	struct sockaddr_storage	sockaddr;
+	socklen_t		salen;
+} fr_packet_addr_t;
 
-	struct sockaddr_storage src;
-	socklen_t	salen;
-} fr_packet_ctx_t;
+/*
+ *	Per-request context, allocated by mod_decode().  It replaces
+ *	the socket context in request->packet_ctx, so that
+ *	mod_encode() can build the reply.
+ */
+typedef struct fr_packet_request_t {
+	fr_packet_ctx_t const	*pc;
+
+	uint8_t			original[20];
+	fr_packet_addr_t	addr;
+} fr_packet_request_t;
 
 
 static int mod_decode(void const *ctx, uint8_t *const data, size_t data_len, REQUEST *request)
 {
 	fr_packet_ctx_t const *pc = ctx;
+	fr_packet_request_t *pr;
 
 	RDEBUG("\t\tDECODE <<< request %zd - %p data %p size %zd\n", request->number, pc, data, data_len);
 
+	if (data_len < (20 + sizeof(pr->addr))) return -1;
+
+	pr = talloc_zero(request, fr_packet_request_t);
+	if (!pr) return -1;
+
+	pr->pc = pc;
+	memcpy(pr->original, data, sizeof(pr->original));
+	memcpy(&pr->addr, data + data_len - sizeof(pr->addr), sizeof(pr->addr));
+
+	request->packet_ctx = pr;
+
 	return 0;
 }
 
 static ssize_t mod_encode(void const *ctx, REQUEST *request, uint8_t *buffer, size_t buffer_len)
 {
-	fr_packet_ctx_t const *pc = ctx;
+	fr_packet_request_t const *pr = ctx;
 
-	RDEBUG("\t\tENCODE >>> request %zd - data %p %p room %zd\n", request->number, pc, buffer, buffer_len);
+	RDEBUG("\t\tENCODE >>> request %zd - data %p %p room %zd\n", request->number, pr, buffer, buffer_len);
 
-	if (buffer_len < 20) return -1;
+	if (buffer_len < (20 + sizeof(pr->addr))) return -1;
 
 	buffer[0] = PW_CODE_ACCESS_ACCEPT;
-	buffer[1] = pc->id;
+	buffer[1] = pr->original[1];
 	buffer[2] = 0;
 	buffer[3] = 20;
 
-	(void) fr_radius_sign(buffer, pc->original, pc->secret, pc->secret_len);
+	(void) fr_radius_sign(buffer, pr->original, pr->pc->secret, pr->pc->secret_len);
+
+	memcpy(buffer + 20, &pr->addr, sizeof(pr->addr));
 
-	return 20;
+	return 20 + sizeof(pr->addr);
 }
 
 static size_t mod_nak(void const *ctx, uint8_t *const packet, size_t packet_len, UNUSED uint8_t *reply, UNUSED size_t reply_len)
@@ -99,11 +134,16 @@ static ssize_t mod_read(int sockfd, void *ctx, uint8_t *buffer, size_t buffer_le
 	ssize_t data_size;
 	size_t packet_len;
 	fr_packet_ctx_t *pc = ctx;
+	fr_packet_addr_t addr;
 	decode_fail_t reason;
 
-	pc->salen = sizeof(pc->src);
+	if (buffer_len <= sizeof(addr)) return -1;
 
-	data_size = recvfrom(sockfd, buffer, buffer_len, 0, (struct sockaddr *) &pc->src, &pc->salen);
+	memset(&addr, 0, sizeof(addr));
+	addr.salen = sizeof(addr.sockaddr);
+
+	data_size = recvfrom(sockfd, buffer, buffer_len - sizeof(addr), 0,
+			     (struct sockaddr *) &addr.sockaddr, &addr.salen);
 	if (data_size <= 0) return data_size;
 
 	packet_len = data_size;
@@ -118,28 +158,93 @@ static ssize_t mod_read(int sockfd, void *ctx, uint8_t *buffer, size_t buffer_le
 	/*
 	 *	If the signature fails validation, ignore it.
 	 */
-	if (!fr_radius_verify(buffer, NULL, pc->secret, pc->secret_len)) {
+	if (fr_radius_verify(buffer, NULL, pc->secret, pc->secret_len) < 0) {
 		return 0;
 	}
 
-	pc->id = buffer[1];
-	memcpy(pc->original, buffer, sizeof(pc->original));
+	memcpy(buffer + packet_len, &addr, sizeof(addr));
 
-	return packet_len;
+	return packet_len + sizeof(addr);
 }
 
+#ifdef HAVE_RECVMMSG
+#define MAX_READ_BATCH (64)
 
-static ssize_t mod_write(int sockfd, void *ctx, uint8_t *buffer, size_t buffer_len)
+/*
+ *	Read up to num_packets in one system call.  Packets which fail
+ *	validation are given a length of zero, and are ignored by the
+ *	caller.
+ */
+static int mod_read_batch(int sockfd, void *ctx, uint8_t **buffer, size_t buffer_len,
+			  size_t *packet_len, int num_packets)
 {
-	ssize_t data_size;
+	int i, num;
 	fr_packet_ctx_t *pc = ctx;
+	struct mmsghdr msg[MAX_READ_BATCH];
+	struct iovec iov[MAX_READ_BATCH];
+	fr_packet_addr_t addr[MAX_READ_BATCH];
+
+	if (buffer_len <= sizeof(addr[0])) return -1;
+
+	if (num_packets > MAX_READ_BATCH) num_packets = MAX_READ_BATCH;
+
+	memset(msg, 0, sizeof(msg));
+
+	for (i = 0; i < num_packets; i++) {
+		iov[i].iov_base = buffer[i];
+		iov[i].iov_len = buffer_len - sizeof(addr[i]);
+
+		memset(&addr[i], 0, sizeof(addr[i]));
+		msg[i].msg_hdr.msg_name = &addr[i].sockaddr;
+		msg[i].msg_hdr.msg_namelen = sizeof(addr[i].sockaddr);
+		msg[i].msg_hdr.msg_iov = &iov[i];
+		msg[i].msg_hdr.msg_iovlen = 1;
+	}
+
+	num = recvmmsg(sockfd, msg, num_packets, MSG_DONTWAIT, NULL);
+	if (num < 0) {
+		if ((errno == EAGAIN) || (errno == EWOULDBLOCK)) return 0;
+		return -1;
+	}
+
+	for (i = 0; i < num; i++) packet_len[i] = msg[i].msg_len;
+
+	/*
+	 *	Ignore anything which isn't a RADIUS packet, or which
+	 *	fails signature validation.
+	 */
+	(void) fr_radius_recv_multi(buffer, packet_len, num, pc->secret, pc->secret_len);
+
+	for (i = 0; i < num; i++) {
+		if (!packet_len[i]) continue;
+
+		addr[i].salen = msg[i].msg_hdr.msg_namelen;
+		memcpy(buffer[i] + packet_len[i], &addr[i], sizeof(addr[i]));
+		packet_len[i] += sizeof(addr[i]);
+	}
+
+	return num;
+}
+#endif
 
-	pc->salen = sizeof(pc->src);
+
+static ssize_t mod_write(int sockfd, UNUSED void *ctx, uint8_t *buffer, size_t buffer_len)
+{
+	ssize_t data_size;
+	fr_packet_addr_t addr;
+
+	/*
+	 *	NAKs have no destination.  There's nothing to send.
+	 */
+	if (buffer_len < (20 + sizeof(addr))) return buffer_len;
+
+	buffer_len -= sizeof(addr);
+	memcpy(&addr, buffer + buffer_len, sizeof(addr));
 
 	/*
 	 *	@todo - do more stuff
 	 */
-	data_size = sendto(sockfd, buffer, buffer_len, 0, (struct sockaddr *) &pc->src, pc->salen);
+	data_size = sendto(sockfd, buffer, buffer_len, 0, (struct sockaddr *) &addr.sockaddr, addr.salen);
 	if (data_size <= 0) return data_size;
 
 	/*
@@ -149,13 +254,86 @@ static ssize_t mod_write(int sockfd, void *ctx, uint8_t *buffer, size_t buffer_l
 	return data_size;
 }
 
+#ifdef HAVE_SENDMMSG
+#define MAX_WRITE_BATCH (64)
+
+/*
+ *	Write up to num_packets in one system call.
+ */
+static int mod_write_batch(int sockfd, UNUSED void *ctx, uint8_t **buffer, size_t *buffer_len, int num_packets)
+{
+	int i, num, sent;
+	struct mmsghdr msg[MAX_WRITE_BATCH];
+	struct iovec iov[MAX_WRITE_BATCH];
+	fr_packet_addr_t addr[MAX_WRITE_BATCH];
+	int idx[MAX_WRITE_BATCH];
+
+	if (num_packets > MAX_WRITE_BATCH) num_packets = MAX_WRITE_BATCH;
+
+	memset(msg, 0, sizeof(msg));
+
+	/*
+	 *	Each reply goes to the address in its own trailer.
+	 *	NAKs have no destination, so they're skipped, but
+	 *	still count as written.  idx[] records which buffer
+	 *	each message came from.
+	 */
+	for (i = 0, num = 0; i < num_packets; i++) {
+		size_t len = buffer_len[i];
+
+		if (len < (20 + sizeof(addr[num]))) continue;
+
+		len -= sizeof(addr[num]);
+		memcpy(&addr[num], buffer[i] + len, sizeof(addr[num]));
+
+		iov[num].iov_base = buffer[i];
+		iov[num].iov_len = len;
+
+		msg[num].msg_hdr.msg_name = &addr[num].sockaddr;
+		msg[num].msg_hdr.msg_namelen = addr[num].salen;
+		msg[num].msg_hdr.msg_iov = &iov[num];
+		msg[num].msg_hdr.msg_iovlen = 1;
+		idx[num++] = i;
+	}
+
+	/*
+	 *	sendmmsg() may write fewer packets than we asked
+	 *	for.  Keep going until they're all written, or there
+	 *	is an error.
+	 */
+	sent = 0;
+	while (sent < num) {
+		i = sendmmsg(sockfd, msg + sent, num - sent, 0);
+		if (i <= 0) break;
+
+		sent += i;
+	}
+
+	if (sent == num) return num_packets;
+
+	/*
+	 *	Everything before the first message which wasn't
+	 *	sent has been written, or skipped.
+	 */
+	if (!idx[sent]) return -1;
+
+	return idx[sent];
+}
+#endif
+
 extern fr_transport_t fr_radius_server_udp;
 fr_transport_t fr_radius_server_udp = {
 	.name			= "radius_server_udp",
 	.id			= 1,		/* @todo fix me later */
 	.default_message_size	= 4096,
 	.read			= mod_read,
+#ifdef HAVE_RECVMMSG
+	.read_batch		= mod_read_batch,
+#endif
 	.write			= mod_write,
+#ifdef HAVE_SENDMMSG
+	.write_batch		= mod_write_batch,
+#endif
 	.decode			= mod_decode,
 	.encode			= mod_encode,
 	.nak			= mod_nak,
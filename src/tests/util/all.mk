@@ -1,8 +1,28 @@
-SUBMAKEFILES := ring_buffer_test.mk message_set_test.mk atomic_queue_test.mk control_test.mk 
+SUBMAKEFILES := ring_buffer_test.mk message_set_test.mk atomic_queue_test.mk control_test.mk channel_steal_test.mk time_order_test.mk event_timer_test.mk pair_arena_bench.mk md5_multi_bench.mk md5_multi_test.mk radius_recv_test.mk client_trie_test.mk dict_cache_test.mk pair_index_test.mk sql_io_test.mk
 
 #
 #  These require pthread.
 #
 ifneq "$(findstring thread,${CFLAGS})" ""
-SUBMAKEFILES += channel_test.mk worker_test.mk radius1_test.mk schedule_test.mk radius_schedule_test.mk
+SUBMAKEFILES += channel_test.mk worker_test.mk radius1_test.mk schedule_test.mk radius_schedule_test.mk atomic_queue_bench.mk
 endif
+
+#
+#  Tests which need no configuration, and are run by "make test".
+#
+UTIL_TESTS := client_trie_test channel_steal_test event_timer_test time_order_test radius_recv_test \
+	      md5_multi_test dict_cache_test pair_index_test sql_io_test
+
+.PHONY: $(BUILD_DIR)/tests/util
+$(BUILD_DIR)/tests/util:
+	${Q}mkdir -p $@
+
+$(BUILD_DIR)/tests/util/%: $(BUILD_DIR)/bin/% $(TESTBINDIR)/% | $(BUILD_DIR)/tests/util
+	${Q}echo UTIL-TEST $(notdir $@)
+	${Q}if ! $(TESTBIN)/$(notdir $@); then \
+		echo "$(TESTBIN)/$(notdir $@)"; \
+		exit 1; \
+	fi
+	${Q}touch $@
+
+tests.util: $(addprefix $(BUILD_DIR)/tests/util/,$(UTIL_TESTS))
@@ -0,0 +1,237 @@
+/*
+ * atomic_queue_bench.c	Benchmark single vs batched atomic queue operations
+ *
+ * Version:	$Id$
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA
+ *
+ * Copyright 2026  The FreeRADIUS server project
+ */
+
+RCSID("$Id$")
+
+#include <freeradius-devel/libradius.h>
+#include <freeradius-devel/io/atomic_queue.h>
+#include <freeradius-devel/io/time.h>
+#include <freeradius-devel/rad_assert.h>
+#include <pthread.h>
+#include <sched.h>
+
+#ifdef HAVE_STDATOMIC_H
+#  include <stdatomic.h>
+#else
+#  include <freeradius-devel/stdatomic.h>
+#endif
+
+#ifdef HAVE_GETOPT_H
+#	include <getopt.h>
+#endif
+
+#define MAX_THREADS	(64)
+#define MAX_BATCH	(256)
+
+static int		debug_lvl = 0;
+static int		queue_size = 1024;
+static int		num_messages = 1000000;
+
+typedef struct bench_t {
+	fr_atomic_queue_t	*aq;
+	int			batch;		//!< 1 == use the single push / pop API
+	int			to_push;	//!< per producer
+	int			total;		//!< total messages to pop
+	_Atomic(int)		popped;		//!< messages popped so far
+	_Atomic(int)		sum;		//!< sanity check on the data
+} bench_t;
+
+static void *producer(void *arg)
+{
+	int i, j, n;
+	bench_t *b = arg;
+	void *array[MAX_BATCH];
+
+	for (i = 0; i < b->to_push; i += n) {
+		n = b->to_push - i;
+		if (n > b->batch) n = b->batch;
+
+		for (j = 0; j < n; j++) array[j] = (void *) (intptr_t) 1;
+
+		if (b->batch == 1) {
+			while (!fr_atomic_queue_push(b->aq, array[0])) sched_yield();
+			continue;
+		}
+
+		/*
+		 *	The queue may have room for only some of the
+		 *	entries.  Keep pushing until they're all in.
+		 */
+		j = 0;
+		while (j < n) {
+			int pushed;
+
+			pushed = fr_atomic_queue_push_n(b->aq, &array[j], n - j);
+			if (!pushed) sched_yield();
+
+			j += pushed;
+		}
+	}
+
+	return NULL;
+}
+
+static void *consumer(void *arg)
+{
+	int i, n, sum;
+	bench_t *b = arg;
+	void *array[MAX_BATCH];
+
+	while (atomic_load_explicit(&b->popped, memory_order_relaxed) < b->total) {
+		if (b->batch == 1) {
+			n = fr_atomic_queue_pop(b->aq, &array[0]);
+		} else {
+			n = fr_atomic_queue_pop_n(b->aq, array, b->batch);
+		}
+
+		/*
+		 *	Let the producers run if there's nothing to
+		 *	do.  Otherwise we starve them on small systems.
+		 */
+		if (!n) {
+			sched_yield();
+			continue;
+		}
+
+		for (i = sum = 0; i < n; i++) sum += (int) (intptr_t) array[i];
+
+		atomic_fetch_add_explicit(&b->sum, sum, memory_order_relaxed);
+		atomic_fetch_add_explicit(&b->popped, n, memory_order_relaxed);
+	}
+
+	return NULL;
+}
+
+static void run_bench(TALLOC_CTX *ctx, int num_threads, int batch)
+{
+	int i, producers;
+	bench_t b;
+	pthread_t pthread_id[MAX_THREADS];
+	fr_time_t start, end;
+
+	producers = num_threads / 2;
+
+	memset(&b, 0, sizeof(b));
+	b.aq = fr_atomic_queue_create(ctx, queue_size);
+	if (!b.aq) {
+		fprintf(stderr, "Failed creating atomic queue\n");
+		exit(1);
+	}
+	b.batch = batch;
+	b.to_push = num_messages / producers;
+	b.total = b.to_push * producers;
+	atomic_init(&b.popped, 0);
+	atomic_init(&b.sum, 0);
+
+	start = fr_time();
+
+	for (i = 0; i < num_threads; i++) {
+		if (pthread_create(&pthread_id[i], NULL, (i < producers) ? producer : consumer, &b) != 0) {
+			fprintf(stderr, "Failed creating thread: %s\n", fr_syserror(errno));
+			exit(1);
+		}
+	}
+
+	for (i = 0; i < num_threads; i++) {
+		(void) pthread_join(pthread_id[i], NULL);
+	}
+
+	end = fr_time();
+
+	rad_assert(atomic_load(&b.popped) == b.total);
+	rad_assert(atomic_load(&b.sum) == b.total);
+
+	printf("%d threads, batch %d\t%d messages in %" PRIu64 " us (%" PRIu64 " ns/message)\n",
+	       num_threads, batch, b.total, (end - start) / 1000, (end - start) / b.total);
+
+	talloc_free(b.aq);
+}
+
+static void NEVER_RETURNS usage(void)
+{
+	fprintf(stderr, "usage: atomic_queue_bench [OPTS]\n");
+	fprintf(stderr, "  -b <batch>             Set batch size (default 16).\n");
+	fprintf(stderr, "  -n <num>               Set the number of messages to send.\n");
+	fprintf(stderr, "  -s <size>              Set queue size.\n");
+	fprintf(stderr, "  -t <threads>           Only test <threads> threads (default 2, 4, 8).\n");
+	fprintf(stderr, "  -x                     Debugging mode.\n");
+
+	exit(1);
+}
+
+int main(int argc, char *argv[])
+{
+	int c, i;
+	int batch = 16;
+	int num_threads = 0;
+	static int const threads[] = { 2, 4, 8 };
+
+	TALLOC_CTX	*autofree = talloc_init("main");
+
+	while ((c = getopt(argc, argv, "b:hn:s:t:x")) != EOF) switch (c) {
+		case 'b':
+			batch = atoi(optarg);
+			if ((batch < 2) || (batch > MAX_BATCH)) usage();
+			break;
+
+		case 'n':
+			num_messages = atoi(optarg);
+			if (num_messages <= 0) usage();
+			break;
+
+		case 's':
+			queue_size = atoi(optarg);
+			if (queue_size <= 0) usage();
+			break;
+
+		case 't':
+			num_threads = atoi(optarg);
+			if ((num_threads < 2) || (num_threads > MAX_THREADS)) usage();
+			break;
+
+		case 'x':
+			debug_lvl++;
+			break;
+
+		case 'h':
+		default:
+			usage();
+	}
+
+	if (fr_time_start() < 0) {
+		fprintf(stderr, "Failed to start time: %s\n", fr_strerror());
+		exit(1);
+	}
+
+	for (i = 0; i < (int) (sizeof(threads) / sizeof(threads[0])); i++) {
+		int t = num_threads ? num_threads : threads[i];
+
+		run_bench(autofree, t, 1);
+		run_bench(autofree, t, batch);
+
+		if (num_threads) break;
+	}
+
+	talloc_free(autofree);
+
+	return 0;
+}
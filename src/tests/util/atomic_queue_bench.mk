@@ -0,0 +1,7 @@
+TARGET := atomic_queue_bench
+
+SOURCES		:= atomic_queue_bench.c
+
+TGT_PREREQS	:= libfreeradius-util.a libfreeradius-server.a libfreeradius-radius.a libfreeradius-io.a
+TGT_LDLIBS	:= $(LIBS)
+
@@ -0,0 +1,228 @@
+/*
+ * channel_steal_test.c	Tests for moving requests between channels
+ *
+ * Version:	$Id$
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA
+ *
+ * Copyright 2026  The FreeRADIUS server project
+ */
+
+RCSID("$Id$")
+
+#include <freeradius-devel/libradius.h>
+#include <freeradius-devel/io/control.h>
+#include <freeradius-devel/io/channel.h>
+#include <freeradius-devel/rad_assert.h>
+
+#ifdef HAVE_GETOPT_H
+#	include <getopt.h>
+#endif
+
+#include <sys/event.h>
+
+#define MAX_MESSAGES		(16)
+#define MAX_CONTROL_PLANE	(1024)
+
+#define MPRINT1 if (debug_lvl) printf
+
+static int		debug_lvl = 0;
+
+static void NEVER_RETURNS usage(void)
+{
+	fprintf(stderr, "usage: channel_steal_test [OPTS]\n");
+	fprintf(stderr, "  -x                     Debugging mode.\n");
+
+	exit(1);
+}
+
+static fr_channel_data_t *message_alloc(fr_message_set_t *ms, int id, fr_time_t when)
+{
+	fr_channel_data_t *cd;
+
+	cd = (fr_channel_data_t *) fr_message_alloc(ms, NULL, 100);
+	rad_assert(cd != NULL);
+
+	cd->m.when = when;
+	memcpy(cd->m.data, &id, sizeof(id));
+
+	return cd;
+}
+
+/*
+ *	Read all of the requests from a channel, and reply to them.
+ *	Returns the number of requests read.
+ */
+static int worker_drain(fr_message_set_t *ms, fr_channel_t *ch, int *ids, fr_time_t *whens, int max)
+{
+	int			num = 0;
+	fr_channel_data_t	*cd, *reply;
+
+	cd = fr_channel_recv_request(ch);
+	while (cd) {
+		rad_assert(num < max);
+
+		memcpy(&ids[num], cd->m.data, sizeof(ids[num]));
+		whens[num] = cd->m.when;
+		MPRINT1("\tWorker got message %d\n", ids[num]);
+		num++;
+
+		reply = (fr_channel_data_t *) fr_message_alloc(ms, NULL, 100);
+		rad_assert(reply != NULL);
+
+		reply->m.when = fr_time();
+		fr_message_done(&cd->m);
+
+		if (fr_channel_send_reply(ch, reply, &cd) < 0) {
+			fprintf(stderr, "Failed sending reply: %s\n", fr_strerror());
+			exit(1);
+		}
+	}
+
+	return num;
+}
+
+static int master_drain(fr_channel_t *ch)
+{
+	int			num = 0;
+	fr_channel_data_t	*reply;
+
+	while ((reply = fr_channel_recv_reply(ch)) != NULL) {
+		num++;
+		fr_message_done(&reply->m);
+	}
+
+	return num;
+}
+
+int main(int argc, char *argv[])
+{
+	int			c, kq_master, kq_worker;
+	int			ids[MAX_MESSAGES];
+	fr_time_t		whens[MAX_MESSAGES];
+	fr_time_t		now;
+	fr_atomic_queue_t	*aq_master, *aq_worker;
+	fr_control_t		*control_master, *control_worker;
+	fr_channel_t		*stalled, *idle;
+	fr_message_set_t	*ms;
+	fr_channel_data_t	*old, *new, *cd, *reply;
+	TALLOC_CTX		*autofree = talloc_init("main");
+
+	fr_time_start();
+
+	while ((c = getopt(argc, argv, "hx")) != EOF) switch (c) {
+		case 'x':
+			debug_lvl++;
+			break;
+
+		case 'h':
+		default:
+			usage();
+	}
+
+	kq_master = kqueue();
+	rad_assert(kq_master >= 0);
+
+	kq_worker = kqueue();
+	rad_assert(kq_worker >= 0);
+
+	aq_master = fr_atomic_queue_create(autofree, MAX_CONTROL_PLANE);
+	rad_assert(aq_master != NULL);
+
+	aq_worker = fr_atomic_queue_create(autofree, MAX_CONTROL_PLANE);
+	rad_assert(aq_worker != NULL);
+
+	control_master = fr_control_create(autofree, kq_master, aq_master);
+	rad_assert(control_master != NULL);
+
+	control_worker = fr_control_create(autofree, kq_worker, aq_worker);
+	rad_assert(control_worker != NULL);
+
+	stalled = fr_channel_create(autofree, control_master, control_worker);
+	idle = fr_channel_create(autofree, control_master, control_worker);
+	if (!stalled || !idle) {
+		fprintf(stderr, "channel_steal_test: Failed to create channels\n");
+		exit(1);
+	}
+
+	ms = fr_message_set_create(autofree, MAX_MESSAGES, sizeof(fr_channel_data_t), MAX_MESSAGES * 1024);
+	rad_assert(ms != NULL);
+
+	/*
+	 *	The request sent to the stalled worker is older than
+	 *	the one sent to the idle worker, so when it's moved,
+	 *	it's older than the idle channel's last write.
+	 */
+	now = fr_time();
+	old = message_alloc(ms, 1, now);
+	new = message_alloc(ms, 2, now + NANOSEC);
+
+	if (fr_channel_send_request(stalled, old, &reply) < 0) {
+		fprintf(stderr, "Failed sending request: %s\n", fr_strerror());
+		exit(1);
+	}
+	rad_assert(reply == NULL);
+
+	if (fr_channel_send_request(idle, new, &reply) < 0) {
+		fprintf(stderr, "Failed sending request: %s\n", fr_strerror());
+		exit(1);
+	}
+	rad_assert(reply == NULL);
+
+	/*
+	 *	Steal the request, the same way fr_network_steal() does.
+	 */
+	cd = fr_channel_recall_request(stalled);
+	rad_assert(cd == old);
+	rad_assert(fr_channel_recall_request(stalled) == NULL);
+
+	MPRINT1("Master moving message 1 to the idle channel\n");
+	if (fr_channel_send_request(idle, cd, &reply) < 0) {
+		fprintf(stderr, "Failed re-sending request: %s\n", fr_strerror());
+		exit(1);
+	}
+	rad_assert(reply == NULL);
+
+	/*
+	 *	The stalled worker has nothing to read.  The idle
+	 *	worker sees both requests, in the order they were
+	 *	sent to it, with the original receive times.
+	 */
+	rad_assert(fr_channel_recv_request(stalled) == NULL);
+
+	rad_assert(worker_drain(ms, idle, ids, whens, MAX_MESSAGES) == 2);
+	rad_assert(ids[0] == 2);
+	rad_assert(whens[0] == now + NANOSEC);
+	rad_assert(ids[1] == 1);
+	rad_assert(whens[1] == now);
+
+	/*
+	 *	All of the replies come back on the idle channel.
+	 */
+	rad_assert(master_drain(stalled) == 0);
+	rad_assert(master_drain(idle) == 2);
+
+	if (debug_lvl) {
+		fr_channel_debug(stalled, stdout);
+		fr_channel_debug(idle, stdout);
+	}
+
+	close(kq_master);
+	close(kq_worker);
+
+	talloc_free(autofree);
+
+	return 0;
+}
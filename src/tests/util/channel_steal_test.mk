@@ -0,0 +1,6 @@
+TARGET := channel_steal_test
+
+SOURCES		:= channel_steal_test.c
+
+TGT_PREREQS	:= libfreeradius-util.a libfreeradius-server.a libfreeradius-radius.a libfreeradius-io.a
+TGT_LDLIBS	:= $(LIBS)
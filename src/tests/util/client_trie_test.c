@@ -0,0 +1,333 @@
+/*
+ * client_trie_test.c	Tests for the client prefix trie
+ *
+ * Version:	$Id$
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA
+ *
+ * Copyright 2026  The FreeRADIUS server project
+ */
+
+/*
+ *	client.c is built into radiusd, not into a library, so we
+ *	include it directly, and stub out the few functions it needs
+ *	from the rest of the server.
+ */
+#include "../../main/client.c"
+
+#ifdef HAVE_GETOPT_H
+#	include <getopt.h>
+#endif
+
+main_config_t main_config;
+
+bool realm_home_server_add(UNUSED home_server_t *home)
+{
+	return false;
+}
+
+home_server_t *home_server_afrom_cs(UNUSED TALLOC_CTX *ctx, UNUSED realm_config_t *rc, UNUSED CONF_SECTION *cs)
+{
+	return NULL;
+}
+
+CONF_SECTION *home_server_cs_afrom_client(UNUSED CONF_SECTION *client)
+{
+	return NULL;
+}
+
+home_server_t *home_server_byname(UNUSED char const *name, UNUSED int type)
+{
+	return NULL;
+}
+
+home_pool_t *home_pool_byname(UNUSED char const *name, UNUSED int type)
+{
+	return NULL;
+}
+
+#define MAX_CLIENTS	(1024)
+#define MAX_BASES	(8)
+
+#define MPRINT1 if (debug_lvl) printf
+
+static int		debug_lvl = 0;
+
+static RADCLIENT	*added[MAX_CLIENTS];
+static int		num_added = 0;
+
+/*
+ *	Clients are put under a few base addresses, so that
+ *	prefixes nest and diverge at many depths.
+ */
+static fr_ipaddr_t	bases[MAX_BASES];
+
+static void NEVER_RETURNS usage(void)
+{
+	fprintf(stderr, "usage: client_trie_test [OPTS]\n");
+	fprintf(stderr, "  -n <num>               Number of operations.\n");
+	fprintf(stderr, "  -s <seed>              Random number seed.\n");
+	fprintf(stderr, "  -x                     Debugging mode.\n");
+
+	exit(1);
+}
+
+static void random_ipaddr(fr_ipaddr_t *ipaddr)
+{
+	size_t	i, len;
+	uint8_t	*p;
+
+	*ipaddr = bases[random() % MAX_BASES];
+
+	if (ipaddr->af == AF_INET) {
+		p = (uint8_t *) &ipaddr->addr.v4.s_addr;
+		len = 4;
+	} else {
+		p = ipaddr->addr.v6.s6_addr;
+		len = 16;
+	}
+
+	/*
+	 *	Flip a few random bits, mostly near the end.
+	 */
+	for (i = 0; i < 3; i++) {
+		size_t byte = len - 1 - (random() % ((random() & 1) ? 2 : len));
+
+		p[byte] ^= 1 << (random() % 8);
+	}
+}
+
+#ifdef WITH_TCP
+static int random_proto(void)
+{
+	switch (random() % 3) {
+	case 0:
+		return IPPROTO_IP;
+
+	case 1:
+		return IPPROTO_UDP;
+
+	default:
+		return IPPROTO_TCP;
+	}
+}
+#endif
+
+/*
+ *	The reference implementation.  Check every client, and
+ *	return the one with the longest matching prefix.
+ */
+static RADCLIENT *linear_find(fr_ipaddr_t const *ipaddr, int proto)
+{
+	int		i;
+	RADCLIENT	*best = NULL;
+	RADCLIENT	myclient;
+
+	for (i = 0; i < num_added; i++) {
+		RADCLIENT *c = added[i];
+
+		if (c->ipaddr.af != ipaddr->af) continue;
+		if (best && (best->ipaddr.prefix >= c->ipaddr.prefix)) continue;
+
+		myclient.ipaddr = *ipaddr;
+		myclient.proto = proto;
+		fr_ipaddr_mask(&myclient.ipaddr, c->ipaddr.prefix);
+
+		if (client_ipaddr_cmp(&myclient, c) == 0) best = c;
+	}
+
+	return best;
+}
+
+static void do_add(RADCLIENT_LIST *clients, int id)
+{
+	RADCLIENT	*c;
+	int		max_prefix;
+
+	if (num_added == MAX_CLIENTS) return;
+
+	c = talloc_zero(NULL, RADCLIENT);
+	rad_assert(c != NULL);
+
+	random_ipaddr(&c->ipaddr);
+	max_prefix = (c->ipaddr.af == AF_INET) ? 32 : 128;
+
+	/*
+	 *	Half host addresses, half networks.
+	 */
+	fr_ipaddr_mask(&c->ipaddr, (random() & 1) ? max_prefix : (random() % (max_prefix + 1)));
+
+	/*
+	 *	Unique names, so a duplicate is never silently
+	 *	merged with the existing client.
+	 */
+	c->longname = c->shortname = talloc_asprintf(c, "client%d", id);
+	c->secret = "testing123";
+#ifdef WITH_TCP
+	c->proto = random_proto();
+#endif
+#ifdef WITH_DYNAMIC_CLIENTS
+	c->dynamic = 1;
+#endif
+
+	if (!client_add(clients, c)) {
+		MPRINT1("Duplicate %s\n", c->longname);
+		talloc_free(c);
+		return;
+	}
+
+	/*
+	 *	client_add() may have changed 0.0.0.0/32 into
+	 *	0.0.0.0/0.  The reference list sees the change, too.
+	 */
+	added[num_added++] = c;
+}
+
+#ifdef WITH_DYNAMIC_CLIENTS
+static void do_delete(RADCLIENT_LIST *clients)
+{
+	int i;
+
+	if (!num_added) return;
+
+	i = random() % num_added;
+
+	MPRINT1("Deleting %s\n", added[i]->longname);
+	client_delete(clients, added[i]);
+
+	added[i] = added[--num_added];
+}
+#endif
+
+static void do_find(RADCLIENT_LIST *clients)
+{
+	fr_ipaddr_t	ipaddr;
+	RADCLIENT	*trie, *linear;
+	int		proto;
+
+	random_ipaddr(&ipaddr);
+
+	/*
+	 *	Listeners are always UDP or TCP.  IPPROTO_IP would
+	 *	match a TCP and a UDP client for the same network, and
+	 *	either one is a correct answer.
+	 */
+#ifdef WITH_TCP
+	proto = (random() & 1) ? IPPROTO_UDP : IPPROTO_TCP;
+#else
+	proto = IPPROTO_UDP;
+#endif
+
+	trie = client_find(clients, &ipaddr, proto);
+	linear = linear_find(&ipaddr, proto);
+
+	if (trie != linear) {
+		char buffer[FR_IPADDR_PREFIX_STRLEN];
+
+		fr_inet_ntop_prefix(buffer, sizeof(buffer), &ipaddr);
+		fprintf(stderr, "client_trie_test: Lookup of %s proto %d returned %s, expected %s\n",
+			buffer, proto, trie ? trie->longname : "none", linear ? linear->longname : "none");
+		exit(1);
+	}
+}
+
+int main(int argc, char *argv[])
+{
+	int			c, i, ops = 20000, found = 0;
+	unsigned int		seed = 1;
+	RADCLIENT_LIST		*clients;
+	TALLOC_CTX		*autofree = talloc_init("main");
+
+	while ((c = getopt(argc, argv, "n:s:hx")) != EOF) switch (c) {
+		case 'n':
+			ops = atoi(optarg);
+			break;
+
+		case 's':
+			seed = atoi(optarg);
+			break;
+
+		case 'x':
+			debug_lvl++;
+			break;
+
+		case 'h':
+		default:
+			usage();
+	}
+
+	/*
+	 *	client_add() complains about duplicates.
+	 */
+	if (!debug_lvl) default_log.dst = L_DST_NULL;
+
+	srandom(seed);
+
+	for (i = 0; i < MAX_BASES; i++) {
+		size_t j;
+
+		memset(&bases[i], 0, sizeof(bases[i]));
+
+		if (i & 1) {
+			bases[i].af = AF_INET6;
+			bases[i].prefix = 128;
+			for (j = 0; j < sizeof(bases[i].addr.v6.s6_addr); j++) {
+				bases[i].addr.v6.s6_addr[j] = random();
+			}
+		} else {
+			bases[i].af = AF_INET;
+			bases[i].prefix = 32;
+			bases[i].addr.v4.s_addr = random();
+		}
+	}
+
+	/*
+	 *	Include the wildcards, which are stored at the root.
+	 */
+	bases[0].addr.v4.s_addr = 0;
+
+	clients = client_list_init(NULL);
+	rad_assert(clients != NULL);
+	(void) talloc_steal(autofree, clients);
+
+	for (i = 0; i < ops; i++) {
+		switch (random() % 4) {
+		case 0:
+			do_add(clients, i);
+			break;
+
+#ifdef WITH_DYNAMIC_CLIENTS
+		case 1:
+			/*
+			 *	Delete less often than we add, so the
+			 *	list grows.
+			 */
+			if (random() & 1) do_delete(clients);
+			break;
+#endif
+
+		default:
+			do_find(clients);
+			found++;
+			break;
+		}
+	}
+
+	MPRINT1("%d clients, %d lookups\n", num_added, found);
+
+	talloc_free(autofree);
+
+	return 0;
+}
@@ -0,0 +1,7 @@
+TARGET := client_trie_test
+
+SOURCES		:= client_trie_test.c
+
+TGT_PREREQS	:= libfreeradius-util.a libfreeradius-server.a libfreeradius-radius.a libfreeradius-io.a
+TGT_LDLIBS	:= $(LIBS)
+
@@ -0,0 +1,298 @@
+/*
+ * dict_cache_test.c	Tests for the binary dictionary cache
+ *
+ * Version:	$Id$
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA
+ *
+ * Copyright 2026  The FreeRADIUS server project
+ */
+
+/*
+ *	The cache functions and the dictionary internals are static,
+ *	so we include dict.c directly.
+ */
+#include "../../lib/util/dict.c"
+
+#ifdef HAVE_GETOPT_H
+#	include <getopt.h>
+#endif
+
+#define MPRINT1 if (debug_lvl) printf
+
+static int		debug_lvl = 0;
+
+static void NEVER_RETURNS usage(void)
+{
+	fprintf(stderr, "usage: dict_cache_test [OPTS]\n");
+	fprintf(stderr, "  -D <dictdir>           Set main dictionary directory (defaults to share).\n");
+	fprintf(stderr, "  -x                     Debugging mode.\n");
+
+	exit(1);
+}
+
+static void NEVER_RETURNS fail(char const *msg, char const *name)
+{
+	fprintf(stderr, "dict_cache_test: %s (%s)\n", msg, name);
+	exit(1);
+}
+
+static void attr_cmp(fr_dict_attr_t const *a, fr_dict_attr_t const *b)
+{
+	if (strcmp(a->name, b->name) != 0) fail("Attribute has the wrong name", a->name);
+
+	if ((a->vendor != b->vendor) || (a->attr != b->attr) ||
+	    (a->type != b->type) || (a->depth != b->depth)) fail("Attribute has the wrong number or type", a->name);
+
+	if (memcmp(&a->flags, &b->flags, sizeof(a->flags)) != 0) fail("Attribute has the wrong flags", a->name);
+
+	if (!a->parent != !b->parent) fail("Attribute has the wrong parent", a->name);
+	if (a->parent && (strcmp(a->parent->name, b->parent->name) != 0)) fail("Attribute has the wrong parent", a->name);
+}
+
+/*
+ *	Walk both trees together.  The children must be in the same
+ *	bins, and in the same order within each bin.
+ */
+static int tree_cmp(fr_dict_attr_t const *a, fr_dict_attr_t const *b)
+{
+	size_t			i;
+	int			num = 1;
+	fr_dict_attr_t const	*p, *q;
+
+	attr_cmp(a, b);
+
+	if (!a->children != !b->children) fail("Attribute has the wrong children", a->name);
+	if (!a->children) return num;
+
+	if (talloc_array_length(a->children) != talloc_array_length(b->children)) {
+		fail("Attribute has the wrong number of bins", a->name);
+	}
+
+	for (i = 0; i < talloc_array_length(a->children); i++) {
+		for (p = a->children[i], q = b->children[i];
+		     p && q;
+		     p = p->next, q = q->next) {
+			if (q->parent != b) fail("Child has the wrong parent", q->name);
+
+			num += tree_cmp(p, q);
+		}
+
+		if (p || q) fail("Bin has the wrong number of children", a->name);
+	}
+
+	return num;
+}
+
+static int attr_by_name_cmp(void *ctx, void *data)
+{
+	fr_dict_t		*cached = ctx;
+	fr_dict_attr_t const	*da = data;
+	fr_dict_attr_t const	*found;
+
+	found = fr_dict_attr_by_name(cached, da->name);
+	if (!found) fail("Attribute isn't found by name", da->name);
+
+	attr_cmp(da, found);
+
+	return 0;
+}
+
+static int vendor_cmp(void *ctx, void *data)
+{
+	fr_dict_t		*cached = ctx;
+	fr_dict_vendor_t const	*dv = data;
+	fr_dict_vendor_t const	*found;
+
+	if (fr_dict_vendor_by_name(cached, dv->name) != (int) dv->vendorpec) fail("Vendor isn't found by name", dv->name);
+
+	found = fr_dict_vendor_by_num(cached, dv->vendorpec);
+	if (!found) fail("Vendor isn't found by number", dv->name);
+
+	if ((found->type != dv->type) || (found->length != dv->length) ||
+	    (found->flags != dv->flags)) fail("Vendor has the wrong format", dv->name);
+
+	return 0;
+}
+
+static int enum_by_name_cmp(void *ctx, void *data)
+{
+	fr_dict_t		*cached = ctx;
+	fr_dict_enum_t const	*dval = data;
+	fr_dict_attr_t const	*da;
+	fr_dict_enum_t const	*found;
+
+	/*
+	 *	Attributes which reuse a number aren't in the tree, but
+	 *	they may still have enums.
+	 */
+	da = fr_dict_attr_by_name(cached, dval->da->name);
+	if (!da) fail("Attribute for enum isn't found by name", dval->da->name);
+
+	found = fr_dict_enum_by_name(cached, da, dval->name);
+	if (!found) fail("Enum isn't found by name", dval->name);
+
+	if (found->value != dval->value) fail("Enum has the wrong value", dval->name);
+
+	return 0;
+}
+
+static int enum_by_da_cmp(void *ctx, void *data)
+{
+	fr_dict_t		*cached = ctx;
+	fr_dict_enum_t const	*dval = data;
+	fr_dict_attr_t const	*da;
+	fr_dict_enum_t const	*found;
+
+	da = fr_dict_attr_by_name(cached, dval->da->name);
+	if (!da) fail("Attribute for enum isn't found by name", dval->da->name);
+
+	found = fr_dict_enum_by_da(cached, da, dval->value);
+	if (!found) fail("Enum isn't found by value", dval->name);
+
+	if (strcmp(found->name, dval->name) != 0) fail("Enum value has the wrong name", dval->name);
+
+	return 0;
+}
+
+/*
+ *	fr_dict_from_file() silently falls back to parsing the text
+ *	files if the image can't be used, so check that the image
+ *	which was just written would be used.
+ */
+static void image_check(char const *dir, char const *fn, char const *name)
+{
+	char			path[PATH_MAX];
+	fr_dict_t		*dict;
+	dict_cache_image_t	img;
+	uint8_t			*data;
+	struct stat		stat_buf;
+	int			fd;
+
+	if (dict_cache_path(path, sizeof(path), dir, fn) < 0) fail("Image path is too long", dir);
+
+	fd = open(path, O_RDONLY);
+	if (fd < 0) fail("Image wasn't written", path);
+
+	if (fstat(fd, &stat_buf) < 0) fail("Failed reading image", path);
+
+	data = talloc_array(NULL, uint8_t, stat_buf.st_size);
+	if (!data || (read(fd, data, stat_buf.st_size) != stat_buf.st_size)) fail("Failed reading image", path);
+	close(fd);
+
+	if (dict_cache_image_verify(&img, data, stat_buf.st_size, name, !defined_cast_types) < 0) {
+		fail("Image is invalid", path);
+	}
+
+	/*
+	 *	Checking the files adds them to the dictionary, so use
+	 *	an empty one.
+	 */
+	dict = talloc_zero(NULL, fr_dict_t);
+	if (dict_cache_stat_verify(dict, &img) < 0) fail("Image is out of date", path);
+
+	talloc_free(dict);
+	talloc_free(data);
+}
+
+int main(int argc, char *argv[])
+{
+	int		c, num;
+	char const	*dict_dir = "share";
+	char		cache_dir[] = "/tmp/dict_cache_test.XXXXXX";
+	char		path[PATH_MAX];
+	fr_dict_t	*text = NULL, *cached = NULL;
+	TALLOC_CTX	*autofree = talloc_init("main");
+
+	while ((c = getopt(argc, argv, "D:hx")) != EOF) switch (c) {
+		case 'D':
+			dict_dir = optarg;
+			break;
+
+		case 'x':
+			debug_lvl++;
+			break;
+
+		case 'h':
+		default:
+			usage();
+	}
+
+	if (!mkdtemp(cache_dir)) fail("Failed creating cache directory", fr_syserror(errno));
+
+	/*
+	 *	Parse the text files and write the image, and then read
+	 *	the image.  The cast attributes are only added to the
+	 *	first dictionary which is loaded, so pretend that each
+	 *	one is the first.
+	 */
+	if (fr_dict_cache_dir(cache_dir) < 0) {
+		fr_perror("dict_cache_test");
+		exit(1);
+	}
+
+	defined_cast_types = false;
+	if (fr_dict_from_file(autofree, &text, dict_dir, FR_DICTIONARY_FILE, "radius") < 0) {
+		fr_perror("dict_cache_test");
+		exit(1);
+	}
+
+	defined_cast_types = false;
+	image_check(dict_dir, FR_DICTIONARY_FILE, "radius");
+
+	if (fr_dict_from_file(autofree, &cached, dict_dir, FR_DICTIONARY_FILE, "radius") < 0) {
+		fr_perror("dict_cache_test");
+		exit(1);
+	}
+
+	num = tree_cmp(text->root, cached->root);
+
+	MPRINT1("%d attributes in the tree\n", num);
+
+	if (fr_hash_table_num_elements(text->attributes_by_name) != fr_hash_table_num_elements(cached->attributes_by_name)) {
+		fail("Wrong number of attributes by name", cache_dir);
+	}
+	fr_hash_table_walk(text->attributes_by_name, attr_by_name_cmp, cached);
+
+	if (fr_hash_table_num_elements(text->attributes_combo) != fr_hash_table_num_elements(cached->attributes_combo)) {
+		fail("Wrong number of combo attributes", cache_dir);
+	}
+
+	if ((fr_hash_table_num_elements(text->vendors_by_name) != fr_hash_table_num_elements(cached->vendors_by_name)) ||
+	    (fr_hash_table_num_elements(text->vendors_by_num) != fr_hash_table_num_elements(cached->vendors_by_num))) {
+		fail("Wrong number of vendors", cache_dir);
+	}
+	fr_hash_table_walk(text->vendors_by_name, vendor_cmp, cached);
+
+	if ((fr_hash_table_num_elements(text->values_by_name) != fr_hash_table_num_elements(cached->values_by_name)) ||
+	    (fr_hash_table_num_elements(text->values_by_da) != fr_hash_table_num_elements(cached->values_by_da))) {
+		fail("Wrong number of enums", cache_dir);
+	}
+	fr_hash_table_walk(text->values_by_name, enum_by_name_cmp, cached);
+	fr_hash_table_walk(text->values_by_da, enum_by_da_cmp, cached);
+
+	MPRINT1("%d attributes, %d vendors, %d enums\n",
+		fr_hash_table_num_elements(text->attributes_by_name),
+		fr_hash_table_num_elements(text->vendors_by_name),
+		fr_hash_table_num_elements(text->values_by_name));
+
+	if (dict_cache_path(path, sizeof(path), dict_dir, FR_DICTIONARY_FILE) == 0) unlink(path);
+	rmdir(cache_dir);
+
+	fr_dict_cache_dir(NULL);
+	talloc_free(autofree);
+
+	return 0;
+}
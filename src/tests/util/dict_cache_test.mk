@@ -0,0 +1,11 @@
+TARGET := dict_cache_test
+
+SOURCES		:= dict_cache_test.c
+
+#
+#  dict.c is built as part of libfreeradius-util.
+#
+SRC_CFLAGS	:= -D_LIBRADIUS
+
+TGT_PREREQS	:= libfreeradius-util.a libfreeradius-server.a libfreeradius-radius.a libfreeradius-io.a
+TGT_LDLIBS	:= $(LIBS)
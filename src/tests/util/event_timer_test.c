@@ -0,0 +1,247 @@
+/*
+ * event_timer_test.c	Tests and benchmarks for the timer heap and timer wheel
+ *
+ * Version:	$Id$
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA
+ *
+ * Copyright 2026  The FreeRADIUS server project
+ */
+
+RCSID("$Id$")
+
+#include <freeradius-devel/libradius.h>
+#include <freeradius-devel/event.h>
+#include <freeradius-devel/hash.h>
+#include <freeradius-devel/io/time.h>
+#include <freeradius-devel/rad_assert.h>
+
+#ifdef HAVE_GETOPT_H
+#	include <getopt.h>
+#endif
+
+static int		debug_lvl = 0;
+
+typedef struct test_timer_t {
+	struct timeval		when;
+	fr_event_timer_t	*ev;
+	bool			fired;
+} test_timer_t;
+
+static struct timeval	last_fired;
+static int		num_fired;
+static uint64_t		max_late;
+
+static void timeval_add_usec(struct timeval *out, struct timeval const *in, uint32_t usec)
+{
+	out->tv_sec = in->tv_sec + (usec / 1000000);
+	out->tv_usec = in->tv_usec + (usec % 1000000);
+	if (out->tv_usec >= 1000000) {
+		out->tv_usec -= 1000000;
+		out->tv_sec++;
+	}
+}
+
+static void timer_fired(UNUSED fr_event_list_t *el, struct timeval *now, void *ctx)
+{
+	uint64_t late;
+	test_timer_t *t = ctx;
+
+	rad_assert(!t->fired);
+	rad_assert(fr_timeval_cmp(now, &t->when) >= 0);
+	rad_assert(fr_timeval_cmp(&t->when, &last_fired) >= 0);
+
+	late = ((now->tv_sec - t->when.tv_sec) * 1000000) + now->tv_usec - t->when.tv_usec;
+	if (late > max_late) max_late = late;
+
+	t->fired = true;
+	last_fired = t->when;
+	num_fired++;
+}
+
+/*
+ *	Insert timers over the next 250ms, delete half of them, and
+ *	check that the rest fire in order, and not early.
+ */
+static void test_order(TALLOC_CTX *ctx, int num_timers, bool wheel)
+{
+	int i, num_deleted = 0;
+	uint32_t hash = 0xabcdef;
+	struct timeval now;
+	test_timer_t *array;
+	fr_event_list_t *el;
+
+	el = fr_event_list_alloc(ctx, NULL, NULL);
+	if (!el) {
+		fprintf(stderr, "Failed creating event list: %s\n", fr_strerror());
+		exit(1);
+	}
+
+	if (fr_event_list_timer_wheel(el, wheel) < 0) {
+		fprintf(stderr, "Failed setting timer wheel: %s\n", fr_strerror());
+		exit(1);
+	}
+
+	array = talloc_zero_array(ctx, test_timer_t, num_timers);
+	if (!array) {
+		fprintf(stderr, "Failed allocating timers\n");
+		exit(1);
+	}
+
+	gettimeofday(&now, NULL);
+
+	for (i = 0; i < num_timers; i++) {
+		hash = fr_hash_update(&i, sizeof(i), hash);
+
+		timeval_add_usec(&array[i].when, &now, hash % 250000);
+
+		if (fr_event_timer_insert(el, timer_fired, &array[i], &array[i].when, &array[i].ev) < 0) {
+			fprintf(stderr, "Failed inserting timer: %s\n", fr_strerror());
+			exit(1);
+		}
+	}
+
+	for (i = 0; i < num_timers; i += 2) {
+		(void) fr_event_timer_delete(el, &array[i].ev);
+		num_deleted++;
+	}
+
+	memset(&last_fired, 0, sizeof(last_fired));
+	num_fired = 0;
+	max_late = 0;
+
+	while (fr_event_list_num_elements(el) > 0) {
+		if (fr_event_corral(el, true) < 0) {
+			fprintf(stderr, "Failed corralling events: %s\n", fr_strerror());
+			exit(1);
+		}
+		fr_event_service(el);
+	}
+
+	rad_assert(num_fired == (num_timers - num_deleted));
+
+	for (i = 0; i < num_timers; i++) {
+		rad_assert(array[i].fired == ((i & 1) != 0));
+	}
+
+	printf("%s\t%d timers fired in order, at most %" PRIu64 " us late\n",
+	       wheel ? "wheel" : "heap", num_fired, max_late);
+
+	talloc_free(array);
+	talloc_free(el);
+}
+
+/*
+ *	Insert timers over the next 30s, and delete them all.  Most
+ *	request timers are deleted before they fire.
+ */
+static void test_insert_delete(TALLOC_CTX *ctx, int num_timers, bool wheel)
+{
+	int i;
+	uint32_t hash = 0xabcdef;
+	struct timeval now;
+	fr_time_t start, end;
+	test_timer_t *array;
+	fr_event_list_t *el;
+
+	el = fr_event_list_alloc(ctx, NULL, NULL);
+	if (!el) {
+		fprintf(stderr, "Failed creating event list: %s\n", fr_strerror());
+		exit(1);
+	}
+
+	(void) fr_event_list_timer_wheel(el, wheel);
+
+	array = talloc_zero_array(ctx, test_timer_t, num_timers);
+	if (!array) {
+		fprintf(stderr, "Failed allocating timers\n");
+		exit(1);
+	}
+
+	gettimeofday(&now, NULL);
+
+	for (i = 0; i < num_timers; i++) {
+		hash = fr_hash_update(&i, sizeof(i), hash);
+
+		timeval_add_usec(&array[i].when, &now, 1000000 + (hash % 29000000));
+	}
+
+	start = fr_time();
+
+	for (i = 0; i < num_timers; i++) {
+		(void) fr_event_timer_insert(el, timer_fired, &array[i], &array[i].when, &array[i].ev);
+	}
+
+	for (i = 0; i < num_timers; i++) {
+		(void) fr_event_timer_delete(el, &array[i].ev);
+	}
+
+	end = fr_time();
+
+	rad_assert(fr_event_list_num_elements(el) == 0);
+
+	printf("%s\t%d timers inserted and deleted in %" PRIu64 " us (%" PRIu64 " ns/timer)\n",
+	       wheel ? "wheel" : "heap", num_timers, (end - start) / 1000, (end - start) / num_timers);
+
+	talloc_free(array);
+	talloc_free(el);
+}
+
+static void NEVER_RETURNS usage(void)
+{
+	fprintf(stderr, "usage: event_timer_test [OPTS]\n");
+	fprintf(stderr, "  -n <num>               Benchmark with <num> timers (default 500000).\n");
+	fprintf(stderr, "  -x                     Debugging mode.\n");
+
+	exit(1);
+}
+
+int main(int argc, char *argv[])
+{
+	int c;
+	int num_timers = 500000;
+
+	TALLOC_CTX	*autofree = talloc_init("main");
+
+	while ((c = getopt(argc, argv, "hn:x")) != EOF) switch (c) {
+		case 'n':
+			num_timers = atoi(optarg);
+			if (num_timers <= 0) usage();
+			break;
+
+		case 'x':
+			debug_lvl++;
+			break;
+
+		case 'h':
+		default:
+			usage();
+	}
+
+	if (fr_time_start() < 0) {
+		fprintf(stderr, "Failed to start time: %s\n", fr_strerror());
+		exit(1);
+	}
+
+	test_order(autofree, 10000, false);
+	test_order(autofree, 10000, true);
+
+	test_insert_delete(autofree, num_timers, false);
+	test_insert_delete(autofree, num_timers, true);
+
+	talloc_free(autofree);
+
+	return 0;
+}
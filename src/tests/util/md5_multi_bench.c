@@ -0,0 +1,153 @@
+/*
+ * md5_multi_bench.c	Benchmark batched RADIUS verification with multi-buffer MD5
+ *
+ * Version:	$Id$
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA
+ *
+ * Copyright 2026  The FreeRADIUS server project
+ */
+
+RCSID("$Id$")
+
+#include <freeradius-devel/libradius.h>
+#include <freeradius-devel/md5.h>
+#include <freeradius-devel/io/time.h>
+
+#ifdef HAVE_GETOPT_H
+#	include <getopt.h>
+#endif
+
+#define HDR_LEN		(20)
+#define MAX_BATCH	(256)
+#define MAX_MSG_LEN	(512)
+
+static uint8_t		data[MAX_BATCH][MAX_MSG_LEN];
+static uint8_t		secret[] = "testing123";
+
+/*
+ *	Build a response with a Message-Authenticator, and sign it.
+ */
+static void make_packet(uint8_t *packet, uint8_t *original, int num)
+{
+	int	i;
+	size_t	len = HDR_LEN + 18 + ((num * 7) % 200);
+
+	original[0] = PW_CODE_ACCESS_REQUEST;
+	original[1] = num;
+	for (i = 0; i < AUTH_VECTOR_LEN; i++) original[4 + i] = fr_rand();
+
+	memset(packet, 0, len);
+	packet[0] = (num & 1) ? PW_CODE_ACCESS_ACCEPT : PW_CODE_ACCESS_REJECT;
+	packet[1] = num;
+	packet[2] = len >> 8;
+	packet[3] = len & 0xff;
+
+	packet[HDR_LEN] = PW_MESSAGE_AUTHENTICATOR;
+	packet[HDR_LEN + 1] = 18;
+
+	if (len > (HDR_LEN + 18 + 2)) {
+		packet[HDR_LEN + 18] = PW_REPLY_MESSAGE;
+		packet[HDR_LEN + 18 + 1] = len - HDR_LEN - 18;
+	}
+
+	if (fr_radius_sign(packet, original, secret, sizeof(secret) - 1) < 0) {
+		fprintf(stderr, "Failed signing: %s\n", fr_strerror());
+		exit(1);
+	}
+}
+
+static void run_bench(int num, int iterations)
+{
+	int			i, j;
+	uint8_t			original[MAX_BATCH][HDR_LEN];
+	fr_radius_batch_t	batch[MAX_BATCH];
+	fr_time_t		start, end;
+
+	for (i = 0; i < num; i++) {
+		make_packet(data[i], original[i], i);
+
+		batch[i] = (fr_radius_batch_t) {
+			.packet = data[i],
+			.original = original[i],
+			.secret = secret,
+			.secret_len = sizeof(secret) - 1
+		};
+	}
+
+	start = fr_time();
+	for (i = 0; i < iterations; i++) {
+		for (j = 0; j < num; j++) (void) fr_radius_verify(data[j], original[j], secret, sizeof(secret) - 1);
+	}
+	end = fr_time();
+
+	printf("single\t%d packets in %" PRIu64 " us (%" PRIu64 " ns/packet)\n",
+	       num * iterations, (end - start) / 1000, (end - start) / (num * iterations));
+
+	start = fr_time();
+	for (i = 0; i < iterations; i++) (void) fr_radius_verify_multi(batch, num);
+	end = fr_time();
+
+	printf("batch\t%d packets in %" PRIu64 " us (%" PRIu64 " ns/packet, %u lanes)\n",
+	       num * iterations, (end - start) / 1000, (end - start) / (num * iterations),
+	       fr_md5_multi_lanes());
+}
+
+static void NEVER_RETURNS usage(void)
+{
+	fprintf(stderr, "usage: md5_multi_bench [OPTS]\n");
+	fprintf(stderr, "  -b <num>               Verify <num> packets per batch (default 64).\n");
+	fprintf(stderr, "  -n <num>               Verify <num> batches (default 10000).\n");
+
+	exit(1);
+}
+
+int main(int argc, char *argv[])
+{
+	int		c, i;
+	int		num = 64;
+	int		iterations = 10000;
+
+	while ((c = getopt(argc, argv, "b:hn:")) != EOF) switch (c) {
+		case 'b':
+			num = atoi(optarg);
+			if ((num <= 0) || (num > MAX_BATCH)) usage();
+			break;
+
+		case 'n':
+			iterations = atoi(optarg);
+			if (iterations <= 0) usage();
+			break;
+
+		case 'h':
+		default:
+			usage();
+	}
+
+	if (fr_time_start() < 0) {
+		fprintf(stderr, "Failed to start time: %s\n", fr_strerror());
+		exit(1);
+	}
+
+	for (i = 0; i < MAX_BATCH; i++) {
+		size_t j;
+
+		for (j = 0; j < sizeof(data[i]); j++) data[i][j] = fr_rand();
+	}
+
+	run_bench(num, iterations);
+
+	return 0;
+}
@@ -0,0 +1,6 @@
+TARGET := md5_multi_bench
+
+SOURCES		:= md5_multi_bench.c
+
+TGT_PREREQS	:= libfreeradius-util.a libfreeradius-server.a libfreeradius-radius.a libfreeradius-io.a
+TGT_LDLIBS	:= $(LIBS)
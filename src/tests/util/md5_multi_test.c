@@ -0,0 +1,239 @@
+/*
+ * md5_multi_test.c	Tests for multi-buffer MD5, and batched RADIUS verification
+ *
+ * Version:	$Id$
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA
+ *
+ * Copyright 2026  The FreeRADIUS server project
+ */
+
+RCSID("$Id$")
+
+#include <freeradius-devel/libradius.h>
+#include <freeradius-devel/md5.h>
+
+#ifdef HAVE_GETOPT_H
+#	include <getopt.h>
+#endif
+
+#define HDR_LEN		(20)
+#define MAX_BATCH	(256)
+#define MAX_MSG_LEN	(512)
+
+#define MPRINT1 if (debug_lvl) printf
+
+static int		debug_lvl = 0;
+
+static uint8_t		data[MAX_BATCH][MAX_MSG_LEN];
+static uint8_t		secret[] = "testing123";
+
+static void NEVER_RETURNS usage(void)
+{
+	fprintf(stderr, "usage: md5_multi_test [OPTS]\n");
+	fprintf(stderr, "  -x                     Debugging mode.\n");
+
+	exit(1);
+}
+
+static void NEVER_RETURNS fail(char const *what, int i)
+{
+	fprintf(stderr, "md5_multi_test: %s differs for message %d\n", what, i);
+	exit(1);
+}
+
+/*
+ *	Check the multi-buffer results against the scalar ones, for
+ *	messages of many different lengths, split in different places,
+ *	and continuing from different states.
+ */
+static void check_md5(void)
+{
+	int		i, j;
+	fr_md5_job_t	jobs[MAX_BATCH];
+	uint32_t	state[MAX_BATCH][4];
+	uint8_t		out[MAX_BATCH][MD5_DIGEST_LENGTH];
+	uint8_t		expected[MD5_DIGEST_LENGTH];
+	FR_MD5_CTX	ctx;
+
+	for (i = 1; i <= MAX_BATCH; i = (i * 3) + 1) {
+		for (j = 0; j < i; j++) {
+			size_t prefix = (j % 3) * MD5_BLOCK_LENGTH;
+			size_t len = fr_rand() % (MAX_MSG_LEN - prefix - 64);
+			size_t split = len ? fr_rand() % len : 0;
+
+			jobs[j] = (fr_md5_job_t) {
+				.in = data[j] + prefix,
+				.inlen = split,
+				.in2 = data[j] + prefix + split,
+				.in2len = len - split,
+				.out = out[j]
+			};
+
+			if (prefix) {
+				fr_md5_multi_state(state[j], data[j], prefix);
+				jobs[j].state = state[j];
+				jobs[j].state_len = prefix;
+			}
+		}
+
+		fr_md5_multi(jobs, i);
+
+		for (j = 0; j < i; j++) {
+			fr_md5_init(&ctx);
+			fr_md5_update(&ctx, data[j], jobs[j].state_len + jobs[j].inlen + jobs[j].in2len);
+			fr_md5_final(expected, &ctx);
+
+			if (memcmp(expected, out[j], sizeof(expected)) != 0) fail("MD5", j);
+		}
+
+		MPRINT1("Checked %d messages with %u lanes\n", i, fr_md5_multi_lanes());
+	}
+}
+
+/*
+ *	Build and sign a packet.  Responses and Access-Requests have a
+ *	Message-Authenticator.  Accounting-Requests don't.
+ */
+static uint8_t const *make_packet(uint8_t *packet, uint8_t *original, int num)
+{
+	int	i;
+	size_t	len = HDR_LEN + 18 + (((num * 7) % 100) * 2);
+
+	memset(packet, 0, len);
+	packet[1] = num;
+	packet[2] = len >> 8;
+	packet[3] = len & 0xff;
+
+	packet[HDR_LEN] = PW_MESSAGE_AUTHENTICATOR;
+	packet[HDR_LEN + 1] = 18;
+
+	if (len >= (HDR_LEN + 18 + 2)) {
+		packet[HDR_LEN + 18] = PW_REPLY_MESSAGE;
+		packet[HDR_LEN + 18 + 1] = len - HDR_LEN - 18;
+	}
+
+	switch (num % 3) {
+	case 0:
+		original[0] = PW_CODE_ACCESS_REQUEST;
+		original[1] = num;
+		for (i = 0; i < AUTH_VECTOR_LEN; i++) original[4 + i] = fr_rand();
+
+		packet[0] = (num & 1) ? PW_CODE_ACCESS_ACCEPT : PW_CODE_ACCESS_REJECT;
+		break;
+
+	case 1:
+		original = NULL;
+		packet[0] = PW_CODE_ACCESS_REQUEST;
+		for (i = 0; i < AUTH_VECTOR_LEN; i++) packet[4 + i] = fr_rand();
+		break;
+
+	default:
+		original = NULL;
+		packet[0] = PW_CODE_ACCOUNTING_REQUEST;
+		packet[HDR_LEN] = PW_REPLY_MESSAGE;
+		break;
+	}
+
+	if (fr_radius_sign(packet, original, secret, sizeof(secret) - 1) < 0) {
+		fprintf(stderr, "md5_multi_test: Failed signing: %s\n", fr_strerror());
+		exit(1);
+	}
+
+	return original;
+}
+
+/*
+ *	The batch must give the same result as verifying each packet
+ *	on its own.
+ */
+static int check_batch(fr_radius_batch_t *batch, int num)
+{
+	int	i, failed;
+	uint8_t	copy[MAX_MSG_LEN];
+
+	failed = fr_radius_verify_multi(batch, num);
+
+	for (i = 0; i < num; i++) {
+		size_t	len = (batch[i].packet[2] << 8) | batch[i].packet[3];
+		int	rcode;
+
+		memcpy(copy, batch[i].packet, len);
+		rcode = fr_radius_verify(copy, batch[i].original, secret, sizeof(secret) - 1);
+
+		if ((rcode < 0) != (batch[i].rcode < 0)) fail("Verification", i);
+	}
+
+	return failed;
+}
+
+static void check_radius(int num)
+{
+	int			i;
+	uint8_t			original[MAX_BATCH][HDR_LEN];
+	fr_radius_batch_t	batch[MAX_BATCH];
+
+	for (i = 0; i < num; i++) {
+		batch[i] = (fr_radius_batch_t) {
+			.packet = data[i],
+			.original = make_packet(data[i], original[i], i),
+			.secret = secret,
+			.secret_len = sizeof(secret) - 1
+		};
+	}
+
+	if (check_batch(batch, num) != 0) {
+		fprintf(stderr, "md5_multi_test: Failed verifying: %s\n", fr_strerror());
+		exit(1);
+	}
+
+	/*
+	 *	Break every other authenticator.
+	 */
+	for (i = 0; i < num; i += 2) data[i][4] ^= 0xff;
+
+	if (check_batch(batch, num) != ((num + 1) / 2)) {
+		fprintf(stderr, "md5_multi_test: Verified packets with bad signatures\n");
+		exit(1);
+	}
+
+	MPRINT1("Checked %d packets\n", num);
+}
+
+int main(int argc, char *argv[])
+{
+	int	c, i;
+
+	while ((c = getopt(argc, argv, "hx")) != EOF) switch (c) {
+		case 'x':
+			debug_lvl++;
+			break;
+
+		case 'h':
+		default:
+			usage();
+	}
+
+	for (i = 0; i < MAX_BATCH; i++) {
+		size_t j;
+
+		for (j = 0; j < sizeof(data[i]); j++) data[i][j] = fr_rand();
+	}
+
+	check_md5();
+	for (i = 1; i <= MAX_BATCH; i *= 2) check_radius(i);
+
+	return 0;
+}
@@ -0,0 +1,307 @@
+/*
+ * pair_arena_bench.c	Benchmark decoding and freeing pairs with and without an arena
+ *
+ * Version:	$Id$
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA
+ *
+ * Copyright 2026  The FreeRADIUS server project
+ */
+
+RCSID("$Id$")
+
+#include <freeradius-devel/libradius.h>
+#include <freeradius-devel/io/time.h>
+#include <freeradius-devel/rad_assert.h>
+
+#ifdef HAVE_GETOPT_H
+#	include <getopt.h>
+#endif
+
+static int		debug_lvl = 0;
+
+/*
+ *	A typical interim update from a NAS.
+ */
+static char const *acct_attrs[][2] = {
+	{ "User-Name",			"bob@example.com" },
+	{ "NAS-IP-Address",		"192.0.2.1" },
+	{ "NAS-Port",			"1234567" },
+	{ "NAS-Port-Type",		"Ethernet" },
+	{ "NAS-Port-Id",		"eth0/1/0/12:100.200" },
+	{ "NAS-Identifier",		"bras01.example.com" },
+	{ "Service-Type",		"Framed-User" },
+	{ "Framed-Protocol",		"PPP" },
+	{ "Framed-IP-Address",		"198.51.100.23" },
+	{ "Framed-MTU",			"1492" },
+	{ "Called-Station-Id",		"00-11-22-33-44-55:example" },
+	{ "Calling-Station-Id",		"66-77-88-99-aa-bb" },
+	{ "Class",			"0x436c6173732d56616c75652d31323334" },
+	{ "Connect-Info",		"100000000/100000000" },
+	{ "Idle-Timeout",		"600" },
+	{ "Session-Timeout",		"86400" },
+	{ "Filter-Id",			"default-in" },
+	{ "Port-Limit",			"1" },
+	{ "Acct-Status-Type",		"Interim-Update" },
+	{ "Acct-Delay-Time",		"0" },
+	{ "Acct-Authentic",		"RADIUS" },
+	{ "Acct-Session-Id",		"0123456789ABCDEF" },
+	{ "Acct-Multi-Session-Id",	"FEDCBA9876543210" },
+	{ "Acct-Session-Time",		"3600" },
+	{ "Acct-Input-Octets",		"123456789" },
+	{ "Acct-Output-Octets",		"987654321" },
+	{ "Acct-Input-Gigawords",	"1" },
+	{ "Acct-Output-Gigawords",	"2" },
+	{ "Acct-Input-Packets",		"123456" },
+	{ "Acct-Output-Packets",	"654321" },
+	{ "Acct-Link-Count",		"1" },
+	{ "Acct-Interim-Interval",	"300" },
+	{ "Chargeable-User-Identity",	"cui-0123456789" },
+	{ "Cisco-AVPair",		"client-mac-address=6677.8899.aabb" },
+	{ "Cisco-AVPair",		"connect-progress=LAN Ses Up" },
+	{ "Cisco-AVPair",		"nas-tx-speed=100000000" },
+	{ "Cisco-AVPair",		"nas-rx-speed=100000000" },
+	{ "Cisco-AVPair",		"ppp-disconnect-cause=Received LCP TERMREQ from peer" },
+	{ "Cisco-NAS-Port",		"0/1/0/12" },
+	{ "Cisco-Service-Info",		"QU;10000000;D;20000000" },
+};
+
+#define NUM_ACCT_ATTRS (sizeof(acct_attrs) / sizeof(acct_attrs[0]))
+
+static uint8_t		vector[AUTH_VECTOR_LEN];
+
+static int decode(TALLOC_CTX *ctx, VALUE_PAIR **out, uint8_t const *data, size_t data_len, fr_radius_ctx_t *decoder_ctx)
+{
+	int		num = 0;
+	uint8_t const	*p = data, *end = data + data_len;
+	vp_cursor_t	cursor;
+	VALUE_PAIR	*vp;
+
+	*out = NULL;
+	fr_pair_cursor_init(&cursor, out);
+
+	while (p < end) {
+		ssize_t slen;
+
+		slen = fr_radius_decode_pair(ctx, &cursor, fr_dict_root(fr_dict_internal), p, end - p, decoder_ctx);
+		if (slen <= 0) {
+			fprintf(stderr, "Failed decoding attribute: %s\n", fr_strerror());
+			exit(1);
+		}
+		p += slen;
+	}
+
+	for (vp = *out; vp; vp = vp->next) num++;
+
+	return num;
+}
+
+/*
+ *	Copy a decoded list out of an arena, free the arena, and check
+ *	that the copies are intact.
+ */
+static void check_arena_copy(TALLOC_CTX *ctx, uint8_t const *data, size_t data_len, fr_radius_ctx_t *decoder_ctx)
+{
+	TALLOC_CTX	*arena, *out;
+	VALUE_PAIR	*head, *expected, *vp;
+
+	arena = fr_pair_arena_alloc(ctx, 1024);
+	out = talloc_new(ctx);
+	if (!arena || !out) {
+		fprintf(stderr, "Failed allocating arena\n");
+		exit(1);
+	}
+
+	(void) decode(out, &expected, data, data_len, decoder_ctx);
+	(void) decode(arena, &head, data, data_len, decoder_ctx);
+
+	if (fr_pair_list_arena_copy(out, &head) < 0) {
+		fprintf(stderr, "Failed copying pairs out of arena: %s\n", fr_strerror());
+		exit(1);
+	}
+
+	for (vp = head; vp; vp = vp->next) {
+		if (vp->arena || (talloc_parent(vp) != out)) {
+			fprintf(stderr, "%s was not copied out of the arena\n", vp->da->name);
+			exit(1);
+		}
+	}
+
+	talloc_free(arena);
+
+	if (fr_pair_list_cmp(expected, head) != 0) {
+		fprintf(stderr, "Pairs copied out of the arena differ from the originals\n");
+		exit(1);
+	}
+
+	talloc_free(out);
+}
+
+typedef enum {
+	BENCH_TALLOC = 0,		//!< Pairs allocated individually.
+	BENCH_POOL,			//!< Pairs allocated in a talloc pool, like a REQUEST.
+	BENCH_ARENA			//!< Pairs allocated in a pair arena.
+} bench_type_t;
+
+static char const *bench_names[] = { "talloc", "pool", "arena" };
+
+static void run_bench(TALLOC_CTX *ctx, uint8_t const *data, size_t data_len, fr_radius_ctx_t *decoder_ctx,
+		      bench_type_t type, int num_packets, size_t pool_size)
+{
+	int		i, num;
+	fr_time_t	start, end;
+	VALUE_PAIR	*head;
+
+	start = fr_time();
+
+	for (i = 0; i < num_packets; i++) {
+		TALLOC_CTX *pool;
+
+		switch (type) {
+		default:
+		case BENCH_TALLOC:
+			pool = ctx;
+			break;
+
+		case BENCH_POOL:
+			pool = talloc_pool(ctx, pool_size);
+			break;
+
+		case BENCH_ARENA:
+			pool = fr_pair_arena_alloc(ctx, pool_size);
+			break;
+		}
+		if (!pool) {
+			fprintf(stderr, "Failed allocating pool\n");
+			exit(1);
+		}
+
+		num = decode(pool, &head, data, data_len, decoder_ctx);
+		rad_assert(num == NUM_ACCT_ATTRS);
+
+		/*
+		 *	What the server does when the request is done.
+		 */
+		fr_pair_list_free(&head);
+		if (pool != ctx) talloc_free(pool);
+	}
+
+	end = fr_time();
+
+	printf("%s\t%d packets of %d attributes in %" PRIu64 " us (%" PRIu64 " ns/packet)\n",
+	       bench_names[type], num_packets, (int) NUM_ACCT_ATTRS,
+	       (end - start) / 1000, (end - start) / num_packets);
+}
+
+static void NEVER_RETURNS usage(void)
+{
+	fprintf(stderr, "usage: pair_arena_bench [OPTS]\n");
+	fprintf(stderr, "  -D <dictdir>           Set main dictionary directory (defaults to " DICTDIR ").\n");
+	fprintf(stderr, "  -n <num>               Decode <num> packets (default 100000).\n");
+	fprintf(stderr, "  -s <size>              Set pool and arena size (default 16384).\n");
+	fprintf(stderr, "  -x                     Debugging mode.\n");
+
+	exit(1);
+}
+
+int main(int argc, char *argv[])
+{
+	int		c;
+	size_t		i;
+	int		num_packets = 100000;
+	size_t		pool_size = 16384;
+	char const	*dict_dir = DICTDIR;
+	fr_dict_t	*dict = NULL;
+	VALUE_PAIR	*vps = NULL, *vp;
+	vp_cursor_t	cursor;
+	uint8_t		data[4096], *p, *end;
+	fr_radius_ctx_t	radius_ctx;
+
+	TALLOC_CTX	*autofree = talloc_init("main");
+
+	while ((c = getopt(argc, argv, "D:hn:s:x")) != EOF) switch (c) {
+		case 'D':
+			dict_dir = optarg;
+			break;
+
+		case 'n':
+			num_packets = atoi(optarg);
+			if (num_packets <= 0) usage();
+			break;
+
+		case 's':
+			pool_size = atoi(optarg);
+			if (pool_size < 1024) usage();
+			break;
+
+		case 'x':
+			debug_lvl++;
+			break;
+
+		case 'h':
+		default:
+			usage();
+	}
+
+	if (fr_time_start() < 0) {
+		fprintf(stderr, "Failed to start time: %s\n", fr_strerror());
+		exit(1);
+	}
+
+	if (fr_dict_from_file(autofree, &dict, dict_dir, FR_DICTIONARY_FILE, "radius") < 0) {
+		fprintf(stderr, "Failed reading dictionaries: %s\n", fr_strerror());
+		exit(1);
+	}
+
+	for (i = 0; i < NUM_ACCT_ATTRS; i++) {
+		if (!fr_pair_make(autofree, &vps, acct_attrs[i][0], acct_attrs[i][1], T_OP_EQ)) {
+			fprintf(stderr, "Failed creating %s: %s\n", acct_attrs[i][0], fr_strerror());
+			exit(1);
+		}
+	}
+
+	radius_ctx.vector = vector;
+	radius_ctx.secret = talloc_typed_strdup(autofree, "testing123");
+
+	/*
+	 *	Encode the attributes once.  The benchmark decodes
+	 *	the same data over and over.
+	 */
+	p = data;
+	end = data + sizeof(data);
+	fr_pair_cursor_init(&cursor, &vps);
+	while ((vp = fr_pair_cursor_current(&cursor))) {
+		ssize_t slen;
+
+		slen = fr_radius_encode_pair(p, end - p, &cursor, &radius_ctx);
+		if (slen < 0) {
+			fprintf(stderr, "Failed encoding %s: %s\n", vp->da->name, fr_strerror());
+			exit(1);
+		}
+		p += slen;
+	}
+
+	if (debug_lvl) fr_pair_list_fprint(stdout, vps);
+
+	check_arena_copy(autofree, data, p - data, &radius_ctx);
+
+	run_bench(autofree, data, p - data, &radius_ctx, BENCH_TALLOC, num_packets, pool_size);
+	run_bench(autofree, data, p - data, &radius_ctx, BENCH_POOL, num_packets, pool_size);
+	run_bench(autofree, data, p - data, &radius_ctx, BENCH_ARENA, num_packets, pool_size);
+
+	talloc_free(autofree);
+
+	return 0;
+}
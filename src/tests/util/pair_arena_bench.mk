@@ -0,0 +1,6 @@
+TARGET := pair_arena_bench
+
+SOURCES		:= pair_arena_bench.c
+
+TGT_PREREQS	:= libfreeradius-util.a libfreeradius-server.a libfreeradius-radius.a libfreeradius-io.a
+TGT_LDLIBS	:= $(LIBS)
@@ -0,0 +1,299 @@
+/*
+ * pair_index_test.c	Tests for indexes over VALUE_PAIR lists
+ *
+ * Version:	$Id$
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA
+ *
+ * Copyright 2026  The FreeRADIUS server project
+ */
+
+#include <freeradius-devel/libradius.h>
+#include <freeradius-devel/pair_cursor.h>
+#include <freeradius-devel/rad_assert.h>
+
+#ifdef HAVE_GETOPT_H
+#	include <getopt.h>
+#endif
+
+#define MAX_ATTRS	(64)
+#define MAX_LISTS	(2)
+
+#define MPRINT1 if (debug_lvl) printf
+
+static int			debug_lvl = 0;
+
+static fr_dict_attr_t const	*attrs[MAX_ATTRS];
+static int			num_attrs = 0;
+
+static void NEVER_RETURNS usage(void)
+{
+	fprintf(stderr, "usage: pair_index_test [OPTS]\n");
+	fprintf(stderr, "  -D <dictdir>           Set main dictionary directory (defaults to share).\n");
+	fprintf(stderr, "  -n <num>               Number of operations.\n");
+	fprintf(stderr, "  -s <seed>              Random number seed.\n");
+	fprintf(stderr, "  -x                     Debugging mode.\n");
+
+	exit(1);
+}
+
+static int8_t random_tag(void)
+{
+	switch (random() % 4) {
+	case 0:
+		return TAG_ANY;
+
+	case 1:
+		return TAG_NONE;
+
+	default:
+		return random() % 4;
+	}
+}
+
+static VALUE_PAIR *random_pair(TALLOC_CTX *ctx)
+{
+	VALUE_PAIR *vp;
+
+	vp = fr_pair_afrom_da(ctx, attrs[random() % num_attrs]);
+	rad_assert(vp != NULL);
+
+	if (vp->da->flags.has_tag) vp->tag = random_tag();
+	vp->op = T_OP_ADD;
+
+	return vp;
+}
+
+static int list_length(VALUE_PAIR *head)
+{
+	int num = 0;
+
+	for (; head; head = head->next) num++;
+
+	return num;
+}
+
+/*
+ *	Look up attributes in the list with the index, and check that
+ *	the result is the same as searching the list.  Each lookup is
+ *	done twice, as the index is only built on the second lookup
+ *	after a change.
+ */
+static void check_lookups(fr_pair_index_t *index, VALUE_PAIR **head, int op)
+{
+	int			i, j;
+	fr_dict_attr_t const	*da;
+	int8_t			tag;
+	VALUE_PAIR		*found, *expected;
+
+	for (i = 0; i < 4; i++) {
+		da = attrs[random() % num_attrs];
+		tag = random_tag();
+
+		expected = fr_pair_find_by_da(*head, da, tag);
+
+		for (j = 0; j < 2; j++) {
+			found = fr_pair_index_find(index, head, da, tag);
+			if (found != expected) {
+				fprintf(stderr, "pair_index_test: Operation %d: %s:%d found %p, expected %p\n",
+					op, da->name, tag, found, expected);
+				exit(1);
+			}
+		}
+	}
+}
+
+int main(int argc, char *argv[])
+{
+	int			c, i, ops = 20000;
+	unsigned int		seed = 1;
+	char const		*dict_dir = "share";
+	fr_dict_t		*dict = NULL;
+	fr_dict_attr_t const	*da;
+	VALUE_PAIR		*lists[MAX_LISTS] = { NULL, NULL };
+	VALUE_PAIR		**head;
+	VALUE_PAIR		*vp, *next;
+	vp_cursor_t		cursor;
+	fr_cursor_list_watch_t	watch;
+	fr_pair_index_t		*index;
+	TALLOC_CTX		*autofree = talloc_init("main");
+
+	while ((c = getopt(argc, argv, "D:n:s:hx")) != EOF) switch (c) {
+		case 'D':
+			dict_dir = optarg;
+			break;
+
+		case 'n':
+			ops = atoi(optarg);
+			break;
+
+		case 's':
+			seed = atoi(optarg);
+			break;
+
+		case 'x':
+			debug_lvl++;
+			break;
+
+		case 'h':
+		default:
+			usage();
+	}
+
+	srandom(seed);
+
+	if (fr_dict_from_file(autofree, &dict, dict_dir, FR_DICTIONARY_FILE, "radius") < 0) {
+		fr_perror("pair_index_test");
+		exit(1);
+	}
+
+	/*
+	 *	A mix of tagged and untagged attributes, so that lists
+	 *	are long, and have many duplicates.
+	 */
+	for (i = 1; (i < 256) && (num_attrs < MAX_ATTRS); i++) {
+		da = fr_dict_attr_by_num(dict, 0, i);
+		if (!da) continue;
+
+		switch (da->type) {
+		case FR_TYPE_STRUCTURAL:
+			continue;
+
+		default:
+			break;
+		}
+
+		attrs[num_attrs++] = da;
+	}
+
+	fr_pair_index_enable(true);
+
+	memset(&watch, 0, sizeof(watch));
+	fr_cursor_list_watch(&watch);
+
+	index = fr_pair_index_alloc(autofree, &watch, 0);
+	rad_assert(index != NULL);
+
+	/*
+	 *	The index is used for each list in turn, as happens when
+	 *	a packet is replaced.
+	 */
+	head = &lists[0];
+
+	for (i = 0; i < ops; i++) {
+		switch (random() % 16) {
+		case 0:
+		case 1:
+		case 2:
+		case 3:
+			fr_pair_add(head, random_pair(autofree));
+			break;
+
+		case 4:
+			fr_pair_cursor_init(&cursor, head);
+			fr_pair_cursor_prepend(&cursor, random_pair(autofree));
+			break;
+
+		case 5:
+			da = attrs[random() % num_attrs];
+			fr_pair_delete_by_num(head, da->vendor, da->attr, random_tag());
+			break;
+
+		case 6:
+		case 7:
+		{
+			int num = list_length(*head);
+
+			if (!num) break;
+
+			num = random() % num;
+			for (vp = fr_pair_cursor_init(&cursor, head); num > 0; num--) vp = fr_pair_cursor_next(&cursor);
+
+			if (random() & 1) {
+				talloc_free(fr_pair_cursor_remove(&cursor));
+			} else {
+				talloc_free(fr_pair_cursor_replace(&cursor, random_pair(autofree)));
+			}
+		}
+			break;
+
+		case 8:
+			fr_pair_list_sort(head, fr_pair_cmp_by_da_tag);
+			break;
+
+		case 9:
+			if ((random() % 8) == 0) fr_pair_list_free(head);
+			break;
+
+		case 10:
+			vp = random_pair(autofree);
+			fr_pair_add(&vp, random_pair(autofree));
+			fr_pair_list_move(autofree, head, &vp);
+			fr_pair_list_free(&vp);
+			break;
+
+		/*
+		 *	Unlinked by hand, as some modules do.
+		 */
+		case 11:
+			vp = *head;
+			if (!vp || !vp->next) break;
+
+			next = vp->next;
+			vp->next = next->next;
+			talloc_free(next);
+			fr_pair_list_touch(head);
+			break;
+
+		/*
+		 *	Modified while no-one's watching, e.g. between
+		 *	one run of the interpreter and the next.
+		 */
+		case 12:
+			fr_cursor_list_watch(NULL);
+
+			if (fr_pair_index_find(index, head, attrs[0], TAG_ANY) != fr_pair_find_by_da(*head, attrs[0], TAG_ANY)) {
+				fprintf(stderr, "pair_index_test: Operation %d: Index used while not watched\n", i);
+				exit(1);
+			}
+
+			vp = *head;
+			if (vp && vp->next) {
+				next = vp->next;
+				vp->next = next->next;
+				talloc_free(next);
+			}
+
+			fr_cursor_list_watch(&watch);
+			break;
+
+		case 13:
+			head = &lists[random() % MAX_LISTS];
+			break;
+
+		default:
+			break;
+		}
+
+		check_lookups(index, head, i);
+	}
+
+	MPRINT1("%d and %d pairs in the lists\n", list_length(lists[0]), list_length(lists[1]));
+
+	fr_cursor_list_watch(NULL);
+	talloc_free(autofree);
+
+	return 0;
+}
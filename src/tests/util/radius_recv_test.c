@@ -0,0 +1,137 @@
+/*
+ * radius_recv_test.c	Tests for checking batches of received RADIUS packets
+ *
+ * Version:	$Id$
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA
+ *
+ * Copyright 2026  The FreeRADIUS server project
+ */
+
+RCSID("$Id$")
+
+#include <freeradius-devel/libradius.h>
+#include <freeradius-devel/radius/radius.h>
+
+#define HDR_LEN		(20)
+#define MAX_PACKETS	(200)
+#define MAX_MSG_LEN	(64)
+
+static uint8_t		data[MAX_PACKETS][MAX_MSG_LEN];
+static uint8_t		secret[] = "testing123";
+
+/*
+ *	Accounting-Requests are always signed, unlike Access-Requests,
+ *	so a bad signature is always caught.
+ */
+static void make_packet(uint8_t *packet, int num, bool good)
+{
+	size_t len = HDR_LEN + 6;
+
+	memset(packet, 0, MAX_MSG_LEN);
+	packet[0] = PW_CODE_ACCOUNTING_REQUEST;
+	packet[1] = num;
+	packet[2] = len >> 8;
+	packet[3] = len & 0xff;
+
+	packet[HDR_LEN] = PW_ACCT_STATUS_TYPE;
+	packet[HDR_LEN + 1] = 6;
+	packet[HDR_LEN + 5] = num;
+
+	if (fr_radius_sign(packet, NULL, secret, sizeof(secret) - 1) < 0) {
+		fprintf(stderr, "Failed signing: %s\n", fr_strerror());
+		exit(1);
+	}
+
+	if (!good) packet[4] ^= 0xff;
+}
+
+int main(UNUSED int argc, UNUSED char *argv[])
+{
+	int		i, good;
+	uint8_t		*packet[MAX_PACKETS];
+	size_t		packet_len[MAX_PACKETS];
+
+	/*
+	 *	The single packet API returns zero for a good
+	 *	signature, and a negative number for a bad one.
+	 */
+	make_packet(data[0], 0, true);
+	make_packet(data[1], 1, false);
+
+	if (fr_radius_verify(data[0], NULL, secret, sizeof(secret) - 1) != 0) {
+		fprintf(stderr, "Failed verifying good packet: %s\n", fr_strerror());
+		exit(1);
+	}
+
+	if (fr_radius_verify(data[1], NULL, secret, sizeof(secret) - 1) >= 0) {
+		fprintf(stderr, "Verified packet with bad signature\n");
+		exit(1);
+	}
+
+	/*
+	 *	One good packet, and one bad one.  Only the good one
+	 *	is kept.
+	 */
+	for (i = 0; i < 2; i++) {
+		packet[i] = data[i];
+		packet_len[i] = MAX_MSG_LEN;
+	}
+
+	if (fr_radius_recv_multi(packet, packet_len, 2, secret, sizeof(secret) - 1) != 1) {
+		fprintf(stderr, "Expected one good packet\n");
+		exit(1);
+	}
+
+	if ((packet_len[0] != (HDR_LEN + 6)) || (packet_len[1] != 0)) {
+		fprintf(stderr, "Expected good packet of length %d, and bad packet of length 0, got %zd and %zd\n",
+			HDR_LEN + 6, packet_len[0], packet_len[1]);
+		exit(1);
+	}
+
+	/*
+	 *	More packets than are verified in one pass, with every
+	 *	third one badly signed, every fifth one truncated, and
+	 *	every seventh one already ignored by the caller.
+	 */
+	good = 0;
+	for (i = 0; i < MAX_PACKETS; i++) {
+		make_packet(data[i], i, (i % 3) != 0);
+
+		packet[i] = data[i];
+		packet_len[i] = MAX_MSG_LEN;
+		if ((i % 5) == 0) packet_len[i] = HDR_LEN + 2;
+		if ((i % 7) == 0) packet_len[i] = 0;
+
+		if (((i % 3) != 0) && ((i % 5) != 0) && ((i % 7) != 0)) good++;
+	}
+
+	if (fr_radius_recv_multi(packet, packet_len, MAX_PACKETS, secret, sizeof(secret) - 1) != good) {
+		fprintf(stderr, "Expected %d good packets\n", good);
+		exit(1);
+	}
+
+	for (i = 0; i < MAX_PACKETS; i++) {
+		bool ok = ((i % 3) != 0) && ((i % 5) != 0) && ((i % 7) != 0);
+
+		if (ok && (packet_len[i] == (HDR_LEN + 6))) continue;
+		if (!ok && (packet_len[i] == 0)) continue;
+
+		fprintf(stderr, "Packet %d has unexpected length %zd\n", i, packet_len[i]);
+		exit(1);
+	}
+
+	return 0;
+}
@@ -0,0 +1,7 @@
+TARGET := radius_recv_test
+
+SOURCES		:= radius_recv_test.c
+
+TGT_PREREQS	:= libfreeradius-util.a libfreeradius-server.a libfreeradius-radius.a libfreeradius-io.a
+TGT_LDLIBS	:= $(LIBS)
+
@@ -64,6 +64,7 @@ static fr_packet_ctx_t  packet_ctx = { 0 };
  *	Declare these here until we move all of the new field to the REQUEST.
  */
 extern int		fr_socket_server_base(int proto, fr_ipaddr_t *ipaddr, int *port, char const *port_name, bool async);
+extern int		fr_socket_server_reuseport(int sockfd);
 extern int		fr_socket_server_bind(int sockfd, fr_ipaddr_t *ipaddr, int *port, char const *interface);
 extern int		fr_fault_setup(char const *cmd, char const *program);
 
@@ -132,6 +133,54 @@ static ssize_t test_read(int sockfd, void *ctx, uint8_t *buffer, size_t buffer_l
 	return data_size;
 }
 
+#ifdef HAVE_RECVMMSG
+#define MAX_READ_BATCH (64)
+
+static int test_read_batch(int sockfd, void *ctx, uint8_t **buffer, size_t buffer_len,
+			   size_t *packet_len, int num_packets)
+{
+	int i, num;
+	fr_packet_ctx_t *pc = ctx;
+	struct mmsghdr msg[MAX_READ_BATCH];
+	struct iovec iov[MAX_READ_BATCH];
+
+	if (num_packets > MAX_READ_BATCH) num_packets = MAX_READ_BATCH;
+
+	memset(msg, 0, sizeof(msg));
+
+	for (i = 0; i < num_packets; i++) {
+		iov[i].iov_base = buffer[i];
+		iov[i].iov_len = buffer_len;
+
+		msg[i].msg_hdr.msg_name = &pc->src;
+		msg[i].msg_hdr.msg_namelen = sizeof(pc->src);
+		msg[i].msg_hdr.msg_iov = &iov[i];
+		msg[i].msg_hdr.msg_iovlen = 1;
+	}
+
+	num = recvmmsg(sockfd, msg, num_packets, MSG_DONTWAIT, NULL);
+	if (num < 0) {
+		if ((errno == EAGAIN) || (errno == EWOULDBLOCK)) return 0;
+		return -1;
+	}
+
+	MPRINT1("\t\tREAD BATCH --- %d packets\n", num);
+
+	for (i = 0; i < num; i++) {
+		packet_len[i] = msg[i].msg_len;
+
+		/*
+		 *	@todo - check if it's RADIUS.
+		 */
+		pc->salen = msg[i].msg_hdr.msg_namelen;
+		pc->id = buffer[i][1];
+		memcpy(pc->vector, buffer[i] + 4, sizeof(pc->vector));
+	}
+
+	return num;
+}
+#endif
+
 
 static ssize_t test_write(int sockfd, void *ctx, uint8_t *buffer, size_t buffer_len)
 {
@@ -150,6 +199,38 @@ static ssize_t test_write(int sockfd, void *ctx, uint8_t *buffer, size_t buffer_
 	return data_size;
 }
 
+#ifdef HAVE_SENDMMSG
+#define MAX_WRITE_BATCH (64)
+
+static int test_write_batch(int sockfd, void *ctx, uint8_t **buffer, size_t *buffer_len, int num_packets)
+{
+	int i, num;
+	fr_packet_ctx_t *pc = ctx;
+	struct mmsghdr msg[MAX_WRITE_BATCH];
+	struct iovec iov[MAX_WRITE_BATCH];
+
+	if (num_packets > MAX_WRITE_BATCH) num_packets = MAX_WRITE_BATCH;
+
+	memset(msg, 0, sizeof(msg));
+
+	for (i = 0; i < num_packets; i++) {
+		iov[i].iov_base = buffer[i];
+		iov[i].iov_len = buffer_len[i];
+
+		msg[i].msg_hdr.msg_name = &pc->src;
+		msg[i].msg_hdr.msg_namelen = pc->salen;
+		msg[i].msg_hdr.msg_iov = &iov[i];
+		msg[i].msg_hdr.msg_iovlen = 1;
+	}
+
+	num = sendmmsg(sockfd, msg, num_packets, 0);
+
+	MPRINT1("\t\tWRITE BATCH --- %d packets\n", num);
+
+	return num;
+}
+#endif
+
 
 static fr_transport_t transport = {
 	.name = "schedule-test",
@@ -165,10 +246,44 @@ static fr_transport_t transport = {
 
 static fr_transport_t *transports = &transport;
 
+/*
+ *	Open one socket per network thread, all bound to the same
+ *	address and port.
+ */
+static int test_socket_open(void *uctx, UNUSED int id, void **p_ctx)
+{
+	int sockfd;
+	fr_packet_ctx_t *pc;
+
+	sockfd = fr_socket_server_base(IPPROTO_UDP, &my_ipaddr, &my_port, NULL, true);
+	if (sockfd < 0) return -1;
+
+	if ((fr_socket_server_reuseport(sockfd) < 0) ||
+	    (fr_socket_server_bind(sockfd, &my_ipaddr, &my_port, NULL) < 0)) {
+		close(sockfd);
+		return -1;
+	}
+
+	pc = talloc_zero(uctx, fr_packet_ctx_t);
+	if (!pc) {
+		close(sockfd);
+		return -1;
+	}
+	pc->sockfd = sockfd;
+
+	*p_ctx = pc;
+	return sockfd;
+}
+
 static void NEVER_RETURNS usage(void)
 {
 	fprintf(stderr, "usage: schedule_test [OPTS]\n");
+	fprintf(stderr, "  -a                     Pin threads to CPUs.\n");
 	fprintf(stderr, "  -n <num>               Start num network threads\n");
+	fprintf(stderr, "  -p <usec>              Workers poll their channels for usec before sleeping.\n");
+	fprintf(stderr, "  -t                     Use timer wheels for the worker and network timers.\n");
+	fprintf(stderr, "  -r                     Open one SO_REUSEPORT socket per network thread.\n");
+	fprintf(stderr, "  -b                     Read and write packets in batches.\n");
 	fprintf(stderr, "  -i <address>[:port]    Set IP address and optional port.\n");
 	fprintf(stderr, "  -s <secret>            Set shared secret.\n");
 	fprintf(stderr, "  -x                     Debugging mode.\n");
@@ -181,6 +296,10 @@ int main(int argc, char *argv[])
 	int c;
 	int num_networks = 1;
 	int num_workers = 2;
+	bool cpu_affinity = false;
+	uint32_t spin_usec = 0;
+	bool timer_wheel = false;
+	bool reuseport = false;
 	uint16_t	port16 = 0;
 	int sockfd;
 	TALLOC_CTX	*autofree = talloc_init("main");
@@ -197,7 +316,21 @@ int main(int argc, char *argv[])
 	my_ipaddr.addr.v4.s_addr = htonl(INADDR_LOOPBACK);
 	my_port = 1812;
 
-	while ((c = getopt(argc, argv, "i:n:s:w:x")) != EOF) switch (c) {
+	while ((c = getopt(argc, argv, "abi:n:p:rs:tw:x")) != EOF) switch (c) {
+		case 'a':
+			cpu_affinity = true;
+			break;
+
+		case 'b':
+#if defined(HAVE_RECVMMSG) && defined(HAVE_SENDMMSG)
+			transport.read_batch = test_read_batch;
+			transport.write_batch = test_write_batch;
+#else
+			fprintf(stderr, "radius_schedule_test: Batched reads are not supported on this platform\n");
+			exit(1);
+#endif
+			break;
+
 		case 'i':
 			if (fr_inet_pton_port(&my_ipaddr, &port16, optarg, -1, AF_INET, true, false) < 0) {
 				fprintf(stderr, "Failed parsing ipaddr: %s\n", fr_strerror());
@@ -211,6 +344,18 @@ int main(int argc, char *argv[])
 			if ((num_networks <= 0) || (num_networks > 16)) usage();
 			break;
 
+		case 'p':
+			spin_usec = atoi(optarg);
+			break;
+
+		case 't':
+			timer_wheel = true;
+			break;
+
+		case 'r':
+			reuseport = true;
+			break;
+
 		case 's':
 			secret = optarg;
 			break;
@@ -235,12 +380,24 @@ int main(int argc, char *argv[])
 	argv += (optind - 1);
 #endif
 
-	sched = fr_schedule_create(autofree, &default_log, num_networks, num_workers, 1, &transports, NULL, NULL);
+	sched = fr_schedule_create(autofree, &default_log, num_networks, num_workers, cpu_affinity,
+				   spin_usec, timer_wheel, 1, &transports, NULL, NULL);
 	if (!sched) {
 		fprintf(stderr, "schedule_test: Failed to create scheduler\n");
 		exit(1);
 	}
 
+	fr_fault_setup(NULL, argv[0]);
+
+	if (reuseport) {
+		if (fr_schedule_socket_add_reuseport(sched, test_socket_open, autofree, &transport) < 0) {
+			fprintf(stderr, "radius_test: Failed creating sockets: %s\n", fr_strerror());
+			exit(1);
+		}
+
+		goto run;
+	}
+
 	sockfd = fr_socket_server_base(IPPROTO_UDP, &my_ipaddr, &my_port, NULL, true);
 	if (sockfd < 0) {
 		fprintf(stderr, "radius_test: Failed creating socket: %s\n", fr_strerror());
@@ -263,12 +420,11 @@ int main(int argc, char *argv[])
 	}
 #endif
 
-	fr_fault_setup(NULL, argv[0]);
-
 	packet_ctx.sockfd = sockfd;
 
 	(void) fr_schedule_socket_add(sched, sockfd, &packet_ctx, &transport);
 
+run:
 	sleep(10);
 
 	(void) fr_schedule_destroy(sched);
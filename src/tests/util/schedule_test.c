@@ -117,7 +117,10 @@ static fr_transport_t *transports = &transport;
 static void NEVER_RETURNS usage(void)
 {
 	fprintf(stderr, "usage: schedule_test [OPTS]\n");
+	fprintf(stderr, "  -a                     Pin threads to CPUs.\n");
 	fprintf(stderr, "  -n <num>               Start num network threads\n");
+	fprintf(stderr, "  -p <usec>              Workers poll their channels for usec before sleeping.\n");
+	fprintf(stderr, "  -t                     Use timer wheels for the worker and network timers.\n");
 	fprintf(stderr, "  -w <num>               Start num worker threads\n");
 	fprintf(stderr, "  -x                     Debugging mode.\n");
 
@@ -129,6 +132,9 @@ int main(int argc, char *argv[])
 	int c;
 	int num_networks = 1;
 	int num_workers = 2;
+	bool cpu_affinity = false;
+	uint32_t spin_usec = 0;
+	bool timer_wheel = false;
 	TALLOC_CTX	*autofree = talloc_init("main");
 	fr_schedule_t	*sched;
 
@@ -136,12 +142,24 @@ int main(int argc, char *argv[])
 
 	fr_log_init(&default_log, false);
 
-	while ((c = getopt(argc, argv, "n:w:x")) != EOF) switch (c) {
+	while ((c = getopt(argc, argv, "an:p:tw:x")) != EOF) switch (c) {
+		case 'a':
+			cpu_affinity = true;
+			break;
+
 		case 'n':
 			num_networks = atoi(optarg);
 			if ((num_networks <= 0) || (num_networks > 16)) usage();
 			break;
 
+		case 'p':
+			spin_usec = atoi(optarg);
+			break;
+
+		case 't':
+			timer_wheel = true;
+			break;
+
 		case 'w':
 			num_workers = atoi(optarg);
 			if ((num_workers <= 0) || (num_workers > 1024)) usage();
@@ -162,7 +180,8 @@ int main(int argc, char *argv[])
 	argv += (optind - 1);
 #endif
 
-	sched = fr_schedule_create(autofree, &default_log, num_networks, num_workers, 1, &transports, NULL, NULL);
+	sched = fr_schedule_create(autofree, &default_log, num_networks, num_workers, cpu_affinity,
+				   spin_usec, timer_wheel, 1, &transports, NULL, NULL);
 	if (!sched) {
 		fprintf(stderr, "schedule_test: Failed to create scheduler\n");
 		exit(1);
@@ -0,0 +1,444 @@
+/*
+ * sql_io_test.c	Tests for rlm_sql's asynchronous queries
+ *
+ * Version:	$Id$
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA
+ *
+ * Copyright 2026  The FreeRADIUS server project
+ */
+
+/*
+ *	The connection handling is static, so we include io.c directly.
+ *	The functions it calls in the rest of rlm_sql, and in the
+ *	interpreter, are replaced with stubs.
+ */
+#define unlang_resumable		test_resumable
+#define mod_conn_create			test_conn_create
+#define rlm_sql_print_error		test_print_error
+#define fr_connection_pool_timeout	test_pool_timeout
+
+#include "../../modules/rlm_sql/io.c"
+
+#ifdef HAVE_GETOPT_H
+#	include <getopt.h>
+#endif
+
+#define MAX_WAITING	(256)
+#define MAX_SENT	(1024)
+#define QUERY_LEN	(32)
+
+#define MPRINT1 if (debug_lvl) printf
+
+static int		debug_lvl = 0;
+
+/*
+ *	Requests which have sent a query, and are waiting for it to
+ *	complete.
+ */
+typedef struct {
+	REQUEST		*request;
+	rlm_sql_query_t	*query;
+	bool		fail;			//!< The query fails with a constraint violation.
+} test_request_t;
+
+static test_request_t	requests[MAX_WAITING];
+static int		num_requests = 0;
+static int		num_resumed = 0;
+static int		num_full = 0;
+static int		num_broken = 0;
+static int		num_batches = 0;
+
+/*
+ *	The database.  Queries are executed in the order they were
+ *	submitted, and results are made available "deliver" at a time.
+ */
+static char		sent[MAX_SENT][QUERY_LEN];
+static uint64_t		num_sent = 0;
+static uint64_t		num_read = 0;
+static uint64_t		deliver = 0;
+
+static bool		broken = false;		//!< Reading from the connection fails.
+static bool		refuse = false;		//!< New connections fail.
+
+static int		fd[2] = { -1, -1 };
+
+static void NEVER_RETURNS usage(void)
+{
+	fprintf(stderr, "usage: sql_io_test [OPTS]\n");
+	fprintf(stderr, "  -n <num>               Number of operations.\n");
+	fprintf(stderr, "  -s <seed>              Random number seed.\n");
+	fprintf(stderr, "  -x                     Debugging mode.\n");
+
+	exit(1);
+}
+
+static void NEVER_RETURNS fail(char const *msg, int i)
+{
+	fprintf(stderr, "sql_io_test: %s (request %d)\n", msg, i);
+	exit(1);
+}
+
+void test_resumable(REQUEST *request)
+{
+	int		i;
+	test_request_t	*r;
+
+	i = request->number;
+	if ((i >= MAX_WAITING) || (requests[i].request != request)) fail("Resumed a request which isn't waiting", i);
+	r = &requests[i];
+
+	if (r->query->mux) fail("Resumed a request with its query still in the pipeline", i);
+
+	switch (r->query->rcode) {
+	case RLM_SQL_OK:
+		if (r->fail) fail("Query which should have failed succeeded", i);
+		if (r->query->numaffected != 1) fail("Query has the wrong number of affected rows", i);
+		break;
+
+	case RLM_SQL_ALT_QUERY:
+		if (!r->fail) fail("Query which should have succeeded failed", i);
+		break;
+
+	case RLM_SQL_RECONNECT:
+		if (!broken) fail("Query failed with a working connection", i);
+		break;
+
+	default:
+		fail("Query has the wrong rcode", i);
+	}
+
+	talloc_free(r->query);
+	talloc_free(r->request);
+	memset(r, 0, sizeof(*r));
+
+	num_requests--;
+	num_resumed++;
+}
+
+void *test_conn_create(TALLOC_CTX *ctx, UNUSED void *instance, UNUSED struct timeval const *timeout)
+{
+	if (refuse) return NULL;
+
+	return talloc_zero(ctx, rlm_sql_handle_t);
+}
+
+void test_print_error(UNUSED rlm_sql_t const *inst, UNUSED REQUEST *request,
+		      UNUSED rlm_sql_handle_t *handle, UNUSED bool force_debug)
+{
+}
+
+struct timeval test_pool_timeout(UNUSED fr_connection_pool_t *pool)
+{
+	return (struct timeval) { .tv_sec = 1 };
+}
+
+static sql_rcode_t test_async_init(UNUSED rlm_sql_handle_t *handle, UNUSED rlm_sql_config_t *config)
+{
+	num_sent = num_read = deliver = 0;
+
+	return RLM_SQL_OK;
+}
+
+static int test_async_fd(UNUSED rlm_sql_handle_t *handle, UNUSED rlm_sql_config_t *config)
+{
+	return fd[0];
+}
+
+static sql_rcode_t test_async_submit(UNUSED rlm_sql_handle_t *handle, UNUSED rlm_sql_config_t *config,
+				     char const *query)
+{
+	if ((num_sent - num_read) >= MAX_SENT) fail("Too many queries outstanding", -1);
+
+	strlcpy(sent[num_sent++ % MAX_SENT], query, QUERY_LEN);
+
+	return RLM_SQL_OK;
+}
+
+static int test_async_flush(UNUSED rlm_sql_handle_t *handle, UNUSED rlm_sql_config_t *config)
+{
+	return 0;
+}
+
+static int test_async_poll(UNUSED rlm_sql_handle_t *handle, UNUSED rlm_sql_config_t *config)
+{
+	if (broken) return -1;
+
+	return (num_read < deliver) && (num_read < num_sent);
+}
+
+static sql_rcode_t test_async_fetch(UNUSED rlm_sql_handle_t *handle, UNUSED rlm_sql_config_t *config)
+{
+	char const *query = sent[num_read++ % MAX_SENT];
+
+	if (strncmp(query, "fail", 4) == 0) return RLM_SQL_ALT_QUERY;
+
+	return RLM_SQL_OK;
+}
+
+static int test_affected_rows(UNUSED rlm_sql_handle_t *handle, UNUSED rlm_sql_config_t *config)
+{
+	return 1;
+}
+
+static sql_rcode_t test_finish_query(UNUSED rlm_sql_handle_t *handle, UNUSED rlm_sql_config_t *config)
+{
+	return RLM_SQL_OK;
+}
+
+static rlm_sql_driver_t test_driver = {
+	.name			= "test",
+	.flags			= RLM_SQL_RCODE_FLAGS_ALT_QUERY,
+	.sql_affected_rows	= test_affected_rows,
+	.sql_finish_query	= test_finish_query,
+	.sql_async_init		= test_async_init,
+	.sql_async_fd		= test_async_fd,
+	.sql_async_submit	= test_async_submit,
+	.sql_async_flush	= test_async_flush,
+	.sql_async_poll		= test_async_poll,
+	.sql_async_fetch	= test_async_fetch
+};
+
+/*
+ *	Read the results which are available, as the event loop would.
+ */
+static void read_results(rlm_sql_thread_t *t, uint64_t num)
+{
+	if (!t->mux) return;
+
+	deliver = num_read + num;
+	_mux_read(t->el, fd[0], t->mux);
+}
+
+/*
+ *	Send a query, if there's space in the pipeline.  Queries which
+ *	start a new batch need space for BEGIN and COMMIT too.
+ */
+static void send_query(rlm_sql_thread_t *t, sql_acct_section_t *section)
+{
+	int		i;
+	test_request_t	*r;
+	char		query[QUERY_LEN];
+	rlm_sql_batch_t	*batch = NULL;
+	uint32_t	needed = 1;
+	bool		full;
+
+	for (i = 0; i < MAX_WAITING; i++) if (!requests[i].request) break;
+	if (i == MAX_WAITING) return;
+	r = &requests[i];
+
+	r->request = talloc_zero(NULL, REQUEST);
+	if (!r->request) fail("Out of memory", i);
+	r->request->number = i;
+	r->request->el = t->el;
+	r->fail = ((random() % 4) == 0);
+
+	if (t->mux && (section->batch_size > 1)) {
+		for (batch = t->mux->pending; batch; batch = batch->next) {
+			if ((batch->section == section) && (batch->num_queries < section->batch_size)) break;
+		}
+		if (!batch) needed = 3;
+	}
+
+	full = (t->mux &&
+		((fr_fifo_num_elements(t->mux->queries) + t->mux->reserved + needed) > t->inst->config->pipeline_depth));
+
+	if (!rlm_sql_io_handle(t, r->request, section)) {
+		if (!full) fail("No handle, but the pipeline isn't full", i);
+
+		num_full++;
+		TALLOC_FREE(r->request);
+		return;
+	}
+	if (full) fail("Got a handle, but the pipeline is full", i);
+
+	snprintf(query, sizeof(query), "%s %d", r->fail ? "fail" : "query", i);
+
+	if (section->batch_size > 1) {
+		r->query = rlm_sql_query_batch(t, r->request, section, query);
+	} else {
+		r->query = rlm_sql_query_async(t, r->request, query);
+	}
+	if (!r->query) fail("Failed sending query", i);
+
+	num_requests++;
+}
+
+/*
+ *	Send the oldest pending batch, as its timer would.
+ */
+static void send_batch(rlm_sql_thread_t *t)
+{
+	rlm_sql_batch_t *batch;
+
+	if (!t->mux || !t->mux->pending) return;
+
+	for (batch = t->mux->pending; batch->next; batch = batch->next);
+
+	num_batches++;
+	_batch_timeout(t->el, NULL, batch);
+}
+
+/*
+ *	Cancel a request.  Its query is freed when the result arrives.
+ */
+static void cancel_query(void)
+{
+	test_request_t *r = &requests[random() % MAX_WAITING];
+
+	if (!r->request) return;
+
+	talloc_free(r->query);
+	talloc_free(r->request);
+	memset(r, 0, sizeof(*r));
+
+	num_requests--;
+}
+
+/*
+ *	Fail the connection, optionally refusing to open a new one.
+ */
+static void break_connection(rlm_sql_thread_t *t, sql_acct_section_t *section)
+{
+	REQUEST request = { .el = t->el };
+
+	if (!t->mux) return;
+
+	broken = true;
+	num_broken++;
+	refuse = ((random() % 2) == 0);
+	read_results(t, 1);
+	broken = false;
+
+	if (t->mux) fail("Connection is still open after it failed", -1);
+
+	/*
+	 *	Connections aren't retried for a second, so pretend
+	 *	that a second has passed, once we've checked that.
+	 */
+	if (refuse) {
+		if (rlm_sql_io_handle(t, &request, section)) fail("Got a handle, but connections can't be opened", -1);
+		t->mux_failed = 0;
+	}
+	refuse = false;
+}
+
+int main(int argc, char *argv[])
+{
+	int			c, i, ops = 100000;
+	unsigned int		seed = 1;
+	rlm_sql_config_t	config = { .pipeline_depth = 16 };
+	rlm_sql_t		inst = { .name = "sql", .config = &config, .driver = &test_driver };
+	sql_acct_section_t	sections[] = {
+					{ .batch_size = 0 },
+					{ .batch_size = 4 },
+					{ .batch_size = 8 }
+				};
+	rlm_sql_thread_t	t = { .inst = &inst };
+	TALLOC_CTX		*autofree = talloc_init("main");
+
+	while ((c = getopt(argc, argv, "n:s:hx")) != EOF) switch (c) {
+		case 'n':
+			ops = atoi(optarg);
+			break;
+
+		case 's':
+			seed = atoi(optarg);
+			break;
+
+		case 'x':
+			debug_lvl++;
+			break;
+
+		case 'h':
+		default:
+			usage();
+	}
+
+	srandom(seed);
+
+	if (!debug_lvl) default_log.dst = L_DST_NULL;
+
+	if (pipe(fd) < 0) {
+		fprintf(stderr, "sql_io_test: Failed creating pipe: %s\n", fr_syserror(errno));
+		exit(1);
+	}
+
+	t.el = fr_event_list_alloc(autofree, NULL, NULL);
+	if (!t.el) {
+		fr_perror("sql_io_test");
+		exit(1);
+	}
+
+	if (rlm_sql_io_init(&t) < 0) fail("Failed opening connection", -1);
+
+	for (i = 0; i < ops; i++) {
+		switch (random() % 16) {
+		case 0:
+		case 1:
+		case 2:
+		case 3:
+		case 4:
+		case 5:
+			send_query(&t, &sections[random() % (sizeof(sections) / sizeof(sections[0]))]);
+			break;
+
+		case 6:
+		case 7:
+		case 8:
+		case 9:
+			read_results(&t, random() % 8);
+			break;
+
+		case 10:
+			cancel_query();
+			break;
+
+		case 11:
+			if ((random() % 16) == 0) break_connection(&t, &sections[0]);
+			break;
+
+		case 12:
+		case 13:
+			send_batch(&t);
+			break;
+
+		default:
+			break;
+		}
+	}
+
+	/*
+	 *	Everything which is still outstanding must complete,
+	 *	and leave the whole pipeline free.
+	 */
+	while (t.mux && t.mux->pending) send_batch(&t);
+	read_results(&t, MAX_SENT);
+	if (num_requests != 0) fail("Requests weren't resumed", num_requests);
+
+	if (t.mux && (t.mux->reserved || fr_fifo_num_elements(t.mux->queries))) {
+		fail("Space in the pipeline wasn't released", (int) t.mux->reserved);
+	}
+
+	MPRINT1("%d requests resumed, %d found the pipeline full, %d batches sent, %d connections failed\n",
+		num_resumed, num_full, num_batches, num_broken);
+
+	rlm_sql_io_free(&t);
+	talloc_free(autofree);
+	close(fd[0]);
+	close(fd[1]);
+
+	return 0;
+}
@@ -0,0 +1,6 @@
+TARGET := sql_io_test
+
+SOURCES		:= sql_io_test.c
+
+TGT_PREREQS	:= libfreeradius-util.a libfreeradius-server.a libfreeradius-radius.a libfreeradius-io.a
+TGT_LDLIBS	:= $(LIBS)
@@ -0,0 +1,287 @@
+/*
+ * time_order_test.c	Tests for the worker's receive time tracking
+ *
+ * Version:	$Id$
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA
+ *
+ * Copyright 2026  The FreeRADIUS server project
+ */
+
+/*
+ *	The time order functions are static, so we include worker.c
+ *	directly, and drive them the same way the worker does.
+ */
+#include "../../lib/io/worker.c"
+
+#ifdef HAVE_GETOPT_H
+#	include <getopt.h>
+#endif
+
+#define MAX_REQUESTS	(4096)
+
+#define MPRINT1 if (debug_lvl) printf
+
+static int		debug_lvl = 0;
+
+/*
+ *	Requests which are in the time order heap, and requests which
+ *	are on the "waiting to die" list.
+ */
+static REQUEST		*live[MAX_REQUESTS];
+static int		num_live = 0;
+
+static REQUEST		*dead[MAX_REQUESTS];
+static int		num_dead = 0;
+
+static void NEVER_RETURNS usage(void)
+{
+	fprintf(stderr, "usage: time_order_test [OPTS]\n");
+	fprintf(stderr, "  -n <num>               Number of operations.\n");
+	fprintf(stderr, "  -s <seed>              Random number seed.\n");
+	fprintf(stderr, "  -x                     Debugging mode.\n");
+
+	exit(1);
+}
+
+static void NEVER_RETURNS fail(char const *msg, REQUEST *request)
+{
+	if (!request) {
+		fprintf(stderr, "time_order_test: %s\n", msg);
+		exit(1);
+	}
+
+	fprintf(stderr, "time_order_test: %s (request %zd, recv_time %" PRIu64 ")\n",
+		msg, request->number, request->recv_time);
+	exit(1);
+}
+
+/*
+ *	The reference implementation.  Check every live request, and
+ *	return the oldest one.
+ */
+static REQUEST *linear_oldest(void)
+{
+	int	i;
+	REQUEST	*oldest = NULL;
+
+	for (i = 0; i < num_live; i++) {
+		if (!oldest || (live[i]->recv_time < oldest->recv_time)) oldest = live[i];
+	}
+
+	return oldest;
+}
+
+static int find(REQUEST **array, int num, REQUEST *request)
+{
+	int i;
+
+	for (i = 0; i < num; i++) {
+		if (array[i] == request) return i;
+	}
+
+	return -1;
+}
+
+/*
+ *	As in fr_worker_get_request().  Requests from different
+ *	network threads arrive out of order, so the receive time is
+ *	up to two seconds in the past.
+ */
+static void do_insert(TALLOC_CTX *ctx, fr_worker_t *worker, fr_time_t now, int id)
+{
+	REQUEST *request;
+
+	if (num_live == MAX_REQUESTS) return;
+
+	request = talloc_zero(ctx, REQUEST);
+	rad_assert(request != NULL);
+
+	request->number = id;
+	request->recv_time = now - (random() % ((fr_time_t) 2 * NANOSEC));
+	request->heap_id = -1;
+
+	worker_time_order_insert(worker, request);
+	live[num_live++] = request;
+}
+
+/*
+ *	As in fr_worker_send_reply().  The request may be live, or
+ *	waiting to die.
+ */
+static void do_free(fr_worker_t *worker, REQUEST **array, int *num, int i)
+{
+	REQUEST *request = array[i];
+
+	worker_time_order_remove(worker, request);
+	if (request->time_order_id >= 0) fail("Freed request is still in the heap", request);
+
+	array[i] = array[--(*num)];
+	talloc_free(request);
+}
+
+/*
+ *	As in fr_worker_run_request(), and fr_worker_check_timeouts().
+ */
+static void do_kill(fr_worker_t *worker, int i)
+{
+	REQUEST *request = live[i];
+
+	if (num_dead == MAX_REQUESTS) {
+		do_free(worker, live, &num_live, i);
+		return;
+	}
+
+	worker_time_order_kill(worker, request);
+	if (request->time_order_id >= 0) fail("Dying request is still in the heap", request);
+
+	live[i] = live[--num_live];
+	dead[num_dead++] = request;
+}
+
+/*
+ *	As in fr_worker_check_timeouts().  Expired requests must come
+ *	out oldest first, and everything left must be newer than the
+ *	timeout.
+ */
+static void do_expire(fr_worker_t *worker, fr_time_t now)
+{
+	int	i;
+	REQUEST	*request, *oldest;
+
+	while ((request = worker_time_order_expired(worker, now, NANOSEC)) != NULL) {
+		oldest = linear_oldest();
+
+		if (!oldest || (request->recv_time != oldest->recv_time)) fail("Expired request isn't the oldest", request);
+		if ((now - request->recv_time) < NANOSEC) fail("Expired request is too new", request);
+
+		i = find(live, num_live, request);
+		if (i < 0) fail("Expired request isn't live", request);
+
+		MPRINT1("Expiring %zd\n", request->number);
+
+		if (random() & 1) {
+			do_kill(worker, i);
+		} else {
+			do_free(worker, live, &num_live, i);
+		}
+	}
+
+	oldest = linear_oldest();
+	if (oldest && ((now - oldest->recv_time) >= NANOSEC)) fail("Request wasn't expired", oldest);
+}
+
+static void check_lists(fr_worker_t *worker)
+{
+	int		i, num;
+	fr_dlist_t	*entry;
+
+	if (fr_heap_num_elements(worker->time_order) != (size_t) num_live) fail("Heap has the wrong number of requests", NULL);
+
+	for (i = 0; i < num_live; i++) {
+		if (live[i]->time_order_id < 0) fail("Live request isn't in the heap", live[i]);
+	}
+
+	num = 0;
+	for (entry = FR_DLIST_FIRST(worker->waiting_to_die);
+	     entry != NULL;
+	     entry = FR_DLIST_NEXT(worker->waiting_to_die, entry)) {
+		REQUEST *request = fr_ptr_to_type(REQUEST, time_order, entry);
+
+		if (find(dead, num_dead, request) < 0) fail("Unexpected request waiting to die", request);
+		num++;
+	}
+
+	if (num != num_dead) fail("Waiting to die list has the wrong number of requests", NULL);
+}
+
+int main(int argc, char *argv[])
+{
+	int		c, i, ops = 100000;
+	unsigned int	seed = 1;
+	fr_time_t	now = (fr_time_t) 10 * NANOSEC;
+	fr_worker_t	*worker;
+	TALLOC_CTX	*autofree = talloc_init("main");
+
+	while ((c = getopt(argc, argv, "n:s:hx")) != EOF) switch (c) {
+		case 'n':
+			ops = atoi(optarg);
+			break;
+
+		case 's':
+			seed = atoi(optarg);
+			break;
+
+		case 'x':
+			debug_lvl++;
+			break;
+
+		case 'h':
+		default:
+			usage();
+	}
+
+	srandom(seed);
+
+	/*
+	 *	Only the fields used to track requests by time.
+	 */
+	worker = talloc_zero(autofree, fr_worker_t);
+	rad_assert(worker != NULL);
+
+	FR_DLIST_INIT(worker->waiting_to_die);
+	worker->time_order = fr_heap_create(worker_time_order_cmp, offsetof(REQUEST, time_order_id));
+	rad_assert(worker->time_order != NULL);
+
+	for (i = 0; i < ops; i++) {
+		now += random() % (NANOSEC / 100);
+
+		switch (random() % 9) {
+		case 0:
+		case 1:
+		case 2:
+			do_insert(autofree, worker, now, i);
+			break;
+
+		case 3:
+			if (num_live) do_free(worker, live, &num_live, random() % num_live);
+			break;
+
+		case 4:
+			if (num_live) do_kill(worker, random() % num_live);
+			break;
+
+		case 5:
+		case 6:
+			if (num_dead) do_free(worker, dead, &num_dead, random() % num_dead);
+			break;
+
+		default:
+			do_expire(worker, now);
+			break;
+		}
+
+		if ((i % 1000) == 0) check_lists(worker);
+	}
+
+	check_lists(worker);
+
+	MPRINT1("%d live, %d waiting to die\n", num_live, num_dead);
+
+	fr_heap_delete(worker->time_order);
+	talloc_free(autofree);
+
+	return 0;
+}